@@ -0,0 +1,73 @@
+#!/bin/bash
+# Receive buffer size and busy-poll against the blocking path, on loopback
+#  Drops: bursts of 1024 datagrams at 100k pkt/s into the default SO_RCVBUF
+#         and into net.core.rmem_max (-R max), blocking and spinning (-B)
+#  Latency: UDP echo RTT at 2000 probes/s with the receiver blocking or
+#           spinning for different budgets before it blocks
+# Spinning needs a core of its own, with fewer cores than spinning processes
+# the spinner takes CPU time from the sender and both numbers get worse
+# Usage: bench/busy_poll.sh [build_dir] [seconds]
+
+BUILD=$(cd "${1:-build}" 2> /dev/null && pwd) || { echo "Build directory ${1:-build} not found" >&2; exit 1; }
+SECS=${2:-3}
+PORT=${PORT:-9600}
+PROBES=${PROBES:-2000}
+
+UDP_RX=$BUILD/udp_receiver/udp_receiver
+TX=$BUILD/udp_tcp_sender/udp_tcp_sender
+
+for bin in "$UDP_RX" "$TX"; do
+    if [ ! -x "$bin" ]; then
+        echo "Missing $bin, build first" >&2
+        exit 1
+    fi
+done
+
+strip_color() {
+    sed -e 's/\x1b\[[0-9;]*m//g'
+}
+
+# drop_case <label> <receiver args...>
+drop_case() {
+    local label=$1; shift
+    "$UDP_RX" -p "$PORT" -b 64 -k -S "$@" 2> rx.log &
+    local rx_pid=$!
+    sleep 0.3
+    timeout -s INT "$SECS" "$TX" -p "$PORT" -R 100000 -b 1024 -n 256 2> tx.log
+    sleep 0.3
+    kill -INT "$rx_pid"
+    wait "$rx_pid"
+    local sent dropped delay
+    sent=$(strip_color < tx.log | grep -o 'Sent [0-9]* packets' | grep -o '[0-9]*')
+    dropped=$(strip_color < rx.log | grep -o '[0-9]* datagrams dropped' | grep -o '^[0-9]*')
+    delay=$(strip_color < rx.log | grep 'kernel->user' | tail -1 | grep -o 'min/avg/max [0-9./]* us')
+    printf "%-22s sent %8s, dropped %8s, kernel->user %s\n" "$label" "$sent" "$dropped" "$delay"
+    strip_color < rx.log | grep 'Busy-poll' | sed 's/.*\[UDP\] /                       /'
+}
+
+# rtt_case <label> <receiver args...>
+rtt_case() {
+    local label=$1; shift
+    "$UDP_RX" -p "$PORT" -e "$@" 2> rx.log &
+    local rx_pid=$!
+    sleep 0.3
+    "$TX" -p "$PORT" -P "$PROBES" -r $((SECS * PROBES)) -n 64 2> tx.log
+    kill -INT "$rx_pid"
+    wait "$rx_pid"
+    printf "%-22s %s\n" "$label" "$(strip_color < tx.log | grep 'RTT us' | sed 's/.*\[UDP\] //')"
+}
+
+# Logs go to a scratch directory
+cd "$(mktemp -d)" || exit 1
+
+echo "Bursts of 1024 x 256 B at 100k pkt/s, ${SECS}s, net.core.rmem_max $(cat /proc/sys/net/core/rmem_max)"
+drop_case "default buffer"
+drop_case "-R max"               -R max
+drop_case "default buffer, -B 50" -B 50
+drop_case "-R max, -B 50"        -R max -B 50
+echo
+echo "UDP echo RTT, $PROBES probes/s, ${SECS}s, $(nproc) CPU(s)"
+rtt_case "blocking"
+rtt_case "-B 20"                 -B 20
+rtt_case "-B 200"                -B 200
+rtt_case "-B 5000"               -B 5000
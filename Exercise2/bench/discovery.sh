@@ -0,0 +1,53 @@
+#!/bin/bash
+# Peer discovery with many nodes on one host, over the loopback broadcast address
+# Starts node 0 as the observer plus <peers> more nodes, SIGKILLs a quarter of
+# them halfway so they have to time out, and stops the rest cleanly at the end
+# Prints the observer's membership changes and CPU cost per heartbeat received
+# Usage: bench/discovery.sh [build_dir] [seconds] [peers]
+
+BUILD=$(cd "${1:-build}" 2> /dev/null && pwd) || { echo "Build directory ${1:-build} not found" >&2; exit 1; }
+SECS=${2:-6}
+PEERS=${3:-128}
+PORT=${PORT:-9540}
+HEARTBEAT_MS=${HEARTBEAT_MS:-100}
+
+TX=$BUILD/udp_tcp_sender/udp_tcp_sender
+
+if [ ! -x "$TX" ]; then
+    echo "Missing $TX, build first" >&2
+    exit 1
+fi
+
+strip_color() {
+    sed -e 's/\x1b\[[0-9;]*m//g'
+}
+
+# Logs go to a scratch directory
+cd "$(mktemp -d)" || exit 1
+
+ARGS=(-a 127.255.255.255 -p "$PORT" -K "$HEARTBEAT_MS")
+
+"$TX" "${ARGS[@]}" -D 0 2> observer.log &
+observer=$!
+pids=()
+for i in $(seq 1 "$PEERS"); do
+    "$TX" "${ARGS[@]}" -D "$i" 2> /dev/null &
+    pids+=($!)
+done
+
+sleep $((SECS / 2))
+killed=("${pids[@]:0:$((PEERS / 4))}")
+kill -KILL "${killed[@]}"
+wait "${killed[@]}" 2> /dev/null
+sleep $((SECS - SECS / 2))
+kill -INT "${pids[@]:$((PEERS / 4))}"
+sleep 0.2
+kill -INT "$observer"
+wait 2> /dev/null
+
+echo "$PEERS peers, heartbeat every $HEARTBEAT_MS ms, $((PEERS / 4)) killed after $((SECS / 2)) s, the rest stopped after $SECS s"
+printf "  joined:    %s\n" "$(strip_color < observer.log | grep -c 'Peer [0-9]* joined')"
+printf "  timed out: %s\n" "$(strip_color < observer.log | grep -c 'Peer [0-9]* timed out')"
+printf "  left:      %s\n" "$(strip_color < observer.log | grep -c 'Peer [0-9]* left')"
+strip_color < observer.log | grep 'peers alive, .* heartbeats/s' | sed 's/.*\[UDP\] /  /' | sort -t, -k2 -n | tail -1 | sed 's/^  /  peak: /'
+strip_color < observer.log | grep 'peers alive after' | sed 's/.*\[UDP\] /  /'
@@ -0,0 +1,49 @@
+#!/bin/bash
+# Measures UDP segmentation offload on loopback
+#  Sender: plain sendmmsg vs UDP_SEGMENT (-G), same burst of small datagrams
+#  Receiver: plain recvmmsg vs UDP_GRO (-G) splitting coalesced buffers
+# Each case floods for the given time and prints pkt/syscall and CPU/pkt of both sides
+# Usage: bench/gso_gro.sh [build_dir] [seconds]
+
+BUILD=$(cd "${1:-build}" 2> /dev/null && pwd) || { echo "Build directory ${1:-build} not found" >&2; exit 1; }
+SECS=${2:-5}
+PORT=${PORT:-9510}
+PAYLOAD=${PAYLOAD:-256}
+
+UDP_RX=$BUILD/udp_receiver/udp_receiver
+TX=$BUILD/udp_tcp_sender/udp_tcp_sender
+
+for bin in "$UDP_RX" "$TX"; do
+    if [ ! -x "$bin" ]; then
+        echo "Missing $bin, build first" >&2
+        exit 1
+    fi
+done
+
+strip_color() {
+    sed -e 's/\x1b\[[0-9;]*m//g'
+}
+
+# gso_case <label> <receiver args> <sender args>
+gso_case() {
+    local label=$1
+    "$UDP_RX" -p "$PORT" $2 2> rx.log &
+    local rx_pid=$!
+    sleep 0.3
+    timeout -s INT "$SECS" "$TX" -p "$PORT" -R 10000000 -b 64 -n "$PAYLOAD" $3 2> tx.log
+    sleep 0.5
+    kill -INT "$rx_pid"
+    wait "$rx_pid"
+    echo "$label"
+    printf "  tx %s\n" "$(strip_color < tx.log | grep 'Sent .* packets' | sed 's/.*\[UDP\] //')"
+    printf "  rx %s\n" "$(strip_color < rx.log | grep 'Received .* packets' | sed 's/.*\[UDP\] //')"
+}
+
+# Logs go to a scratch directory
+cd "$(mktemp -d)" || exit 1
+
+echo "UDP flood, $PAYLOAD byte datagrams, bursts of 64, ${SECS}s"
+gso_case "sendmmsg -> recvmmsg"        "-b 64" ""
+gso_case "sendmmsg -> recvmmsg + GRO"  "-G"    ""
+gso_case "GSO x32  -> recvmmsg"        "-b 64" "-G 32"
+gso_case "GSO x32  -> recvmmsg + GRO"  "-G"    "-G 32"
@@ -0,0 +1,53 @@
+#!/bin/bash
+# Sequence-tracked UDP stream through the receiver's impairment shim (-N) on
+# loopback, one case per network condition, no root or tc needed
+# Each case prints what the receiver's tracker saw after impairment
+# Usage: bench/impair.sh [build_dir] [seconds]
+
+BUILD=$(cd "${1:-build}" 2> /dev/null && pwd) || { echo "Build directory ${1:-build} not found" >&2; exit 1; }
+SECS=${2:-3}
+PORT=${PORT:-9530}
+PAYLOAD=${PAYLOAD:-256}
+RATE=${RATE:-20000}
+
+UDP_RX=$BUILD/udp_receiver/udp_receiver
+TX=$BUILD/udp_tcp_sender/udp_tcp_sender
+
+for bin in "$UDP_RX" "$TX"; do
+    if [ ! -x "$bin" ]; then
+        echo "Missing $bin, build first" >&2
+        exit 1
+    fi
+done
+
+strip_color() {
+    sed -e 's/\x1b\[[0-9;]*m//g'
+}
+
+# impair_case <spec>
+impair_case() {
+    "$UDP_RX" -p "$PORT" -H -N "$1" 2> rx.log &
+    local rx_pid=$!
+    sleep 0.3
+    timeout -s INT "$SECS" "$TX" -p "$PORT" -R "$RATE" -i 1 -n "$PAYLOAD" 2> /dev/null
+    sleep 1  # Longest delay of any case, so nothing is still held
+    kill -INT "$rx_pid"
+    wait "$rx_pid"
+    echo "$1"
+    printf "  %s\n" "$(strip_color < rx.log | grep 'Impairment: .* datagrams in' | sed 's/.*\[UDP\] //')"
+    printf "  %s\n" "$(strip_color < rx.log | grep 'sender 1:' | tail -1 | sed 's/.*\[UDP\] //')"
+}
+
+# Logs go to a scratch directory
+cd "$(mktemp -d)" || exit 1
+
+echo "UDP at $RATE pkt/s, $PAYLOAD byte datagrams, ${SECS}s per case"
+impair_case "loss=0"
+impair_case "loss=2"
+impair_case "loss=2,burst=8"
+impair_case "delay=20,jitter=5,dist=uniform"
+impair_case "delay=20,jitter=5,dist=normal"
+impair_case "delay=5,jitter=5,dist=pareto"
+impair_case "delay=10,reorder=10"
+impair_case "dup=5"
+impair_case "rate=20,limit=200"
@@ -0,0 +1,66 @@
+#!/bin/bash
+# Multicast fan-out on loopback: one sender, a growing number of receivers that
+# joined the group, and one receiver on another group that must see nothing
+# Each case prints what the sender sent and what every member received
+# Usage: bench/multicast.sh [build_dir] [seconds]
+
+BUILD=$(cd "${1:-build}" 2> /dev/null && pwd) || { echo "Build directory ${1:-build} not found" >&2; exit 1; }
+SECS=${2:-3}
+PORT=${PORT:-9540}
+PAYLOAD=${PAYLOAD:-256}
+RATE=${RATE:-20000}
+GROUP=${GROUP:-239.255.0.1}
+OTHER_GROUP=${OTHER_GROUP:-239.255.0.2}
+IFACE=${IFACE:-lo}
+RECEIVERS=${RECEIVERS:-"1 2 4 8"}
+
+UDP_RX=$BUILD/udp_receiver/udp_receiver
+TX=$BUILD/udp_tcp_sender/udp_tcp_sender
+
+for bin in "$UDP_RX" "$TX"; do
+    if [ ! -x "$bin" ]; then
+        echo "Missing $bin, build first" >&2
+        exit 1
+    fi
+done
+
+strip_color() {
+    sed -e 's/\x1b\[[0-9;]*m//g'
+}
+
+received() {
+    strip_color < "$1" | grep 'Received .* packets' | tail -1 | sed 's/.*Received \([0-9]*\) packets.*/\1/'
+}
+
+# fanout_case <receivers>
+fanout_case() {
+    local pids=()
+    for i in $(seq 1 "$1"); do
+        "$UDP_RX" -p "$PORT" -g "$GROUP" -I "$IFACE" -b 64 2> "rx$i.log" &
+        pids+=($!)
+    done
+    "$UDP_RX" -p "$PORT" -g "$OTHER_GROUP" -I "$IFACE" -b 64 2> other.log &
+    pids+=($!)
+    sleep 0.3
+    timeout -s INT "$SECS" "$TX" -a "$GROUP" -p "$PORT" -I "$IFACE" -R "$RATE" -n "$PAYLOAD" 2> tx.log
+    sleep 0.2
+    kill -INT "${pids[@]}"
+    wait "${pids[@]}"
+
+    local counts=""
+    for i in $(seq 1 "$1"); do
+        counts="$counts $(received "rx$i.log")"
+    done
+    echo "$1 receiver(s)"
+    printf "  %s\n" "$(strip_color < tx.log | grep 'Sent .* packets' | sed 's/.*\[UDP\] //')"
+    printf "  members received:%s\n" "$counts"
+    printf "  other group received: %s\n" "$(received other.log)"
+}
+
+# Logs go to a scratch directory
+cd "$(mktemp -d)" || exit 1
+
+echo "UDP multicast to $GROUP on $IFACE at $RATE pkt/s, $PAYLOAD byte datagrams, ${SECS}s per case"
+for n in $RECEIVERS; do
+    fanout_case "$n"
+done
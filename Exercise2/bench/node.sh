@@ -0,0 +1,57 @@
+#!/bin/bash
+# Event-loop node scaling on loopback: a growing number of nodes broadcasting
+# heartbeats, probing each other and holding a full TCP mesh, plus one observer
+# node that also runs LOAD periodic timers. Each case prints how many nodes saw
+# every other one, the observer's last one-second report and its totals
+# Usage: bench/node.sh [build_dir] [seconds]
+
+BUILD=$(cd "${1:-build}" 2> /dev/null && pwd) || { echo "Build directory ${1:-build} not found" >&2; exit 1; }
+SECS=${2:-5}
+PORT=${PORT:-9560}
+DEST=${DEST:-127.255.255.255}
+HEARTBEAT=${HEARTBEAT:-200}
+PROBE=${PROBE:-1000}
+STATE=${STATE:-1000}
+LOAD=${LOAD:-10000}
+NODES=${NODES:-"10 50 100"}
+
+NODE=$BUILD/udp_tcp_node/udp_tcp_node
+
+if [ ! -x "$NODE" ]; then
+    echo "Missing $NODE, build first" >&2
+    exit 1
+fi
+
+strip_color() {
+    sed -e 's/\x1b\[[0-9;]*m//g'
+}
+
+# scale_case <nodes>
+scale_case() {
+    local pids=()
+    for i in $(seq 2 "$1"); do
+        "$NODE" -i "$i" -p "$PORT" -a "$DEST" -K "$HEARTBEAT" -U "$PROBE" -S "$STATE" 2> "node$i.log" &
+        pids+=($!)
+    done
+    timeout -s INT "$SECS" "$NODE" -i 1 -p "$PORT" -a "$DEST" -K "$HEARTBEAT" -U "$PROBE" -S "$STATE" -W "$LOAD" 2> node1.log
+    kill -INT "${pids[@]}"
+    wait "${pids[@]}"
+
+    local complete=0
+    for i in $(seq 1 "$1"); do
+        if strip_color < "node$i.log" | grep -q "$(($1 - 1)) peers, $(($1 - 1)) TCP connections"; then
+            complete=$((complete + 1))
+        fi
+    done
+    echo "$1 nodes, $complete with all peers and connections"
+    strip_color < node1.log | grep ' peers, .* CPU$' | tail -1 | sed 's/^I udp_tcp_node: /  /'
+    strip_color < node1.log | grep 'Node 1: ' | sed 's/^I udp_tcp_node: Node 1: /  /'
+}
+
+# Logs go to a scratch directory
+cd "$(mktemp -d)" || exit 1
+
+echo "Nodes on $DEST:$PORT, heartbeat ${HEARTBEAT} ms, probes ${PROBE} ms, TCP state ${STATE} ms, $LOAD load timers on the observer, ${SECS}s per case"
+for n in $NODES; do
+    scale_case "$n"
+done
@@ -0,0 +1,53 @@
+#!/bin/bash
+# Reliable UDP under simulated loss on loopback
+# Both sides drop the given share of their outgoing datagrams (-l), so data
+# and ACKs are lost alike. For each loss rate:
+#  throughput: as many messages as the window allows
+#  latency:    paced at a fixed rate, first transmission to ACK
+# Usage: bench/rudp_loss.sh [build_dir] [messages]
+
+BUILD=$(cd "${1:-build}" 2> /dev/null && pwd) || { echo "Build directory ${1:-build} not found" >&2; exit 1; }
+COUNT=${2:-100000}
+PORT=${PORT:-9520}
+PAYLOAD=${PAYLOAD:-256}
+RATE=${RATE:-10000}
+LOSSES=${LOSSES:-"0 1 5 10 20"}
+
+UDP_RX=$BUILD/udp_receiver/udp_receiver
+TX=$BUILD/udp_tcp_sender/udp_tcp_sender
+
+for bin in "$UDP_RX" "$TX"; do
+    if [ ! -x "$bin" ]; then
+        echo "Missing $bin, build first" >&2
+        exit 1
+    fi
+done
+
+strip_color() {
+    sed -e 's/\x1b\[[0-9;]*m//g'
+}
+
+# rudp_case <loss %> <sender args...>
+rudp_case() {
+    local loss=$1; shift
+    "$UDP_RX" -p "$PORT" -L -l "$loss" 2> /dev/null &
+    local rx_pid=$!
+    sleep 0.3
+    timeout -s INT 60 "$TX" -p "$PORT" -L -l "$loss" -n "$PAYLOAD" -r "$COUNT" "$@" 2> tx.log
+    kill -INT "$rx_pid"
+    wait "$rx_pid"
+    strip_color < tx.log | grep 'Reliable: .* messages in' | sed 's/.*\[UDP\] Reliable: //'
+    strip_color < tx.log | grep 'Delivery latency' | sed 's/.*\[UDP\] /  /'
+}
+
+# Logs go to a scratch directory
+cd "$(mktemp -d)" || exit 1
+
+for loss in $LOSSES; do
+    echo "== ${loss}% loss each way, $COUNT messages of $PAYLOAD bytes"
+    echo "throughput (window limited):"
+    rudp_case "$loss"
+    echo "latency (paced at $RATE msg/s):"
+    rudp_case "$loss" -R "$RATE"
+    echo
+done
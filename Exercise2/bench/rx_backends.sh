@@ -0,0 +1,60 @@
+#!/bin/bash
+# Compares the receive backends on loopback
+#  UDP: recvmmsg (-b 64) vs io_uring (-u) under a flood from the sendmmsg benchmark mode
+#  TCP: epoll vs io_uring echo, measured with the RTT ping mode
+# Usage: bench/rx_backends.sh [build_dir] [seconds]
+
+BUILD=$(cd "${1:-build}" 2> /dev/null && pwd) || { echo "Build directory ${1:-build} not found" >&2; exit 1; }
+SECS=${2:-5}
+PORT=${PORT:-9500}
+
+UDP_RX=$BUILD/udp_receiver/udp_receiver
+TCP_RX=$BUILD/tcp_receiver/tcp_receiver
+TX=$BUILD/udp_tcp_sender/udp_tcp_sender
+
+for bin in "$UDP_RX" "$TCP_RX" "$TX"; do
+    if [ ! -x "$bin" ]; then
+        echo "Missing $bin, build first" >&2
+        exit 1
+    fi
+done
+
+strip_color() {
+    sed -e 's/\x1b\[[0-9;]*m//g'
+}
+
+# udp_case <label> <receiver args...>
+udp_case() {
+    local label=$1; shift
+    "$UDP_RX" -p "$PORT" "$@" 2> rx.log &
+    local rx_pid=$!
+    sleep 0.3
+    timeout -s INT "$SECS" "$TX" -p "$PORT" -R 5000000 -b 64 -n 64 2> /dev/null
+    sleep 0.5
+    kill -INT "$rx_pid"
+    wait "$rx_pid"
+    printf "%-18s %s\n" "$label" "$(strip_color < rx.log | grep 'Received .* packets' | sed 's/.*\[UDP\] //')"
+}
+
+# tcp_case <label> <receiver args...>
+tcp_case() {
+    local label=$1; shift
+    "$TCP_RX" -p "$PORT" -e "$@" 2> /dev/null &
+    local rx_pid=$!
+    sleep 0.3
+    "$TX" -T -p "$PORT" -P 20000 -r $((SECS * 20000)) 2> tx.log
+    kill -INT "$rx_pid"
+    wait "$rx_pid"
+    printf "%-18s %s\n" "$label" "$(strip_color < tx.log | grep 'RTT us' | sed 's/.*\[TCP\] //')"
+}
+
+# Logs go to a scratch directory
+cd "$(mktemp -d)" || exit 1
+
+echo "UDP flood, 64 byte datagrams, ${SECS}s"
+udp_case "recvmmsg -b 64" -b 64
+udp_case "io_uring"       -u
+echo
+echo "TCP echo RTT, 20000 probes/s, ${SECS}s"
+tcp_case "epoll"
+tcp_case "io_uring"       -u
@@ -0,0 +1,53 @@
+#!/bin/bash
+# TCP streaming on loopback: the plain send() loop against writev gathering,
+# Nagle/TCP_NODELAY/TCP_CORK coalescing and MSG_ZEROCOPY, for small and large
+# messages. Each case floods for the given time and prints the sender summary
+# Loopback always copies zerocopy data to the receiver, expect the completions
+# to report it copied; on a NIC the pages go out without a copy
+# Usage: bench/tcp_stream.sh [build_dir] [seconds]
+
+BUILD=$(cd "${1:-build}" 2> /dev/null && pwd) || { echo "Build directory ${1:-build} not found" >&2; exit 1; }
+SECS=${2:-3}
+PORT=${PORT:-9580}
+SMALL=${SMALL:-64}
+LARGE=${LARGE:-65000}
+
+TCP_RX=$BUILD/tcp_receiver/tcp_receiver
+TX=$BUILD/udp_tcp_sender/udp_tcp_sender
+
+for bin in "$TCP_RX" "$TX"; do
+    if [ ! -x "$bin" ]; then
+        echo "Missing $bin, build first" >&2
+        exit 1
+    fi
+done
+
+strip_color() {
+    sed -e 's/\x1b\[[0-9;]*m//g'
+}
+
+# stream_case <label> <sender args>
+stream_case() {
+    # Stats mode, the receiver only counts instead of logging every read
+    "$TCP_RX" -p "$PORT" -s 65507 -S 2> /dev/null &
+    local rx_pid=$!
+    sleep 0.3
+    timeout -s INT "$SECS" "$TX" -T -p "$PORT" $2 2> tx.log
+    kill -INT "$rx_pid"
+    wait "$rx_pid"
+    echo "$1"
+    strip_color < tx.log | grep -E 'Sent .* messages|Zerocopy:' | sed 's/.*\[TCP\] /  /'
+}
+
+# Logs go to a scratch directory
+cd "$(mktemp -d)" || exit 1
+
+echo "TCP streaming, $SMALL and $LARGE byte messages, ${SECS}s per case"
+stream_case "$SMALL B send, Nagle"          "-S send -n $SMALL"
+stream_case "$SMALL B send, TCP_NODELAY"    "-S send -n $SMALL -C nodelay"
+stream_case "$SMALL B send, TCP_CORK x64"   "-S send -n $SMALL -C cork -b 64"
+stream_case "$SMALL B writev x64"           "-S writev -n $SMALL -b 64"
+stream_case "$SMALL B writev x64, len framing" "-S writev -n $SMALL -b 64 -f len"
+stream_case "$LARGE B send"                 "-S send -n $LARGE"
+stream_case "$LARGE B writev x4"            "-S writev -n $LARGE -b 4"
+stream_case "$LARGE B zerocopy x4"          "-S zerocopy -n $LARGE -b 4"
@@ -0,0 +1,190 @@
+// Peer discovery and liveness over UDP broadcast or multicast
+//
+// Every node broadcasts a small heartbeat each interval on a shared port and
+// listens on the same port. With a multicast group as destination the node
+// joins the group instead, so only group members see the heartbeats. A peer joins with its first heartbeat and leaves
+// after timeout without one, or at once when it shuts down cleanly. A changed
+// incarnation means the peer restarted and lost its state in between. A node
+// may announce a service port (e.g. where it accepts TCP) in its heartbeats.
+//
+// Peers live in a peer_table keyed by node id, and on a list ordered by the
+// last heartbeat. A heartbeat is one hash lookup and one move
+// to the list tail, expiry only ever looks at the head, so the cost per
+// heartbeat does not grow with the number of peers.
+//
+// Joins, leaves and restarts are queued and signalled on an eventfd, which
+// can sit in the same poll or epoll set as the socket. Single-threaded:
+// the caller waits at most discovery_timeout_ms and then calls discovery_process.
+//
+// Programs with their own event loop and timers can speak the same protocol
+// with discovery_heartbeat_encode and discovery_heartbeat_decode.
+
+/* Usage example:
+#include "discovery/discovery.h"
+
+discovery_config_t cfg = DISCOVERY_CONFIG_DEFAULT;
+cfg.node_id = 3;
+cfg.port = 30001;
+cfg.dest = bcast_addr;          // 255.255.255.255, the subnet broadcast or a multicast group, same port
+discovery_t disc;
+discovery_init(&disc, sock, &cfg);  // sock has SO_BROADCAST, gets bound here
+
+while (running) {
+    struct pollfd pfd[2] = { { .fd = sock, .events = POLLIN }, { .fd = discovery_event_fd(&disc), .events = POLLIN } };
+    poll(pfd, 2, discovery_timeout_ms(&disc));
+    discovery_process(&disc);  // Receives, sends the heartbeat when due, expires silent peers
+
+    discovery_event_t ev;
+    while (discovery_next_event(&disc, &ev)) {
+        if (ev.type == DISCOVERY_JOINED) add_elevator(ev.node_id);
+    }
+}
+discovery_free(&disc);  // Tells the peers we are leaving
+*/
+
+#ifndef DISCOVERY_H
+#define DISCOVERY_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <netinet/in.h>
+
+#include "mcast/mcast.h"
+#include "peer_table/peer_table.h"
+
+#define DISCOVERY_MAGIC 0x4842              // "HB"
+#define DISCOVERY_VERSION 2
+#define DISCOVERY_HEARTBEAT_SIZE 20         // magic(2) version(1) flags(1) node(4) incarnation(4) seq(4) service_port(2) reserved(2), network byte order
+#define DISCOVERY_FLAG_LEAVING 0x01         // Last heartbeat before a clean shutdown
+#define DISCOVERY_RX_BATCH 32               // Heartbeats per recvmmsg in discovery_process
+
+typedef struct {
+    uint32_t node_id;
+    uint16_t port;                  // Bound with SO_REUSEADDR, several nodes can share a host
+    struct sockaddr_in dest;        // Where heartbeats go, a broadcast address or multicast group on port
+    mcast_iface_t iface;            // Multicast only: interface to join and send on
+    int mcast_ttl;
+    int mcast_loop;                 // Needed for several nodes on one host
+    uint64_t interval_ns;
+    uint64_t timeout_ns;            // Silence after which a peer has left
+    uint32_t max_peers;
+    uint16_t service_port;          // Announced in heartbeats, 0 for none
+} discovery_config_t;
+
+// Five heartbeats may go missing before a peer is declared gone
+#define DISCOVERY_CONFIG_DEFAULT { \
+    .node_id = 0, .port = 0, .dest = { .sin_family = AF_INET }, \
+    .iface = MCAST_IFACE_DEFAULT, .mcast_ttl = MCAST_DEFAULT_TTL, .mcast_loop = 1, \
+    .interval_ns = 100000000ull, .timeout_ns = 500000000ull, .max_peers = 256, .service_port = 0 }
+
+typedef enum {
+    DISCOVERY_JOINED,
+    DISCOVERY_LEFT,        // Timed out or shut down cleanly
+    DISCOVERY_RESTARTED    // Still there, but with a new incarnation
+} discovery_event_type_t;
+
+typedef struct {
+    discovery_event_type_t type;
+    uint32_t node_id;
+    struct sockaddr_in addr;
+    int graceful;          // DISCOVERY_LEFT: announced rather than timed out
+} discovery_event_t;
+
+typedef struct {
+    uint32_t node_id;
+    uint32_t incarnation;
+    struct sockaddr_in addr;
+    uint64_t joined_ns;
+    uint64_t last_seen_ns;
+    uint64_t heartbeats;
+    uint64_t missed;       // Gaps in the heartbeat sequence
+    uint32_t last_seq;
+    uint16_t service_port; // As last announced, 0 for none
+
+    // Liveness list, oldest heartbeat first, indices into the peer array, -1 ends it
+    int32_t prev;
+    int32_t next;
+} discovery_peer_t;
+
+typedef struct {
+    uint32_t node_id;
+    uint32_t incarnation;
+    uint32_t seq;
+    uint16_t service_port;
+    uint8_t flags;
+} discovery_heartbeat_t;
+
+typedef struct {
+    uint64_t heartbeats_sent;
+    uint64_t heartbeats_received;   // From peers, our own looped back ones not counted
+    uint64_t invalid;
+    uint64_t joins;
+    uint64_t leaves;
+    uint64_t timeouts;              // Leaves without a goodbye
+    uint64_t restarts;
+    uint64_t table_full;            // Heartbeats of peers that did not fit
+    uint64_t events_dropped;        // Queue overflow, the consumer fell behind
+} discovery_stats_t;
+
+typedef struct {
+    int sock;
+    int event_fd;
+    discovery_config_t cfg;
+    uint32_t incarnation;
+    uint32_t seq;
+    uint64_t next_heartbeat_ns;
+
+    discovery_peer_t *peers;  // Indexed by table slot
+    peer_table_t table;
+    int32_t oldest;        // Liveness list
+    int32_t newest;
+
+    discovery_event_t *events;  // Ring
+    uint32_t event_mask;
+    uint32_t event_head;
+    uint32_t event_tail;
+
+    // recvmmsg batch
+    uint8_t (*rx_bufs)[DISCOVERY_HEARTBEAT_SIZE];
+    struct iovec *rx_iovs;
+    struct mmsghdr *rx_msgs;
+    struct sockaddr_in *rx_addrs;
+
+    discovery_stats_t stats;
+} discovery_t;
+
+// Binds sock to cfg->port, joins cfg->dest if it is a group, and sends the first heartbeat
+// Returns 0 on success, -1 on invalid config, bind, join or allocation failure
+int discovery_init(discovery_t *d, int sock, const discovery_config_t *cfg);
+
+// Sends a leaving heartbeat, leaves the group and releases everything but the socket
+void discovery_free(discovery_t *d);
+
+// Drains the socket, sends the heartbeat if due and expires silent peers
+// Returns 0, or -1 on a socket error
+int discovery_process(discovery_t *d);
+
+// Milliseconds until the next heartbeat or expiry is due
+int discovery_timeout_ms(const discovery_t *d);
+
+// Readable while events are queued
+int discovery_event_fd(const discovery_t *d);
+
+// Pops the oldest event, returns 1, or 0 once the queue is empty
+int discovery_next_event(discovery_t *d, discovery_event_t *ev);
+
+// NULL if the node is not currently alive
+const discovery_peer_t *discovery_find(const discovery_t *d, uint32_t node_id);
+
+uint32_t discovery_peer_count(const discovery_t *d);
+
+// Writes DISCOVERY_HEARTBEAT_SIZE bytes to pkt
+void discovery_heartbeat_encode(const discovery_heartbeat_t *hb, uint8_t *pkt);
+
+// Returns 0, or -1 if pkt is not a heartbeat of this version
+int discovery_heartbeat_decode(const uint8_t *pkt, size_t len, discovery_heartbeat_t *hb);
+
+// A fresh incarnation for a node that is starting, tells a restart apart from a long silence
+uint32_t discovery_new_incarnation(void);
+
+#endif
@@ -0,0 +1,103 @@
+// Compact binary encoding of the shared elevator world state
+//
+// The state is everything the nodes broadcast several times per second: hall
+// requests for every floor, and each elevator's floor, direction, behaviour
+// and cab requests. It is written as a bit stream, LSB first: request
+// matrices take one bit per floor, enums two bits, the floor as few bits as
+// the floor count needs, ids and sequence numbers are varints.
+//
+// A delta encodes a state against an older one the receiver already holds,
+// normally the last one it acknowledged. Only changed fields go on the wire,
+// changed request bits as a list of flipped floors or as a XOR mask, whichever
+// is shorter. When the floor count or the elevator roster differ from the base
+// the encoder falls back to a full state.
+//
+// Encoding and decoding work on caller buffers only, nothing is allocated.
+
+/* Usage example:
+#include "elev_state/elev_state.h"
+
+// Sender, acked is the state every peer has confirmed
+uint8_t buf[ELEV_STATE_MAX_SIZE];
+state.seq++;
+int len = elev_state_encode_delta(&state, &acked, buf, sizeof(buf));
+sendto(sock, buf, len, ...);
+
+// Receiver, known is the last state it decoded
+elev_state_t next;
+int rc = elev_state_decode(rx_buf, rx_len, &known, &next);
+if (rc == 0) {
+    known = next;  // And acknowledge known.seq
+} else if (rc == ELEV_STATE_NEED_BASE) {
+    // Delta against a state we never got, ask for a full one
+}
+*/
+
+#ifndef ELEV_STATE_H
+#define ELEV_STATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define ELEV_STATE_MAGIC 0xE        // High nibble of the first byte
+#define ELEV_STATE_VERSION 1        // Bits 3..1 of the first byte, bit 0 is set for a delta
+#define ELEV_STATE_MAX_FLOORS 32
+#define ELEV_STATE_MAX_ELEVATORS 16
+
+// Largest full encoding: header byte, seq varint, the two counts, hall
+// requests, then per elevator an id varint, floor, two enums and cab requests
+#define ELEV_STATE_MAX_SIZE (1 + (40 + 5 + 5 + 2 * ELEV_STATE_MAX_FLOORS + \
+    ELEV_STATE_MAX_ELEVATORS * (40 + 5 + 2 + 2 + ELEV_STATE_MAX_FLOORS) + 7) / 8)
+
+#define ELEV_STATE_INVALID -1       // Malformed, unknown version or out of range
+#define ELEV_STATE_NEED_BASE -2     // Delta against a state other than the given base
+
+typedef enum {
+    ELEV_DIR_STOP,
+    ELEV_DIR_UP,
+    ELEV_DIR_DOWN
+} elev_dir_t;
+
+typedef enum {
+    ELEV_IDLE,
+    ELEV_MOVING,
+    ELEV_DOOR_OPEN
+} elev_behaviour_t;
+
+typedef struct {
+    uint32_t id;
+    uint8_t floor;
+    uint8_t direction;          // elev_dir_t
+    uint8_t behaviour;          // elev_behaviour_t
+    uint32_t cab_requests;      // Bit per floor
+} elev_state_elevator_t;
+
+typedef struct {
+    uint32_t seq;               // Bumped by the owner on every change, deltas name their base by it
+    uint8_t n_floors;           // 1 to ELEV_STATE_MAX_FLOORS
+    uint8_t n_elevators;
+    uint32_t hall_up;           // Bit per floor
+    uint32_t hall_down;
+    elev_state_elevator_t elevators[ELEV_STATE_MAX_ELEVATORS];
+} elev_state_t;
+
+// Full encoding of state into buf
+// Returns the length, or ELEV_STATE_INVALID if a field is out of range or len is too small
+int elev_state_encode(const elev_state_t *state, void *buf, size_t len);
+
+// Encodes the difference between state and base, a full state if base is
+// NULL or has other floors or elevators. Returns like elev_state_encode
+int elev_state_encode_delta(const elev_state_t *state, const elev_state_t *base, void *buf, size_t len);
+
+// Decodes a full state or a delta against base into out, which may be base itself
+// Returns 0, ELEV_STATE_INVALID, or ELEV_STATE_NEED_BASE if base is NULL or
+// its seq is not the one the delta was made against. out is untouched on failure
+int elev_state_decode(const void *buf, size_t len, const elev_state_t *base, elev_state_t *out);
+
+// Returns 1 and the seq the delta needs as base, 0 for a full state, or ELEV_STATE_INVALID
+int elev_state_delta_base(const void *buf, size_t len, uint32_t *base_seq);
+
+// Same seq and contents, unused elevator slots are ignored
+int elev_state_equal(const elev_state_t *a, const elev_state_t *b);
+
+#endif
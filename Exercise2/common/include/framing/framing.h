@@ -0,0 +1,78 @@
+// Streaming message framing for TCP
+
+/* Usage example:
+#include "framing/framing.h"
+
+frame_decoder_t dec;
+frame_decoder_init(&dec, FRAMING_DELIMITED, 4096);
+
+size_t space;
+char *dst = frame_decoder_write_ptr(&dec, &space);
+ssize_t n = recv(fd, dst, space, 0);
+frame_decoder_commit(&dec, n);
+
+const char *msg;
+size_t len;
+int rc;
+while ((rc = frame_decoder_next(&dec, &msg, &len)) == 1) {
+    handle(msg, len);  // Points into the decoder buffer, valid until the next write_ptr
+}
+if (rc < 0) {
+    // Oversized message, the stream cannot be resynchronized
+}
+frame_decoder_free(&dec);
+*/
+
+#ifndef FRAMING_H
+#define FRAMING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define FRAMING_FIXED_SIZE 1024       // Exercise server fixed-size frames, zero padded
+#define FRAMING_LENGTH_PREFIX_SIZE 4  // Big-endian uint32 payload length
+
+typedef enum {
+    FRAMING_NONE,           // Whatever one recv returned is one message
+    FRAMING_LENGTH_PREFIX,
+    FRAMING_FIXED,
+    FRAMING_DELIMITED,      // Terminated by '\0'
+} framing_type_t;
+
+// Single buffer allocated at init, messages are returned in place.
+// Valid data is buf[start, end); the partial tail is moved to the front
+// only when the free space at the end runs out.
+typedef struct {
+    framing_type_t type;
+    char *buf;
+    size_t capacity;
+    size_t start;
+    size_t end;
+    size_t scanned;  // FRAMING_DELIMITED: buf[start, scanned) holds no delimiter
+} frame_decoder_t;
+
+// capacity bounds the largest message (minus the prefix for FRAMING_LENGTH_PREFIX)
+// Returns 0 on success, -1 if allocation fails or capacity is too small for the framing
+int frame_decoder_init(frame_decoder_t *dec, framing_type_t type, size_t capacity);
+void frame_decoder_free(frame_decoder_t *dec);
+
+// Free space to receive into, at least one byte unless a message fills the buffer
+// Invalidates messages returned by frame_decoder_next
+char *frame_decoder_write_ptr(frame_decoder_t *dec, size_t *space);
+
+// Marks n bytes written at the write pointer as received
+void frame_decoder_commit(frame_decoder_t *dec, size_t n);
+
+// Returns 1 with the next complete message, 0 if more data is needed,
+// -1 if a message can never fit in the buffer
+int frame_decoder_next(frame_decoder_t *dec, const char **msg, size_t *len);
+
+// Writes msg with framing into out
+// Returns the framed size, or -1 if it does not fit in out_cap or the framing
+int frame_encode(framing_type_t type, const char *msg, size_t len, char *out, size_t out_cap);
+
+// "none", "len", "fixed" or "nul". Returns -1 for unknown names
+int framing_parse(const char *name);
+const char *framing_name(framing_type_t type);
+
+#endif
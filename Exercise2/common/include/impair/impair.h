@@ -0,0 +1,137 @@
+// Network impairment in user space, netem style
+//
+// Datagrams submitted to an impair_t are dropped, delayed, reordered,
+// duplicated and rate limited as configured, then handed to the deliver
+// callback when due. Wrapped around sendto it impairs a sender, wrapped
+// around recvfrom it impairs a receiver, so adverse networks can be tested on
+// plain loopback without root or tc.
+//
+// Delayed datagrams wait in pooled buffers on a hashed timer wheel with
+// IMPAIR_TICK_NS slots. A datagram is never released before its time, and at
+// most one tick late if the caller wakes at impair_next_ns. Not thread safe.
+
+/* Usage example:
+#include "impair/impair.h"
+
+impair_config_t cfg = IMPAIR_CONFIG_DEFAULT;
+if (impair_parse(&cfg, "loss=2,delay=20,jitter=5,dist=normal,reorder=10") < 0) {
+    // Bad spec
+}
+
+impair_t im;
+impair_init(&im, &cfg, 1500, impair_sendto, &sock);
+
+impair_submit(&im, buf, len, &dest_addr);  // Instead of sendto
+
+while (running) {
+    ppoll(..., timeout until impair_next_ns(&im), ...);
+    impair_run(&im);  // Sends whatever is due
+}
+impair_free(&im);
+*/
+
+#ifndef IMPAIR_H
+#define IMPAIR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <netinet/in.h>
+
+#include "mempool/mempool.h"
+
+#define IMPAIR_TICK_NS 50000ull     // Timer wheel resolution
+#define IMPAIR_WHEEL_SLOTS 8192     // Power of two, one revolution is about 410 ms
+#define IMPAIR_SPEC_HELP "loss=<%>,burst=<packets>,delay=<ms>,jitter=<ms>,dist=<uniform|normal|pareto>,reorder=<%>,dup=<%>,rate=<Mbit/s>,limit=<packets>,seed=<n>"
+
+typedef enum {
+    IMPAIR_UNIFORM,  // delay +- jitter
+    IMPAIR_NORMAL,   // Mean delay, standard deviation jitter
+    IMPAIR_PARETO    // At least delay, plus a heavy tail with mean jitter
+} impair_dist_t;
+
+typedef struct {
+    double loss;            // Share of datagrams dropped
+    double loss_burst;      // Mean length of a loss burst in datagrams, 1 for independent losses
+    uint64_t delay_ns;
+    uint64_t jitter_ns;
+    impair_dist_t dist;
+    double reorder;         // Share sent without delay, overtaking the delayed ones
+    double duplicate;       // Share delivered twice, each copy delayed on its own
+    double rate_bps;        // Bottleneck bandwidth, 0 for unlimited
+    uint32_t limit;         // Datagrams held at once, more are dropped like a full queue
+    uint64_t seed;          // 0 picks one from the clock
+} impair_config_t;
+
+#define IMPAIR_CONFIG_DEFAULT { \
+    .loss = 0.0, .loss_burst = 1.0, .delay_ns = 0, .jitter_ns = 0, .dist = IMPAIR_UNIFORM, \
+    .reorder = 0.0, .duplicate = 0.0, .rate_bps = 0.0, .limit = 1000, .seed = 0 }
+
+typedef void (*impair_deliver_fn)(void *arg, const void *data, size_t len, const struct sockaddr_in *addr);
+
+typedef struct impair_pkt impair_pkt_t;
+
+typedef struct {
+    impair_pkt_t *head;
+    impair_pkt_t *tail;
+} impair_slot_t;
+
+typedef struct {
+    uint64_t submitted;
+    uint64_t delivered;
+    uint64_t lost;          // Dropped by the loss model
+    uint64_t overflow;      // Dropped because limit datagrams were held
+    uint64_t duplicated;
+    uint64_t reordered;
+    uint64_t oversized;     // Larger than max_packet, passed on undelayed
+} impair_stats_t;
+
+typedef struct {
+    impair_config_t cfg;
+    impair_deliver_fn deliver;
+    void *arg;
+    mempool_t pool;
+    size_t max_packet;
+    impair_slot_t *wheel;
+    uint64_t tick;          // Next tick to run, everything before was released
+    uint64_t link_free_ns;  // When the bottleneck finishes its current datagram
+    uint64_t rng;
+    double burst_enter;     // Gilbert model: P(good -> lossy)
+    double burst_leave;     // P(lossy -> good)
+    int in_burst;
+    int spare_valid;        // Box-Muller makes normals in pairs
+    double spare;
+    impair_stats_t stats;
+} impair_t;
+
+// Returns 0 on success, -1 on an invalid config or allocation failure
+// Datagrams up to max_packet bytes can be held back
+int impair_init(impair_t *im, const impair_config_t *cfg, size_t max_packet, impair_deliver_fn deliver, void *arg);
+
+// Held datagrams are discarded
+void impair_free(impair_t *im);
+
+// Parses a comma separated IMPAIR_SPEC_HELP list into cfg, keys not given keep their value
+// Returns 0 on success, -1 on an unknown key or a value out of range
+int impair_parse(impair_config_t *cfg, const char *spec);
+
+// Human readable summary of cfg for logs
+void impair_describe(const impair_config_t *cfg, char *buf, size_t len);
+
+// Applies the impairments to one datagram, a datagram due now is delivered
+// before this returns. addr may be NULL
+void impair_submit(impair_t *im, const void *data, size_t len, const struct sockaddr_in *addr);
+
+// Delivers every held datagram that is due, returns how many
+int impair_run(impair_t *im);
+
+// net_now_ns() time when the next held datagram is due, UINT64_MAX if none
+uint64_t impair_next_ns(const impair_t *im);
+
+// Datagrams currently held
+uint32_t impair_held(const impair_t *im);
+
+// Deliver callback for impairing a sender: arg points to the int socket,
+// sends non-blocking, errors count as loss
+void impair_sendto(void *arg, const void *data, size_t len, const struct sockaddr_in *addr);
+
+#endif
@@ -0,0 +1,66 @@
+// IPv4 multicast socket setup
+//
+// A datagram sent to a group reaches only the hosts that joined it, unlike a
+// broadcast, which every host on the LAN has to receive and drop. Receivers
+// join groups on an interface, senders pick the outgoing interface, the TTL
+// (1 stays on the local subnet) and whether copies loop back to members on
+// the sending host, which is how several nodes on one machine see each other.
+// On lo every datagram sent is received again anyway, loopback control only
+// matters on real interfaces.
+
+/* Usage example:
+#include "mcast/mcast.h"
+
+mcast_iface_t iface;
+mcast_parse_iface("lo", &iface);  // Or an address, NULL for the route's choice
+
+// Receiver, bound to INADDR_ANY:port with SO_REUSEADDR to share the port
+mcast_join(sock, group, &iface);
+...
+mcast_leave(sock, group, &iface);
+
+// Sender
+mcast_set_sender(sock, &iface, 1, 1);  // TTL 1, loop back to local members
+sendto(sock, buf, len, 0, (struct sockaddr *)&group_addr, sizeof(group_addr));
+*/
+
+#ifndef MCAST_H
+#define MCAST_H
+
+#include <netinet/in.h>
+
+#define MCAST_DEFAULT_TTL 1     // Local subnet only
+#define MCAST_MAX_GROUPS 16     // Per socket in the programs, the kernel allows more
+
+// Interface by index or by one of its addresses, both zero lets the routing table choose
+typedef struct {
+    int ifindex;
+    struct in_addr addr;
+} mcast_iface_t;
+
+#define MCAST_IFACE_DEFAULT { .ifindex = 0, .addr = { .s_addr = INADDR_ANY } }
+
+// 224.0.0.0/4
+int mcast_is_group(struct in_addr addr);
+
+// Accepts an interface name or an IPv4 address of one
+// Returns 0 on success, -1 if there is no such interface or the address is malformed
+int mcast_parse_iface(const char *str, mcast_iface_t *iface);
+
+// Readable name of iface for logs, "default" if unset
+const char *mcast_iface_name(const mcast_iface_t *iface, char *buf, size_t len);
+
+// Joins group on iface, iface may be NULL. Also turns off IP_MULTICAST_ALL so
+// a socket bound to INADDR_ANY only gets the groups it joined itself
+// Returns 0 on success, -1 with errno set
+int mcast_join(int sock, struct in_addr group, const mcast_iface_t *iface);
+
+// Returns 0 on success, -1 with errno set
+int mcast_leave(int sock, struct in_addr group, const mcast_iface_t *iface);
+
+// Outgoing interface (iface may be NULL to keep the route's choice), TTL 0-255
+// and loopback to members on this host for datagrams sent to groups
+// Returns 0 on success, -1 with errno set
+int mcast_set_sender(int sock, const mcast_iface_t *iface, int ttl, int loop);
+
+#endif
@@ -0,0 +1,43 @@
+// Fixed-size block pool for hot paths
+//
+// One allocation up front, then O(1) alloc and release through an intrusive
+// free list threaded through the unused blocks. Not thread safe.
+
+/* Usage example:
+#include "mempool/mempool.h"
+
+mempool_t pool;
+mempool_init(&pool, 1500, 1024);
+
+char *pkt = mempool_alloc(&pool);
+if (pkt == NULL) {
+    // Exhausted, apply backpressure
+}
+mempool_release(&pool, pkt);
+mempool_destroy(&pool);
+*/
+
+#ifndef MEMPOOL_H
+#define MEMPOOL_H
+
+#include <stddef.h>
+
+typedef struct {
+    char *mem;
+    void *free_list;    // Next free block, each free block starts with a pointer to the next
+    size_t block_size;  // Rounded up so every block is suitably aligned
+    size_t count;
+    size_t in_use;
+} mempool_t;
+
+// Returns 0 on success, -1 if allocation fails or a size is zero
+int mempool_init(mempool_t *pool, size_t block_size, size_t count);
+void mempool_destroy(mempool_t *pool);
+
+// Returns a block of at least block_size bytes, NULL when all are in use
+void *mempool_alloc(mempool_t *pool);
+
+// block must come from this pool
+void mempool_release(mempool_t *pool, void *block);
+
+#endif
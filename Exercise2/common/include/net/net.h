@@ -0,0 +1,152 @@
+// Socket setup, option parsing, clocks and signal handling shared by the programs
+//
+// The factories create IPv4 sockets with close-on-exec set and apply a
+// net_opts_t before binding, so buffer sizes and SO_REUSEPORT take effect
+// before the first datagram or connection arrives. A failing call closes the
+// socket and returns -1 with errno set, the caller logs. The kernel doubles
+// buffer sizes for its bookkeeping and clamps them to net.core.rmem_max and
+// wmem_max, net_buffer_sizes reads back what a socket really got. The parsers
+// accept whole decimal numbers only and follow the CHECK convention of the
+// programs: a negative result is an invalid argument.
+
+/* Usage example:
+#include "net/net.h"
+
+static volatile sig_atomic_t running = 1;
+
+int port = net_parse_port(optarg);
+CHECK(port, TAG, "Invalid port: %s", optarg);
+
+net_handle_signals(&running);  // SIGINT/SIGTERM clear running, SIGPIPE is ignored
+
+net_opts_t opts = NET_OPTS_DEFAULT;
+opts.nonblocking = 1;
+opts.rcvbuf = 4 << 20;
+int sock = net_udp_socket(port, &opts);
+if (sock < 0) {
+    LOGE_ERRNO(TAG, "Could not set up a UDP socket on port %d", port);
+}
+int rcvbuf;
+net_buffer_sizes(sock, &rcvbuf, NULL);
+if (rcvbuf < 2 * opts.rcvbuf) {
+    LOGW(TAG, "Receive buffer clamped to %d bytes, net.core.rmem_max is %ld", rcvbuf, net_rmem_max());
+}
+
+int listen_fd = net_tcp_listener(port, 1024, &opts);
+...
+struct sockaddr_in from;
+int fd = net_accept(listen_fd, &from);  // Non-blocking, -1 with EAGAIN once the backlog is empty
+*/
+
+#ifndef NET_H
+#define NET_H
+
+#include <signal.h>
+#include <stdint.h>
+#include <time.h>
+#include <netinet/in.h>
+
+#define NET_MAX_UDP_PAYLOAD 65507   // 65535 - IPv4 header - UDP header
+
+typedef struct {
+    int nonblocking;    // SOCK_NONBLOCK, for event loops
+    int reuseaddr;      // SO_REUSEADDR, quick restarts and UDP ports shared between receivers
+    int reuseport;      // SO_REUSEPORT, the kernel spreads load over sockets on one port
+    int broadcast;      // SO_BROADCAST, needed to send to broadcast addresses
+    int rcvbuf;         // SO_RCVBUF in bytes, 0 keeps the system default
+    int sndbuf;         // SO_SNDBUF in bytes, 0 keeps the system default
+    int busy_poll_us;   // SO_BUSY_POLL, how long a blocking receive spins on the device queue, 0 off
+} net_opts_t;
+
+#define NET_OPTS_DEFAULT { 0 }
+
+// Whole decimal number in [min, max]
+// Returns 0 and stores it in value, -1 if malformed or out of range
+int net_parse_long(const char *str, long min, long max, long *value);
+
+// Decimal or floating point number in [min, max]
+// Returns 0 and stores it in value, -1 if malformed or out of range
+int net_parse_double(const char *str, double min, double max, double *value);
+
+// 1-65535, -1 if invalid
+int net_parse_port(const char *str);
+
+// Percent 0-100 on the command line, returned as a fraction 0-1, -1 if invalid
+double net_parse_percent(const char *str);
+
+// Payload size min-NET_MAX_UDP_PAYLOAD, -1 if invalid
+int net_parse_size(const char *str, int min);
+
+// -1 (infinite) up to INT_MAX, -2 if invalid
+int net_parse_repetitions(const char *str);
+
+static inline uint64_t net_timespec_ns(const struct timespec *ts) {
+    return (uint64_t)ts->tv_sec * 1000000000ull + (uint64_t)ts->tv_nsec;
+}
+
+// CLOCK_MONOTONIC in ns, for intervals and deadlines
+static inline uint64_t net_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return net_timespec_ns(&ts);
+}
+
+// User + system time of the whole process in ns
+static inline uint64_t net_cpu_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return net_timespec_ns(&ts);
+}
+
+// SIGINT and SIGTERM set *running to 0. The handler is installed without
+// SA_RESTART, so blocking calls return EINTR and loops see the flag.
+// SIGPIPE is ignored, a write to a reset connection fails with EPIPE instead
+void net_handle_signals(volatile sig_atomic_t *running);
+
+// Applies opts to an existing socket, opts may be NULL
+// Returns 0 on success, -1 with errno set
+int net_apply_opts(int fd, const net_opts_t *opts);
+
+// Unbound socket of type SOCK_DGRAM or SOCK_STREAM with opts applied
+// Returns the socket, -1 with errno set
+int net_socket(int type, const net_opts_t *opts);
+
+// UDP socket bound to INADDR_ANY:port, 0 picks a free port
+// Returns the socket, -1 with errno set
+int net_udp_socket(int port, const net_opts_t *opts);
+
+// Listening TCP socket on INADDR_ANY:port, 0 picks a free port, see net_local_port
+// Returns the socket, -1 with errno set
+int net_tcp_listener(int port, int backlog, const net_opts_t *opts);
+
+// Connects to addr. With opts->nonblocking the connection completes in the
+// background, wait for the socket to become writable
+// Returns the socket, -1 with errno set
+int net_tcp_connect(const struct sockaddr_in *addr, const net_opts_t *opts);
+
+// Next pending connection as a non-blocking socket, addr may be NULL
+// Returns the socket, -1 with errno set (EAGAIN once none are pending)
+int net_accept(int listen_fd, struct sockaddr_in *addr);
+
+// Turns off Nagle, small writes go out at once
+// Returns 0 on success, -1 with errno set
+int net_set_nodelay(int fd);
+
+// Port the socket is bound to, -1 with errno set
+int net_local_port(int fd);
+
+// Effective SO_RCVBUF and SO_SNDBUF in bytes, twice what was set unless
+// clamped. Either pointer may be NULL
+// Returns 0 on success, -1 with errno set
+int net_buffer_sizes(int fd, int *rcvbuf, int *sndbuf);
+
+// net.core.rmem_max and wmem_max, the largest SO_RCVBUF / SO_SNDBUF a socket
+// may set, -1 if unreadable
+long net_rmem_max(void);
+long net_wmem_max(void);
+
+// Raises the soft open file limit to wanted, as far as the hard limit allows
+// Returns the limit now in effect, -1 if it could not be read
+long net_raise_fd_limit(long wanted);
+
+#endif
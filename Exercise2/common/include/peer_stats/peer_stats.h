@@ -0,0 +1,94 @@
+// Per-peer receive counters for dashboards that replace per-message logging
+//
+// Peers are keyed by address and port (a TCP connection, or a UDP sender
+// socket) in a fixed-size table, traffic from peers beyond its capacity is
+// summed under one overflow entry. Socket receive queue drops come from the
+// SO_RXQ_OVFL control message. The kernel does not know who sent a dropped
+// datagram, so drops are counted per socket, not per peer.
+// peer_stats_mark starts a new interval, the rates of a dashboard line are
+// the counts since the previous mark. Not thread safe, one table per thread.
+
+/* Usage example:
+#include "peer_stats/peer_stats.h"
+
+peer_stats_t ps;
+peer_stats_init(&ps, 1024, now_ns());
+peer_stats_enable_drops(sock);
+
+char ctrl[PEER_STATS_CMSG_SPACE];
+// recvmsg() with msg.msg_name = &from and msg.msg_control = ctrl
+peer_stats_count(peer_stats_get(&ps, &from), n, msg.msg_flags & MSG_TRUNC);
+peer_stats_read_drops(&ps, &msg);
+
+// Every second
+const peer_stats_entry_t *top[20];
+const uint32_t shown = peer_stats_top(&ps, top, 20);
+... log top[0..shown), rates are (packets - last_packets) / interval
+peer_stats_mark(&ps, now_ns());
+peer_stats_free(&ps);
+*/
+
+#ifndef PEER_STATS_H
+#define PEER_STATS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#define PEER_STATS_CMSG_SPACE CMSG_SPACE(sizeof(uint32_t))
+
+typedef struct {
+    struct sockaddr_in addr;
+    uint64_t packets;       // Datagrams, or messages on a stream
+    uint64_t bytes;
+    uint64_t truncated;     // Datagrams cut to the buffer, or oversized messages
+    uint64_t last_packets;  // At the previous mark
+    uint64_t last_bytes;
+    int32_t hash_next;
+} peer_stats_entry_t;
+
+typedef struct {
+    peer_stats_entry_t *entries;
+    uint32_t count;
+    uint32_t capacity;
+    int32_t *buckets;
+    uint32_t bucket_shift;
+    peer_stats_entry_t other;   // Every peer that did not fit, address zero
+    uint64_t drops;             // Dropped by the socket, sources unknown
+    uint64_t last_drops;
+    uint32_t ovfl_counter;      // Last SO_RXQ_OVFL value, the kernel counts in 32 bits
+    uint64_t mark_ns;
+} peer_stats_t;
+
+// Returns 0 on success, -1 if out of memory
+int peer_stats_init(peer_stats_t *ps, uint32_t capacity, uint64_t now_ns);
+void peer_stats_free(peer_stats_t *ps);
+
+// Entry of addr, added on first sight. Never NULL, the overflow entry once full
+peer_stats_entry_t *peer_stats_get(peer_stats_t *ps, const struct sockaddr_in *addr);
+
+static inline void peer_stats_count(peer_stats_entry_t *e, size_t bytes, int truncated) {
+    e->packets++;
+    e->bytes += bytes;
+    e->truncated += truncated != 0;
+}
+
+// Asks the kernel for the drop counter on every datagram. UDP and raw only
+// Returns 0 on success, -1 with errno set
+int peer_stats_enable_drops(int sock);
+
+// Takes the drop counter from a received message, if it carries one
+void peer_stats_read_drops(peer_stats_t *ps, const struct msghdr *msg);
+
+// Up to n entries with traffic since the last mark, busiest (bytes) first
+// Returns how many were stored in out
+uint32_t peer_stats_top(const peer_stats_t *ps, const peer_stats_entry_t **out, uint32_t n);
+
+// All peers summed into one entry, the overflow entry included
+void peer_stats_total(const peer_stats_t *ps, peer_stats_entry_t *sum);
+
+// Starts the next interval
+void peer_stats_mark(peer_stats_t *ps, uint64_t now_ns);
+
+#endif
@@ -0,0 +1,61 @@
+// Fixed-size table of peers keyed by node id
+//
+// The table hands out slots, indices into a peer array the caller owns, so
+// every user keeps its own per-peer record (liveness list links, timers,
+// connections) and only the lookup is shared. Node ids are Fibonacci hashed
+// into buckets kept at most half full, chains run through the slots, and
+// unused slots are chained through the same links as a free list. Lookup,
+// insert and removal never allocate and do not slow down as peers come and go.
+// Not thread safe.
+
+/* Usage example:
+#include "peer_table/peer_table.h"
+
+peer_table_t table;
+my_peer_t *peers = calloc(256, sizeof(my_peer_t));
+peer_table_init(&table, 256);
+
+int32_t slot = peer_table_find(&table, node_id);
+if (slot < 0) {
+    slot = peer_table_add(&table, node_id);  // -1 once the table is full
+    peers[slot] = (my_peer_t){ .node_id = node_id };
+}
+...
+peer_table_remove(&table, slot);  // peers[slot] may be reused by the next add
+peer_table_free(&table);
+*/
+
+#ifndef PEER_TABLE_H
+#define PEER_TABLE_H
+
+#include <stdint.h>
+
+typedef struct {
+    uint32_t *ids;         // Node id per slot
+    int32_t *links;        // Hash chain of a used slot, free list of an unused one, -1 ends both
+    int32_t *buckets;      // Hash heads
+    uint32_t bucket_shift;
+    int32_t free_list;
+    uint32_t capacity;
+    uint32_t count;
+} peer_table_t;
+
+// Slots are [0, capacity)
+// Returns 0 on success, -1 on an invalid capacity or allocation failure
+int peer_table_init(peer_table_t *t, uint32_t capacity);
+
+void peer_table_free(peer_table_t *t);
+
+// Slot of node_id, or -1 if it is not in the table
+int32_t peer_table_find(const peer_table_t *t, uint32_t node_id);
+
+// Takes a free slot for node_id, which must not be in the table yet
+// Returns the slot, or -1 if the table is full
+int32_t peer_table_add(peer_table_t *t, uint32_t node_id);
+
+// Returns the slot to the free list
+void peer_table_remove(peer_table_t *t, int32_t slot);
+
+uint32_t peer_table_count(const peer_table_t *t);
+
+#endif
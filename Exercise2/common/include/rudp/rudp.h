@@ -0,0 +1,177 @@
+// Reliable datagrams over UDP
+//
+// Every message sent with rudp_send is delivered exactly once to the peer's
+// callback, or counted as failed after max_retransmits. Delivery is not
+// ordered across messages, state messages should carry their own versions.
+//
+// Per peer, the sender keeps a window of unacknowledged messages in pooled
+// buffers. The receiver answers with a cumulative ACK plus a selective ACK
+// bitmap for the window beyond it, one ACK per peer per rudp_process call.
+// Retransmission timeouts follow Jacobson/Karels (RFC 6298) with Karn's rule
+// and exponential backoff. A SACK showing RUDP_FAST_RETX_THRESH later messages
+// triggers a fast retransmit of the hole. Every DATA header carries the
+// sender's lowest unacknowledged seq, so a receiver skips the holes of
+// messages the sender gave up on instead of waiting for them forever.
+//
+// Single-threaded and non-blocking: the caller polls the socket for input,
+// waits at most rudp_timeout_ms and then calls rudp_process.
+
+/* Usage example:
+#include "rudp/rudp.h"
+
+static void on_message(void *arg, const struct sockaddr_in *from, const void *data, size_t len) {
+    handle(data, len);
+}
+
+rudp_t rudp;
+rudp_config_t cfg = RUDP_CONFIG_DEFAULT;
+cfg.on_message = on_message;
+rudp_init(&rudp, sock, &cfg);
+
+if (rudp_send(&rudp, &peer_addr, "order 3 up", 10) < 0 && errno == EAGAIN) {
+    // Window or buffer pool full, retry after rudp_process
+}
+
+while (running) {
+    struct pollfd pfd = { .fd = sock, .events = POLLIN };
+    poll(&pfd, 1, rudp_timeout_ms(&rudp));
+    rudp_process(&rudp);  // Receives, delivers, ACKs and retransmits
+}
+rudp_free(&rudp);
+*/
+
+#ifndef RUDP_H
+#define RUDP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <netinet/in.h>
+
+#include "mempool/mempool.h"
+#include "impair/impair.h"
+#include "net/net.h"
+
+#define RUDP_MAGIC 0x5255               // "RU"
+#define RUDP_HEADER_SIZE 16             // magic(2) type(1) flags(1) session(4) seq(4) base(4), network byte order
+                                        // base: lowest unacknowledged seq, DATA only
+#define RUDP_MAX_WINDOW 256             // Also the SACK bitmap size in bits
+#define RUDP_ACK_SIZE (RUDP_HEADER_SIZE + RUDP_MAX_WINDOW / 8)  // seq is the cumulative ACK
+#define RUDP_MAX_PAYLOAD (NET_MAX_UDP_PAYLOAD - RUDP_HEADER_SIZE)
+#define RUDP_FAST_RETX_THRESH 3
+#define RUDP_RX_BATCH 32                // Datagrams per recvmmsg in rudp_process
+
+typedef void (*rudp_message_fn)(void *arg, const struct sockaddr_in *from, const void *data, size_t len);
+// latency_ns is from the first transmission until the ACK arrived
+typedef void (*rudp_acked_fn)(void *arg, const struct sockaddr_in *peer, uint64_t latency_ns);
+
+typedef struct {
+    uint32_t window;           // Unacknowledged messages per peer, at most RUDP_MAX_WINDOW
+    uint32_t max_payload;      // Largest message, sizes the pool blocks
+    uint32_t pool_blocks;      // Messages in flight over all peers
+    uint32_t max_peers;
+    uint32_t max_retransmits;  // Then the message is dropped and counted as failed
+    uint64_t initial_rto_ns;
+    uint64_t min_rto_ns;
+    uint64_t max_rto_ns;
+    impair_t *impair;          // Testing: outgoing datagrams pass through it, run by rudp_process,
+                               // the caller also wakes for impair_next_ns
+    rudp_message_fn on_message;
+    rudp_acked_fn on_acked;    // Optional
+    void *arg;                 // Passed to both callbacks
+} rudp_config_t;
+
+// LAN defaults: RFC 6298's 1 s minimum would stall a lost message far longer
+// than the round trip it protects
+#define RUDP_CONFIG_DEFAULT { \
+    .window = 128, .max_payload = 1400, .pool_blocks = 4096, .max_peers = 32, \
+    .max_retransmits = 20, .initial_rto_ns = 100000000ull, .min_rto_ns = 1000000ull, \
+    .max_rto_ns = 2000000000ull, .impair = NULL, .on_message = NULL, .on_acked = NULL, .arg = NULL }
+
+typedef struct {
+    char *pkt;           // Pool block holding header + payload, NULL when the slot is free
+    uint32_t len;
+    uint32_t transmits;
+    uint64_t first_ns;
+    uint64_t last_ns;
+    int fast_retransmitted;
+} rudp_slot_t;
+
+typedef struct {
+    struct sockaddr_in addr;
+
+    // Sending side: slots[seq % RUDP_MAX_WINDOW] for seq in [base, next)
+    uint32_t session;     // Ours, chosen at init, lets the peer detect restarts
+    uint32_t base;
+    uint32_t next;
+    rudp_slot_t slots[RUDP_MAX_WINDOW];
+    uint64_t srtt_ns;     // 0 until the first sample
+    uint64_t rttvar_ns;
+    uint64_t rto_ns;
+
+    // Receiving side: bit (seq % RUDP_MAX_WINDOW) set for messages received beyond cum
+    uint32_t rx_session;
+    uint32_t cum;         // Next expected, everything below was delivered
+    uint64_t received[RUDP_MAX_WINDOW / 64];
+    int rx_started;
+    int ack_pending;
+} rudp_peer_t;
+
+typedef struct {
+    uint64_t sent;              // First transmissions
+    uint64_t retransmits;       // Timeout and fast retransmissions
+    uint64_t fast_retransmits;
+    uint64_t timeouts;          // RTO expirations, each doubles the peer's RTO
+    uint64_t acked;
+    uint64_t failed;            // Gave up after max_retransmits
+    uint64_t delivered;
+    uint64_t duplicates;        // Received again, suppressed
+    uint64_t out_of_window;
+    uint64_t skipped;           // Never received, the sender gave up on them
+    uint64_t acks_sent;
+    uint64_t acks_received;
+    uint64_t invalid;           // Not rudp or malformed
+} rudp_stats_t;
+
+typedef struct {
+    int sock;
+    rudp_config_t cfg;
+    mempool_t pool;
+    rudp_peer_t *peers;
+    uint32_t n_peers;
+    uint32_t session;
+    uint64_t rng;
+    rudp_stats_t stats;
+
+    // recvmmsg batch
+    char *rx_bufs;
+    struct iovec *rx_iovs;
+    struct mmsghdr *rx_msgs;
+    struct sockaddr_in *rx_addrs;
+} rudp_t;
+
+// Takes over a UDP socket (bound or not), all I/O on it uses MSG_DONTWAIT
+// Returns 0 on success, -1 on invalid config or allocation failure
+int rudp_init(rudp_t *r, int sock, const rudp_config_t *cfg);
+
+// Releases buffers, the socket stays open
+void rudp_free(rudp_t *r);
+
+// Queues and transmits one message
+// Returns 0 on success, -1 with errno EAGAIN (window or pool full),
+// EMSGSIZE (larger than max_payload) or ENOSPC (peer table full)
+int rudp_send(rudp_t *r, const struct sockaddr_in *to, const void *data, size_t len);
+
+// Drains the socket, delivers new messages, sends pending ACKs and retransmits
+// expired messages. Returns messages delivered, or -1 on a socket error
+int rudp_process(rudp_t *r);
+
+// Milliseconds until the next retransmission is due, -1 if nothing is in flight
+int rudp_timeout_ms(const rudp_t *r);
+
+// Messages sent but not yet acknowledged, over all peers
+uint32_t rudp_inflight(const rudp_t *r);
+
+// NULL if the peer was never seen
+const rudp_peer_t *rudp_peer(const rudp_t *r, const struct sockaddr_in *addr);
+
+#endif
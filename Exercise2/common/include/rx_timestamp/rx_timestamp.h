@@ -0,0 +1,74 @@
+// Kernel receive timestamps from SO_TIMESTAMPING (or SO_TIMESTAMPNS) control
+// messages, plus delay accounting that splits the path of a packet into
+// sender -> kernel (network) and kernel -> user space (scheduling)
+
+/* Usage example:
+#include "rx_timestamp/rx_timestamp.h"
+
+rx_ts_enable(sock);
+char ctrl[RX_TS_CMSG_SPACE];
+struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1, .msg_control = ctrl, .msg_controllen = sizeof(ctrl) };
+recvmsg(sock, &msg, 0);
+const uint64_t user_ns = rx_ts_now_ns();
+
+static rx_ts_stats_t stats;
+rx_ts_t ts;
+if (rx_ts_read(&msg, &ts) == 0) {
+    rx_ts_stats_add(&stats, &ts, user_ns, 0);  // send_ns 0: no sender timestamp
+}
+*/
+
+#ifndef RX_TIMESTAMP_H
+#define RX_TIMESTAMP_H
+
+#include <stdint.h>
+#include <sys/socket.h>
+#include <linux/errqueue.h>
+
+// Room for either control message, SCM_TIMESTAMPING is the larger one
+#define RX_TS_CMSG_SPACE CMSG_SPACE(sizeof(struct scm_timestamping))
+
+typedef enum {
+    RX_TS_TIMESTAMPING = 1,  // SO_TIMESTAMPING, software and (if the NIC is set up) raw hardware stamps
+    RX_TS_TIMESTAMPNS  = 2,  // SO_TIMESTAMPNS fallback, software stamps only
+} rx_ts_mode_t;
+
+typedef struct {
+    uint64_t kernel_ns;  // CLOCK_REALTIME, or the NIC clock for hardware stamps
+    int hardware;
+} rx_ts_t;
+
+typedef struct {
+    uint64_t count;
+    int64_t  min_ns;
+    int64_t  max_ns;
+    int64_t  sum_ns;
+} rx_ts_delay_t;
+
+typedef struct {
+    uint64_t samples;
+    uint64_t hardware;   // Samples stamped by the NIC
+    uint64_t missing;    // Packets received without a timestamp
+    rx_ts_delay_t sched; // user - kernel: queueing in the socket plus wakeup and scheduling
+    rx_ts_delay_t net;   // kernel - send: only with a sender timestamp, needs synced clocks
+} rx_ts_stats_t;
+
+// Current CLOCK_REALTIME in ns, the clock software stamps use
+uint64_t rx_ts_now_ns(void);
+
+// Turns on receive timestamps, SO_TIMESTAMPING if available, else SO_TIMESTAMPNS
+// Returns the rx_ts_mode_t in use, or -1 (errno set) if neither is supported
+int rx_ts_enable(int sock);
+
+// Finds the receive timestamp in the control messages of msg, preferring a hardware one
+// Returns 0 on success, -1 if there is none
+int rx_ts_read(struct msghdr *msg, rx_ts_t *ts);
+
+// Accounts one packet received in user space at user_ns
+// send_ns is the sender's CLOCK_REALTIME stamp, 0 if the packet has none
+void rx_ts_stats_add(rx_ts_stats_t *stats, const rx_ts_t *ts, uint64_t user_ns, uint64_t send_ns);
+
+// Adds src into dst, for per-thread stats
+void rx_ts_stats_merge(rx_ts_stats_t *dst, const rx_ts_stats_t *src);
+
+#endif
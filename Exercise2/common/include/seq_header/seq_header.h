@@ -0,0 +1,83 @@
+// Sequence header for UDP test traffic, plus receive side accounting
+
+/* Usage example:
+#include "seq_header/seq_header.h"
+
+// Sender
+char buf[SEQ_HEADER_SIZE + 32];
+seq_header_t hdr = { .sender_id = 7, .seq = next_seq++, .send_ns = seq_now_ns() };
+seq_header_encode(buf, &hdr);
+
+// Receiver
+static seq_tracker_t tracker;
+seq_tracker_init(&tracker);
+seq_header_t hdr;
+if (seq_header_decode(rx_buf, len, &hdr) == 0) {
+    seq_tracker_record(&tracker, &hdr, seq_now_ns());
+}
+*/
+
+#ifndef SEQ_HEADER_H
+#define SEQ_HEADER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SEQ_HEADER_MAGIC 0x53455131u  // "SEQ1"
+#define SEQ_HEADER_SIZE  24           // magic(4) sender_id(4) seq(8) send_ns(8), network byte order
+
+// Packets this far behind the highest sequence number can still be classified,
+// older ones are counted as late
+#define SEQ_WINDOW_BITS 1024
+#define SEQ_MAX_SENDERS 64
+
+typedef struct {
+    uint32_t sender_id;
+    uint64_t seq;
+    uint64_t send_ns;  // CLOCK_REALTIME, one-way latency needs synced clocks
+} seq_header_t;
+
+typedef struct {
+    uint32_t sender_id;
+    uint64_t first_seq;
+    uint64_t highest_seq;
+    uint64_t window[SEQ_WINDOW_BITS / 64];  // Bit (seq % SEQ_WINDOW_BITS) set when seen
+
+    uint64_t received;    // All packets, including duplicates
+    uint64_t duplicates;
+    uint64_t reordered;   // Arrived after a higher sequence number
+    uint64_t late;        // Too far behind to classify, counted as lost
+
+    // One-way transit (recv - send) and RFC 3550 interarrival jitter
+    int64_t  last_transit_ns;
+    int64_t  min_transit_ns;
+    int64_t  max_transit_ns;
+    int64_t  sum_transit_ns;
+    double   jitter_ns;
+} seq_sender_t;
+
+typedef struct {
+    seq_sender_t senders[SEQ_MAX_SENDERS];
+    size_t count;
+    uint64_t untracked;  // Packets dropped from accounting because the table was full
+} seq_tracker_t;
+
+// Current CLOCK_REALTIME in ns
+uint64_t seq_now_ns(void);
+
+// Writes SEQ_HEADER_SIZE bytes to buf
+void seq_header_encode(void *buf, const seq_header_t *hdr);
+
+// Returns 0 on success, -1 if len is too short or the magic does not match
+int seq_header_decode(const void *buf, size_t len, seq_header_t *hdr);
+
+void seq_tracker_init(seq_tracker_t *tracker);
+
+// Accounts one received packet
+// Returns the sender entry, or NULL if the sender table is full
+seq_sender_t *seq_tracker_record(seq_tracker_t *tracker, const seq_header_t *hdr, uint64_t recv_ns);
+
+// Sequence numbers in [first_seq, highest_seq] not received within the window
+uint64_t seq_sender_lost(const seq_sender_t *sender);
+
+#endif
@@ -0,0 +1,107 @@
+// Hierarchical timer wheel for event loops
+//
+// TIMER_WHEEL_LEVELS wheels of TIMER_WHEEL_SLOTS slots. A slot of level 0 is
+// one tick, a slot of each higher level is one full turn of the level below.
+// A timer goes into the coarsest level its distance needs and drops to finer
+// levels as its time comes closer, so it moves at most LEVELS - 1 times.
+// Arming, re-arming and cancelling are O(1), timers are intrusive and nothing
+// is allocated. Occupancy bitmaps find the next due slot without scanning, and
+// ticks without work are skipped.
+//
+// Timers fire on the first tick at or after their expiry, never early and at
+// most one tick late when the loop wakes at timer_wheel_next_ns. Timers due
+// on the same tick fire in no particular order. Callbacks may arm and cancel
+// any timer, including the one firing. Not thread safe.
+
+/* Usage example:
+#include "timer_wheel/timer_wheel.h"
+
+static void on_heartbeat(wheel_timer_t *t, void *arg) {
+    send_heartbeat(arg);
+    timer_wheel_schedule(&wheel, t, t->expire_ns + interval_ns);  // Periodic without drift
+}
+
+timer_wheel_t wheel;
+timer_wheel_init(&wheel, 1000000, now_ns());  // 1 ms ticks
+wheel_timer_t hb;
+timer_wheel_timer_init(&hb, on_heartbeat, node);
+timer_wheel_schedule(&wheel, &hb, now_ns() + interval_ns);
+
+while (running) {
+    epoll_wait(epfd, events, n, timeout until timer_wheel_next_ns(&wheel));
+    ...
+    timer_wheel_advance(&wheel, now_ns());  // Runs the callbacks of every due timer
+}
+*/
+
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stdint.h>
+
+#define TIMER_WHEEL_LEVELS 4
+#define TIMER_WHEEL_SLOT_BITS 8
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_SLOT_BITS)
+// Farther timers are clamped, 2^32 ticks is about 50 days at 1 ms
+#define TIMER_WHEEL_MAX_TICKS ((1ull << (TIMER_WHEEL_SLOT_BITS * TIMER_WHEEL_LEVELS)) - 1)
+
+typedef struct wheel_timer wheel_timer_t;
+typedef void (*wheel_timer_fn)(wheel_timer_t *timer, void *arg);
+
+struct wheel_timer {
+    wheel_timer_t *prev;
+    wheel_timer_t *next;
+    uint64_t expire_ns;     // As scheduled, for drift-free periodic re-arming
+    uint64_t expire_tick;
+    wheel_timer_fn fn;
+    void *arg;
+    uint8_t level;
+    uint8_t slot;
+    uint8_t armed;
+};
+
+typedef struct {
+    uint64_t scheduled;
+    uint64_t cancelled;     // Armed timers cancelled or re-armed before firing
+    uint64_t fired;
+    uint64_t cascaded;      // Moves to a finer level
+} timer_wheel_stats_t;
+
+typedef struct {
+    wheel_timer_t *slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+    uint64_t occupied[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS / 64];
+    uint32_t level_count[TIMER_WHEEL_LEVELS];
+    uint32_t count;
+    uint64_t tick_ns;
+    uint64_t now;           // Last tick processed
+    timer_wheel_stats_t stats;
+} timer_wheel_t;
+
+// now_ns on the clock later passed to timer_wheel_advance
+void timer_wheel_init(timer_wheel_t *tw, uint64_t tick_ns, uint64_t now_ns);
+
+void timer_wheel_timer_init(wheel_timer_t *t, wheel_timer_fn fn, void *arg);
+
+// Arms t to fire at expire_ns, moving it if already armed. Times already
+// passed fire on the next tick
+void timer_wheel_schedule(timer_wheel_t *tw, wheel_timer_t *t, uint64_t expire_ns);
+
+// Does nothing if t is not armed
+void timer_wheel_cancel(timer_wheel_t *tw, wheel_timer_t *t);
+
+// Fires every timer due at now_ns, returns how many
+uint32_t timer_wheel_advance(timer_wheel_t *tw, uint64_t now_ns);
+
+// When timer_wheel_advance next has work, UINT64_MAX if no timer is armed.
+// Timers on coarse levels make this the next cascade, which can be early
+uint64_t timer_wheel_next_ns(const timer_wheel_t *tw);
+
+static inline int timer_wheel_armed(const wheel_timer_t *t) {
+    return t->armed;
+}
+
+static inline uint32_t timer_wheel_count(const timer_wheel_t *tw) {
+    return tw->count;
+}
+
+#endif
@@ -0,0 +1,158 @@
+// Minimal io_uring wrapper on raw syscalls (liburing is not required)
+//
+// Covers what the receivers need: one ring per thread, multishot recv and
+// accept, and a provided buffer ring the kernel picks receive buffers from.
+// Requires Linux 5.19 (buffer rings, EXT_ARG), multishot recv needs 6.0.
+
+/* Usage example:
+#include "uring/uring.h"
+
+uring_t ring;
+uring_buf_ring_t bufs;
+if (uring_init(&ring, 64) != 0 || uring_buf_ring_init(&ring, &bufs, 0, 1024, 2048) != 0) {
+    // Fall back to epoll/recvmmsg
+}
+uring_prep_recv_multishot(uring_get_sqe(&ring), sock, 0, 0, 42);
+
+while (running) {
+    uring_submit_and_wait(&ring, 1, 100);
+    struct io_uring_cqe *cqe;
+    while ((cqe = uring_peek_cqe(&ring)) != NULL) {
+        if (cqe->res > 0) {
+            const uint16_t bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+            handle(uring_buf_ring_buf(&bufs, bid), cqe->res);
+            uring_buf_ring_add(&bufs, bid);
+        }
+        if (!(cqe->flags & IORING_CQE_F_MORE)) {
+            // Multishot ended (error or ENOBUFS), re-arm
+        }
+        uring_cqe_seen(&ring);
+    }
+    uring_buf_ring_publish(&bufs);
+}
+uring_buf_ring_free(&ring, &bufs);
+uring_free(&ring);
+*/
+
+#ifndef URING_H
+#define URING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <linux/io_uring.h>
+
+typedef struct {
+    int fd;
+    unsigned features;
+
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    unsigned *sq_array;
+    struct io_uring_sqe *sqes;
+    unsigned sqe_tail;  // Local tail, published on submit
+
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe *cqes;
+
+    void *sq_ring;
+    size_t sq_ring_size;
+    void *cq_ring;
+    size_t cq_ring_size;
+    size_t sqes_size;
+
+    unsigned long long enters;  // io_uring_enter calls, for syscall accounting
+} uring_t;
+
+typedef struct {
+    struct io_uring_buf_ring *br;
+    char *bufs;
+    unsigned entries;   // Power of two
+    unsigned tail;      // Local tail, published with uring_buf_ring_publish
+    size_t buf_size;
+    uint16_t bgid;
+} uring_buf_ring_t;
+
+// Returns 0 on success, -1 with errno set (ENOSYS/EPERM when io_uring is
+// unavailable, EOPNOTSUPP when the kernel is too old)
+int uring_init(uring_t *ring, unsigned entries);
+void uring_free(uring_t *ring);
+
+// Next free SQE, zeroed. Submits pending entries first if the queue is full
+struct io_uring_sqe *uring_get_sqe(uring_t *ring);
+
+// Submits pending SQEs and waits for at least wait_nr completions or timeout_ms
+// Returns submitted count, or -errno (-ETIME on timeout, -EINTR on signal)
+int uring_submit_and_wait(uring_t *ring, unsigned wait_nr, int timeout_ms);
+
+static inline struct io_uring_cqe *uring_peek_cqe(uring_t *ring) {
+    const unsigned head = *ring->cq_head;
+    if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+        return NULL;
+    }
+    return &ring->cqes[head & ring->cq_mask];
+}
+
+static inline void uring_cqe_seen(uring_t *ring) {
+    __atomic_store_n(ring->cq_head, *ring->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+// Registers entries buffers of buf_size bytes as buffer group bgid, all
+// handed to the kernel. Returns 0 on success, -1 with errno set
+int uring_buf_ring_init(uring_t *ring, uring_buf_ring_t *br, uint16_t bgid, unsigned entries, size_t buf_size);
+void uring_buf_ring_free(uring_t *ring, uring_buf_ring_t *br);
+
+static inline char *uring_buf_ring_buf(const uring_buf_ring_t *br, uint16_t bid) {
+    return br->bufs + (size_t)bid * br->buf_size;
+}
+
+// Returns a buffer to the kernel, visible after uring_buf_ring_publish
+static inline void uring_buf_ring_add(uring_buf_ring_t *br, uint16_t bid) {
+    struct io_uring_buf *buf = &br->br->bufs[br->tail & (br->entries - 1)];
+    buf->addr = (uint64_t)(uintptr_t)uring_buf_ring_buf(br, bid);
+    buf->len  = (uint32_t)br->buf_size;
+    buf->bid  = bid;
+    br->tail++;
+}
+
+static inline void uring_buf_ring_publish(uring_buf_ring_t *br) {
+    __atomic_store_n(&br->br->tail, (uint16_t)br->tail, __ATOMIC_RELEASE);
+}
+
+// One CQE per received chunk (datagram for UDP) until an error or ENOBUFS
+static inline void uring_prep_recv_multishot(struct io_uring_sqe *sqe, int fd, uint16_t bgid,
+                                             int msg_flags, uint64_t user_data) {
+    sqe->opcode    = IORING_OP_RECV;
+    sqe->fd        = fd;
+    sqe->ioprio    = IORING_RECV_MULTISHOT;
+    sqe->flags     = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = bgid;
+    sqe->msg_flags = (uint32_t)msg_flags;
+    sqe->user_data = user_data;
+}
+
+// One CQE per accepted connection, res is the new fd
+static inline void uring_prep_accept_multishot(struct io_uring_sqe *sqe, int fd, int accept_flags,
+                                               uint64_t user_data) {
+    sqe->opcode       = IORING_OP_ACCEPT;
+    sqe->fd           = fd;
+    sqe->ioprio       = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = (uint32_t)accept_flags;
+    sqe->user_data    = user_data;
+}
+
+static inline void uring_prep_send(struct io_uring_sqe *sqe, int fd, const void *buf, size_t len,
+                                   int msg_flags, uint64_t user_data) {
+    sqe->opcode    = IORING_OP_SEND;
+    sqe->fd        = fd;
+    sqe->addr      = (uint64_t)(uintptr_t)buf;
+    sqe->len       = (uint32_t)len;
+    sqe->msg_flags = (uint32_t)msg_flags;
+    sqe->user_data = user_data;
+}
+
+#endif
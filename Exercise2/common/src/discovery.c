@@ -0,0 +1,340 @@
+#define _GNU_SOURCE // recvmmsg
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <arpa/inet.h>
+
+#include "discovery/discovery.h"
+#include "net/net.h"
+
+static inline uint32_t get_u32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return ntohl(v);
+}
+
+static inline void put_u32(uint8_t *p, uint32_t v) {
+    v = htonl(v);
+    memcpy(p, &v, sizeof(v));
+}
+
+static inline uint16_t get_u16(const uint8_t *p) {
+    uint16_t v;
+    memcpy(&v, p, sizeof(v));
+    return ntohs(v);
+}
+
+static inline void put_u16(uint8_t *p, uint16_t v) {
+    v = htons(v);
+    memcpy(p, &v, sizeof(v));
+}
+
+static inline uint32_t next_pow2(uint32_t v) {
+    uint32_t p = 1;
+    while (p < v) p <<= 1;
+    return p;
+}
+
+static void send_heartbeat(discovery_t *d, uint8_t flags) {
+    const discovery_heartbeat_t hb = {
+        .node_id = d->cfg.node_id, .incarnation = d->incarnation, .seq = d->seq++,
+        .service_port = d->cfg.service_port, .flags = flags,
+    };
+    uint8_t pkt[DISCOVERY_HEARTBEAT_SIZE];
+    discovery_heartbeat_encode(&hb, pkt);
+    // A lost heartbeat is covered by the timeout
+    sendto(d->sock, pkt, sizeof(pkt), MSG_DONTWAIT, (const struct sockaddr *)&d->cfg.dest, sizeof(d->cfg.dest));
+    d->stats.heartbeats_sent++;
+}
+
+static void push_event(discovery_t *d, discovery_event_type_t type, const discovery_peer_t *p, int graceful) {
+    if (d->event_tail - d->event_head > d->event_mask) {
+        d->stats.events_dropped++;
+        return;
+    }
+    d->events[d->event_tail++ & d->event_mask] = (discovery_event_t){
+        .type = type, .node_id = p->node_id, .addr = p->addr, .graceful = graceful,
+    };
+    const uint64_t one = 1;
+    if (write(d->event_fd, &one, sizeof(one)) < 0) {
+        // Only fails when the counter would overflow, it is readable anyway
+    }
+}
+
+static void list_unlink(discovery_t *d, int32_t idx) {
+    discovery_peer_t *p = &d->peers[idx];
+    if (p->prev >= 0) d->peers[p->prev].next = p->next; else d->oldest = p->next;
+    if (p->next >= 0) d->peers[p->next].prev = p->prev; else d->newest = p->prev;
+}
+
+static void list_append(discovery_t *d, int32_t idx) {
+    discovery_peer_t *p = &d->peers[idx];
+    p->prev = d->newest;
+    p->next = -1;
+    if (d->newest >= 0) d->peers[d->newest].next = idx; else d->oldest = idx;
+    d->newest = idx;
+}
+
+static void remove_peer(discovery_t *d, int32_t idx, int graceful) {
+    discovery_peer_t *p = &d->peers[idx];
+    peer_table_remove(&d->table, idx);
+    list_unlink(d, idx);
+
+    d->stats.leaves++;
+    if (!graceful) d->stats.timeouts++;
+    push_event(d, DISCOVERY_LEFT, p, graceful);
+}
+
+static void handle_heartbeat(discovery_t *d, const uint8_t *pkt, size_t len, const struct sockaddr_in *from, uint64_t now) {
+    discovery_heartbeat_t hb;
+    if (discovery_heartbeat_decode(pkt, len, &hb) < 0) {
+        d->stats.invalid++;
+        return;
+    }
+    const uint32_t node_id = hb.node_id;
+    const uint32_t incarnation = hb.incarnation;
+    const uint32_t seq = hb.seq;
+    if (node_id == d->cfg.node_id) {
+        return;  // Our own heartbeat coming back
+    }
+    d->stats.heartbeats_received++;
+
+    int32_t idx = peer_table_find(&d->table, node_id);
+    if (hb.flags & DISCOVERY_FLAG_LEAVING) {
+        if (idx >= 0 && d->peers[idx].incarnation == incarnation) {
+            remove_peer(d, idx, 1);
+        }
+        return;
+    }
+
+    if (idx < 0) {
+        idx = peer_table_add(&d->table, node_id);
+        if (idx < 0) {
+            d->stats.table_full++;
+            return;
+        }
+        discovery_peer_t *p = &d->peers[idx];
+        *p = (discovery_peer_t){
+            .node_id = node_id, .incarnation = incarnation, .addr = *from,
+            .joined_ns = now, .last_seen_ns = now, .heartbeats = 1, .missed = 0, .last_seq = seq,
+            .service_port = hb.service_port,
+        };
+        list_append(d, idx);
+        d->stats.joins++;
+        push_event(d, DISCOVERY_JOINED, p, 0);
+        return;
+    }
+
+    discovery_peer_t *p = &d->peers[idx];
+    if (p->incarnation != incarnation) {
+        p->incarnation = incarnation;
+        p->joined_ns = now;
+        p->missed = 0;
+        d->stats.restarts++;
+        push_event(d, DISCOVERY_RESTARTED, p, 0);
+    } else if (seq - p->last_seq > 1 && seq - p->last_seq < 0x80000000u) {
+        p->missed += seq - p->last_seq - 1;
+    }
+    p->addr = *from;
+    p->service_port = hb.service_port;
+    p->last_seq = seq;
+    p->last_seen_ns = now;
+    p->heartbeats++;
+    if (d->newest != idx) {
+        list_unlink(d, idx);
+        list_append(d, idx);
+    }
+}
+
+int discovery_init(discovery_t *d, int sock, const discovery_config_t *cfg) {
+    memset(d, 0, sizeof(*d));
+    d->event_fd = -1;
+    if (cfg->interval_ns == 0 || cfg->timeout_ns <= cfg->interval_ns || cfg->max_peers == 0 ||
+        cfg->max_peers > INT32_MAX / 2) {
+        return -1;
+    }
+    d->sock = sock;
+    d->cfg = *cfg;
+
+    int reuse = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    const struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_addr.s_addr = INADDR_ANY,
+        .sin_port = htons(cfg->port)
+    };
+    if (bind(sock, (const struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        return -1;
+    }
+    if (mcast_is_group(cfg->dest.sin_addr) &&
+        (mcast_join(sock, cfg->dest.sin_addr, &cfg->iface) < 0 ||
+         mcast_set_sender(sock, &cfg->iface, cfg->mcast_ttl, cfg->mcast_loop) < 0)) {
+        return -1;
+    }
+
+    const uint32_t n_events = next_pow2(cfg->max_peers * 2);
+    d->peers = calloc(cfg->max_peers, sizeof(discovery_peer_t));
+    d->events = calloc(n_events, sizeof(discovery_event_t));
+    d->rx_bufs = calloc(DISCOVERY_RX_BATCH, sizeof(*d->rx_bufs));
+    d->rx_iovs = calloc(DISCOVERY_RX_BATCH, sizeof(struct iovec));
+    d->rx_msgs = calloc(DISCOVERY_RX_BATCH, sizeof(struct mmsghdr));
+    d->rx_addrs = calloc(DISCOVERY_RX_BATCH, sizeof(struct sockaddr_in));
+    d->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (d->peers == NULL || peer_table_init(&d->table, cfg->max_peers) < 0 || d->events == NULL || d->rx_bufs == NULL ||
+        d->rx_iovs == NULL || d->rx_msgs == NULL || d->rx_addrs == NULL || d->event_fd < 0) {
+        discovery_free(d);
+        return -1;
+    }
+
+    d->event_mask = n_events - 1;
+    d->oldest = d->newest = -1;
+
+    for (int i = 0; i < DISCOVERY_RX_BATCH; i++) {
+        // Anything longer comes back with MSG_TRUNC and is rejected
+        d->rx_iovs[i].iov_base = d->rx_bufs[i];
+        d->rx_iovs[i].iov_len  = DISCOVERY_HEARTBEAT_SIZE;
+        d->rx_msgs[i].msg_hdr.msg_iov    = &d->rx_iovs[i];
+        d->rx_msgs[i].msg_hdr.msg_iovlen = 1;
+        d->rx_msgs[i].msg_hdr.msg_name   = &d->rx_addrs[i];
+    }
+
+    d->incarnation = discovery_new_incarnation();
+    send_heartbeat(d, 0);
+    d->next_heartbeat_ns = net_now_ns() + cfg->interval_ns;
+    return 0;
+}
+
+void discovery_free(discovery_t *d) {
+    if (d->peers != NULL && d->event_fd >= 0) {
+        send_heartbeat(d, DISCOVERY_FLAG_LEAVING);
+        if (mcast_is_group(d->cfg.dest.sin_addr)) {
+            mcast_leave(d->sock, d->cfg.dest.sin_addr, &d->cfg.iface);
+        }
+    }
+    if (d->event_fd >= 0) {
+        close(d->event_fd);
+    }
+    free(d->peers);
+    peer_table_free(&d->table);
+    free(d->events);
+    free(d->rx_bufs);
+    free(d->rx_iovs);
+    free(d->rx_msgs);
+    free(d->rx_addrs);
+    d->peers = NULL;
+    d->events = NULL;
+    d->rx_bufs = NULL;
+    d->rx_iovs = NULL;
+    d->rx_msgs = NULL;
+    d->rx_addrs = NULL;
+    d->event_fd = -1;
+}
+
+int discovery_process(discovery_t *d) {
+    for (;;) {
+        for (int i = 0; i < DISCOVERY_RX_BATCH; i++) {
+            d->rx_msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+        }
+        const int n = recvmmsg(d->sock, d->rx_msgs, DISCOVERY_RX_BATCH, MSG_DONTWAIT, NULL);
+        if (n < 0) {
+            if (errno == EINTR || errno == ECONNREFUSED) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            return -1;
+        }
+        const uint64_t now = net_now_ns();
+        for (int i = 0; i < n; i++) {
+            if (d->rx_msgs[i].msg_hdr.msg_flags & MSG_TRUNC) {
+                d->stats.invalid++;
+                continue;
+            }
+            handle_heartbeat(d, d->rx_bufs[i], d->rx_msgs[i].msg_len, &d->rx_addrs[i], now);
+        }
+        if (n < DISCOVERY_RX_BATCH) {
+            break;
+        }
+    }
+
+    const uint64_t now = net_now_ns();
+    if (now >= d->next_heartbeat_ns) {
+        send_heartbeat(d, 0);
+        d->next_heartbeat_ns += d->cfg.interval_ns;
+        if (d->next_heartbeat_ns <= now) {
+            d->next_heartbeat_ns = now + d->cfg.interval_ns;  // Stalled, do not send a burst to catch up
+        }
+    }
+
+    // Oldest first, stops at the first peer still within the timeout
+    while (d->oldest >= 0 && now - d->peers[d->oldest].last_seen_ns >= d->cfg.timeout_ns) {
+        remove_peer(d, d->oldest, 0);
+    }
+    return 0;
+}
+
+int discovery_timeout_ms(const discovery_t *d) {
+    const uint64_t now = net_now_ns();
+    uint64_t earliest = d->next_heartbeat_ns;
+    if (d->oldest >= 0) {
+        const uint64_t expiry = d->peers[d->oldest].last_seen_ns + d->cfg.timeout_ns;
+        if (expiry < earliest) earliest = expiry;
+    }
+    if (earliest <= now) {
+        return 0;
+    }
+    return (int)((earliest - now + 999999) / 1000000);
+}
+
+int discovery_event_fd(const discovery_t *d) {
+    return d->event_fd;
+}
+
+int discovery_next_event(discovery_t *d, discovery_event_t *ev) {
+    if (d->event_head == d->event_tail) {
+        uint64_t count;
+        if (read(d->event_fd, &count, sizeof(count)) < 0) {
+            // EAGAIN, already reset
+        }
+        return 0;
+    }
+    *ev = d->events[d->event_head++ & d->event_mask];
+    return 1;
+}
+
+const discovery_peer_t *discovery_find(const discovery_t *d, uint32_t node_id) {
+    const int32_t idx = peer_table_find(&d->table, node_id);
+    return idx >= 0 ? &d->peers[idx] : NULL;
+}
+
+uint32_t discovery_peer_count(const discovery_t *d) {
+    return peer_table_count(&d->table);
+}
+
+void discovery_heartbeat_encode(const discovery_heartbeat_t *hb, uint8_t *pkt) {
+    put_u16(pkt, DISCOVERY_MAGIC);
+    pkt[2] = DISCOVERY_VERSION;
+    pkt[3] = hb->flags;
+    put_u32(pkt + 4, hb->node_id);
+    put_u32(pkt + 8, hb->incarnation);
+    put_u32(pkt + 12, hb->seq);
+    put_u16(pkt + 16, hb->service_port);
+    put_u16(pkt + 18, 0);
+}
+
+int discovery_heartbeat_decode(const uint8_t *pkt, size_t len, discovery_heartbeat_t *hb) {
+    if (len != DISCOVERY_HEARTBEAT_SIZE || get_u16(pkt) != DISCOVERY_MAGIC || pkt[2] != DISCOVERY_VERSION) {
+        return -1;
+    }
+    *hb = (discovery_heartbeat_t){
+        .node_id = get_u32(pkt + 4), .incarnation = get_u32(pkt + 8), .seq = get_u32(pkt + 12),
+        .service_port = get_u16(pkt + 16), .flags = pkt[3],
+    };
+    return 0;
+}
+
+uint32_t discovery_new_incarnation(void) {
+    const uint64_t now = net_now_ns();
+    return (uint32_t)(now ^ (now >> 32) ^ ((uint64_t)getpid() << 16));
+}
@@ -0,0 +1,420 @@
+#include "elev_state/elev_state.h"
+
+#define ENUM_BITS 2
+#define VARINT_MAX_GROUPS 5  // 7 bits each cover a uint32_t
+
+typedef enum {
+    FIELD_FLOOR,    // bits_for(n_floors - 1)
+    FIELD_ENUM,     // ENUM_BITS
+    FIELD_MASK      // n_floors bits, deltas as a mask diff
+} field_kind_t;
+
+// Per elevator fields after the id. Full and delta encoding, decoding and the
+// delta field mask are all expanded from this list, so a new field is one line
+#define ELEVATOR_FIELDS(X) \
+    X(floor,        FIELD_FLOOR) \
+    X(direction,    FIELD_ENUM)  \
+    X(behaviour,    FIELD_ENUM)  \
+    X(cab_requests, FIELD_MASK)
+
+enum {
+#define X(name, kind) FIELD_BIT_##name,
+    ELEVATOR_FIELDS(X)
+#undef X
+    FIELD_COUNT
+};
+
+typedef struct {
+    uint8_t *p;
+    uint8_t *end;
+    uint64_t acc;       // Pending bits, fewer than 8 between calls
+    unsigned bits;
+    int overflow;
+} bit_writer_t;
+
+typedef struct {
+    const uint8_t *p;
+    const uint8_t *end;
+    uint64_t acc;
+    unsigned bits;
+    int error;
+} bit_reader_t;
+
+static inline unsigned bits_for(uint32_t max_value) {
+    return max_value == 0 ? 0 : 32 - (unsigned)__builtin_clz(max_value);
+}
+
+static inline uint64_t low_mask(unsigned n) {
+    return n >= 64 ? UINT64_MAX : (1ull << n) - 1;
+}
+
+// n <= 32
+static inline void put_bits(bit_writer_t *w, uint32_t v, unsigned n) {
+    w->acc |= ((uint64_t)v & low_mask(n)) << w->bits;
+    w->bits += n;
+    while (w->bits >= 8) {
+        if (w->p == w->end) {
+            w->overflow = 1;
+        } else {
+            *w->p++ = (uint8_t)w->acc;
+        }
+        w->acc >>= 8;
+        w->bits -= 8;
+    }
+}
+
+static inline void put_bits64(bit_writer_t *w, uint64_t v, unsigned n) {
+    if (n > 32) {
+        put_bits(w, (uint32_t)v, 32);
+        put_bits(w, (uint32_t)(v >> 32), n - 32);
+    } else {
+        put_bits(w, (uint32_t)v, n);
+    }
+}
+
+static inline void put_varint(bit_writer_t *w, uint32_t v) {
+    while (v >= 0x80) {
+        put_bits(w, (v & 0x7F) | 0x80, 8);
+        v >>= 7;
+    }
+    put_bits(w, v, 8);
+}
+
+// Pads to a whole byte, returns the encoded length or ELEV_STATE_INVALID on overflow
+static int finish_bits(bit_writer_t *w, uint8_t *start) {
+    if (w->bits > 0) {
+        put_bits(w, 0, 8 - w->bits);
+    }
+    return w->overflow ? ELEV_STATE_INVALID : (int)(w->p - start);
+}
+
+static inline uint32_t get_bits(bit_reader_t *r, unsigned n) {
+    while (r->bits < n) {
+        if (r->p == r->end) {
+            r->error = 1;
+            return 0;
+        }
+        r->acc |= (uint64_t)*r->p++ << r->bits;
+        r->bits += 8;
+    }
+    const uint32_t v = (uint32_t)(r->acc & low_mask(n));
+    r->acc >>= n;
+    r->bits -= n;
+    return v;
+}
+
+static inline uint64_t get_bits64(bit_reader_t *r, unsigned n) {
+    if (n > 32) {
+        const uint64_t lo = get_bits(r, 32);
+        return lo | (uint64_t)get_bits(r, n - 32) << 32;
+    }
+    return get_bits(r, n);
+}
+
+static inline uint32_t get_varint(bit_reader_t *r) {
+    uint32_t v = 0;
+    for (unsigned i = 0; i < VARINT_MAX_GROUPS; i++) {
+        const uint32_t group = get_bits(r, 8);
+        v |= (group & 0x7F) << (7 * i);
+        if (!(group & 0x80)) {
+            return v;
+        }
+    }
+    r->error = 1;
+    return 0;
+}
+
+// A changed request mask of n bits: mode bit, then either the flipped bit
+// indices each followed by a continue bit, or the whole XOR mask
+static void put_mask_diff(bit_writer_t *w, uint64_t diff, unsigned n) {
+    const unsigned index_bits = bits_for(n - 1);
+    const unsigned flipped = (unsigned)__builtin_popcountll(diff);
+    if (flipped * (index_bits + 1) < n) {
+        put_bits(w, 0, 1);
+        while (diff) {
+            const unsigned i = (unsigned)__builtin_ctzll(diff);
+            diff &= diff - 1;
+            put_bits(w, i, index_bits);
+            put_bits(w, diff != 0, 1);
+        }
+    } else {
+        put_bits(w, 1, 1);
+        put_bits64(w, diff, n);
+    }
+}
+
+static uint64_t get_mask_diff(bit_reader_t *r, unsigned n) {
+    if (get_bits(r, 1)) {
+        return get_bits64(r, n);
+    }
+    const unsigned index_bits = bits_for(n - 1);
+    uint64_t diff = 0;
+    for (unsigned i = 0; i < n; i++) {
+        const unsigned bit = get_bits(r, index_bits);
+        if (bit >= n) {
+            r->error = 1;
+            return 0;
+        }
+        diff |= 1ull << bit;
+        if (!get_bits(r, 1) || r->error) {
+            return diff;
+        }
+    }
+    r->error = 1;  // More indices than bits
+    return 0;
+}
+
+static inline void put_field(bit_writer_t *w, field_kind_t kind, uint32_t v, unsigned n_floors) {
+    switch (kind) {
+    case FIELD_FLOOR: put_bits(w, v, bits_for(n_floors - 1)); break;
+    case FIELD_ENUM:  put_bits(w, v, ENUM_BITS); break;
+    case FIELD_MASK:  put_bits(w, v, n_floors); break;
+    }
+}
+
+static inline void put_field_delta(bit_writer_t *w, field_kind_t kind, uint32_t v, uint32_t base, unsigned n_floors) {
+    if (kind == FIELD_MASK) {
+        put_mask_diff(w, v ^ base, n_floors);
+    } else {
+        put_field(w, kind, v, n_floors);
+    }
+}
+
+static inline uint32_t get_field(bit_reader_t *r, field_kind_t kind, unsigned n_floors) {
+    switch (kind) {
+    case FIELD_FLOOR: return get_bits(r, bits_for(n_floors - 1));
+    case FIELD_ENUM:  return get_bits(r, ENUM_BITS);
+    case FIELD_MASK:  return get_bits(r, n_floors);
+    }
+    return 0;
+}
+
+static inline uint32_t get_field_delta(bit_reader_t *r, field_kind_t kind, uint32_t base, unsigned n_floors) {
+    if (kind == FIELD_MASK) {
+        return base ^ (uint32_t)get_mask_diff(r, n_floors);
+    }
+    return get_field(r, kind, n_floors);
+}
+
+static inline uint64_t hall_matrix(const elev_state_t *s) {
+    return (uint64_t)s->hall_up | (uint64_t)s->hall_down << s->n_floors;
+}
+
+static inline void set_hall_matrix(elev_state_t *s, uint64_t m) {
+    s->hall_up = (uint32_t)(m & low_mask(s->n_floors));
+    s->hall_down = (uint32_t)(m >> s->n_floors);
+}
+
+static int state_valid(const elev_state_t *s) {
+    if (s->n_floors == 0 || s->n_floors > ELEV_STATE_MAX_FLOORS || s->n_elevators > ELEV_STATE_MAX_ELEVATORS) {
+        return 0;
+    }
+    const uint64_t floors = low_mask(s->n_floors);
+    if ((s->hall_up & ~floors) || (s->hall_down & ~floors)) {
+        return 0;
+    }
+    for (unsigned i = 0; i < s->n_elevators; i++) {
+        const elev_state_elevator_t *e = &s->elevators[i];
+        if (e->floor >= s->n_floors || e->direction > ELEV_DIR_DOWN || e->behaviour > ELEV_DOOR_OPEN ||
+            (e->cab_requests & ~floors)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int same_roster(const elev_state_t *a, const elev_state_t *b) {
+    if (a->n_floors != b->n_floors || a->n_elevators != b->n_elevators) {
+        return 0;
+    }
+    for (unsigned i = 0; i < a->n_elevators; i++) {
+        if (a->elevators[i].id != b->elevators[i].id) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static inline uint8_t header_byte(int delta) {
+    return (uint8_t)(ELEV_STATE_MAGIC << 4 | ELEV_STATE_VERSION << 1 | (delta ? 1 : 0));
+}
+
+int elev_state_encode(const elev_state_t *state, void *buf, size_t len) {
+    if (len < 1 || !state_valid(state)) {
+        return ELEV_STATE_INVALID;
+    }
+    uint8_t *start = buf;
+    start[0] = header_byte(0);
+    bit_writer_t w = { .p = start + 1, .end = start + len };
+
+    const unsigned n_floors = state->n_floors;
+    put_varint(&w, state->seq);
+    put_bits(&w, n_floors - 1, 5);
+    put_bits(&w, state->n_elevators, 5);
+    put_bits64(&w, hall_matrix(state), 2 * n_floors);
+
+    for (unsigned i = 0; i < state->n_elevators; i++) {
+        const elev_state_elevator_t *e = &state->elevators[i];
+        put_varint(&w, e->id);
+#define X(name, kind) put_field(&w, kind, e->name, n_floors);
+        ELEVATOR_FIELDS(X)
+#undef X
+    }
+    return finish_bits(&w, start);
+}
+
+int elev_state_encode_delta(const elev_state_t *state, const elev_state_t *base, void *buf, size_t len) {
+    if (base == NULL || !same_roster(state, base)) {
+        return elev_state_encode(state, buf, len);
+    }
+    if (len < 1 || !state_valid(state)) {
+        return ELEV_STATE_INVALID;
+    }
+    uint8_t *start = buf;
+    start[0] = header_byte(1);
+    bit_writer_t w = { .p = start + 1, .end = start + len };
+
+    const unsigned n_floors = state->n_floors;
+    put_varint(&w, state->seq);
+    put_varint(&w, state->seq - base->seq);
+
+    const uint64_t hall_diff = hall_matrix(state) ^ hall_matrix(base);
+    put_bits(&w, hall_diff != 0, 1);
+    if (hall_diff) {
+        put_mask_diff(&w, hall_diff, 2 * n_floors);
+    }
+
+    uint32_t changed[ELEV_STATE_MAX_ELEVATORS];
+    uint32_t changed_elevators = 0;
+    for (unsigned i = 0; i < state->n_elevators; i++) {
+        const elev_state_elevator_t *e = &state->elevators[i];
+        const elev_state_elevator_t *b = &base->elevators[i];
+        changed[i] = 0;
+#define X(name, kind) changed[i] |= (uint32_t)(e->name != b->name) << FIELD_BIT_##name;
+        ELEVATOR_FIELDS(X)
+#undef X
+        changed_elevators |= (uint32_t)(changed[i] != 0) << i;
+    }
+    put_bits(&w, changed_elevators, state->n_elevators);
+
+    for (unsigned i = 0; i < state->n_elevators; i++) {
+        if (!changed[i]) {
+            continue;
+        }
+        const elev_state_elevator_t *e = &state->elevators[i];
+        const elev_state_elevator_t *b = &base->elevators[i];
+        put_bits(&w, changed[i], FIELD_COUNT);
+#define X(name, kind) \
+        if (changed[i] & (1u << FIELD_BIT_##name)) put_field_delta(&w, kind, e->name, b->name, n_floors);
+        ELEVATOR_FIELDS(X)
+#undef X
+    }
+    return finish_bits(&w, start);
+}
+
+// Checks the header byte, returns 1 for a delta, 0 for a full state, -1 if not ours
+static int read_header(const uint8_t *p, size_t len) {
+    if (len < 1 || (p[0] & ~1u) != (header_byte(0))) {
+        return -1;
+    }
+    return p[0] & 1;
+}
+
+int elev_state_delta_base(const void *buf, size_t len, uint32_t *base_seq) {
+    const uint8_t *p = buf;
+    const int delta = read_header(p, len);
+    if (delta <= 0) {
+        return delta < 0 ? ELEV_STATE_INVALID : 0;
+    }
+    bit_reader_t r = { .p = p + 1, .end = p + len };
+    const uint32_t seq = get_varint(&r);
+    const uint32_t distance = get_varint(&r);
+    if (r.error) {
+        return ELEV_STATE_INVALID;
+    }
+    *base_seq = seq - distance;
+    return 1;
+}
+
+int elev_state_decode(const void *buf, size_t len, const elev_state_t *base, elev_state_t *out) {
+    const uint8_t *p = buf;
+    const int delta = read_header(p, len);
+    if (delta < 0) {
+        return ELEV_STATE_INVALID;
+    }
+    bit_reader_t r = { .p = p + 1, .end = p + len };
+
+    // Built aside so a failed decode leaves out alone, even when out is base
+    elev_state_t s;
+    s.seq = get_varint(&r);
+
+    if (!delta) {
+        s.n_floors = (uint8_t)(get_bits(&r, 5) + 1);
+        s.n_elevators = (uint8_t)get_bits(&r, 5);
+        if (r.error || s.n_elevators > ELEV_STATE_MAX_ELEVATORS) {
+            return ELEV_STATE_INVALID;
+        }
+        const unsigned n_floors = s.n_floors;
+        set_hall_matrix(&s, get_bits64(&r, 2 * n_floors));
+        for (unsigned i = 0; i < s.n_elevators; i++) {
+            elev_state_elevator_t *e = &s.elevators[i];
+            e->id = get_varint(&r);
+#define X(name, kind) e->name = get_field(&r, kind, n_floors);
+            ELEVATOR_FIELDS(X)
+#undef X
+        }
+    } else {
+        const uint32_t distance = get_varint(&r);
+        if (r.error) {
+            return ELEV_STATE_INVALID;
+        }
+        if (base == NULL || base->seq != s.seq - distance) {
+            return ELEV_STATE_NEED_BASE;
+        }
+        const uint32_t seq = s.seq;
+        s = *base;
+        s.seq = seq;
+
+        const unsigned n_floors = s.n_floors;
+        if (get_bits(&r, 1)) {
+            set_hall_matrix(&s, hall_matrix(&s) ^ get_mask_diff(&r, 2 * n_floors));
+        }
+        const uint32_t changed_elevators = get_bits(&r, s.n_elevators);
+        for (unsigned i = 0; i < s.n_elevators; i++) {
+            if (!(changed_elevators & (1u << i))) {
+                continue;
+            }
+            elev_state_elevator_t *e = &s.elevators[i];
+            const uint32_t changed = get_bits(&r, FIELD_COUNT);
+#define X(name, kind) \
+            if (changed & (1u << FIELD_BIT_##name)) e->name = get_field_delta(&r, kind, e->name, n_floors);
+            ELEVATOR_FIELDS(X)
+#undef X
+        }
+    }
+
+    // Anything but zero padding after the last field is an error too
+    if (r.error || r.p != r.end || r.acc != 0 || !state_valid(&s)) {
+        return ELEV_STATE_INVALID;
+    }
+    *out = s;
+    return 0;
+}
+
+int elev_state_equal(const elev_state_t *a, const elev_state_t *b) {
+    if (a->seq != b->seq || a->n_floors != b->n_floors || a->n_elevators != b->n_elevators ||
+        a->hall_up != b->hall_up || a->hall_down != b->hall_down) {
+        return 0;
+    }
+    for (unsigned i = 0; i < a->n_elevators; i++) {
+        const elev_state_elevator_t *x = &a->elevators[i];
+        const elev_state_elevator_t *y = &b->elevators[i];
+        if (x->id != y->id) {
+            return 0;
+        }
+#define X(name, kind) if (x->name != y->name) return 0;
+        ELEVATOR_FIELDS(X)
+#undef X
+    }
+    return 1;
+}
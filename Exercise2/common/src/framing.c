@@ -0,0 +1,148 @@
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "framing/framing.h"
+
+static const char *framing_names[] = {
+    [FRAMING_NONE]          = "none",
+    [FRAMING_LENGTH_PREFIX] = "len",
+    [FRAMING_FIXED]         = "fixed",
+    [FRAMING_DELIMITED]     = "nul",
+};
+
+int frame_decoder_init(frame_decoder_t *dec, framing_type_t type, size_t capacity) {
+    if ((type == FRAMING_FIXED && capacity < FRAMING_FIXED_SIZE) ||
+        (type == FRAMING_LENGTH_PREFIX && capacity <= FRAMING_LENGTH_PREFIX_SIZE) ||
+        capacity == 0) {
+        return -1;
+    }
+
+    memset(dec, 0, sizeof(*dec));
+    dec->buf = malloc(capacity);
+    if (dec->buf == NULL) {
+        return -1;
+    }
+    dec->type = type;
+    dec->capacity = capacity;
+    return 0;
+}
+
+void frame_decoder_free(frame_decoder_t *dec) {
+    free(dec->buf);
+    dec->buf = NULL;
+}
+
+char *frame_decoder_write_ptr(frame_decoder_t *dec, size_t *space) {
+    if (dec->start == dec->end) {
+        dec->start = dec->end = dec->scanned = 0;
+    } else if (dec->end == dec->capacity && dec->start > 0) {
+        const size_t pending = dec->end - dec->start;
+        memmove(dec->buf, dec->buf + dec->start, pending);
+        dec->scanned -= dec->start;
+        dec->start = 0;
+        dec->end = pending;
+    }
+    *space = dec->capacity - dec->end;
+    return dec->buf + dec->end;
+}
+
+void frame_decoder_commit(frame_decoder_t *dec, size_t n) {
+    dec->end += n;
+}
+
+static inline int buffer_full(const frame_decoder_t *dec) {
+    return dec->start == 0 && dec->end == dec->capacity;
+}
+
+int frame_decoder_next(frame_decoder_t *dec, const char **msg, size_t *len) {
+    char *p = dec->buf + dec->start;
+    const size_t avail = dec->end - dec->start;
+
+    switch (dec->type) {
+        case FRAMING_NONE:
+            if (avail == 0) return 0;
+            *msg = p;
+            *len = avail;
+            dec->start = dec->end;
+            return 1;
+
+        case FRAMING_FIXED:
+            if (avail < FRAMING_FIXED_SIZE) return 0;
+            *msg = p;
+            *len = FRAMING_FIXED_SIZE;
+            dec->start += FRAMING_FIXED_SIZE;
+            return 1;
+
+        case FRAMING_LENGTH_PREFIX: {
+            if (avail < FRAMING_LENGTH_PREFIX_SIZE) return 0;
+            uint32_t be_len;
+            memcpy(&be_len, p, sizeof(be_len));
+            const size_t payload = ntohl(be_len);
+            if (payload > dec->capacity - FRAMING_LENGTH_PREFIX_SIZE) return -1;
+            if (avail < FRAMING_LENGTH_PREFIX_SIZE + payload) return 0;
+            *msg = p + FRAMING_LENGTH_PREFIX_SIZE;
+            *len = payload;
+            dec->start += FRAMING_LENGTH_PREFIX_SIZE + payload;
+            return 1;
+        }
+
+        case FRAMING_DELIMITED: {
+            if (dec->scanned < dec->start) dec->scanned = dec->start;
+            const char *delim = memchr(dec->buf + dec->scanned, '\0', dec->end - dec->scanned);
+            if (delim == NULL) {
+                dec->scanned = dec->end;
+                return buffer_full(dec) ? -1 : 0;
+            }
+            *msg = p;
+            *len = (size_t)(delim - p);
+            dec->start = (size_t)(delim - dec->buf) + 1;
+            dec->scanned = dec->start;
+            return 1;
+        }
+    }
+    return -1;
+}
+
+int frame_encode(framing_type_t type, const char *msg, size_t len, char *out, size_t out_cap) {
+    switch (type) {
+        case FRAMING_NONE:
+            if (len > out_cap) return -1;
+            memcpy(out, msg, len);
+            return (int)len;
+
+        case FRAMING_FIXED:
+            if (len > FRAMING_FIXED_SIZE || out_cap < FRAMING_FIXED_SIZE) return -1;
+            memcpy(out, msg, len);
+            memset(out + len, 0, FRAMING_FIXED_SIZE - len);
+            return FRAMING_FIXED_SIZE;
+
+        case FRAMING_LENGTH_PREFIX: {
+            if (len > UINT32_MAX || len + FRAMING_LENGTH_PREFIX_SIZE > out_cap) return -1;
+            const uint32_t be_len = htonl((uint32_t)len);
+            memcpy(out, &be_len, sizeof(be_len));
+            memcpy(out + FRAMING_LENGTH_PREFIX_SIZE, msg, len);
+            return (int)(len + FRAMING_LENGTH_PREFIX_SIZE);
+        }
+
+        case FRAMING_DELIMITED:
+            if (len + 1 > out_cap || memchr(msg, '\0', len) != NULL) return -1;
+            memcpy(out, msg, len);
+            out[len] = '\0';
+            return (int)(len + 1);
+    }
+    return -1;
+}
+
+int framing_parse(const char *name) {
+    for (size_t i = 0; i < sizeof(framing_names) / sizeof(framing_names[0]); i++) {
+        if (strcmp(name, framing_names[i]) == 0) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+const char *framing_name(framing_type_t type) {
+    return framing_names[type];
+}
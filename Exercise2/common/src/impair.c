@@ -0,0 +1,324 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <math.h>
+#include <sys/socket.h>
+
+#include "impair/impair.h"
+#include "net/net.h"
+
+#define WHEEL_MASK (IMPAIR_WHEEL_SLOTS - 1)
+#define PARETO_SHAPE 3.0     // Finite variance, still a long tail
+#define MAX_SPEC_LEN 256
+#define MAX_LIMIT 1000000
+
+struct impair_pkt {
+    impair_pkt_t *next;
+    uint64_t tick;           // Released once the wheel has run this tick
+    uint32_t len;
+    int has_addr;
+    struct sockaddr_in addr;
+    char data[];
+};
+
+static inline double next_uniform(impair_t *im) {
+    im->rng ^= im->rng >> 12;
+    im->rng ^= im->rng << 25;
+    im->rng ^= im->rng >> 27;
+    return ((im->rng * 0x2545F4914F6CDD1Dull) >> 11) * 0x1.0p-53;  // [0, 1)
+}
+
+static double next_normal(impair_t *im) {
+    if (im->spare_valid) {
+        im->spare_valid = 0;
+        return im->spare;
+    }
+    const double u1 = 1.0 - next_uniform(im);  // (0, 1], log stays finite
+    const double u2 = next_uniform(im);
+    const double r = sqrt(-2.0 * log(u1));
+    im->spare = r * sin(2.0 * M_PI * u2);
+    im->spare_valid = 1;
+    return r * cos(2.0 * M_PI * u2);
+}
+
+// Gilbert model for bursts: the lossy state drops everything, leaving it after
+// loss_burst datagrams on average, entering it often enough to average loss
+static int lose(impair_t *im) {
+    if (im->cfg.loss <= 0) {
+        return 0;
+    }
+    if (im->cfg.loss_burst <= 1.0) {
+        return next_uniform(im) < im->cfg.loss;
+    }
+    if (im->in_burst) {
+        if (next_uniform(im) < im->burst_leave) im->in_burst = 0;
+    } else {
+        if (next_uniform(im) < im->burst_enter) im->in_burst = 1;
+    }
+    return im->in_burst;
+}
+
+static uint64_t sample_delay(impair_t *im) {
+    const impair_config_t *cfg = &im->cfg;
+    if (cfg->jitter_ns == 0) {
+        return cfg->delay_ns;
+    }
+    double d = (double)cfg->delay_ns;
+    const double j = (double)cfg->jitter_ns;
+    switch (cfg->dist) {
+        case IMPAIR_UNIFORM:
+            d += j * (2.0 * next_uniform(im) - 1.0);
+            break;
+        case IMPAIR_NORMAL:
+            d += j * next_normal(im);
+            break;
+        case IMPAIR_PARETO:
+            // Lomax with scale (shape - 1) * jitter has mean jitter
+            d += j * (PARETO_SHAPE - 1.0) * (pow(1.0 - next_uniform(im), -1.0 / PARETO_SHAPE) - 1.0);
+            break;
+    }
+    return d > 0 ? (uint64_t)d : 0;
+}
+
+static inline void slot_append(impair_slot_t *slot, impair_pkt_t *pkt) {
+    pkt->next = NULL;
+    if (slot->tail != NULL) {
+        slot->tail->next = pkt;
+    } else {
+        slot->head = pkt;
+    }
+    slot->tail = pkt;
+}
+
+static inline void deliver(impair_t *im, const void *data, size_t len, const struct sockaddr_in *addr) {
+    im->stats.delivered++;
+    im->deliver(im->arg, data, len, addr);
+}
+
+int impair_init(impair_t *im, const impair_config_t *cfg, size_t max_packet, impair_deliver_fn deliver_fn, void *arg) {
+    memset(im, 0, sizeof(*im));
+    if (!(cfg->loss >= 0 && cfg->loss <= 1) || !(cfg->loss_burst >= 1) ||
+        !(cfg->reorder >= 0 && cfg->reorder <= 1) || !(cfg->duplicate >= 0 && cfg->duplicate <= 1) ||
+        !(cfg->rate_bps >= 0) || cfg->limit == 0 || max_packet == 0 || deliver_fn == NULL) {
+        return -1;
+    }
+    im->cfg = *cfg;
+    im->deliver = deliver_fn;
+    im->arg = arg;
+    im->max_packet = max_packet;
+
+    im->wheel = calloc(IMPAIR_WHEEL_SLOTS, sizeof(impair_slot_t));
+    if (im->wheel == NULL ||
+        mempool_init(&im->pool, sizeof(impair_pkt_t) + max_packet, cfg->limit) != 0) {
+        impair_free(im);
+        return -1;
+    }
+
+    // Averages loss over the good and lossy states, capped when the bursts are
+    // too long for the requested loss to fit between them
+    im->burst_leave = 1.0 / cfg->loss_burst;
+    im->burst_enter = (cfg->loss < 1) ? cfg->loss * im->burst_leave / (1.0 - cfg->loss) : 1.0;
+    if (im->burst_enter > 1.0) im->burst_enter = 1.0;
+
+    const uint64_t now = net_now_ns();
+    im->tick = now / IMPAIR_TICK_NS + 1;
+    im->link_free_ns = now;
+    im->rng = cfg->seed ? cfg->seed : now ^ (uint64_t)(uintptr_t)im;
+    if (im->rng == 0) im->rng = 1;
+    return 0;
+}
+
+void impair_free(impair_t *im) {
+    mempool_destroy(&im->pool);
+    free(im->wheel);
+    im->wheel = NULL;
+}
+
+static void enqueue(impair_t *im, const void *data, size_t len, const struct sockaddr_in *addr, uint64_t now) {
+    // Serialized behind the datagrams before it, then delayed
+    uint64_t due = now;
+    uint64_t link_free = im->link_free_ns;
+    if (im->cfg.rate_bps > 0) {
+        const uint64_t start = (link_free > now) ? link_free : now;
+        link_free = start + (uint64_t)(len * 8e9 / im->cfg.rate_bps);
+        due = link_free;
+    }
+    if (im->cfg.reorder > 0 && next_uniform(im) < im->cfg.reorder) {
+        im->stats.reordered++;
+    } else {
+        due += sample_delay(im);
+    }
+
+    if (due <= now) {
+        im->link_free_ns = link_free;
+        deliver(im, data, len, addr);
+        return;
+    }
+    if (len > im->max_packet) {
+        im->stats.oversized++;
+        deliver(im, data, len, addr);
+        return;
+    }
+    impair_pkt_t *pkt = mempool_alloc(&im->pool);
+    if (pkt == NULL) {
+        im->stats.overflow++;  // Tail drop, the link stays free for the next one
+        return;
+    }
+    im->link_free_ns = link_free;
+
+    uint64_t tick = (due + IMPAIR_TICK_NS - 1) / IMPAIR_TICK_NS;
+    if (tick < im->tick) tick = im->tick;
+    pkt->tick = tick;
+    pkt->len = (uint32_t)len;
+    pkt->has_addr = (addr != NULL);
+    if (addr != NULL) pkt->addr = *addr;
+    memcpy(pkt->data, data, len);
+    slot_append(&im->wheel[tick & WHEEL_MASK], pkt);
+}
+
+void impair_submit(impair_t *im, const void *data, size_t len, const struct sockaddr_in *addr) {
+    im->stats.submitted++;
+    if (lose(im)) {
+        im->stats.lost++;
+        return;
+    }
+    const uint64_t now = net_now_ns();
+    enqueue(im, data, len, addr, now);
+    if (im->cfg.duplicate > 0 && next_uniform(im) < im->cfg.duplicate) {
+        im->stats.duplicated++;
+        enqueue(im, data, len, addr, now);
+    }
+}
+
+int impair_run(impair_t *im) {
+    const uint64_t now_tick = net_now_ns() / IMPAIR_TICK_NS;
+    int released = 0;
+    while (im->tick <= now_tick) {
+        if (im->pool.in_use == 0) {
+            im->tick = now_tick + 1;  // Idle, skip the empty slots
+            break;
+        }
+        impair_slot_t *slot = &im->wheel[im->tick & WHEEL_MASK];
+        const uint64_t tick = im->tick++;
+
+        // Detached first, so deliver callbacks may submit into this slot again
+        impair_pkt_t *pkt = slot->head;
+        slot->head = slot->tail = NULL;
+        while (pkt != NULL) {
+            impair_pkt_t *next = pkt->next;
+            if (pkt->tick <= tick) {
+                deliver(im, pkt->data, pkt->len, pkt->has_addr ? &pkt->addr : NULL);
+                mempool_release(&im->pool, pkt);
+                released++;
+            } else {
+                slot_append(slot, pkt);  // A later revolution
+            }
+            pkt = next;
+        }
+    }
+    return released;
+}
+
+uint64_t impair_next_ns(const impair_t *im) {
+    if (im->pool.in_use == 0) {
+        return UINT64_MAX;
+    }
+    // The first slot holding a datagram of the current revolution wins,
+    // otherwise everything is at least one revolution out
+    uint64_t earliest = UINT64_MAX;
+    for (uint64_t t = im->tick; t < im->tick + IMPAIR_WHEEL_SLOTS; t++) {
+        for (const impair_pkt_t *pkt = im->wheel[t & WHEEL_MASK].head; pkt != NULL; pkt = pkt->next) {
+            if (pkt->tick < earliest) earliest = pkt->tick;
+        }
+        if (earliest <= t) {
+            break;
+        }
+    }
+    return earliest * IMPAIR_TICK_NS;
+}
+
+uint32_t impair_held(const impair_t *im) {
+    return (uint32_t)im->pool.in_use;
+}
+
+void impair_sendto(void *arg, const void *data, size_t len, const struct sockaddr_in *addr) {
+    const int sock = *(const int *)arg;
+    if (addr != NULL) {
+        sendto(sock, data, len, MSG_DONTWAIT, (const struct sockaddr *)addr, sizeof(*addr));
+    } else {
+        send(sock, data, len, MSG_DONTWAIT);
+    }
+}
+
+int impair_parse(impair_config_t *cfg, const char *spec) {
+    char buf[MAX_SPEC_LEN];
+    if (strlen(spec) >= sizeof(buf)) {
+        return -1;
+    }
+    strcpy(buf, spec);
+
+    // Parsed into a copy, cfg is only touched if the whole spec is valid
+    impair_config_t parsed = *cfg;
+    char *save = NULL;
+    for (char *item = strtok_r(buf, ",", &save); item != NULL; item = strtok_r(NULL, ",", &save)) {
+        char *value = strchr(item, '=');
+        if (value == NULL) {
+            return -1;
+        }
+        *value++ = '\0';
+
+        double v;
+        if (strcmp(item, "dist") == 0) {
+            if (strcmp(value, "uniform") == 0) parsed.dist = IMPAIR_UNIFORM;
+            else if (strcmp(value, "normal") == 0) parsed.dist = IMPAIR_NORMAL;
+            else if (strcmp(value, "pareto") == 0) parsed.dist = IMPAIR_PARETO;
+            else return -1;
+        } else if (strcmp(item, "seed") == 0) {
+            char *endptr;
+            errno = 0;
+            const unsigned long long seed = strtoull(value, &endptr, 10);
+            if (errno != 0 || endptr == value || *endptr != '\0') return -1;
+            parsed.seed = seed;
+        } else if (strcmp(item, "loss") == 0) {
+            if (net_parse_double(value, 0, 100, &v) < 0) return -1;
+            parsed.loss = v / 100.0;
+        } else if (strcmp(item, "burst") == 0) {
+            if (net_parse_double(value, 1, 1e6, &v) < 0) return -1;
+            parsed.loss_burst = v;
+        } else if (strcmp(item, "delay") == 0) {
+            if (net_parse_double(value, 0, 60000, &v) < 0) return -1;
+            parsed.delay_ns = (uint64_t)(v * 1e6);
+        } else if (strcmp(item, "jitter") == 0) {
+            if (net_parse_double(value, 0, 60000, &v) < 0) return -1;
+            parsed.jitter_ns = (uint64_t)(v * 1e6);
+        } else if (strcmp(item, "reorder") == 0) {
+            if (net_parse_double(value, 0, 100, &v) < 0) return -1;
+            parsed.reorder = v / 100.0;
+        } else if (strcmp(item, "dup") == 0) {
+            if (net_parse_double(value, 0, 100, &v) < 0) return -1;
+            parsed.duplicate = v / 100.0;
+        } else if (strcmp(item, "rate") == 0) {
+            if (net_parse_double(value, 0, 1e6, &v) < 0) return -1;
+            parsed.rate_bps = v * 1e6;
+        } else if (strcmp(item, "limit") == 0) {
+            if (net_parse_double(value, 1, MAX_LIMIT, &v) < 0 || v != (uint32_t)v) return -1;
+            parsed.limit = (uint32_t)v;
+        } else {
+            return -1;
+        }
+    }
+    *cfg = parsed;
+    return 0;
+}
+
+void impair_describe(const impair_config_t *cfg, char *buf, size_t len) {
+    static const char *dist_names[] = { "uniform", "normal", "pareto" };
+    char rate[32] = "unlimited";
+    if (cfg->rate_bps > 0) {
+        snprintf(rate, sizeof(rate), "%.2f Mbit/s", cfg->rate_bps / 1e6);
+    }
+    snprintf(buf, len, "loss %.1f%% (bursts of %.1f), delay %.3f ms +- %.3f ms %s, reorder %.1f%%, dup %.1f%%, rate %s, limit %u",
+             cfg->loss * 100, cfg->loss_burst, cfg->delay_ns / 1e6, cfg->jitter_ns / 1e6, dist_names[cfg->dist],
+             cfg->reorder * 100, cfg->duplicate * 100, rate, cfg->limit);
+}
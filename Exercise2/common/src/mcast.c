@@ -0,0 +1,81 @@
+#include <stdio.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+
+#include "mcast/mcast.h"
+
+int mcast_is_group(struct in_addr addr) {
+    return IN_MULTICAST(ntohl(addr.s_addr));
+}
+
+int mcast_parse_iface(const char *str, mcast_iface_t *iface) {
+    memset(iface, 0, sizeof(*iface));
+    if (inet_pton(AF_INET, str, &iface->addr) == 1) {
+        return 0;
+    }
+    const unsigned index = if_nametoindex(str);
+    if (index == 0) {
+        return -1;
+    }
+    iface->ifindex = (int)index;
+    return 0;
+}
+
+const char *mcast_iface_name(const mcast_iface_t *iface, char *buf, size_t len) {
+    char name[IF_NAMESIZE];
+    if (iface == NULL || (iface->ifindex == 0 && iface->addr.s_addr == INADDR_ANY)) {
+        snprintf(buf, len, "default");
+    } else if (iface->ifindex != 0 && if_indextoname((unsigned)iface->ifindex, name) != NULL) {
+        snprintf(buf, len, "%s", name);
+    } else if (iface->ifindex != 0) {
+        snprintf(buf, len, "#%d", iface->ifindex);
+    } else {
+        inet_ntop(AF_INET, &iface->addr, buf, (socklen_t)len);
+    }
+    return buf;
+}
+
+// ip_mreqn takes the interface either way, index wins if both are set
+static struct ip_mreqn make_mreq(struct in_addr group, const mcast_iface_t *iface) {
+    struct ip_mreqn mreq = { .imr_multiaddr = group, .imr_address = { .s_addr = INADDR_ANY } };
+    if (iface != NULL) {
+        mreq.imr_address = iface->addr;
+        mreq.imr_ifindex = iface->ifindex;
+    }
+    return mreq;
+}
+
+int mcast_join(int sock, struct in_addr group, const mcast_iface_t *iface) {
+    const struct ip_mreqn mreq = make_mreq(group, iface);
+    if (setsockopt(sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0) {
+        return -1;
+    }
+#ifdef IP_MULTICAST_ALL
+    // Linux otherwise delivers every group any socket on the host joined
+    const int off = 0;
+    setsockopt(sock, IPPROTO_IP, IP_MULTICAST_ALL, &off, sizeof(off));
+#endif
+    return 0;
+}
+
+int mcast_leave(int sock, struct in_addr group, const mcast_iface_t *iface) {
+    const struct ip_mreqn mreq = make_mreq(group, iface);
+    return setsockopt(sock, IPPROTO_IP, IP_DROP_MEMBERSHIP, &mreq, sizeof(mreq));
+}
+
+int mcast_set_sender(int sock, const mcast_iface_t *iface, int ttl, int loop) {
+    if (iface != NULL && (iface->ifindex != 0 || iface->addr.s_addr != INADDR_ANY)) {
+        const struct ip_mreqn mreq = make_mreq((struct in_addr){ .s_addr = INADDR_ANY }, iface);
+        if (setsockopt(sock, IPPROTO_IP, IP_MULTICAST_IF, &mreq, sizeof(mreq)) < 0) {
+            return -1;
+        }
+    }
+    const unsigned char ttl_val = (unsigned char)ttl;
+    const unsigned char loop_val = loop ? 1 : 0;
+    if (setsockopt(sock, IPPROTO_IP, IP_MULTICAST_TTL, &ttl_val, sizeof(ttl_val)) < 0 ||
+        setsockopt(sock, IPPROTO_IP, IP_MULTICAST_LOOP, &loop_val, sizeof(loop_val)) < 0) {
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,55 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "mempool/mempool.h"
+
+#define MEMPOOL_ALIGN 16  // Enough for any scalar type, like malloc
+
+int mempool_init(mempool_t *pool, size_t block_size, size_t count) {
+    memset(pool, 0, sizeof(*pool));
+    if (block_size == 0 || count == 0) {
+        return -1;
+    }
+
+    const size_t align = MEMPOOL_ALIGN;
+    if (block_size < sizeof(void *)) {
+        block_size = sizeof(void *);
+    }
+    block_size = (block_size + align - 1) & ~(align - 1);
+
+    pool->mem = malloc(block_size * count);
+    if (pool->mem == NULL) {
+        return -1;
+    }
+    pool->block_size = block_size;
+    pool->count = count;
+
+    // Thread the free list front to back so the first allocations are adjacent
+    for (size_t i = count; i-- > 0;) {
+        void *block = pool->mem + i * block_size;
+        *(void **)block = pool->free_list;
+        pool->free_list = block;
+    }
+    return 0;
+}
+
+void mempool_destroy(mempool_t *pool) {
+    free(pool->mem);
+    memset(pool, 0, sizeof(*pool));
+}
+
+void *mempool_alloc(mempool_t *pool) {
+    void *block = pool->free_list;
+    if (block == NULL) {
+        return NULL;
+    }
+    pool->free_list = *(void **)block;
+    pool->in_use++;
+    return block;
+}
+
+void mempool_release(mempool_t *pool, void *block) {
+    *(void **)block = pool->free_list;
+    pool->free_list = block;
+    pool->in_use--;
+}
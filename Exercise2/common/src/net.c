@@ -0,0 +1,230 @@
+#define _GNU_SOURCE // accept4
+#include <errno.h>
+#include <stdio.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <netinet/tcp.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+
+#include "net/net.h"
+
+static volatile sig_atomic_t *stop_flag;
+
+static void stop_handler(int sig) {
+    (void)sig;
+    *stop_flag = 0;
+}
+
+int net_parse_long(const char *str, long min, long max, long *value) {
+    char *endptr;
+    errno = 0;
+    const long v = strtol(str, &endptr, 10);
+
+    if (errno != 0 || endptr == str || *endptr != '\0') {
+        return -1;
+    }
+
+    if (v < min || v > max) {
+        return -1;
+    }
+
+    *value = v;
+    return 0;
+}
+
+int net_parse_double(const char *str, double min, double max, double *value) {
+    char *endptr;
+    errno = 0;
+    const double v = strtod(str, &endptr);
+
+    if (errno != 0 || endptr == str || *endptr != '\0') {
+        return -1;
+    }
+
+    if (!(v >= min && v <= max)) {
+        return -1;
+    }
+
+    *value = v;
+    return 0;
+}
+
+int net_parse_port(const char *str) {
+    long port;
+    return net_parse_long(str, 1, 65535, &port) == 0 ? (int)port : -1;
+}
+
+double net_parse_percent(const char *str) {
+    double percent;
+    return net_parse_double(str, 0, 100, &percent) == 0 ? percent / 100.0 : -1;
+}
+
+int net_parse_size(const char *str, int min) {
+    long size;
+    return net_parse_long(str, min, NET_MAX_UDP_PAYLOAD, &size) == 0 ? (int)size : -1;
+}
+
+int net_parse_repetitions(const char *str) {
+    long repetitions;
+    return net_parse_long(str, -1, INT_MAX, &repetitions) == 0 ? (int)repetitions : -2;
+}
+
+void net_handle_signals(volatile sig_atomic_t *running) {
+    stop_flag = running;
+    struct sigaction sa = {
+        .sa_handler = stop_handler,
+        .sa_flags = 0 // Allow for interrupt
+    };
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+}
+
+static int set_int(int fd, int level, int name, int value) {
+    return setsockopt(fd, level, name, &value, sizeof(value));
+}
+
+int net_apply_opts(int fd, const net_opts_t *opts) {
+    if (opts == NULL) {
+        return 0;
+    }
+    if (opts->reuseaddr && set_int(fd, SOL_SOCKET, SO_REUSEADDR, 1) < 0) return -1;
+    if (opts->reuseport && set_int(fd, SOL_SOCKET, SO_REUSEPORT, 1) < 0) return -1;
+    if (opts->broadcast && set_int(fd, SOL_SOCKET, SO_BROADCAST, 1) < 0) return -1;
+    if (opts->rcvbuf > 0 && set_int(fd, SOL_SOCKET, SO_RCVBUF, opts->rcvbuf) < 0) return -1;
+    if (opts->sndbuf > 0 && set_int(fd, SOL_SOCKET, SO_SNDBUF, opts->sndbuf) < 0) return -1;
+    if (opts->busy_poll_us > 0 && set_int(fd, SOL_SOCKET, SO_BUSY_POLL, opts->busy_poll_us) < 0) return -1;
+    return 0;
+}
+
+// Closes fd keeping the errno of the call that failed
+static int fail(int fd) {
+    const int err = errno;
+    close(fd);
+    errno = err;
+    return -1;
+}
+
+int net_socket(int type, const net_opts_t *opts) {
+    const int nonblock = (opts != NULL && opts->nonblocking) ? SOCK_NONBLOCK : 0;
+    const int fd = socket(AF_INET, type | nonblock | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (net_apply_opts(fd, opts) < 0) {
+        return fail(fd);
+    }
+    return fd;
+}
+
+static int bind_any(int fd, int port) {
+    const struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+        .sin_port = htons((uint16_t)port)
+    };
+    return bind(fd, (const struct sockaddr *)&addr, sizeof(addr));
+}
+
+int net_udp_socket(int port, const net_opts_t *opts) {
+    const int fd = net_socket(SOCK_DGRAM, opts);
+    if (fd < 0) {
+        return -1;
+    }
+    if (bind_any(fd, port) < 0) {
+        return fail(fd);
+    }
+    return fd;
+}
+
+int net_tcp_listener(int port, int backlog, const net_opts_t *opts) {
+    const int fd = net_socket(SOCK_STREAM, opts);
+    if (fd < 0) {
+        return -1;
+    }
+    if (bind_any(fd, port) < 0 || listen(fd, backlog) < 0) {
+        return fail(fd);
+    }
+    return fd;
+}
+
+int net_tcp_connect(const struct sockaddr_in *addr, const net_opts_t *opts) {
+    const int fd = net_socket(SOCK_STREAM, opts);
+    if (fd < 0) {
+        return -1;
+    }
+    if (connect(fd, (const struct sockaddr *)addr, sizeof(*addr)) < 0) {
+        if (!(opts != NULL && opts->nonblocking && errno == EINPROGRESS)) {
+            return fail(fd);
+        }
+    }
+    return fd;
+}
+
+int net_accept(int listen_fd, struct sockaddr_in *addr) {
+    socklen_t addr_len = sizeof(*addr);
+    return accept4(listen_fd, (struct sockaddr *)addr, addr != NULL ? &addr_len : NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+}
+
+int net_set_nodelay(int fd) {
+    return set_int(fd, IPPROTO_TCP, TCP_NODELAY, 1);
+}
+
+int net_local_port(int fd) {
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    if (getsockname(fd, (struct sockaddr *)&addr, &addr_len) < 0) {
+        return -1;
+    }
+    return ntohs(addr.sin_port);
+}
+
+int net_buffer_sizes(int fd, int *rcvbuf, int *sndbuf) {
+    socklen_t len = sizeof(int);
+    if (rcvbuf != NULL && getsockopt(fd, SOL_SOCKET, SO_RCVBUF, rcvbuf, &len) < 0) {
+        return -1;
+    }
+    len = sizeof(int);
+    if (sndbuf != NULL && getsockopt(fd, SOL_SOCKET, SO_SNDBUF, sndbuf, &len) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+static long read_sysctl(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        return -1;
+    }
+    long value;
+    const int ok = fscanf(f, "%ld", &value) == 1;
+    fclose(f);
+    return ok ? value : -1;
+}
+
+long net_rmem_max(void) {
+    return read_sysctl("/proc/sys/net/core/rmem_max");
+}
+
+long net_wmem_max(void) {
+    return read_sysctl("/proc/sys/net/core/wmem_max");
+}
+
+long net_raise_fd_limit(long wanted) {
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) != 0) {
+        return -1;
+    }
+    if (rl.rlim_cur >= (rlim_t)wanted) {
+        return rl.rlim_cur > LONG_MAX ? LONG_MAX : (long)rl.rlim_cur;
+    }
+    const rlim_t old = rl.rlim_cur;
+    rl.rlim_cur = (rl.rlim_max == RLIM_INFINITY || rl.rlim_max >= (rlim_t)wanted) ? (rlim_t)wanted : rl.rlim_max;
+    if (setrlimit(RLIMIT_NOFILE, &rl) != 0) {
+        rl.rlim_cur = old;
+    }
+    return (long)rl.rlim_cur;
+}
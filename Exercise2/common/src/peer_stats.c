@@ -0,0 +1,132 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "peer_stats/peer_stats.h"
+
+// Fibonacci hashing of address and port, spreads neighbouring ports of one host
+static inline uint32_t bucket_of(const peer_stats_t *ps, const struct sockaddr_in *addr) {
+    const uint32_t key = addr->sin_addr.s_addr ^ ((uint32_t)addr->sin_port << 16 | addr->sin_port);
+    return (key * 0x9E3779B1u) >> ps->bucket_shift;
+}
+
+static inline int same_peer(const struct sockaddr_in *a, const struct sockaddr_in *b) {
+    return a->sin_addr.s_addr == b->sin_addr.s_addr && a->sin_port == b->sin_port;
+}
+
+int peer_stats_init(peer_stats_t *ps, uint32_t capacity, uint64_t now_ns) {
+    memset(ps, 0, sizeof(*ps));
+    if (capacity == 0) {
+        capacity = 1;
+    }
+    // Twice the capacity in buckets, a power of two
+    uint32_t n_buckets = 2;
+    while (n_buckets < capacity * 2 && n_buckets < (1u << 31)) {
+        n_buckets <<= 1;
+    }
+    ps->entries = calloc(capacity, sizeof(peer_stats_entry_t));
+    ps->buckets = malloc(n_buckets * sizeof(int32_t));
+    if (ps->entries == NULL || ps->buckets == NULL) {
+        peer_stats_free(ps);
+        return -1;
+    }
+    for (uint32_t i = 0; i < n_buckets; i++) {
+        ps->buckets[i] = -1;
+    }
+    ps->capacity = capacity;
+    ps->bucket_shift = 32 - (uint32_t)__builtin_ctz(n_buckets);
+    ps->other.hash_next = -1;
+    ps->mark_ns = now_ns;
+    return 0;
+}
+
+void peer_stats_free(peer_stats_t *ps) {
+    free(ps->entries);
+    free(ps->buckets);
+    ps->entries = NULL;
+    ps->buckets = NULL;
+    ps->count = ps->capacity = 0;
+}
+
+peer_stats_entry_t *peer_stats_get(peer_stats_t *ps, const struct sockaddr_in *addr) {
+    const uint32_t b = bucket_of(ps, addr);
+    for (int32_t i = ps->buckets[b]; i >= 0; i = ps->entries[i].hash_next) {
+        if (same_peer(&ps->entries[i].addr, addr)) {
+            return &ps->entries[i];
+        }
+    }
+    if (ps->count == ps->capacity) {
+        return &ps->other;
+    }
+    peer_stats_entry_t *e = &ps->entries[ps->count];
+    memset(e, 0, sizeof(*e));
+    e->addr.sin_family = AF_INET;
+    e->addr.sin_addr = addr->sin_addr;
+    e->addr.sin_port = addr->sin_port;
+    e->hash_next = ps->buckets[b];
+    ps->buckets[b] = (int32_t)ps->count++;
+    return e;
+}
+
+int peer_stats_enable_drops(int sock) {
+    const int on = 1;
+    return setsockopt(sock, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof(on));
+}
+
+void peer_stats_read_drops(peer_stats_t *ps, const struct msghdr *msg) {
+    if (msg->msg_control == NULL) {
+        return;
+    }
+    for (struct cmsghdr *cm = CMSG_FIRSTHDR(msg); cm != NULL; cm = CMSG_NXTHDR((struct msghdr *)msg, cm)) {
+        if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SO_RXQ_OVFL) {
+            uint32_t counter;
+            memcpy(&counter, CMSG_DATA(cm), sizeof(counter));
+            ps->drops += (uint32_t)(counter - ps->ovfl_counter);  // Wraps with the kernel's counter
+            ps->ovfl_counter = counter;
+            return;
+        }
+    }
+}
+
+static inline uint64_t interval_bytes(const peer_stats_entry_t *e) {
+    return e->bytes - e->last_bytes;
+}
+
+uint32_t peer_stats_top(const peer_stats_t *ps, const peer_stats_entry_t **out, uint32_t n) {
+    uint32_t found = 0;
+    for (uint32_t i = 0; i <= ps->count; i++) {
+        const peer_stats_entry_t *e = (i < ps->count) ? &ps->entries[i] : &ps->other;
+        if (e->packets == e->last_packets || n == 0) {
+            continue;
+        }
+        // Insertion into the sorted top n, the dashboard shows a few dozen at most
+        uint32_t pos = (found < n) ? found++ : n;
+        while (pos > 0 && interval_bytes(out[pos - 1]) < interval_bytes(e)) {
+            if (pos < n) out[pos] = out[pos - 1];
+            pos--;
+        }
+        if (pos < n) out[pos] = e;
+    }
+    return found;
+}
+
+void peer_stats_total(const peer_stats_t *ps, peer_stats_entry_t *sum) {
+    *sum = ps->other;
+    for (uint32_t i = 0; i < ps->count; i++) {
+        const peer_stats_entry_t *e = &ps->entries[i];
+        sum->packets += e->packets;
+        sum->bytes += e->bytes;
+        sum->truncated += e->truncated;
+        sum->last_packets += e->last_packets;
+        sum->last_bytes += e->last_bytes;
+    }
+}
+
+void peer_stats_mark(peer_stats_t *ps, uint64_t now_ns) {
+    for (uint32_t i = 0; i <= ps->count; i++) {
+        peer_stats_entry_t *e = (i < ps->count) ? &ps->entries[i] : &ps->other;
+        e->last_packets = e->packets;
+        e->last_bytes = e->bytes;
+    }
+    ps->last_drops = ps->drops;
+    ps->mark_ns = now_ns;
+}
@@ -0,0 +1,94 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "peer_table/peer_table.h"
+
+static inline uint32_t next_pow2(uint32_t v) {
+    uint32_t p = 1;
+    while (p < v) p <<= 1;
+    return p;
+}
+
+// Fibonacci hashing spreads small consecutive node ids over the top bits
+static inline uint32_t bucket_of(const peer_table_t *t, uint32_t node_id) {
+    return (node_id * 0x9E3779B1u) >> t->bucket_shift;
+}
+
+int peer_table_init(peer_table_t *t, uint32_t capacity) {
+    memset(t, 0, sizeof(*t));
+    if (capacity == 0 || capacity > INT32_MAX / 2) {
+        return -1;
+    }
+
+    // Half empty buckets keep the chains short
+    const uint32_t n_buckets = next_pow2(capacity * 2);
+    t->ids = calloc(capacity, sizeof(uint32_t));
+    t->links = malloc(capacity * sizeof(int32_t));
+    t->buckets = malloc(n_buckets * sizeof(int32_t));
+    if (t->ids == NULL || t->links == NULL || t->buckets == NULL) {
+        peer_table_free(t);
+        return -1;
+    }
+
+    t->bucket_shift = 32 - __builtin_ctz(n_buckets);
+    t->capacity = capacity;
+    for (uint32_t i = 0; i < n_buckets; i++) {
+        t->buckets[i] = -1;
+    }
+    for (uint32_t i = 0; i < capacity; i++) {
+        t->links[i] = (i + 1 < capacity) ? (int32_t)(i + 1) : -1;
+    }
+    t->free_list = 0;
+    return 0;
+}
+
+void peer_table_free(peer_table_t *t) {
+    free(t->ids);
+    free(t->links);
+    free(t->buckets);
+    t->ids = NULL;
+    t->links = NULL;
+    t->buckets = NULL;
+    t->free_list = -1;
+    t->capacity = 0;
+    t->count = 0;
+}
+
+int32_t peer_table_find(const peer_table_t *t, uint32_t node_id) {
+    for (int32_t i = t->buckets[bucket_of(t, node_id)]; i >= 0; i = t->links[i]) {
+        if (t->ids[i] == node_id) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int32_t peer_table_add(peer_table_t *t, uint32_t node_id) {
+    const int32_t slot = t->free_list;
+    if (slot < 0) {
+        return -1;
+    }
+    t->free_list = t->links[slot];
+
+    const uint32_t b = bucket_of(t, node_id);
+    t->ids[slot] = node_id;
+    t->links[slot] = t->buckets[b];
+    t->buckets[b] = slot;
+    t->count++;
+    return slot;
+}
+
+void peer_table_remove(peer_table_t *t, int32_t slot) {
+    int32_t *link = &t->buckets[bucket_of(t, t->ids[slot])];
+    while (*link != slot) {
+        link = &t->links[*link];
+    }
+    *link = t->links[slot];
+    t->links[slot] = t->free_list;
+    t->free_list = slot;
+    t->count--;
+}
+
+uint32_t peer_table_count(const peer_table_t *t) {
+    return t->count;
+}
@@ -0,0 +1,491 @@
+#define _GNU_SOURCE // recvmmsg
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+#include "rudp/rudp.h"
+#include "net/net.h"
+
+#define RUDP_DATA 1
+#define RUDP_ACK  2
+#define RX_MAX_BATCHES 16  // Per rudp_process, so a flood cannot starve the timers
+
+static inline void put_u16(uint8_t *p, uint16_t v) {
+    v = htons(v);
+    memcpy(p, &v, 2);
+}
+
+static inline void put_u32(uint8_t *p, uint32_t v) {
+    v = htonl(v);
+    memcpy(p, &v, 4);
+}
+
+static inline uint16_t get_u16(const uint8_t *p) {
+    uint16_t v;
+    memcpy(&v, p, 2);
+    return ntohs(v);
+}
+
+static inline uint32_t get_u32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return ntohl(v);
+}
+
+static inline void put_header(uint8_t *p, uint8_t type, uint32_t session, uint32_t seq, uint32_t base) {
+    put_u16(p, RUDP_MAGIC);
+    p[2] = type;
+    p[3] = 0;
+    put_u32(p + 4, session);
+    put_u32(p + 8, seq);
+    put_u32(p + 12, base);
+}
+
+// xorshift64*, only used for the session id and simulated loss
+static inline uint64_t next_random(rudp_t *r) {
+    r->rng ^= r->rng >> 12;
+    r->rng ^= r->rng << 25;
+    r->rng ^= r->rng >> 27;
+    return r->rng * 0x2545F4914F6CDD1Dull;
+}
+
+static inline int bit_test(const uint64_t *bits, uint32_t i) {
+    return (bits[i / 64] >> (i % 64)) & 1;
+}
+
+static inline void bit_set(uint64_t *bits, uint32_t i) {
+    bits[i / 64] |= 1ull << (i % 64);
+}
+
+static inline void bit_clear(uint64_t *bits, uint32_t i) {
+    bits[i / 64] &= ~(1ull << (i % 64));
+}
+
+static inline int same_addr(const struct sockaddr_in *a, const struct sockaddr_in *b) {
+    return a->sin_addr.s_addr == b->sin_addr.s_addr && a->sin_port == b->sin_port;
+}
+
+static rudp_peer_t *find_peer(const rudp_t *r, const struct sockaddr_in *addr) {
+    for (uint32_t i = 0; i < r->n_peers; i++) {
+        if (same_addr(&r->peers[i].addr, addr)) {
+            return &r->peers[i];
+        }
+    }
+    return NULL;
+}
+
+static rudp_peer_t *find_or_add_peer(rudp_t *r, const struct sockaddr_in *addr) {
+    rudp_peer_t *p = find_peer(r, addr);
+    if (p != NULL || r->n_peers == r->cfg.max_peers) {
+        return p;
+    }
+    p = &r->peers[r->n_peers++];
+    memset(p, 0, sizeof(*p));
+    p->addr = *addr;
+    p->session = r->session;
+    p->rto_ns = r->cfg.initial_rto_ns;
+    return p;
+}
+
+// Send errors are not reported, a lost datagram is recovered like any other loss
+static void xmit(rudp_t *r, const rudp_peer_t *p, const void *pkt, size_t len) {
+    if (r->cfg.impair != NULL) {
+        impair_submit(r->cfg.impair, pkt, len, &p->addr);
+        return;
+    }
+    sendto(r->sock, pkt, len, MSG_DONTWAIT, (const struct sockaddr *)&p->addr, sizeof(p->addr));
+}
+
+int rudp_init(rudp_t *r, int sock, const rudp_config_t *cfg) {
+    memset(r, 0, sizeof(*r));
+    if (cfg->window == 0 || cfg->window > RUDP_MAX_WINDOW ||
+        cfg->max_payload == 0 || cfg->max_payload > RUDP_MAX_PAYLOAD ||
+        cfg->pool_blocks == 0 || cfg->max_peers == 0 ||
+        cfg->min_rto_ns == 0 || cfg->min_rto_ns > cfg->max_rto_ns) {
+        return -1;
+    }
+    r->sock = sock;
+    r->cfg = *cfg;
+
+    size_t rx_size = RUDP_HEADER_SIZE + cfg->max_payload;
+    if (rx_size < RUDP_ACK_SIZE) {
+        rx_size = RUDP_ACK_SIZE;
+    }
+    r->peers = calloc(cfg->max_peers, sizeof(rudp_peer_t));
+    r->rx_bufs = malloc(RUDP_RX_BATCH * rx_size);
+    r->rx_iovs = calloc(RUDP_RX_BATCH, sizeof(struct iovec));
+    r->rx_msgs = calloc(RUDP_RX_BATCH, sizeof(struct mmsghdr));
+    r->rx_addrs = calloc(RUDP_RX_BATCH, sizeof(struct sockaddr_in));
+    if (r->peers == NULL || r->rx_bufs == NULL || r->rx_iovs == NULL || r->rx_msgs == NULL ||
+        r->rx_addrs == NULL || mempool_init(&r->pool, RUDP_HEADER_SIZE + cfg->max_payload, cfg->pool_blocks) != 0) {
+        rudp_free(r);
+        return -1;
+    }
+
+    for (int i = 0; i < RUDP_RX_BATCH; i++) {
+        r->rx_iovs[i].iov_base = r->rx_bufs + (size_t)i * rx_size;
+        r->rx_iovs[i].iov_len  = rx_size;
+        r->rx_msgs[i].msg_hdr.msg_iov    = &r->rx_iovs[i];
+        r->rx_msgs[i].msg_hdr.msg_iovlen = 1;
+        r->rx_msgs[i].msg_hdr.msg_name   = &r->rx_addrs[i];
+    }
+
+    // A new session after every restart tells peers to reset their receive state
+    r->rng = net_now_ns() ^ ((uint64_t)getpid() << 32) ^ (uint64_t)(uintptr_t)r;
+    if (r->rng == 0) r->rng = 1;
+    do {
+        r->session = (uint32_t)next_random(r);
+    } while (r->session == 0);
+    return 0;
+}
+
+void rudp_free(rudp_t *r) {
+    mempool_destroy(&r->pool);
+    free(r->peers);
+    free(r->rx_bufs);
+    free(r->rx_iovs);
+    free(r->rx_msgs);
+    free(r->rx_addrs);
+    r->peers = NULL;
+    r->rx_bufs = NULL;
+    r->rx_iovs = NULL;
+    r->rx_msgs = NULL;
+    r->rx_addrs = NULL;
+    r->n_peers = 0;
+}
+
+int rudp_send(rudp_t *r, const struct sockaddr_in *to, const void *data, size_t len) {
+    if (len > r->cfg.max_payload) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    rudp_peer_t *p = find_or_add_peer(r, to);
+    if (p == NULL) {
+        errno = ENOSPC;
+        return -1;
+    }
+    if (p->next - p->base >= r->cfg.window) {
+        errno = EAGAIN;
+        return -1;
+    }
+    uint8_t *pkt = mempool_alloc(&r->pool);
+    if (pkt == NULL) {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    put_header(pkt, RUDP_DATA, p->session, p->next, p->base);
+    memcpy(pkt + RUDP_HEADER_SIZE, data, len);
+
+    const uint64_t now = net_now_ns();
+    rudp_slot_t *slot = &p->slots[p->next % RUDP_MAX_WINDOW];
+    *slot = (rudp_slot_t){
+        .pkt = (char *)pkt, .len = RUDP_HEADER_SIZE + len, .transmits = 1,
+        .first_ns = now, .last_ns = now, .fast_retransmitted = 0,
+    };
+    p->next++;
+    r->stats.sent++;
+    xmit(r, p, pkt, slot->len);
+    return 0;
+}
+
+// Jacobson/Karels as in RFC 6298: SRTT gain 1/8, RTTVAR gain 1/4, RTO = SRTT + 4 * RTTVAR
+static void rtt_sample(const rudp_t *r, rudp_peer_t *p, uint64_t rtt) {
+    if (p->srtt_ns == 0) {
+        p->srtt_ns = rtt;
+        p->rttvar_ns = rtt / 2;
+    } else {
+        const uint64_t err = (rtt > p->srtt_ns) ? rtt - p->srtt_ns : p->srtt_ns - rtt;
+        p->rttvar_ns = p->rttvar_ns - p->rttvar_ns / 4 + err / 4;
+        p->srtt_ns = p->srtt_ns - p->srtt_ns / 8 + rtt / 8;
+    }
+    uint64_t rto = p->srtt_ns + 4 * p->rttvar_ns;
+    if (rto < r->cfg.min_rto_ns) rto = r->cfg.min_rto_ns;
+    if (rto > r->cfg.max_rto_ns) rto = r->cfg.max_rto_ns;
+    p->rto_ns = rto;  // A fresh sample also ends any backoff
+}
+
+static void release_slot(rudp_t *r, rudp_slot_t *slot) {
+    mempool_release(&r->pool, slot->pkt);
+    slot->pkt = NULL;
+}
+
+static void ack_slot(rudp_t *r, rudp_peer_t *p, uint32_t seq, uint64_t now) {
+    rudp_slot_t *slot = &p->slots[seq % RUDP_MAX_WINDOW];
+    if (slot->pkt == NULL) {
+        return;  // Acknowledged before
+    }
+    // Karn: the ACK of a retransmitted message is ambiguous, no RTT sample
+    if (slot->transmits == 1) {
+        rtt_sample(r, p, now - slot->last_ns);
+    }
+    if (r->cfg.on_acked != NULL) {
+        r->cfg.on_acked(r->cfg.arg, &p->addr, now - slot->first_ns);
+    }
+    release_slot(r, slot);
+    r->stats.acked++;
+}
+
+static void advance_base(rudp_peer_t *p) {
+    while (p->base != p->next && p->slots[p->base % RUDP_MAX_WINDOW].pkt == NULL) {
+        p->base++;
+    }
+}
+
+static void retransmit(rudp_t *r, rudp_peer_t *p, rudp_slot_t *slot, uint64_t now) {
+    put_u32((uint8_t *)slot->pkt + 12, p->base);  // Base may have moved since the last transmission
+    slot->transmits++;
+    slot->last_ns = now;
+    r->stats.retransmits++;
+    xmit(r, p, slot->pkt, slot->len);
+}
+
+static void handle_ack(rudp_t *r, const struct sockaddr_in *from, const uint8_t *pkt, size_t len) {
+    rudp_peer_t *p = find_peer(r, from);
+    if (len < RUDP_ACK_SIZE || p == NULL || get_u32(pkt + 4) != p->session) {
+        r->stats.invalid++;  // Unknown peer or an ACK for a previous session
+        return;
+    }
+    r->stats.acks_received++;
+
+    const uint32_t cum = get_u32(pkt + 8);
+    const uint32_t in_flight = p->next - p->base;
+    if (cum - p->base > in_flight) {
+        return;  // Older than base (reordered ACK) or beyond anything sent
+    }
+
+    const uint64_t now = net_now_ns();
+    for (uint32_t seq = p->base; seq != cum; seq++) {
+        ack_slot(r, p, seq, now);
+    }
+
+    // Bit i of the bitmap is cum + i, bit 0 is always clear
+    const uint8_t *sack = pkt + RUDP_HEADER_SIZE;
+    uint32_t highest = cum;
+    for (uint32_t byte = 0; byte < RUDP_MAX_WINDOW / 8; byte++) {
+        unsigned bits = sack[byte];
+        while (bits != 0) {
+            const uint32_t seq = cum + byte * 8 + __builtin_ctz(bits);
+            bits &= bits - 1;
+            if (seq - p->base < in_flight) {
+                ack_slot(r, p, seq, now);
+                highest = seq;
+            }
+        }
+    }
+    advance_base(p);
+
+    // Holes well below the highest selectively acknowledged message are
+    // almost certainly lost, resend them once without waiting for the RTO
+    for (uint32_t seq = p->base; highest - seq >= RUDP_FAST_RETX_THRESH && highest - seq < in_flight; seq++) {
+        rudp_slot_t *slot = &p->slots[seq % RUDP_MAX_WINDOW];
+        if (slot->pkt != NULL && !slot->fast_retransmitted) {
+            slot->fast_retransmitted = 1;
+            r->stats.fast_retransmits++;
+            retransmit(r, p, slot, now);
+        }
+    }
+}
+
+// Moves cum to base, then on over messages already received beyond it
+static void skip_to(rudp_t *r, rudp_peer_t *p, uint32_t base) {
+    const uint32_t n = base - p->cum;
+    for (uint32_t i = 0; i < n && i < RUDP_MAX_WINDOW; i++) {
+        const uint32_t idx = (p->cum + i) % RUDP_MAX_WINDOW;
+        if (bit_test(p->received, idx)) {
+            bit_clear(p->received, idx);
+        } else {
+            r->stats.skipped++;
+        }
+    }
+    if (n > RUDP_MAX_WINDOW) {
+        r->stats.skipped += n - RUDP_MAX_WINDOW;  // Beyond the bitmap, none of these arrived
+    }
+    p->cum = base;
+    while (bit_test(p->received, p->cum % RUDP_MAX_WINDOW)) {
+        bit_clear(p->received, p->cum % RUDP_MAX_WINDOW);
+        p->cum++;
+    }
+}
+
+static int handle_data(rudp_t *r, const struct sockaddr_in *from, const uint8_t *pkt, size_t len) {
+    rudp_peer_t *p = find_or_add_peer(r, from);
+    if (p == NULL) {
+        r->stats.invalid++;  // Peer table full
+        return 0;
+    }
+
+    const uint32_t session = get_u32(pkt + 4);
+    const uint32_t seq = get_u32(pkt + 8);
+    const uint32_t base = get_u32(pkt + 12);
+    if (!p->rx_started || session != p->rx_session) {
+        // First contact or the peer restarted, nothing below its base will come
+        p->rx_started = 1;
+        p->rx_session = session;
+        p->cum = base;
+        memset(p->received, 0, sizeof(p->received));
+    }
+    p->ack_pending = 1;  // Duplicates too, the previous ACK may have been lost
+
+    // Everything below the sender's base was either delivered here or given up
+    // on by the sender. Skip the holes, they will never be sent again
+    const uint32_t skip = base - p->cum;
+    if (skip != 0 && skip < 0x80000000u) {
+        skip_to(r, p, base);
+    }
+
+    const uint32_t d = seq - p->cum;
+    if (d >= 0x80000000u) {
+        r->stats.duplicates++;  // Below cum, delivered before
+        return 0;
+    }
+    if (d >= RUDP_MAX_WINDOW) {
+        r->stats.out_of_window++;
+        return 0;
+    }
+    if (bit_test(p->received, seq % RUDP_MAX_WINDOW)) {
+        r->stats.duplicates++;
+        return 0;
+    }
+
+    bit_set(p->received, seq % RUDP_MAX_WINDOW);
+    while (bit_test(p->received, p->cum % RUDP_MAX_WINDOW)) {
+        bit_clear(p->received, p->cum % RUDP_MAX_WINDOW);
+        p->cum++;
+    }
+
+    r->stats.delivered++;
+    if (r->cfg.on_message != NULL) {
+        r->cfg.on_message(r->cfg.arg, from, pkt + RUDP_HEADER_SIZE, len - RUDP_HEADER_SIZE);
+    }
+    return 1;
+}
+
+static void send_ack(rudp_t *r, rudp_peer_t *p) {
+    uint8_t pkt[RUDP_ACK_SIZE];
+    put_header(pkt, RUDP_ACK, p->rx_session, p->cum, 0);
+
+    // Rotate the ring bitmap so bit i means cum + i
+    uint8_t *sack = pkt + RUDP_HEADER_SIZE;
+    memset(sack, 0, RUDP_MAX_WINDOW / 8);
+    for (uint32_t word = 0; word < RUDP_MAX_WINDOW / 64; word++) {
+        uint64_t bits = p->received[word];
+        while (bits != 0) {
+            const uint32_t idx = word * 64 + __builtin_ctzll(bits);
+            bits &= bits - 1;
+            const uint32_t i = (idx - p->cum) % RUDP_MAX_WINDOW;
+            sack[i / 8] |= 1u << (i % 8);
+        }
+    }
+
+    p->ack_pending = 0;
+    r->stats.acks_sent++;
+    xmit(r, p, pkt, sizeof(pkt));
+}
+
+// Retransmits everything older than the RTO, gives up after max_retransmits
+static void run_timers(rudp_t *r, rudp_peer_t *p, uint64_t now) {
+    int expired = 0;
+    for (uint32_t seq = p->base; seq != p->next; seq++) {
+        rudp_slot_t *slot = &p->slots[seq % RUDP_MAX_WINDOW];
+        if (slot->pkt == NULL || now - slot->last_ns < p->rto_ns) {
+            continue;
+        }
+        if (slot->transmits > r->cfg.max_retransmits) {
+            release_slot(r, slot);
+            r->stats.failed++;
+            continue;
+        }
+        retransmit(r, p, slot, now);
+        expired = 1;
+    }
+    if (expired) {
+        r->stats.timeouts++;
+        p->rto_ns = (p->rto_ns * 2 < r->cfg.max_rto_ns) ? p->rto_ns * 2 : r->cfg.max_rto_ns;
+    }
+    advance_base(p);
+}
+
+int rudp_process(rudp_t *r) {
+    int delivered = 0;
+    if (r->cfg.impair != NULL) {
+        impair_run(r->cfg.impair);
+    }
+    for (int batch = 0; batch < RX_MAX_BATCHES; batch++) {
+        for (int i = 0; i < RUDP_RX_BATCH; i++) {
+            r->rx_msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+        }
+        const int n = recvmmsg(r->sock, r->rx_msgs, RUDP_RX_BATCH, MSG_DONTWAIT, NULL);
+        if (n < 0) {
+            if (errno == EINTR || errno == ECONNREFUSED) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            return -1;
+        }
+
+        for (int i = 0; i < n; i++) {
+            const uint8_t *pkt = r->rx_iovs[i].iov_base;
+            const size_t len = r->rx_msgs[i].msg_len;
+            if (len < RUDP_HEADER_SIZE || get_u16(pkt) != RUDP_MAGIC ||
+                (r->rx_msgs[i].msg_hdr.msg_flags & MSG_TRUNC)) {
+                r->stats.invalid++;
+                continue;
+            }
+            if (pkt[2] == RUDP_DATA) {
+                delivered += handle_data(r, &r->rx_addrs[i], pkt, len);
+            } else if (pkt[2] == RUDP_ACK) {
+                handle_ack(r, &r->rx_addrs[i], pkt, len);
+            } else {
+                r->stats.invalid++;
+            }
+        }
+        if (n < RUDP_RX_BATCH) {
+            break;
+        }
+    }
+
+    // One ACK per peer for everything received in this call
+    const uint64_t now = net_now_ns();
+    for (uint32_t i = 0; i < r->n_peers; i++) {
+        rudp_peer_t *p = &r->peers[i];
+        if (p->ack_pending) {
+            send_ack(r, p);
+        }
+        if (p->base != p->next) {
+            run_timers(r, p, now);
+        }
+    }
+    return delivered;
+}
+
+int rudp_timeout_ms(const rudp_t *r) {
+    const uint64_t now = net_now_ns();
+    uint64_t earliest = UINT64_MAX;
+    for (uint32_t i = 0; i < r->n_peers; i++) {
+        const rudp_peer_t *p = &r->peers[i];
+        for (uint32_t seq = p->base; seq != p->next; seq++) {
+            const rudp_slot_t *slot = &p->slots[seq % RUDP_MAX_WINDOW];
+            if (slot->pkt != NULL && slot->last_ns + p->rto_ns < earliest) {
+                earliest = slot->last_ns + p->rto_ns;
+            }
+        }
+    }
+    if (earliest == UINT64_MAX) {
+        return -1;
+    }
+    if (earliest <= now) {
+        return 0;
+    }
+    return (int)((earliest - now + 999999) / 1000000);  // Round up, waking early just spins
+}
+
+uint32_t rudp_inflight(const rudp_t *r) {
+    return (uint32_t)r->pool.in_use;
+}
+
+const rudp_peer_t *rudp_peer(const rudp_t *r, const struct sockaddr_in *addr) {
+    return find_peer(r, addr);
+}
@@ -0,0 +1,86 @@
+#include <string.h>
+#include <time.h>
+#include <linux/net_tstamp.h>
+
+#include "rx_timestamp/rx_timestamp.h"
+#include "net/net.h"
+
+uint64_t rx_ts_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+int rx_ts_enable(int sock) {
+    // Hardware stamps only show up once the NIC is configured (SIOCSHWTSTAMP,
+    // e.g. through ptp4l or hwstamp_ctl), asking for them is harmless otherwise
+    const int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE |
+                      SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE;
+    if (setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) == 0) {
+        return RX_TS_TIMESTAMPING;
+    }
+    const int on = 1;
+    if (setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) == 0) {
+        return RX_TS_TIMESTAMPNS;
+    }
+    return -1;
+}
+
+int rx_ts_read(struct msghdr *msg, rx_ts_t *ts) {
+    for (struct cmsghdr *cm = CMSG_FIRSTHDR(msg); cm != NULL; cm = CMSG_NXTHDR(msg, cm)) {
+        if (cm->cmsg_level != SOL_SOCKET) {
+            continue;
+        }
+        if (cm->cmsg_type == SCM_TIMESTAMPING) {
+            // ts[0] software, ts[1] unused, ts[2] raw hardware
+            struct scm_timestamping stamps;
+            memcpy(&stamps, CMSG_DATA(cm), sizeof(stamps));
+            ts->hardware = stamps.ts[2].tv_sec != 0 || stamps.ts[2].tv_nsec != 0;
+            ts->kernel_ns = net_timespec_ns(&stamps.ts[ts->hardware ? 2 : 0]);
+            return ts->kernel_ns != 0 ? 0 : -1;
+        }
+        if (cm->cmsg_type == SCM_TIMESTAMPNS) {
+            struct timespec stamp;
+            memcpy(&stamp, CMSG_DATA(cm), sizeof(stamp));
+            ts->hardware = 0;
+            ts->kernel_ns = net_timespec_ns(&stamp);
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static void delay_add(rx_ts_delay_t *d, int64_t ns) {
+    if (d->count == 0 || ns < d->min_ns) d->min_ns = ns;
+    if (d->count == 0 || ns > d->max_ns) d->max_ns = ns;
+    d->sum_ns += ns;
+    d->count++;
+}
+
+static void delay_merge(rx_ts_delay_t *dst, const rx_ts_delay_t *src) {
+    if (src->count == 0) {
+        return;
+    }
+    if (dst->count == 0 || src->min_ns < dst->min_ns) dst->min_ns = src->min_ns;
+    if (dst->count == 0 || src->max_ns > dst->max_ns) dst->max_ns = src->max_ns;
+    dst->sum_ns += src->sum_ns;
+    dst->count += src->count;
+}
+
+void rx_ts_stats_add(rx_ts_stats_t *stats, const rx_ts_t *ts, uint64_t user_ns, uint64_t send_ns) {
+    stats->samples++;
+    stats->hardware += ts->hardware;
+    // Signed, clocks of different hosts (or a NIC clock) can put the stamps in any order
+    delay_add(&stats->sched, (int64_t)(user_ns - ts->kernel_ns));
+    if (send_ns != 0) {
+        delay_add(&stats->net, (int64_t)(ts->kernel_ns - send_ns));
+    }
+}
+
+void rx_ts_stats_merge(rx_ts_stats_t *dst, const rx_ts_stats_t *src) {
+    dst->samples += src->samples;
+    dst->hardware += src->hardware;
+    dst->missing += src->missing;
+    delay_merge(&dst->sched, &src->sched);
+    delay_merge(&dst->net, &src->net);
+}
@@ -0,0 +1,144 @@
+#include <string.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+#include "seq_header/seq_header.h"
+
+uint64_t seq_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static inline void put_u64(uint8_t *p, uint64_t v) {
+    const uint32_t hi = htonl((uint32_t)(v >> 32));
+    const uint32_t lo = htonl((uint32_t)v);
+    memcpy(p, &hi, 4);
+    memcpy(p + 4, &lo, 4);
+}
+
+static inline uint64_t get_u64(const uint8_t *p) {
+    uint32_t hi, lo;
+    memcpy(&hi, p, 4);
+    memcpy(&lo, p + 4, 4);
+    return ((uint64_t)ntohl(hi) << 32) | ntohl(lo);
+}
+
+void seq_header_encode(void *buf, const seq_header_t *hdr) {
+    uint8_t *p = buf;
+    const uint32_t magic = htonl(SEQ_HEADER_MAGIC);
+    const uint32_t id = htonl(hdr->sender_id);
+    memcpy(p, &magic, 4);
+    memcpy(p + 4, &id, 4);
+    put_u64(p + 8, hdr->seq);
+    put_u64(p + 16, hdr->send_ns);
+}
+
+int seq_header_decode(const void *buf, size_t len, seq_header_t *hdr) {
+    const uint8_t *p = buf;
+    if (len < SEQ_HEADER_SIZE) {
+        return -1;
+    }
+
+    uint32_t magic, id;
+    memcpy(&magic, p, 4);
+    if (ntohl(magic) != SEQ_HEADER_MAGIC) {
+        return -1;
+    }
+    memcpy(&id, p + 4, 4);
+    hdr->sender_id = ntohl(id);
+    hdr->seq = get_u64(p + 8);
+    hdr->send_ns = get_u64(p + 16);
+    return 0;
+}
+
+void seq_tracker_init(seq_tracker_t *tracker) {
+    memset(tracker, 0, sizeof(*tracker));
+}
+
+static inline int window_test(const seq_sender_t *s, uint64_t seq) {
+    const uint64_t bit = seq % SEQ_WINDOW_BITS;
+    return (s->window[bit / 64] >> (bit % 64)) & 1;
+}
+
+static inline void window_set(seq_sender_t *s, uint64_t seq) {
+    const uint64_t bit = seq % SEQ_WINDOW_BITS;
+    s->window[bit / 64] |= 1ull << (bit % 64);
+}
+
+static inline void window_clear(seq_sender_t *s, uint64_t seq) {
+    const uint64_t bit = seq % SEQ_WINDOW_BITS;
+    s->window[bit / 64] &= ~(1ull << (bit % 64));
+}
+
+static seq_sender_t *find_sender(seq_tracker_t *tracker, uint32_t sender_id) {
+    for (size_t i = 0; i < tracker->count; i++) {
+        if (tracker->senders[i].sender_id == sender_id) {
+            return &tracker->senders[i];
+        }
+    }
+    return NULL;
+}
+
+static void record_transit(seq_sender_t *s, int64_t transit) {
+    if (s->received == 1) {
+        s->min_transit_ns = s->max_transit_ns = transit;
+    } else {
+        int64_t d = transit - s->last_transit_ns;
+        if (d < 0) d = -d;
+        s->jitter_ns += ((double)d - s->jitter_ns) / 16.0;
+        if (transit < s->min_transit_ns) s->min_transit_ns = transit;
+        if (transit > s->max_transit_ns) s->max_transit_ns = transit;
+    }
+    s->last_transit_ns = transit;
+    s->sum_transit_ns += transit;
+}
+
+seq_sender_t *seq_tracker_record(seq_tracker_t *tracker, const seq_header_t *hdr, uint64_t recv_ns) {
+    seq_sender_t *s = find_sender(tracker, hdr->sender_id);
+    if (s == NULL) {
+        if (tracker->count == SEQ_MAX_SENDERS) {
+            tracker->untracked++;
+            return NULL;
+        }
+        s = &tracker->senders[tracker->count++];
+        memset(s, 0, sizeof(*s));
+        s->sender_id = hdr->sender_id;
+        s->first_seq = s->highest_seq = hdr->seq;
+        window_set(s, hdr->seq);
+        s->received = 1;
+        record_transit(s, (int64_t)(recv_ns - hdr->send_ns));
+        return s;
+    }
+
+    s->received++;
+    record_transit(s, (int64_t)(recv_ns - hdr->send_ns));
+
+    if (hdr->seq > s->highest_seq) {
+        // Slide the window forward, clearing slots of the skipped numbers
+        const uint64_t advance = hdr->seq - s->highest_seq;
+        if (advance >= SEQ_WINDOW_BITS) {
+            memset(s->window, 0, sizeof(s->window));
+        } else {
+            for (uint64_t seq = s->highest_seq + 1; seq < hdr->seq; seq++) {
+                window_clear(s, seq);
+            }
+        }
+        window_set(s, hdr->seq);
+        s->highest_seq = hdr->seq;
+    } else if (s->highest_seq - hdr->seq >= SEQ_WINDOW_BITS || hdr->seq < s->first_seq) {
+        s->late++;
+    } else if (window_test(s, hdr->seq)) {
+        s->duplicates++;
+    } else {
+        window_set(s, hdr->seq);
+        s->reordered++;
+    }
+    return s;
+}
+
+uint64_t seq_sender_lost(const seq_sender_t *sender) {
+    const uint64_t expected = sender->highest_seq - sender->first_seq + 1;
+    const uint64_t unique = sender->received - sender->duplicates - sender->late;
+    return expected > unique ? expected - unique : 0;
+}
@@ -0,0 +1,171 @@
+#include <string.h>
+
+#include "timer_wheel/timer_wheel.h"
+
+#define SLOT_MASK (TIMER_WHEEL_SLOTS - 1)
+#define BITMAP_WORDS (TIMER_WHEEL_SLOTS / 64)
+
+// Ticks covered by one slot of level
+static inline uint64_t slot_span(unsigned level) {
+    return 1ull << (TIMER_WHEEL_SLOT_BITS * level);
+}
+
+static void link_timer(timer_wheel_t *tw, wheel_timer_t *t, unsigned level, unsigned slot) {
+    wheel_timer_t *head = tw->slots[level][slot];
+    t->level = (uint8_t)level;
+    t->slot = (uint8_t)slot;
+    t->prev = NULL;
+    t->next = head;
+    if (head != NULL) head->prev = t;
+    tw->slots[level][slot] = t;
+    tw->occupied[level][slot / 64] |= 1ull << (slot % 64);
+    tw->level_count[level]++;
+}
+
+static void unlink_timer(timer_wheel_t *tw, wheel_timer_t *t) {
+    if (t->prev != NULL) t->prev->next = t->next; else tw->slots[t->level][t->slot] = t->next;
+    if (t->next != NULL) t->next->prev = t->prev;
+    if (tw->slots[t->level][t->slot] == NULL) {
+        tw->occupied[t->level][t->slot / 64] &= ~(1ull << (t->slot % 64));
+    }
+    tw->level_count[t->level]--;
+}
+
+// Coarsest level whose slot still ends before expiry, expire_tick >= now
+static void place_timer(timer_wheel_t *tw, wheel_timer_t *t) {
+    const uint64_t delta = t->expire_tick - tw->now;
+    unsigned level = 0;
+    while (level + 1 < TIMER_WHEEL_LEVELS && delta >= slot_span(level + 1)) {
+        level++;
+    }
+    link_timer(tw, t, level, (unsigned)(t->expire_tick >> (TIMER_WHEEL_SLOT_BITS * level)) & SLOT_MASK);
+}
+
+// First occupied slot at or after start, wrapping around, -1 if none
+static int find_occupied(const uint64_t *bits, unsigned start) {
+    for (unsigned n = 0; n <= BITMAP_WORDS; n++) {
+        const unsigned w = (start / 64 + n) % BITMAP_WORDS;
+        uint64_t word = bits[w];
+        if (n == 0) {
+            word &= ~0ull << (start % 64);
+        } else if (n == BITMAP_WORDS) {
+            word &= (1ull << (start % 64)) - 1;  // Back in the first word, the part before start
+        }
+        if (word) {
+            return (int)(w * 64 + (unsigned)__builtin_ctzll(word));
+        }
+    }
+    return -1;
+}
+
+// Next tick with anything to do: a level 0 slot or, while coarser levels hold
+// timers, the next level 1 boundary where a cascade may be due
+static uint64_t next_tick(const timer_wheel_t *tw) {
+    uint64_t next = UINT64_MAX;
+    if (tw->level_count[0] > 0) {
+        const unsigned start = (unsigned)(tw->now + 1) & SLOT_MASK;
+        const int slot = find_occupied(tw->occupied[0], start);
+        next = tw->now + 1 + (((unsigned)slot - start) & SLOT_MASK);
+    }
+    if (tw->count > tw->level_count[0]) {
+        const uint64_t boundary = (tw->now | SLOT_MASK) + 1;
+        if (boundary < next) next = boundary;
+    }
+    return next;
+}
+
+static void cascade(timer_wheel_t *tw, unsigned level, unsigned slot) {
+    wheel_timer_t *t;
+    while ((t = tw->slots[level][slot]) != NULL) {
+        unlink_timer(tw, t);
+        place_timer(tw, t);
+        tw->stats.cascaded++;
+    }
+}
+
+void timer_wheel_init(timer_wheel_t *tw, uint64_t tick_ns, uint64_t now_ns) {
+    memset(tw, 0, sizeof(*tw));
+    tw->tick_ns = tick_ns > 0 ? tick_ns : 1;
+    tw->now = now_ns / tw->tick_ns;
+}
+
+void timer_wheel_timer_init(wheel_timer_t *t, wheel_timer_fn fn, void *arg) {
+    memset(t, 0, sizeof(*t));
+    t->fn = fn;
+    t->arg = arg;
+}
+
+void timer_wheel_schedule(timer_wheel_t *tw, wheel_timer_t *t, uint64_t expire_ns) {
+    if (t->armed) {
+        unlink_timer(tw, t);
+        tw->count--;
+        tw->stats.cancelled++;
+    }
+
+    // Rounded up so a timer never fires before its time
+    uint64_t tick = expire_ns / tw->tick_ns + (expire_ns % tw->tick_ns != 0);
+    if (tick <= tw->now) {
+        tick = tw->now + 1;
+    } else if (tick - tw->now > TIMER_WHEEL_MAX_TICKS) {
+        tick = tw->now + TIMER_WHEEL_MAX_TICKS;
+    }
+    t->expire_ns = expire_ns;
+    t->expire_tick = tick;
+    t->armed = 1;
+    place_timer(tw, t);
+    tw->count++;
+    tw->stats.scheduled++;
+}
+
+void timer_wheel_cancel(timer_wheel_t *tw, wheel_timer_t *t) {
+    if (!t->armed) {
+        return;
+    }
+    unlink_timer(tw, t);
+    t->armed = 0;
+    tw->count--;
+    tw->stats.cancelled++;
+}
+
+uint32_t timer_wheel_advance(timer_wheel_t *tw, uint64_t now_ns) {
+    const uint64_t target = now_ns / tw->tick_ns;
+    uint32_t fired = 0;
+
+    while (tw->now < target) {
+        const uint64_t next = tw->count > 0 ? next_tick(tw) : UINT64_MAX;
+        if (next > target) {
+            tw->now = target;  // Nothing due in between
+            break;
+        }
+        tw->now = next;
+
+        // Coarse levels first, what they hand down may be due in a finer slot this very tick
+        unsigned top = 0;
+        while (top + 1 < TIMER_WHEEL_LEVELS && (next & (slot_span(top + 1) - 1)) == 0) {
+            top++;
+        }
+        for (unsigned level = top; level >= 1; level--) {
+            cascade(tw, level, (unsigned)(next >> (TIMER_WHEEL_SLOT_BITS * level)) & SLOT_MASK);
+        }
+
+        // Popped one at a time, a callback may cancel others in the same slot
+        const unsigned slot = (unsigned)next & SLOT_MASK;
+        wheel_timer_t *t;
+        while ((t = tw->slots[0][slot]) != NULL) {
+            unlink_timer(tw, t);
+            t->armed = 0;
+            tw->count--;
+            tw->stats.fired++;
+            fired++;
+            t->fn(t, t->arg);
+        }
+    }
+    return fired;
+}
+
+uint64_t timer_wheel_next_ns(const timer_wheel_t *tw) {
+    if (tw->count == 0) {
+        return UINT64_MAX;
+    }
+    return next_tick(tw) * tw->tick_ns;
+}
@@ -0,0 +1,556 @@
+// Size and speed of the elevator state encodings
+//
+// Simulates a world state changing one event at a time (button presses,
+// moves, doors), then encodes and decodes the whole trace with the binary
+// codec, full and as deltas against the state acknowledged -A steps earlier,
+// and with a line of text and hall_request_assigner style JSON for comparison.
+// Every decoded state is checked against the original.
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <time.h>
+
+#define LOG_LEVEL LOG_LEVEL_DEBUG
+#include "log_helper/log_helper.h"
+#include "elev_state/elev_state.h"
+#include "net/net.h"
+
+#define DEFAULT_FLOORS 4
+#define DEFAULT_ELEVATORS 3
+#define DEFAULT_TRACE_LEN 10000
+#define DEFAULT_REPEATS 50
+#define DEFAULT_ACK_LAG 1
+#define MAX_ACK_LAG 1000
+#define TEXT_MAX_SIZE 8192
+
+static const char *TAG = "elev_state_bench";
+
+static volatile uint64_t sink;  // Keeps the decode loop from being optimized out
+
+typedef struct {
+    const char *name;
+    size_t max_size;
+    int (*encode)(const elev_state_t *state, const elev_state_t *base, void *buf, size_t len);
+    int (*decode)(const void *buf, size_t len, const elev_state_t *base, elev_state_t *out);
+} codec_t;
+
+static inline int parse_count(const char *str, long min, long max);
+
+static int encode_full(const elev_state_t *state, const elev_state_t *base, void *buf, size_t len);
+static int encode_delta(const elev_state_t *state, const elev_state_t *base, void *buf, size_t len);
+static int encode_text(const elev_state_t *state, const elev_state_t *base, void *buf, size_t len);
+static int decode_text(const void *buf, size_t len, const elev_state_t *base, elev_state_t *out);
+static int encode_json(const elev_state_t *state, const elev_state_t *base, void *buf, size_t len);
+static int decode_json(const void *buf, size_t len, const elev_state_t *base, elev_state_t *out);
+static void make_trace(elev_state_t *trace, int len, int floors, int elevators, unsigned seed);
+static int run_codec(const codec_t *codec, const elev_state_t *trace, int len, int lag, int repeats, double *avg_size);
+
+static const codec_t codecs[] = {
+    { "binary",       ELEV_STATE_MAX_SIZE, encode_full,  elev_state_decode },
+    { "binary delta", ELEV_STATE_MAX_SIZE, encode_delta, elev_state_decode },
+    { "text",         TEXT_MAX_SIZE,       encode_text,  decode_text },
+    { "json",         TEXT_MAX_SIZE,       encode_json,  decode_json },
+};
+#define N_CODECS (sizeof(codecs) / sizeof(codecs[0]))
+
+#define CHECK(result, tag, fmt, ...) \
+    do { if ((result) < 0) { \
+        LOGE(tag, fmt, ##__VA_ARGS__); \
+        return EXIT_FAILURE; \
+    } } while(0)
+
+#define HELP_MSG() \
+    LOGI(TAG, "[-h (this message)] [-f <floors 1-%d> (%d by default)] [-e <elevators 0-%d> (%d by default)] "\
+         "[-n <states in the trace> (%d by default)] [-r <repeats> (%d by default)] "\
+         "[-A <ack_lag 1-%d> (deltas against the state this many changes back, %d by default)] [-S <seed>]\n", \
+         ELEV_STATE_MAX_FLOORS, DEFAULT_FLOORS, ELEV_STATE_MAX_ELEVATORS, DEFAULT_ELEVATORS, \
+         DEFAULT_TRACE_LEN, DEFAULT_REPEATS, MAX_ACK_LAG, DEFAULT_ACK_LAG)
+
+
+int main(int argc, char **argv) {
+    int floors    = DEFAULT_FLOORS;
+    int elevators = DEFAULT_ELEVATORS;
+    int trace_len = DEFAULT_TRACE_LEN;
+    int repeats   = DEFAULT_REPEATS;
+    int lag       = DEFAULT_ACK_LAG;
+    int seed      = 1;
+    int  opt;
+    while ((opt = getopt(argc, argv, "f:e:n:r:A:S:h")) != -1) {
+        switch (opt) {
+            case 'f':
+                floors = parse_count(optarg, 1, ELEV_STATE_MAX_FLOORS);
+                CHECK(floors, TAG, "Invalid floor count: %s (must be between 1-%d)", optarg, ELEV_STATE_MAX_FLOORS);
+                break;
+            case 'e':
+                elevators = parse_count(optarg, 0, ELEV_STATE_MAX_ELEVATORS);
+                CHECK(elevators, TAG, "Invalid elevator count: %s (must be between 0-%d)", optarg, ELEV_STATE_MAX_ELEVATORS);
+                break;
+            case 'n':
+                trace_len = parse_count(optarg, 1, 10000000);
+                CHECK(trace_len, TAG, "Invalid trace length: %s (must be between 1-10000000)", optarg);
+                break;
+            case 'r':
+                repeats = parse_count(optarg, 1, 1000000);
+                CHECK(repeats, TAG, "Invalid repeats: %s (must be between 1-1000000)", optarg);
+                break;
+            case 'A':
+                lag = parse_count(optarg, 1, MAX_ACK_LAG);
+                CHECK(lag, TAG, "Invalid ack lag: %s (must be between 1-%d)", optarg, MAX_ACK_LAG);
+                break;
+            case 'S':
+                seed = parse_count(optarg, 0, INT_MAX);
+                CHECK(seed, TAG, "Invalid seed: %s (must be between 0-%d)", optarg, INT_MAX);
+                break;
+            case 'h':
+                HELP_MSG();
+                return EXIT_SUCCESS;
+            default:
+                HELP_MSG();
+                return EXIT_FAILURE;
+        }
+    }
+
+    elev_state_t *trace = malloc((size_t)trace_len * sizeof(*trace));
+    if (trace == NULL) {
+        LOGE(TAG, "Failed to allocate a trace of %d states", trace_len);
+        return EXIT_FAILURE;
+    }
+    make_trace(trace, trace_len, floors, elevators, (unsigned)seed);
+    LOGI(TAG, "%d floors, %d elevators, %d states x %d repeats, deltas against the state %d change%s back",
+         floors, elevators, trace_len, repeats, lag, lag == 1 ? "" : "s");
+
+    double sizes[N_CODECS];
+    for (size_t c = 0; c < N_CODECS; c++) {
+        if (run_codec(&codecs[c], trace, trace_len, lag, repeats, &sizes[c]) < 0) {
+            free(trace);
+            return EXIT_FAILURE;
+        }
+    }
+    LOGI(TAG, "binary is %.1fx smaller than json, binary delta %.1fx",
+         sizes[3] / sizes[0], sizes[3] / sizes[1]);
+
+    free(trace);
+    return EXIT_SUCCESS;
+}
+
+static inline int parse_count(const char *str, long min, long max) {
+    long count;
+    return net_parse_long(str, min, max, &count) == 0 ? (int)count : -1;
+}
+
+// =============================================================================
+// State trace
+// =============================================================================
+
+// One random event per state: a hall or cab button, an elevator starting,
+// moving a floor, or arriving and serving the requests there
+static void step(elev_state_t *s, unsigned *rng) {
+    const int floor = rand_r(rng) % s->n_floors;
+    const int event = rand_r(rng) % 4;
+    s->seq++;
+
+    if (s->n_elevators == 0 || event == 0) {
+        if (floor < s->n_floors - 1 && (floor == 0 || rand_r(rng) % 2)) {
+            s->hall_up |= 1u << floor;
+        } else {
+            s->hall_down |= 1u << floor;
+        }
+        return;
+    }
+
+    elev_state_elevator_t *e = &s->elevators[rand_r(rng) % s->n_elevators];
+    switch (event) {
+    case 1:
+        e->cab_requests |= 1u << floor;
+        break;
+    case 2:
+        if (e->behaviour != ELEV_MOVING) {
+            e->behaviour = ELEV_MOVING;
+            e->direction = e->floor == 0 ? ELEV_DIR_UP :
+                           e->floor == s->n_floors - 1 ? ELEV_DIR_DOWN :
+                           (rand_r(rng) % 2 ? ELEV_DIR_UP : ELEV_DIR_DOWN);
+        } else if (e->direction == ELEV_DIR_UP && e->floor < s->n_floors - 1) {
+            e->floor++;
+        } else if (e->direction == ELEV_DIR_DOWN && e->floor > 0) {
+            e->floor--;
+        }
+        break;
+    case 3:
+        e->behaviour = e->behaviour == ELEV_DOOR_OPEN ? ELEV_IDLE : ELEV_DOOR_OPEN;
+        if (e->behaviour == ELEV_IDLE) {
+            e->direction = ELEV_DIR_STOP;
+        }
+        e->cab_requests &= ~(1u << e->floor);
+        s->hall_up &= ~(1u << e->floor);
+        s->hall_down &= ~(1u << e->floor);
+        break;
+    }
+}
+
+static void make_trace(elev_state_t *trace, int len, int floors, int elevators, unsigned seed) {
+    elev_state_t s;
+    memset(&s, 0, sizeof(s));
+    s.n_floors = (uint8_t)floors;
+    s.n_elevators = (uint8_t)elevators;
+    for (int i = 0; i < elevators; i++) {
+        s.elevators[i].id = (uint32_t)i + 1;
+    }
+    for (int i = 0; i < len; i++) {
+        step(&s, &seed);
+        trace[i] = s;
+    }
+}
+
+// =============================================================================
+// Codecs
+// =============================================================================
+
+static int encode_full(const elev_state_t *state, const elev_state_t *base, void *buf, size_t len) {
+    (void)base;
+    return elev_state_encode(state, buf, len);
+}
+
+static int encode_delta(const elev_state_t *state, const elev_state_t *base, void *buf, size_t len) {
+    return elev_state_encode_delta(state, base, buf, len);
+}
+
+static const char *dir_names[] = { "stop", "up", "down" };
+static const char *behaviour_names[] = { "idle", "moving", "doorOpen" };
+
+static int name_index(const char *const *names, int count, const char *str, size_t len) {
+    for (int i = 0; i < count; i++) {
+        if (strlen(names[i]) == len && memcmp(names[i], str, len) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// seq=12 floors=4 up=0100 down=0010 e=1:2:up:moving:0100 e=2:...
+static int encode_text(const elev_state_t *state, const elev_state_t *base, void *buf, size_t len) {
+    (void)base;
+    char *p = buf;
+    char *end = p + len;
+    char up[ELEV_STATE_MAX_FLOORS + 1], down[ELEV_STATE_MAX_FLOORS + 1];
+    for (int f = 0; f < state->n_floors; f++) {
+        up[f] = (state->hall_up >> f) & 1 ? '1' : '0';
+        down[f] = (state->hall_down >> f) & 1 ? '1' : '0';
+    }
+    up[state->n_floors] = down[state->n_floors] = '\0';
+    p += snprintf(p, (size_t)(end - p), "seq=%u floors=%u up=%s down=%s",
+                  state->seq, state->n_floors, up, down);
+
+    for (int i = 0; i < state->n_elevators && p < end; i++) {
+        const elev_state_elevator_t *e = &state->elevators[i];
+        char cab[ELEV_STATE_MAX_FLOORS + 1];
+        for (int f = 0; f < state->n_floors; f++) {
+            cab[f] = (e->cab_requests >> f) & 1 ? '1' : '0';
+        }
+        cab[state->n_floors] = '\0';
+        p += snprintf(p, (size_t)(end - p), " e=%u:%u:%s:%s:%s", e->id, e->floor,
+                      dir_names[e->direction], behaviour_names[e->behaviour], cab);
+    }
+    return p < end ? (int)(p - (char *)buf) : -1;
+}
+
+static int parse_bits(const char *str, size_t len, int n_floors, uint32_t *mask) {
+    if ((int)len != n_floors) {
+        return -1;
+    }
+    *mask = 0;
+    for (int f = 0; f < n_floors; f++) {
+        if (str[f] != '0' && str[f] != '1') {
+            return -1;
+        }
+        *mask |= (uint32_t)(str[f] == '1') << f;
+    }
+    return 0;
+}
+
+static int decode_text(const void *buf, size_t len, const elev_state_t *base, elev_state_t *out) {
+    (void)base;
+    const char *p = buf;
+    const char *end = p + len;
+    elev_state_t s;
+    memset(&s, 0, sizeof(s));
+    int floors = -1;
+
+    while (p < end) {
+        const char *word_end = memchr(p, ' ', (size_t)(end - p));
+        if (word_end == NULL) {
+            word_end = end;
+        }
+        const char *eq = memchr(p, '=', (size_t)(word_end - p));
+        if (eq == NULL) {
+            return -1;
+        }
+        const size_t key_len = (size_t)(eq - p);
+        const char *val = eq + 1;
+        const size_t val_len = (size_t)(word_end - val);
+
+        if (key_len == 3 && memcmp(p, "seq", 3) == 0) {
+            s.seq = (uint32_t)strtoul(val, NULL, 10);
+        } else if (key_len == 6 && memcmp(p, "floors", 6) == 0) {
+            floors = (int)strtol(val, NULL, 10);
+            if (floors < 1 || floors > ELEV_STATE_MAX_FLOORS) {
+                return -1;
+            }
+            s.n_floors = (uint8_t)floors;
+        } else if (key_len == 2 && memcmp(p, "up", 2) == 0) {
+            if (parse_bits(val, val_len, floors, &s.hall_up) < 0) return -1;
+        } else if (key_len == 4 && memcmp(p, "down", 4) == 0) {
+            if (parse_bits(val, val_len, floors, &s.hall_down) < 0) return -1;
+        } else if (key_len == 1 && p[0] == 'e' && s.n_elevators < ELEV_STATE_MAX_ELEVATORS) {
+            elev_state_elevator_t *e = &s.elevators[s.n_elevators++];
+            const char *fields[5];
+            size_t lens[5];
+            const char *q = val;
+            for (int i = 0; i < 5; i++) {
+                const char *colon = i < 4 ? memchr(q, ':', (size_t)(word_end - q)) : word_end;
+                if (colon == NULL) {
+                    return -1;
+                }
+                fields[i] = q;
+                lens[i] = (size_t)(colon - q);
+                q = colon + 1;
+            }
+            const int dir = name_index(dir_names, 3, fields[2], lens[2]);
+            const int behaviour = name_index(behaviour_names, 3, fields[3], lens[3]);
+            if (dir < 0 || behaviour < 0 || parse_bits(fields[4], lens[4], floors, &e->cab_requests) < 0) {
+                return -1;
+            }
+            e->id = (uint32_t)strtoul(fields[0], NULL, 10);
+            e->floor = (uint8_t)strtoul(fields[1], NULL, 10);
+            e->direction = (uint8_t)dir;
+            e->behaviour = (uint8_t)behaviour;
+        } else {
+            return -1;
+        }
+        p = word_end + 1;
+    }
+    if (floors < 0) {
+        return -1;
+    }
+    *out = s;
+    return 0;
+}
+
+// The input format of the course's hall_request_assigner, plus seq
+// {"seq":12,"hallRequests":[[false,true],...],"states":{"1":{"behaviour":"moving","floor":2,"direction":"up","cabRequests":[false,...]},...}}
+static int encode_json(const elev_state_t *state, const elev_state_t *base, void *buf, size_t len) {
+    (void)base;
+    char *p = buf;
+    char *end = p + len;
+#define EMIT(...) do { p += snprintf(p, (size_t)(end - p), __VA_ARGS__); if (p >= end) return -1; } while (0)
+    EMIT("{\"seq\":%u,\"hallRequests\":[", state->seq);
+    for (int f = 0; f < state->n_floors; f++) {
+        EMIT("%s[%s,%s]", f ? "," : "",
+             (state->hall_up >> f) & 1 ? "true" : "false", (state->hall_down >> f) & 1 ? "true" : "false");
+    }
+    EMIT("],\"states\":{");
+    for (int i = 0; i < state->n_elevators; i++) {
+        const elev_state_elevator_t *e = &state->elevators[i];
+        EMIT("%s\"%u\":{\"behaviour\":\"%s\",\"floor\":%u,\"direction\":\"%s\",\"cabRequests\":[",
+             i ? "," : "", e->id, behaviour_names[e->behaviour], e->floor, dir_names[e->direction]);
+        for (int f = 0; f < state->n_floors; f++) {
+            EMIT("%s%s", f ? "," : "", (e->cab_requests >> f) & 1 ? "true" : "false");
+        }
+        EMIT("]}");
+    }
+    EMIT("}}");
+#undef EMIT
+    return (int)(p - (char *)buf);
+}
+
+// Naive recursive-descent reader for exactly the layout above, whitespace allowed
+typedef struct {
+    const char *p;
+    const char *end;
+    int error;
+} json_reader_t;
+
+static void json_ws(json_reader_t *j) {
+    while (j->p < j->end && (*j->p == ' ' || *j->p == '\n' || *j->p == '\t' || *j->p == '\r')) j->p++;
+}
+
+static int json_peek(json_reader_t *j, char c) {
+    json_ws(j);
+    return j->p < j->end && *j->p == c;
+}
+
+static void json_expect(json_reader_t *j, const char *lit) {
+    json_ws(j);
+    const size_t n = strlen(lit);
+    if ((size_t)(j->end - j->p) < n || memcmp(j->p, lit, n) != 0) {
+        j->error = 1;
+        return;
+    }
+    j->p += n;
+}
+
+static int json_bool(json_reader_t *j) {
+    if (json_peek(j, 't')) {
+        json_expect(j, "true");
+        return 1;
+    }
+    json_expect(j, "false");
+    return 0;
+}
+
+static uint32_t json_uint(json_reader_t *j) {
+    json_ws(j);
+    uint32_t v = 0;
+    const char *start = j->p;
+    while (j->p < j->end && *j->p >= '0' && *j->p <= '9') {
+        v = v * 10 + (uint32_t)(*j->p++ - '0');
+    }
+    if (j->p == start) j->error = 1;
+    return v;
+}
+
+// Points str at the contents of a string without escapes
+static size_t json_string(json_reader_t *j, const char **str) {
+    json_expect(j, "\"");
+    *str = j->p;
+    while (j->p < j->end && *j->p != '"') j->p++;
+    const size_t len = (size_t)(j->p - *str);
+    json_expect(j, "\"");
+    return len;
+}
+
+static int decode_json(const void *buf, size_t len, const elev_state_t *base, elev_state_t *out) {
+    (void)base;
+    json_reader_t j = { .p = buf, .end = (const char *)buf + len };
+    elev_state_t s;
+    memset(&s, 0, sizeof(s));
+
+    json_expect(&j, "{\"seq\":");
+    s.seq = json_uint(&j);
+    json_expect(&j, ",\"hallRequests\":[");
+    int floors = 0;
+    while (!j.error && !json_peek(&j, ']') && floors < ELEV_STATE_MAX_FLOORS) {
+        if (floors) json_expect(&j, ",");
+        json_expect(&j, "[");
+        s.hall_up |= (uint32_t)json_bool(&j) << floors;
+        json_expect(&j, ",");
+        s.hall_down |= (uint32_t)json_bool(&j) << floors;
+        json_expect(&j, "]");
+        floors++;
+    }
+    s.n_floors = (uint8_t)floors;
+    json_expect(&j, "]");
+    json_expect(&j, ",\"states\":{");
+
+    while (!j.error && !json_peek(&j, '}') && s.n_elevators < ELEV_STATE_MAX_ELEVATORS) {
+        elev_state_elevator_t *e = &s.elevators[s.n_elevators];
+        if (s.n_elevators++) json_expect(&j, ",");
+        const char *str;
+        json_string(&j, &str);
+        e->id = (uint32_t)strtoul(str, NULL, 10);
+        json_expect(&j, ":{\"behaviour\":");
+        size_t n = json_string(&j, &str);
+        const int behaviour = name_index(behaviour_names, 3, str, n);
+        json_expect(&j, ",\"floor\":");
+        e->floor = (uint8_t)json_uint(&j);
+        json_expect(&j, ",\"direction\":");
+        n = json_string(&j, &str);
+        const int dir = name_index(dir_names, 3, str, n);
+        if (dir < 0 || behaviour < 0) {
+            return -1;
+        }
+        e->direction = (uint8_t)dir;
+        e->behaviour = (uint8_t)behaviour;
+        json_expect(&j, ",\"cabRequests\":[");
+        for (int f = 0; f < floors && !j.error; f++) {
+            if (f) json_expect(&j, ",");
+            e->cab_requests |= (uint32_t)json_bool(&j) << f;
+        }
+        json_expect(&j, "]}");
+    }
+    json_expect(&j, "}}");
+    if (j.error || floors == 0) {
+        return -1;
+    }
+    *out = s;
+    return 0;
+}
+
+// =============================================================================
+// Measurement
+// =============================================================================
+
+static int run_codec(const codec_t *codec, const elev_state_t *trace, int len, int lag, int repeats, double *avg_size) {
+    uint8_t *bufs = malloc((size_t)len * codec->max_size);
+    int *lens = malloc((size_t)len * sizeof(int));
+    if (bufs == NULL || lens == NULL) {
+        LOGE(TAG, "Failed to allocate encode buffers for %s", codec->name);
+        free(bufs);
+        free(lens);
+        return -1;
+    }
+
+    // State i goes out as a delta against i - lag, the first ones in full
+    uint64_t total_bytes = 0;
+    int max_len = 0;
+    const uint64_t enc_start = net_now_ns();
+    for (int r = 0; r < repeats; r++) {
+        for (int i = 0; i < len; i++) {
+            const elev_state_t *base = i >= lag ? &trace[i - lag] : NULL;
+            lens[i] = codec->encode(&trace[i], base, bufs + (size_t)i * codec->max_size, codec->max_size);
+        }
+    }
+    const uint64_t enc_ns = net_now_ns() - enc_start;
+
+    for (int i = 0; i < len; i++) {
+        if (lens[i] < 0) {
+            LOGE(TAG, "[%s] Failed to encode state %d", codec->name, i);
+            free(bufs);
+            free(lens);
+            return -1;
+        }
+        total_bytes += (uint64_t)lens[i];
+        if (lens[i] > max_len) max_len = lens[i];
+    }
+
+    elev_state_t decoded;
+    uint64_t checksum = 0;
+    const uint64_t dec_start = net_now_ns();
+    for (int r = 0; r < repeats; r++) {
+        for (int i = 0; i < len; i++) {
+            const elev_state_t *base = i >= lag ? &trace[i - lag] : NULL;
+            codec->decode(bufs + (size_t)i * codec->max_size, (size_t)lens[i], base, &decoded);
+            checksum += decoded.seq;
+        }
+    }
+    const uint64_t dec_ns = net_now_ns() - dec_start;
+    sink = checksum;
+
+    int mismatches = 0;
+    for (int i = 0; i < len; i++) {
+        const elev_state_t *base = i >= lag ? &trace[i - lag] : NULL;
+        memset(&decoded, 0, sizeof(decoded));
+        if (codec->decode(bufs + (size_t)i * codec->max_size, (size_t)lens[i], base, &decoded) != 0 ||
+            !elev_state_equal(&decoded, &trace[i])) {
+            mismatches++;
+        }
+    }
+    free(bufs);
+    free(lens);
+
+    if (mismatches) {
+        LOGE(TAG, "[%s] %d of %d states did not decode to the original", codec->name, mismatches, len);
+        return -1;
+    }
+
+    const double ops = (double)len * repeats;
+    *avg_size = (double)total_bytes / len;
+    LOGI(TAG, "[%-12s] %7.1f bytes avg, %4d max, encode %7.1f ns, decode %7.1f ns",
+         codec->name, *avg_size, max_len, (double)enc_ns / ops, (double)dec_ns / ops);
+    return 0;
+}
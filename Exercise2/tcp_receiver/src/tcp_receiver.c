@@ -1,20 +1,38 @@
 #include <netinet/in.h>
 #include <stdlib.h>
+#include <string.h>
 #include <limits.h>
 #include <errno.h>
 #include <unistd.h>
+#include <time.h>
+#include <pthread.h>
 #include <sys/socket.h>
+#include <sys/epoll.h>
 #include <arpa/inet.h>
 #include <signal.h>
 
 #define LOG_LEVEL LOG_LEVEL_DEBUG
 #include "log_helper/log_helper.h"
+#include "framing/framing.h"
+#include "uring/uring.h"
+#include "rx_timestamp/rx_timestamp.h"
+#include "peer_stats/peer_stats.h"
+#include "net/net.h"
 
 #define PROTO_TAG "[TCP] "
 
 #define DEFAULT_PORT 8080
 #define DEFAULT_BUFFER_SIZE 1024
-#define DEFAULT_BACKLOG 5
+#define DEFAULT_BACKLOG 1024
+#define DEFAULT_MAX_CONNECTIONS 4096
+#define MAX_THREADS 64
+#define MAX_EVENTS 256
+#define EPOLL_TIMEOUT_MS 100 // Signals interrupt only one thread, so every loop polls the running flag
+#define URING_ENTRIES 256
+#define URING_BUF_ENTRIES 4096 // Provided receive buffers shared by all connections of a worker
+#define REPORT_INTERVAL_NS 1000000000ull
+#define MAX_PEERS 4096         // Stats mode, per worker, connections beyond this are summed as "other"
+#define DASHBOARD_PEERS 20     // Busiest connections shown per report
 
 #define REM_TRAIL // optional macro to remove trailing newline
 
@@ -22,14 +40,74 @@ static const char *TAG = "tcp_receiver";
 
 static volatile sig_atomic_t running = 1;
 
-static void signal_handler(int sig) {
-    (void)sig;
-    running = 0;
-}
-
-static inline int parse_port(const char *str);
-static inline int parse_size(const char *str);
-static inline int parse_repetitions(const char *str);
+typedef struct {
+    int port;
+    int buffer_size;
+    int max_connections;
+    int threads;
+    int echo;
+    int uring;
+    int timestamps;
+    int stats;
+    framing_type_t framing;
+} server_config_t;
+
+// Per-connection state, owned by the worker whose epoll it is registered in
+typedef struct conn {
+    int fd;
+    struct sockaddr_in addr;
+    frame_decoder_t dec;  // Message mode: reassembles frames across recv calls
+    char *buf;            // Echo mode: buffer_size bytes, also holds unsent echo data
+    size_t out_off;       // Pending echo bytes are buf[out_off, out_off + out_len)
+    size_t out_len;
+    int inflight;         // io_uring: recv/send operations still referencing this conn
+    int echo_head;        // io_uring: buffer ids queued for echo, head is being sent, -1 if empty
+    int echo_tail;
+    peer_stats_entry_t *stats;  // Stats mode: counters of this connection, outlive it
+    struct conn *prev, *next;
+} conn_t;
+
+// io_uring worker state. Echo queues are linked through buffer ids so
+// sends on one connection stay ordered without extra allocation
+typedef struct {
+    uring_t ring;
+    uring_buf_ring_t bufs;
+    uint16_t next_bid[URING_BUF_ENTRIES];
+    uint32_t bid_len[URING_BUF_ENTRIES];
+} uring_ctx_t;
+
+// user_data: conn pointer (8-byte aligned) with the op in the low bits and a
+// buffer id in the top 16 bits, user space addresses fit in the low 48
+#define UD_ACCEPT 1
+#define UD_RECV   2
+#define UD_SEND   3
+#define UD_OP_MASK 7ull
+#define UD_PTR_MASK ((1ull << 48) - 1 - UD_OP_MASK)
+
+typedef struct {
+    int id;
+    int listen_fd;
+    int epfd;
+    const server_config_t *cfg;
+    conn_t *conns;
+    pthread_t thread;
+    int result;
+    rx_ts_stats_t rx_ts;  // Kernel receive timestamps, merged after the workers stop
+    peer_stats_t peers;   // Stats mode: per connection counters, each worker reports its own
+} worker_t;
+
+// Shared between workers, updated atomically
+static int connection_count = 0;
+static int remaining_messages = -1; // -1 = infinite
+
+static inline int parse_count(const char *str, int max);
+
+static void raise_fd_limit(int max_connections);
+static void *worker_run(void *arg);
+static void *worker_run_uring(void *arg);
+static void report_rx_ts(const worker_t *workers, int n_workers);
+static void report_peers(worker_t *w, uint64_t now);
+static void report_peer_totals(const worker_t *workers, int n_workers);
 
 #define CHECK(result, tag, fmt, ...) \
     do { if ((result) < 0) { \
@@ -38,28 +116,67 @@ static inline int parse_repetitions(const char *str);
     } } while(0)
 
 #define HELP_MSG() \
-    LOGI(TAG, "[-h (this message)] [-p <port 1-65535>] [-s <buffer_size>] [-r <repetitions -1-%d> (infinite by default)] \n", INT_MAX)
+    LOGI(TAG, "[-h (this message)] [-p <port 1-65535>] [-s <buffer_size>] [-r <repetitions -1-%d> (infinite by default)] [-e (echo data back to client, for ping mode)] "\
+         "[-c <max_connections 1-%d> (%d by default)] [-t <threads 1-%d> (SO_REUSEPORT listener per thread when > 1)] "\
+         "[-f <none|len|fixed|nul> (message framing, none by default)] [-u (io_uring multishot accept/recv, falls back to epoll)] "\
+         "[-k (kernel receive timestamps, report kernel->user delay)] [-S (stats: per-connection dashboard every second instead of per-message output)] \n", \
+         INT_MAX, INT_MAX, DEFAULT_MAX_CONNECTIONS, MAX_THREADS)
 
 
 int main(int argc, char **argv) {
-    int buffer_size = DEFAULT_BUFFER_SIZE;
-    int my_port = DEFAULT_PORT;
+    server_config_t cfg = {
+        .port = DEFAULT_PORT,
+        .buffer_size = DEFAULT_BUFFER_SIZE,
+        .max_connections = DEFAULT_MAX_CONNECTIONS,
+        .threads = 1,
+        .echo = 0,
+        .uring = 0,
+        .timestamps = 0,
+        .stats = 0,
+        .framing = FRAMING_NONE,
+    };
     int repetitions = -1; //infinite by default
     int opt;
-    while ((opt = getopt(argc, argv, "p:s:r:h")) != -1) {
+    while ((opt = getopt(argc, argv, "p:s:r:ec:t:f:ukSh")) != -1) {
         switch (opt) {
             case 'p':
-                my_port = parse_port(optarg);
-                CHECK(my_port, TAG, "Invalid port: %s (must be between 1-65535)", optarg);
+                cfg.port = net_parse_port(optarg);
+                CHECK(cfg.port, TAG, "Invalid port: %s (must be between 1-65535)", optarg);
                 break;
             case 's':
-                buffer_size = parse_size(optarg);
-                CHECK(buffer_size, TAG, "Invalid size: %s (must be between 1-65507)", optarg);
+                cfg.buffer_size = net_parse_size(optarg, 1);
+                CHECK(cfg.buffer_size, TAG, "Invalid size: %s (must be between 1-%d)", optarg, NET_MAX_UDP_PAYLOAD);
                 break;
             case 'r':
-                repetitions = parse_repetitions(optarg);
+                repetitions = net_parse_repetitions(optarg);
                 if (repetitions != -1) CHECK(repetitions, TAG, "Invalid repetition: %s (must be between -1-%d)", optarg, INT_MAX);
                 break;
+            case 'e':
+                cfg.echo = 1;
+                break;
+            case 'u':
+                cfg.uring = 1;
+                break;
+            case 'k':
+                cfg.timestamps = 1;
+                break;
+            case 'S':
+                cfg.stats = 1;
+                break;
+            case 'c':
+                cfg.max_connections = parse_count(optarg, INT_MAX);
+                CHECK(cfg.max_connections, TAG, "Invalid connection limit: %s (must be between 1-%d)", optarg, INT_MAX);
+                break;
+            case 't':
+                cfg.threads = parse_count(optarg, MAX_THREADS);
+                CHECK(cfg.threads, TAG, "Invalid thread count: %s (must be between 1-%d)", optarg, MAX_THREADS);
+                break;
+            case 'f': {
+                const int framing = framing_parse(optarg);
+                CHECK(framing, TAG, "Invalid framing: %s (must be none, len, fixed or nul)", optarg);
+                cfg.framing = framing;
+                break;
+            }
             case 'h':
                 HELP_MSG();
                 return EXIT_SUCCESS;
@@ -73,167 +190,706 @@ int main(int argc, char **argv) {
             return EXIT_FAILURE;
         }
     }
-    LOGD(TAG, "buffer size: %d, port: %d, repetitions: %d", buffer_size, my_port, repetitions);
+    LOGD(TAG, "buffer size: %d, port: %d, repetitions: %d, max connections: %d, threads: %d, framing: %s",
+         cfg.buffer_size, cfg.port, repetitions, cfg.max_connections, cfg.threads, framing_name(cfg.framing));
+    remaining_messages = repetitions;
+
+    if (cfg.timestamps && cfg.uring) {
+        LOGW(TAG, PROTO_TAG "Timestamps need the control messages of recvmsg, ignoring -u");
+        cfg.uring = 0;
+    }
 
-    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
-    if (listen_fd < 0) {
-        LOGE_ERRNO(TAG, "Failed to create socket");
-        return EXIT_FAILURE;
+    raise_fd_limit(cfg.max_connections);
+
+    // Also ignores SIGPIPE, peers resetting mid-echo must not kill the process
+    net_handle_signals(&running);
+
+    // One listener and epoll instance per worker, the kernel spreads new
+    // connections across SO_REUSEPORT listeners
+    worker_t workers[MAX_THREADS];
+    int n_workers = 0;
+    int result = EXIT_SUCCESS;
+    const net_opts_t listen_opts = { .nonblocking = 1, .reuseaddr = 1, .reuseport = cfg.threads > 1 };
+    for (int i = 0; i < cfg.threads; i++) {
+        worker_t *w = &workers[i];
+        *w = (worker_t){ .id = i, .listen_fd = -1, .epfd = -1, .cfg = &cfg, .conns = NULL, .result = EXIT_SUCCESS };
+
+        w->listen_fd = net_tcp_listener(cfg.port, DEFAULT_BACKLOG, &listen_opts);
+        if (w->listen_fd < 0) {
+            LOGE_ERRNO(TAG, "Could not listen on port %d", cfg.port);
+            result = EXIT_FAILURE;
+            break;
+        }
+        if (cfg.stats && peer_stats_init(&w->peers, MAX_PEERS, net_now_ns()) != 0) {
+            LOGE(TAG, "Failed to allocate stats for %d connections", MAX_PEERS);
+            close(w->listen_fd);
+            result = EXIT_FAILURE;
+            break;
+        }
+        w->epfd = epoll_create1(EPOLL_CLOEXEC);
+        if (w->epfd < 0) {
+            LOGE_ERRNO(TAG, "epoll_create1() failed");
+            peer_stats_free(&w->peers);
+            close(w->listen_fd);
+            result = EXIT_FAILURE;
+            break;
+        }
+        // Accepted sockets inherit the setting, so data that arrives before accept() is stamped too
+        if (cfg.timestamps && rx_ts_enable(w->listen_fd) < 0) {
+            LOGE_ERRNO(TAG, "Kernel receive timestamps unsupported");
+            peer_stats_free(&w->peers);
+            close(w->epfd);
+            close(w->listen_fd);
+            result = EXIT_FAILURE;
+            break;
+        }
+        // Listener is level-triggered, so connections left in the backlog
+        // when accept hits EMFILE are retried on the next wait
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = NULL };
+        epoll_ctl(w->epfd, EPOLL_CTL_ADD, w->listen_fd, &ev);
+        n_workers++;
     }
-    LOGD(TAG, PROTO_TAG "Created listen socket");
 
-    // Allow port reuse for quick restarts
-    int optval = 1;
-    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &optval, sizeof(optval));
+    if (result == EXIT_SUCCESS) {
+        LOGI(TAG, PROTO_TAG "Listening on port %d with %d thread(s), up to %d connections",
+             cfg.port, cfg.threads, cfg.max_connections);
+
+        void *(*run)(void *) = cfg.uring ? worker_run_uring : worker_run;
+        if (n_workers == 1) {
+            run(&workers[0]);
+        } else {
+            int started = 0;
+            for (; started < n_workers; started++) {
+                if (pthread_create(&workers[started].thread, NULL, run, &workers[started]) != 0) {
+                    LOGE(TAG, "pthread_create() failed for worker %d", started);
+                    running = 0;
+                    result = EXIT_FAILURE;
+                    break;
+                }
+            }
+            for (int i = 0; i < started; i++) {
+                pthread_join(workers[i].thread, NULL);
+            }
+        }
+        for (int i = 0; i < n_workers; i++) {
+            if (workers[i].result != EXIT_SUCCESS) result = EXIT_FAILURE;
+        }
+        if (cfg.timestamps) {
+            report_rx_ts(workers, n_workers);
+        }
+        if (cfg.stats) {
+            report_peer_totals(workers, n_workers);
+        }
+    }
 
-    struct sockaddr_in my_addr = {
-        .sin_family = AF_INET,
-        .sin_addr.s_addr = INADDR_ANY,
-        .sin_port = htons(my_port)
-    };
+    for (int i = 0; i < n_workers; i++) {
+        close(workers[i].epfd);
+        close(workers[i].listen_fd);
+        peer_stats_free(&workers[i].peers);
+    }
 
-    int result = bind(listen_fd, (struct sockaddr *)&my_addr, sizeof(my_addr));
-    if (result < 0) {
-        LOGE_ERRNO(TAG, "Could not bind socket to port %d", my_port);
-        close(listen_fd);
-        return EXIT_FAILURE;
+    if (!running) {
+        LOGD(TAG, "Received shutdown signal, exiting gracefully");
     }
-    LOGD(TAG, PROTO_TAG "Bound socket to port");
+    return result;
+}
+
 
-    if (listen(listen_fd, DEFAULT_BACKLOG) < 0) {
-        LOGE_ERRNO(TAG, "listen() failed");
-        close(listen_fd);
-        return EXIT_FAILURE;
+// Each connection needs a descriptor, raise the soft limit as far as the hard one allows
+static void raise_fd_limit(int max_connections) {
+    const long wanted = (long)max_connections + MAX_THREADS * 2 + 16;
+    const long limit = net_raise_fd_limit(wanted);
+    if (limit >= 0 && limit < wanted) {
+        LOGW(TAG, "Open file limit is %ld, fewer than %d connections may be accepted", limit, max_connections);
     }
+}
 
-    struct sigaction sa = {
-        .sa_handler = signal_handler,
-        .sa_flags = 0 // Allow for interrupt
-    };
-    sigemptyset(&sa.sa_mask);
-    sigaction(SIGINT, &sa, NULL);
-    sigaction(SIGTERM, &sa, NULL);
+// Counts one received message, stops all workers when repetitions run out
+static inline void count_message(void) {
+    if (__atomic_load_n(&remaining_messages, __ATOMIC_RELAXED) < 0) {
+        return;
+    }
+    if (__atomic_sub_fetch(&remaining_messages, 1, __ATOMIC_RELAXED) <= 0) {
+        running = 0;
+    }
+}
 
-    LOGI(TAG, PROTO_TAG "Listening on port %d", my_port);
+// Registers an accepted socket, applying the connection limit
+// Returns NULL (socket closed) if over the limit or out of memory
+static conn_t *conn_open(worker_t *w, int client_fd, const struct sockaddr_in *client_addr) {
+    // Over the limit: close right away so the client sees a reset instead
+    // of waiting in the backlog
+    if (__atomic_add_fetch(&connection_count, 1, __ATOMIC_RELAXED) > w->cfg->max_connections) {
+        __atomic_sub_fetch(&connection_count, 1, __ATOMIC_RELAXED);
+        LOGW(TAG, PROTO_TAG "Connection limit %d reached, rejecting %s:%d", w->cfg->max_connections,
+             inet_ntoa(client_addr->sin_addr), ntohs(client_addr->sin_port));
+        close(client_fd);
+        return NULL;
+    }
+
+    // Fixed frames always fit, whatever the buffer size
+    conn_t *c = calloc(1, sizeof(conn_t));
+    size_t capacity = w->cfg->buffer_size;
+    if (w->cfg->framing == FRAMING_FIXED && capacity < FRAMING_FIXED_SIZE) {
+        capacity = FRAMING_FIXED_SIZE;
+    }
+    // io_uring echoes straight from the provided buffers
+    int alloc_failed = (c == NULL);
+    if (!alloc_failed && w->cfg->echo && !w->cfg->uring) {
+        c->buf = malloc(capacity);
+        alloc_failed = (c->buf == NULL);
+    } else if (!alloc_failed && !w->cfg->echo) {
+        alloc_failed = frame_decoder_init(&c->dec, w->cfg->framing, capacity) != 0;
+    }
+    if (alloc_failed) {
+        LOGE(TAG, "Failed to allocate connection buffer of size: %zu", capacity);
+        if (c != NULL) free(c->buf);
+        free(c);
+        close(client_fd);
+        __atomic_sub_fetch(&connection_count, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+    c->fd = client_fd;
+    c->addr = *client_addr;
+    c->echo_head = c->echo_tail = -1;
+    if (w->cfg->stats) {
+        c->stats = peer_stats_get(&w->peers, client_addr);
+    }
+
+    if (w->cfg->echo) {
+        // Small replies must not wait for Nagle
+        net_set_nodelay(client_fd);
+    }
 
-    char *rx_buf = malloc(buffer_size);
-    if (rx_buf == NULL) {
-        LOGE(TAG, "Failed to allocate receive buffer of size: %d", buffer_size);
-        close(listen_fd);
-        return EXIT_FAILURE;
+    c->next = w->conns;
+    if (w->conns) w->conns->prev = c;
+    w->conns = c;
+
+    LOGI(TAG, PROTO_TAG "Client connected: %s:%d",
+         inet_ntoa(client_addr->sin_addr), ntohs(client_addr->sin_port));
+    return c;
+}
+
+// Closes the socket but keeps the state until conn_close, for io_uring
+// operations that still reference it. shutdown() ends a pending multishot recv
+static void conn_shutdown(conn_t *c) {
+    if (c->fd < 0) {
+        return;
     }
+    LOGI(TAG, PROTO_TAG "Client disconnected: %s:%d",
+         inet_ntoa(c->addr.sin_addr), ntohs(c->addr.sin_port));
+    shutdown(c->fd, SHUT_RDWR);
+    close(c->fd);  // Also removes it from the epoll set
+    c->fd = -1;
+    __atomic_sub_fetch(&connection_count, 1, __ATOMIC_RELAXED);
+}
+
+static void conn_close(worker_t *w, conn_t *c) {
+    conn_shutdown(c);
+    if (c->prev) c->prev->next = c->next;
+    else w->conns = c->next;
+    if (c->next) c->next->prev = c->prev;
+    free(c->buf);
+    frame_decoder_free(&c->dec);
+    free(c);
+}
 
-    // Outer loop: accept connections
+static void accept_all(worker_t *w) {
     while (running) {
         struct sockaddr_in client_addr;
-        socklen_t addr_len = sizeof(client_addr);
-
-        LOGD(TAG, PROTO_TAG "Waiting for connection...");
-        int client_fd = accept(listen_fd, (struct sockaddr *)&client_addr, &addr_len);
+        int client_fd = net_accept(w->listen_fd, &client_addr);
         if (client_fd < 0) {
-            if (errno == EINTR) {
-                continue;  // interrupted by signal, check running flag
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                LOGW_ERRNO(TAG, "accept() failed");
             }
-            LOGE_ERRNO(TAG, "accept() failed");
-            break;
+            return;
         }
 
-        LOGI(TAG, PROTO_TAG "Client connected: %s:%d",
-             inet_ntoa(client_addr.sin_addr), ntohs(client_addr.sin_port));
+        conn_t *c = conn_open(w, client_fd, &client_addr);
+        if (c == NULL) {
+            continue;
+        }
 
-        // Inner loop: receive from this client
-        while (running) {
-            ssize_t bytes_received = recv(client_fd, rx_buf, buffer_size - 1, 0);
+        struct epoll_event ev = { .events = EPOLLIN | EPOLLRDHUP | EPOLLET, .data.ptr = c };
+        if (epoll_ctl(w->epfd, EPOLL_CTL_ADD, client_fd, &ev) < 0) {
+            LOGE_ERRNO(TAG, "epoll_ctl() failed");
+            conn_close(w, c);
+        }
+    }
+}
 
-            if (bytes_received < 0) {
-                if (errno == EINTR) {
-                    continue;  // interrupted by signal, check running flag
-                }
-                LOGE_ERRNO(TAG, "recv() failed");
-                break;
+// Sends pending echo data. Returns 1 when drained, 0 when the socket is full, -1 on error
+static int conn_flush(worker_t *w, conn_t *c) {
+    while (c->out_len > 0) {
+        ssize_t n = send(c->fd, c->buf + c->out_off, c->out_len, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                // Stop reading until the peer drains its side (backpressure)
+                struct epoll_event ev = { .events = EPOLLOUT | EPOLLRDHUP | EPOLLET, .data.ptr = c };
+                epoll_ctl(w->epfd, EPOLL_CTL_MOD, c->fd, &ev);
+                return 0;
             }
+            LOGE_ERRNO(TAG, "send() failed");
+            return -1;
+        }
+        c->out_off += n;
+        c->out_len -= n;
+    }
+    return 1;
+}
 
-            if (bytes_received == 0) {
-                LOGI(TAG, PROTO_TAG "Client disconnected: %s:%d",
-                     inet_ntoa(client_addr.sin_addr), ntohs(client_addr.sin_port));
-                break;
-            }
+// Logs (or in stats mode counts) every complete frame in the decoder
+// Returns -1 on an oversized message
+static int conn_deliver(conn_t *c) {
+    const char *msg;
+    size_t len;
+    int rc;
+    while ((rc = frame_decoder_next(&c->dec, &msg, &len)) == 1) {
+        if (c->stats != NULL) {
+            peer_stats_count(c->stats, len, 0);
+            count_message();
+            continue;
+        }
 
-            rx_buf[bytes_received] = '\0';
+        if (c->dec.type == FRAMING_FIXED) {
+            len = strnlen(msg, len);  // Drop the zero padding
+        }
 
-            #ifdef REM_TRAIL
-            while (bytes_received > 0 &&
-                (rx_buf[bytes_received - 1] == '\n' || rx_buf[bytes_received - 1] == '\r')) {
-                rx_buf[--bytes_received] = '\0';
-            }
-            #endif
+        #ifdef REM_TRAIL
+        while (len > 0 && (msg[len - 1] == '\n' || msg[len - 1] == '\r')) {
+            len--;
+        }
+        #endif
 
-            LOGI(TAG, PROTO_TAG "Received %zd bytes from %s:%d -- Message: %s",
-                bytes_received, inet_ntoa(client_addr.sin_addr),
-                ntohs(client_addr.sin_port), rx_buf);
+        LOGI(TAG, PROTO_TAG "Received %zu bytes from %s:%d -- Message: %.*s",
+            len, inet_ntoa(c->addr.sin_addr),
+            ntohs(c->addr.sin_port), (int)len, msg);
 
-            if (repetitions > 0) repetitions--;
-            if (repetitions == 0) {
-                running = 0;  // exit outer loop too
-                break;
+        count_message();
+    }
+    if (rc < 0) {
+        if (c->stats != NULL) {
+            c->stats->truncated++;
+        }
+        LOGE(TAG, PROTO_TAG "Message from %s:%d exceeds the %zu byte buffer (%s framing)",
+             inet_ntoa(c->addr.sin_addr), ntohs(c->addr.sin_port), c->dec.capacity,
+             framing_name(c->dec.type));
+        return -1;
+    }
+    return 0;
+}
+
+// recv(), or with timestamps recvmsg() accounting the kernel stamp of the data,
+// which for TCP is the arrival of the latest segment in the read
+static ssize_t conn_recv(worker_t *w, conn_t *c, void *dst, size_t len) {
+    if (!w->cfg->timestamps) {
+        return recv(c->fd, dst, len, 0);
+    }
+
+    char ctrl[RX_TS_CMSG_SPACE];
+    struct iovec iov = { .iov_base = dst, .iov_len = len };
+    struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1, .msg_control = ctrl, .msg_controllen = sizeof(ctrl) };
+    ssize_t n = recvmsg(c->fd, &msg, 0);
+    if (n > 0) {
+        const uint64_t user_ns = rx_ts_now_ns();
+        rx_ts_t ts;
+        if (rx_ts_read(&msg, &ts) == 0) {
+            rx_ts_stats_add(&w->rx_ts, &ts, user_ns, 0);
+        } else {
+            w->rx_ts.missing++;
+        }
+    }
+    return n;
+}
+
+// Edge-triggered: read until EAGAIN and reflect the raw bytes
+// Echo mode skips framing and per-message logging, they would dominate the measured RTT
+static int conn_echo(worker_t *w, conn_t *c) {
+    while (running) {
+        ssize_t bytes_received = conn_recv(w, c, c->buf, w->cfg->buffer_size);
+
+        if (bytes_received < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+            LOGE_ERRNO(TAG, "recv() failed");
+            return -1;
+        }
+
+        if (bytes_received == 0) {
+            return -1;
+        }
+
+        c->out_off = 0;
+        c->out_len = bytes_received;
+        if (c->stats != NULL) {
+            peer_stats_count(c->stats, bytes_received, 0);  // A read counts as a message, as for -r
+        }
+        int flushed = conn_flush(w, c);
+        if (flushed < 0) return -1;
+        count_message();
+        if (flushed == 0) return 0;  // Resumed on EPOLLOUT
+    }
+    return 0;
+}
+
+// Edge-triggered: read until EAGAIN, logging every complete frame
+// Returns -1 when the connection should be closed
+static int conn_read(worker_t *w, conn_t *c) {
+    if (w->cfg->echo) {
+        return conn_echo(w, c);
+    }
+
+    while (running) {
+        size_t space;
+        char *dst = frame_decoder_write_ptr(&c->dec, &space);
+        ssize_t bytes_received = conn_recv(w, c, dst, space);
+
+        if (bytes_received < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+            LOGE_ERRNO(TAG, "recv() failed");
+            return -1;
+        }
+
+        if (bytes_received == 0) {
+            return -1;
+        }
+        frame_decoder_commit(&c->dec, bytes_received);
+        if (conn_deliver(c) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void *worker_run(void *arg) {
+    worker_t *w = arg;
+    struct epoll_event events[MAX_EVENTS];
+
+    while (running) {
+        if (w->cfg->stats && net_now_ns() - w->peers.mark_ns >= REPORT_INTERVAL_NS) {
+            report_peers(w, net_now_ns());
+        }
+        int n = epoll_wait(w->epfd, events, MAX_EVENTS, EPOLL_TIMEOUT_MS);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            LOGE_ERRNO(TAG, "epoll_wait() failed");
+            w->result = EXIT_FAILURE;
+            break;
+        }
+
+        for (int i = 0; i < n && running; i++) {
+            conn_t *c = events[i].data.ptr;
+            if (c == NULL) {
+                accept_all(w);
+                continue;
+            }
+
+            int rc = 0;
+            if (events[i].events & EPOLLOUT) {
+                rc = conn_flush(w, c);
+                if (rc > 0) {
+                    struct epoll_event ev = { .events = EPOLLIN | EPOLLRDHUP | EPOLLET, .data.ptr = c };
+                    epoll_ctl(w->epfd, EPOLL_CTL_MOD, c->fd, &ev);
+                    rc = conn_read(w, c);  // Input that arrived meanwhile raised no new edge
+                }
+            } else if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+                rc = conn_read(w, c);
+            }
+            if (rc < 0) {
+                conn_close(w, c);
             }
         }
-        close(client_fd);
     }
 
-    if (!running) {
-        LOGD(TAG, "Received shutdown signal, exiting gracefully");
+    while (w->conns != NULL) {
+        conn_close(w, w->conns);
     }
-    close(listen_fd);
-    free(rx_buf);
-    return EXIT_SUCCESS;
+    return NULL;
+}
+
+
+static inline uint64_t ud_pack(const conn_t *c, unsigned op, uint16_t bid) {
+    return (uint64_t)(uintptr_t)c | op | ((uint64_t)bid << 48);
 }
 
+static void uring_arm_recv(uring_ctx_t *u, conn_t *c) {
+    uring_prep_recv_multishot(uring_get_sqe(&u->ring), c->fd, u->bufs.bgid, 0, ud_pack(c, UD_RECV, 0));
+}
 
-static inline int parse_port(const char *str) {
-    char *endptr;
-    errno = 0;
-    const long port = strtol(str, &endptr, 10);
+static void uring_send_head(uring_ctx_t *u, conn_t *c) {
+    const uint16_t bid = (uint16_t)c->echo_head;
+    // MSG_WAITALL: the kernel retries short stream sends, so a completion means all or error
+    uring_prep_send(uring_get_sqe(&u->ring), c->fd, uring_buf_ring_buf(&u->bufs, bid), u->bid_len[bid],
+                    MSG_WAITALL | MSG_NOSIGNAL, ud_pack(c, UD_SEND, bid));
+    c->inflight++;
+}
 
-    if (errno != 0 || endptr == str || *endptr != '\0') {
-        return -1;
+// Returns queued echo buffers to the ring, except the one being sent
+static void uring_drop_echo_queue(uring_ctx_t *u, conn_t *c) {
+    if (c->echo_head < 0) {
+        return;
     }
+    uint16_t bid = (uint16_t)c->echo_head;
+    while (bid != (uint16_t)c->echo_tail) {
+        bid = u->next_bid[bid];
+        uring_buf_ring_add(&u->bufs, bid);
+    }
+    c->echo_tail = c->echo_head;
+}
 
-    if (port > 65535 || port < 1) {
-        return -1;
+// Handles one received chunk held in provided buffer bid. Returns -1 to close
+static int uring_conn_data(worker_t *w, uring_ctx_t *u, conn_t *c, uint16_t bid, size_t len) {
+    if (c->fd < 0) {
+        uring_buf_ring_add(&u->bufs, bid);
+        return 0;
+    }
+
+    if (w->cfg->echo) {
+        // The buffer goes back to the ring when its send completes
+        u->bid_len[bid] = (uint32_t)len;
+        if (c->echo_head < 0) {
+            c->echo_head = c->echo_tail = bid;
+            uring_send_head(u, c);
+        } else {
+            u->next_bid[c->echo_tail] = bid;
+            c->echo_tail = bid;
+        }
+        if (c->stats != NULL) {
+            peer_stats_count(c->stats, len, 0);
+        }
+        count_message();
+        return 0;
     }
 
-    return (int)port;
+    // Frames may straddle buffers, so message mode copies into the decoder
+    const char *data = uring_buf_ring_buf(&u->bufs, bid);
+    size_t off = 0;
+    int rc = 0;
+    while (off < len && rc == 0) {
+        size_t space;
+        char *dst = frame_decoder_write_ptr(&c->dec, &space);
+        if (space == 0) {
+            rc = -1;
+            break;
+        }
+        const size_t n = (len - off < space) ? len - off : space;
+        memcpy(dst, data + off, n);
+        frame_decoder_commit(&c->dec, n);
+        off += n;
+        rc = conn_deliver(c);
+    }
+    uring_buf_ring_add(&u->bufs, bid);
+    return rc;
 }
 
-static inline int parse_size(const char *str) {
-    char *endptr;
-    errno = 0;
-    const long size = strtol(str, &endptr, 10);
+// io_uring variant of worker_run: one multishot accept for the listener, one
+// multishot recv per connection, all receiving into a shared provided buffer ring
+// Falls back to epoll if the kernel lacks io_uring, buffer rings or multishot
+static void *worker_run_uring(void *arg) {
+    worker_t *w = arg;
+    uring_ctx_t *u = calloc(1, sizeof(uring_ctx_t));
+    if (u == NULL || uring_init(&u->ring, URING_ENTRIES) != 0) {
+        LOGW_ERRNO(TAG, PROTO_TAG "io_uring unavailable, falling back to epoll");
+        free(u);
+        return worker_run(w);
+    }
+    if (uring_buf_ring_init(&u->ring, &u->bufs, 0, URING_BUF_ENTRIES, w->cfg->buffer_size) != 0) {
+        LOGW_ERRNO(TAG, PROTO_TAG "io_uring buffer rings unsupported, falling back to epoll");
+        uring_free(&u->ring);
+        free(u);
+        return worker_run(w);
+    }
 
-    if (errno != 0 || endptr == str || *endptr != '\0') {
-        return -1;
+    uring_prep_accept_multishot(uring_get_sqe(&u->ring), w->listen_fd, SOCK_NONBLOCK | SOCK_CLOEXEC,
+                                ud_pack(NULL, UD_ACCEPT, 0));
+    if (w->id == 0) {
+        LOGI(TAG, PROTO_TAG "io_uring multishot accept/recv, %d provided buffers of %d bytes per thread",
+             URING_BUF_ENTRIES, w->cfg->buffer_size);
     }
 
-    if (size > 65507 || size < 1) {
-        return -1;
+    int accepted = 0;
+    int fallback = 0;
+    while (running && !fallback) {
+        if (w->cfg->stats && net_now_ns() - w->peers.mark_ns >= REPORT_INTERVAL_NS) {
+            report_peers(w, net_now_ns());
+        }
+        int err = uring_submit_and_wait(&u->ring, 1, EPOLL_TIMEOUT_MS);
+        if (err < 0 && err != -ETIME && err != -EINTR) {
+            errno = -err;
+            LOGE_ERRNO(TAG, "io_uring_enter() failed");
+            w->result = EXIT_FAILURE;
+            break;
+        }
+
+        struct io_uring_cqe *cqe;
+        while ((cqe = uring_peek_cqe(&u->ring)) != NULL) {
+            const uint64_t ud = cqe->user_data;
+            const int res = cqe->res;
+            const unsigned flags = cqe->flags;
+            uring_cqe_seen(&u->ring);
+            conn_t *c = (conn_t *)(uintptr_t)(ud & UD_PTR_MASK);
+
+            switch (ud & UD_OP_MASK) {
+                case UD_ACCEPT:
+                    if (res >= 0) {
+                        accepted = 1;
+                        struct sockaddr_in client_addr = { 0 };
+                        socklen_t addr_len = sizeof(client_addr);
+                        getpeername(res, (struct sockaddr *)&client_addr, &addr_len);
+                        conn_t *nc = conn_open(w, res, &client_addr);
+                        if (nc != NULL) {
+                            nc->inflight = 1;
+                            uring_arm_recv(u, nc);
+                        }
+                    } else if (res == -EINVAL && !accepted) {
+                        LOGW(TAG, PROTO_TAG "Multishot accept unsupported, falling back to epoll");
+                        fallback = 1;
+                        break;
+                    } else if (res != -EINTR && res != -ECONNABORTED) {
+                        errno = -res;
+                        LOGW_ERRNO(TAG, "accept() failed");
+                    }
+                    if (!(flags & IORING_CQE_F_MORE)) {
+                        uring_prep_accept_multishot(uring_get_sqe(&u->ring), w->listen_fd,
+                                                    SOCK_NONBLOCK | SOCK_CLOEXEC, ud_pack(NULL, UD_ACCEPT, 0));
+                    }
+                    break;
+
+                case UD_RECV:
+                    if (res > 0 && (flags & IORING_CQE_F_BUFFER)) {
+                        if (uring_conn_data(w, u, c, flags >> IORING_CQE_BUFFER_SHIFT, res) < 0) {
+                            conn_shutdown(c);
+                        }
+                    } else if (res < 0 && res != -ENOBUFS && c->fd >= 0) {
+                        errno = -res;
+                        LOGE_ERRNO(TAG, "io_uring recv failed");
+                    }
+                    if (!(flags & IORING_CQE_F_MORE)) {
+                        // Ends on EOF, error, shutdown or an empty buffer ring
+                        if (c->fd >= 0 && (res > 0 || res == -ENOBUFS)) {
+                            uring_arm_recv(u, c);
+                        } else {
+                            c->inflight--;
+                            conn_shutdown(c);
+                        }
+                    }
+                    break;
+
+                case UD_SEND: {
+                    const uint16_t bid = (uint16_t)(ud >> 48);
+                    c->inflight--;
+                    if (res < 0 && c->fd >= 0) {
+                        errno = -res;
+                        LOGE_ERRNO(TAG, "send() failed");
+                        conn_shutdown(c);
+                    }
+                    if (c->fd < 0) {
+                        uring_drop_echo_queue(u, c);
+                    }
+                    uring_buf_ring_add(&u->bufs, bid);
+                    if (c->echo_head == c->echo_tail) {
+                        c->echo_head = c->echo_tail = -1;
+                    } else {
+                        c->echo_head = u->next_bid[bid];
+                        uring_send_head(u, c);
+                    }
+                    break;
+                }
+            }
+
+            if (c != NULL && c->fd < 0 && c->inflight == 0) {
+                conn_close(w, c);
+            }
+        }
+        uring_buf_ring_publish(&u->bufs);
+    }
+
+    // Closing the ring cancels whatever is still in flight
+    uring_buf_ring_free(&u->ring, &u->bufs);
+    uring_free(&u->ring);
+    free(u);
+    while (w->conns != NULL) {
+        conn_close(w, w->conns);
     }
+    return fallback ? worker_run(w) : NULL;
+}
+
+// Kernel stamp to user space over all workers. One sample per read, not per message
+static void report_rx_ts(const worker_t *workers, int n_workers) {
+    rx_ts_stats_t total = { 0 };
+    for (int i = 0; i < n_workers; i++) {
+        rx_ts_stats_merge(&total, &workers[i].rx_ts);
+    }
+    if (total.samples == 0) {
+        LOGW(TAG, PROTO_TAG "No kernel receive timestamps (%llu reads without)", (unsigned long long)total.missing);
+        return;
+    }
+    LOGI(TAG, PROTO_TAG "kernel->user min/avg/max %.1f/%.1f/%.1f us over %llu reads (%llu hardware stamps, %llu without)",
+         total.sched.min_ns / 1e3, (double)total.sched.sum_ns / total.sched.count / 1e3, total.sched.max_ns / 1e3,
+         (unsigned long long)total.samples, (unsigned long long)total.hardware, (unsigned long long)total.missing);
+}
 
-    return (int)size;
+static const char *peer_name(const peer_stats_entry_t *e, char *buf, size_t len) {
+    if (e->addr.sin_family != AF_INET) {
+        snprintf(buf, len, "other");  // Connections beyond MAX_PEERS
+    } else {
+        snprintf(buf, len, "%s:%d", inet_ntoa(e->addr.sin_addr), ntohs(e->addr.sin_port));
+    }
+    return buf;
 }
 
-static inline int parse_repetitions(const char *str) {
-    char *endptr;
-    errno = 0;
-    const long repetitions = strtol(str, &endptr, 10);
+// Worker line, then one line per connection active since the last report,
+// busiest first. A single worker on a terminal clears the screen first, so
+// the dashboard redraws in place; several workers print one block each
+static void report_peers(worker_t *w, uint64_t now) {
+    peer_stats_t *peers = &w->peers;
+    const double secs = (now - peers->mark_ns) / 1e9;
+    peer_stats_entry_t total;
+    peer_stats_total(peers, &total);
+    const peer_stats_entry_t *top[DASHBOARD_PEERS];
+    const uint32_t shown = peer_stats_top(peers, top, DASHBOARD_PEERS);
+    char worker[16] = "";
+    if (w->cfg->threads > 1) {
+        snprintf(worker, sizeof(worker), "worker %d: ", w->id);
+    } else if (isatty(STDERR_FILENO)) {
+        fputs("\033[H\033[2J", stderr);
+    }
 
-    if (errno != 0 || endptr == str || *endptr != '\0') {
-        return -2;
+    LOGI(TAG, PROTO_TAG "%s%d connections open, %.0f msg/s, %.2f MB/s (total %llu msgs, %llu bytes, %llu oversized)",
+         worker, __atomic_load_n(&connection_count, __ATOMIC_RELAXED), (total.packets - total.last_packets) / secs,
+         (total.bytes - total.last_bytes) / secs / 1e6, (unsigned long long)total.packets,
+         (unsigned long long)total.bytes, (unsigned long long)total.truncated);
+    for (uint32_t i = 0; i < shown; i++) {
+        char name[32];
+        LOGI(TAG, PROTO_TAG "%s  %-21s %10.0f msg/s %9.2f MB/s   total %llu msgs, %llu bytes",
+             worker, peer_name(top[i], name, sizeof(name)), (top[i]->packets - top[i]->last_packets) / secs,
+             (top[i]->bytes - top[i]->last_bytes) / secs / 1e6, (unsigned long long)top[i]->packets,
+             (unsigned long long)top[i]->bytes);
     }
+    peer_stats_mark(peers, now);
+}
 
-    if (repetitions < -1 || repetitions > INT_MAX) {
-        return -2;
+// Over all workers, after they stopped
+static void report_peer_totals(const worker_t *workers, int n_workers) {
+    peer_stats_entry_t sum = { 0 };
+    uint32_t conns = 0;
+    for (int i = 0; i < n_workers; i++) {
+        peer_stats_entry_t total;
+        peer_stats_total(&workers[i].peers, &total);
+        sum.packets += total.packets;
+        sum.bytes += total.bytes;
+        sum.truncated += total.truncated;
+        conns += workers[i].peers.count;
     }
+    LOGI(TAG, PROTO_TAG "Received %llu messages, %llu bytes over %u connections (%llu oversized)",
+         (unsigned long long)sum.packets, (unsigned long long)sum.bytes, conns, (unsigned long long)sum.truncated);
+}
+
 
-    return (int)repetitions;
+static inline int parse_count(const char *str, int max) {
+    long count;
+    return net_parse_long(str, 1, max, &count) == 0 ? (int)count : -1;
 }
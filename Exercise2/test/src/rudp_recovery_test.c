@@ -0,0 +1,156 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#include "log_helper/log_helper.h"
+#include "rudp/rudp.h"
+#include "impair/impair.h"
+#include "net/net.h"
+
+// A link outage long enough for the sender to give up on messages, then
+// recovery. The receiver must skip the abandoned messages and take everything
+// sent afterwards, including more than a window's worth beyond the holes.
+
+#define BEFORE 10
+#define DURING 5
+#define AFTER (3 * RUDP_MAX_WINDOW)
+#define PAYLOAD 64
+#define DEADLINE_NS 10000000000ull
+
+static const char *TAG = "rudp_recovery_test";
+
+typedef struct {
+    rudp_t tx;
+    rudp_t rx;
+    impair_t im;
+    struct sockaddr_in rx_addr;
+    uint64_t delivered;
+} link_t;
+
+static void on_message(void *arg, const struct sockaddr_in *from, const void *data, size_t len) {
+    (void)from;
+    (void)data;
+    (void)len;
+    link_t *l = arg;
+    l->delivered++;
+}
+
+static int setup(link_t *l, int *tx_sock, int *rx_sock) {
+    net_opts_t opts = NET_OPTS_DEFAULT;
+    opts.nonblocking = 1;
+    *tx_sock = net_udp_socket(0, &opts);
+    *rx_sock = net_udp_socket(0, &opts);
+    if (*tx_sock < 0 || *rx_sock < 0) {
+        LOGE_ERRNO(TAG, "Could not create sockets");
+        return -1;
+    }
+    l->rx_addr = (struct sockaddr_in){
+        .sin_family = AF_INET,
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+        .sin_port = htons((uint16_t)net_local_port(*rx_sock)),
+    };
+
+    // Fast timeouts so the outage gives up within milliseconds
+    rudp_config_t cfg = RUDP_CONFIG_DEFAULT;
+    cfg.max_payload = PAYLOAD;
+    cfg.max_retransmits = 3;
+    cfg.initial_rto_ns = 2000000ull;
+    cfg.min_rto_ns = 1000000ull;
+    cfg.max_rto_ns = 10000000ull;
+    cfg.on_message = on_message;
+    cfg.arg = l;
+
+    impair_config_t icfg = IMPAIR_CONFIG_DEFAULT;
+    if (impair_init(&l->im, &icfg, RUDP_HEADER_SIZE + PAYLOAD, impair_sendto, tx_sock) != 0) {
+        LOGE(TAG, "impair_init failed");
+        return -1;
+    }
+    cfg.impair = &l->im;
+    if (rudp_init(&l->tx, *tx_sock, &cfg) != 0 || rudp_init(&l->rx, *rx_sock, &cfg) != 0) {
+        LOGE(TAG, "rudp_init failed");
+        return -1;
+    }
+    l->rx.cfg.impair = NULL;  // ACKs always get through
+    return 0;
+}
+
+// Sends count messages, then runs both ends until done() or the deadline
+static int run(link_t *l, int count, int (*done)(const link_t *)) {
+    const uint64_t deadline = net_now_ns() + DEADLINE_NS;
+    char msg[PAYLOAD] = "rudp";
+    int queued = 0;
+    while (net_now_ns() < deadline) {
+        while (queued < count && rudp_send(&l->tx, &l->rx_addr, msg, sizeof(msg)) == 0) {
+            queued++;
+        }
+        if (queued < count && errno != EAGAIN) {
+            LOGE_ERRNO(TAG, "rudp_send failed");
+            return -1;
+        }
+        if (queued == count && done(l)) {
+            return 0;
+        }
+        struct pollfd pfd[2] = {
+            { .fd = l->tx.sock, .events = POLLIN },
+            { .fd = l->rx.sock, .events = POLLIN },
+        };
+        poll(pfd, 2, 1);
+        if (rudp_process(&l->rx) < 0 || rudp_process(&l->tx) < 0) {
+            LOGE_ERRNO(TAG, "rudp_process failed");
+            return -1;
+        }
+    }
+    return -1;
+}
+
+static int all_acked(const link_t *l) {
+    return rudp_inflight(&l->tx) == 0;
+}
+
+static int all_failed(const link_t *l) {
+    return l->tx.stats.failed == DURING;
+}
+
+int main(void) {
+    link_t l;
+    memset(&l, 0, sizeof(l));
+    int tx_sock = -1, rx_sock = -1;
+    int ok = setup(&l, &tx_sock, &rx_sock) == 0;
+
+    if (ok) {
+        ok = run(&l, BEFORE, all_acked) == 0 && l.delivered == BEFORE;
+        LOGI(TAG, "Before the outage: %llu of %d delivered", (unsigned long long)l.delivered, BEFORE);
+    }
+    if (ok) {
+        l.im.cfg.loss = 1.0;
+        ok = run(&l, DURING, all_failed) == 0 && rudp_inflight(&l.tx) == 0;
+        LOGI(TAG, "Outage: %llu of %d given up", (unsigned long long)l.tx.stats.failed, DURING);
+    }
+    if (ok) {
+        l.im.cfg.loss = 0.0;
+        ok = run(&l, AFTER, all_acked) == 0 && l.delivered == BEFORE + AFTER;
+        LOGI(TAG, "After the outage: %llu of %d delivered, %llu skipped, %llu out of window",
+             (unsigned long long)(l.delivered - BEFORE), AFTER, (unsigned long long)l.rx.stats.skipped,
+             (unsigned long long)l.rx.stats.out_of_window);
+    }
+    if (ok && l.rx.stats.skipped != DURING) {
+        LOGE(TAG, "Receiver skipped %llu messages, expected %d", (unsigned long long)l.rx.stats.skipped, DURING);
+        ok = 0;
+    }
+
+    rudp_free(&l.tx);
+    rudp_free(&l.rx);
+    impair_free(&l.im);
+    if (tx_sock >= 0) close(tx_sock);
+    if (rx_sock >= 0) close(rx_sock);
+
+    if (!ok) {
+        LOGE(TAG, "FAILED");
+        return EXIT_FAILURE;
+    }
+    LOGI(TAG, "Passed");
+    return EXIT_SUCCESS;
+}
@@ -1,19 +1,47 @@
+#define _GNU_SOURCE // recvmmsg, ppoll
 #include <netinet/in.h>
+#include <netinet/udp.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
 #include <limits.h>
 #include <errno.h>
 #include <unistd.h>
+#include <time.h>
 #include <sys/socket.h>
+#include <sys/time.h>
 #include <arpa/inet.h>
 #include <signal.h>
+#include <poll.h>
 
 #define LOG_LEVEL LOG_LEVEL_DEBUG
 #include "log_helper/log_helper.h"
+#include "seq_header/seq_header.h"
+#include "uring/uring.h"
+#include "rx_timestamp/rx_timestamp.h"
+#include "rudp/rudp.h"
+#include "impair/impair.h"
+#include "mcast/mcast.h"
+#include "peer_stats/peer_stats.h"
+#include "net/net.h"
 
 #define PROTO_TAG "[UDP] "
 
 #define DEFAULT_PORT 8080
 #define DEFAULT_BUFFER_SIZE 1024
+#define MAX_BATCH_SIZE 1024
+#define REPORT_INTERVAL_MS 1000
+#define URING_ENTRIES 64
+#define URING_BUF_ENTRIES 4096  // Provided receive buffers, one datagram each
+#define DEFAULT_FALLBACK_BATCH 64
+#define URING_FALLBACK 2        // receive_uring result: backend unavailable, use recvmmsg
+#define GRO_BUFFER_SIZE 65535   // Room for one fully coalesced GRO buffer
+#define GRO_CMSG_SPACE CMSG_SPACE(sizeof(int))
+#define RX_CMSG_SPACE (GRO_CMSG_SPACE + RX_TS_CMSG_SPACE + PEER_STATS_CMSG_SPACE)
+#define MAX_PEERS 4096          // Stats mode, senders beyond this are summed as "other"
+#define DASHBOARD_PEERS 20      // Busiest peers shown per report
+#define MAX_RCVBUF (INT_MAX / 2) // The kernel doubles SO_RCVBUF
+#define MAX_SPIN_US 1000000
 
 #define REM_TRAIL // optional macro to remove trailing newline
 
@@ -21,14 +49,35 @@ static const char *TAG = "udp_receiver";
 
 static volatile sig_atomic_t running = 1;
 
-static void signal_handler(int sig) {
-    (void)sig;
-    running = 0;
-}
+// Busy-poll mode: receives that found nothing, and waits after the spin budget ran out
+typedef struct {
+    unsigned long long empty;
+    unsigned long long blocked;
+} spin_stats_t;
+
+// Groups joined with -g, left again on the way out
+static struct in_addr mcast_groups[MCAST_MAX_GROUPS];
+static int n_mcast_groups = 0;
+static mcast_iface_t mcast_iface = MCAST_IFACE_DEFAULT;
+
+static inline int parse_batch(const char *str);
+static inline int parse_group(const char *str, struct in_addr *group);
+static inline int parse_rcvbuf(const char *str);
+static inline int parse_spin(const char *str);
+static void close_rx_socket(int sock);
 
-static inline int parse_port(const char *str);
-static inline int parse_size(const char *str);
-static inline int parse_repetitions(const char *str);
+static int receive_batched(int sock, int buffer_size, int batch_size, int repetitions, seq_tracker_t *tracker, int gro,
+                           rx_ts_stats_t *rx_ts, peer_stats_t *peers, uint64_t spin_ns);
+static int receive_uring(int sock, int buffer_size, int repetitions, seq_tracker_t *tracker);
+static int echo_batched(int sock, int buffer_size, int batch_size, int repetitions, uint64_t spin_ns);
+static int receive_reliable(int sock, int buffer_size, int repetitions, const impair_config_t *impair_cfg, seq_tracker_t *tracker);
+static int receive_impaired(int sock, int buffer_size, int batch_size, int repetitions, const impair_config_t *impair_cfg,
+                            seq_tracker_t *tracker);
+static void report_seq(const seq_tracker_t *tracker);
+static void report_rx_ts(const rx_ts_stats_t *stats);
+static void report_impair(const impair_t *im);
+static void report_peers(peer_stats_t *peers, uint64_t now_ns);
+static void report_peer_totals(const peer_stats_t *peers);
 
 #define CHECK(result, tag, fmt, ...) \
     do { if ((result) < 0) { \
@@ -37,28 +86,99 @@ static inline int parse_repetitions(const char *str);
     } } while(0)
 
 #define HELP_MSG() \
-    LOGI(TAG, "[-h (this message)] [-p <port 1-65535>] [-s <buffer_size>] [-r <repetitions -1-%d> (infinite by default)] \n", INT_MAX)
+    LOGI(TAG, "[-h (this message)] [-p <port 1-65535>] [-s <buffer_size>] [-r <repetitions -1-%d> (infinite by default)] [-b <batch 1-%d> (recvmmsg, rate reports instead of per-packet output)] [-H (track sequence headers: loss, reordering, duplicates, jitter)] [-e (echo datagrams back to sender, for ping mode)] [-u (io_uring multishot receive, falls back to -b)] [-G (UDP_GRO, receive coalesced buffers and split them, recvmmsg path)] [-k (kernel receive timestamps, split network and scheduling delay)] [-L (reliable UDP: acknowledge, suppress duplicates)] [-N <%s> (impair incoming datagrams, outgoing ACKs in reliable mode)] [-l <loss %%> (same as -N loss=)] [-g <multicast group> (join, up to %d times)] [-I <interface name or address> (to join -g groups on)] [-S (stats: per-sender dashboard every second instead of per-packet output, socket drops via SO_RXQ_OVFL)] [-R <bytes 1-%d|max> (SO_RCVBUF, max is net.core.rmem_max)] [-B <spin_us 1-%d> (busy-poll: SO_BUSY_POLL, spin on non-blocking receives this long before blocking)] \n", INT_MAX, MAX_BATCH_SIZE, IMPAIR_SPEC_HELP, MCAST_MAX_GROUPS, MAX_RCVBUF, MAX_SPIN_US)
 
 
 int main(int argc, char **argv) {
     int buffer_size = DEFAULT_BUFFER_SIZE;
     int my_port = DEFAULT_PORT;
     int repetitions = -1; //infinite by default
+    int batch_size = 0;   // 0 = one recvfrom per datagram
+    static seq_tracker_t seq_tracker;
+    seq_tracker_t *tracker = NULL;
+    int echo = 0;
+    int use_uring = 0;
+    int gro = 0;
+    static rx_ts_stats_t rx_ts_stats;
+    rx_ts_stats_t *rx_ts = NULL;
+    int reliable = 0;
+    impair_config_t impair_cfg = IMPAIR_CONFIG_DEFAULT;
+    int impaired = 0;
+    static peer_stats_t peer_stats;
+    peer_stats_t *peers = NULL;
+    int rcvbuf = 0;       // 0 = system default
+    int spin_us = 0;      // >0 enables busy-poll mode
     int opt;
-    while ((opt = getopt(argc, argv, "p:s:r:h")) != -1) {
+    while ((opt = getopt(argc, argv, "p:s:r:b:HeuGkLl:N:g:I:SR:B:h")) != -1) {
         switch (opt) {
             case 'p':
-                my_port = parse_port(optarg);
+                my_port = net_parse_port(optarg);
                 CHECK(my_port, TAG, "Invalid port: %s (must be between 1-65535)", optarg);
                 break;
             case 's':
-                buffer_size = parse_size(optarg);
-                CHECK(buffer_size, TAG, "Invalid size: %s (must be between 1-65507)", optarg);
+                buffer_size = net_parse_size(optarg, 1);
+                CHECK(buffer_size, TAG, "Invalid size: %s (must be between 1-%d)", optarg, NET_MAX_UDP_PAYLOAD);
                 break;
             case 'r':
-                repetitions = parse_repetitions(optarg);
+                repetitions = net_parse_repetitions(optarg);
                 if (repetitions != -1) CHECK(repetitions, TAG, "Invalid repetition: %s (must be between -1-%d)", optarg, INT_MAX);
                 break;
+            case 'b':
+                batch_size = parse_batch(optarg);
+                CHECK(batch_size, TAG, "Invalid batch: %s (must be between 1-%d)", optarg, MAX_BATCH_SIZE);
+                break;
+            case 'H':
+                tracker = &seq_tracker;
+                seq_tracker_init(tracker);
+                break;
+            case 'e':
+                echo = 1;
+                break;
+            case 'u':
+                use_uring = 1;
+                break;
+            case 'G':
+                gro = 1;
+                break;
+            case 'k':
+                rx_ts = &rx_ts_stats;
+                break;
+            case 'L':
+                reliable = 1;
+                break;
+            case 'l': {
+                const double loss = net_parse_percent(optarg);
+                CHECK(loss, TAG, "Invalid loss: %s (must be between 0-100 %%)", optarg);
+                impair_cfg.loss = loss;
+                impaired = 1;
+                break;
+            }
+            case 'N':
+                CHECK(impair_parse(&impair_cfg, optarg), TAG, "Invalid impairment: %s (must be %s)", optarg, IMPAIR_SPEC_HELP);
+                impaired = 1;
+                break;
+            case 'g':
+                if (n_mcast_groups == MCAST_MAX_GROUPS) {
+                    LOGE(TAG, "At most %d multicast groups (-g)", MCAST_MAX_GROUPS);
+                    return EXIT_FAILURE;
+                }
+                CHECK(parse_group(optarg, &mcast_groups[n_mcast_groups]), TAG, "Invalid multicast group: %s (must be in 224.0.0.0/4)", optarg);
+                n_mcast_groups++;
+                break;
+            case 'I':
+                CHECK(mcast_parse_iface(optarg, &mcast_iface), TAG, "Invalid interface: %s (must be an interface name or IPv4 address)", optarg);
+                break;
+            case 'S':
+                peers = &peer_stats;
+                break;
+            case 'R':
+                rcvbuf = parse_rcvbuf(optarg);
+                CHECK(rcvbuf, TAG, "Invalid receive buffer: %s (must be between 1-%d bytes or max)", optarg, MAX_RCVBUF);
+                break;
+            case 'B':
+                spin_us = parse_spin(optarg);
+                CHECK(spin_us, TAG, "Invalid spin budget: %s (must be between 1-%d us)", optarg, MAX_SPIN_US);
+                break;
             case 'h':
                 HELP_MSG();
                 return EXIT_SUCCESS;
@@ -74,64 +194,209 @@ int main(int argc, char **argv) {
     }
     LOGD(TAG, "buffer size: %d, port: %d, repetitions: %d", buffer_size, my_port, repetitions);
 
-    int udp_rx_socket = socket(AF_INET, SOCK_DGRAM, 0);
-    if (udp_rx_socket < 0) {
-        LOGE_ERRNO(TAG, "Failed to create socket");
+    if (peers != NULL && (reliable || impaired || echo)) {
+        LOGE(TAG, "Stats (-S) is not supported with -L, -N/-l or -e, they have their own reports");
+        return EXIT_FAILURE;
+    }
+    if (spin_us > 0 && (reliable || impaired)) {
+        LOGE(TAG, "Busy-poll (-B) is not supported with -L or -N/-l, they have their own receive loops");
         return EXIT_FAILURE;
     }
 
-    LOGD(TAG, PROTO_TAG "Created rx socket");
-
-    struct sockaddr_in my_addr = {
-        .sin_family = AF_INET,
-        .sin_addr.s_addr = INADDR_ANY,
-        .sin_port = htons(my_port)
-    };
-
-    int result = bind(udp_rx_socket, (struct sockaddr *)&my_addr, sizeof(my_addr));
-    if (result < 0) {
+    // Several receivers on one host share the port, each gets its own copy of group traffic
+    net_opts_t sock_opts = NET_OPTS_DEFAULT;
+    sock_opts.reuseaddr = n_mcast_groups > 0;
+    sock_opts.rcvbuf = rcvbuf;
+    int udp_rx_socket = net_udp_socket(my_port, &sock_opts);
+    if (udp_rx_socket < 0) {
         LOGE_ERRNO(TAG, "Could not bind socket to port %d", my_port);
-        close(udp_rx_socket);
         return EXIT_FAILURE;
     }
     LOGD(TAG, PROTO_TAG "Bound socket to port");
 
-    struct sigaction sa = {
-        .sa_handler = signal_handler,
-        .sa_flags = 0 // Allow for interrupt
-    };
-    sigemptyset(&sa.sa_mask);
-    sigaction(SIGINT, &sa, NULL);
-    sigaction(SIGTERM, &sa, NULL);
+    // The kernel reports twice the size set, the extra half covers its per-datagram overhead
+    int effective_rcvbuf = 0;
+    net_buffer_sizes(udp_rx_socket, &effective_rcvbuf, NULL);
+    if (rcvbuf > 0 && effective_rcvbuf < 2 * rcvbuf) {
+        LOGW(TAG, PROTO_TAG "Receive buffer clamped to %d of %d bytes by net.core.rmem_max (%ld), raise it with sysctl -w net.core.rmem_max=%d",
+             effective_rcvbuf / 2, rcvbuf, net_rmem_max(), rcvbuf);
+    } else if (rcvbuf > 0) {
+        LOGI(TAG, PROTO_TAG "Receive buffer %d bytes (kernel reports %d)", rcvbuf, effective_rcvbuf);
+    } else {
+        LOGD(TAG, PROTO_TAG "Receive buffer %d bytes (system default)", effective_rcvbuf / 2);
+    }
+
+    // SO_BUSY_POLL only acts on devices with NAPI polling, and raising it past
+    // net.core.busy_read needs CAP_NET_ADMIN. The user space spin works regardless
+    if (spin_us > 0) {
+        const net_opts_t busy_opts = { .busy_poll_us = spin_us };
+        if (net_apply_opts(udp_rx_socket, &busy_opts) < 0) {
+            LOGW_ERRNO(TAG, PROTO_TAG "SO_BUSY_POLL not set, spinning in user space only");
+        }
+    }
+
+    char iface_name[INET_ADDRSTRLEN];
+    mcast_iface_name(&mcast_iface, iface_name, sizeof(iface_name));
+    for (int i = 0; i < n_mcast_groups; i++) {
+        if (mcast_join(udp_rx_socket, mcast_groups[i], &mcast_iface) < 0) {
+            LOGE_ERRNO(TAG, "Failed to join %s on interface %s", inet_ntoa(mcast_groups[i]), iface_name);
+            n_mcast_groups = i;
+            close_rx_socket(udp_rx_socket);
+            return EXIT_FAILURE;
+        }
+        LOGI(TAG, PROTO_TAG "Joined %s on interface %s", inet_ntoa(mcast_groups[i]), iface_name);
+    }
+
+    net_handle_signals(&running);
 
     LOGI(TAG, PROTO_TAG "Listening on port %d", my_port);
 
+    if (reliable) {
+        if (echo || gro || rx_ts != NULL || use_uring || batch_size > 0) {
+            LOGW(TAG, PROTO_TAG "Reliable mode has its own receive loop, ignoring -e, -G, -k, -u and -b");
+        }
+        int ret = receive_reliable(udp_rx_socket, buffer_size, repetitions, impaired ? &impair_cfg : NULL, tracker);
+        close_rx_socket(udp_rx_socket);
+        return ret;
+    }
+    if (impaired) {
+        if (echo || gro || rx_ts != NULL || use_uring) {
+            LOGW(TAG, PROTO_TAG "Impaired receive has its own loop, ignoring -e, -G, -k and -u");
+        }
+        int ret = receive_impaired(udp_rx_socket, buffer_size, batch_size > 0 ? batch_size : DEFAULT_FALLBACK_BATCH,
+                                   repetitions, &impair_cfg, tracker);
+        close_rx_socket(udp_rx_socket);
+        return ret;
+    }
+
+    if ((gro || rx_ts != NULL) && echo) {
+        LOGE(TAG, "GRO (-G) and timestamps (-k) are not supported in echo mode");
+        close_rx_socket(udp_rx_socket);
+        return EXIT_FAILURE;
+    }
+    if (gro) {
+        if (batch_size == 0) batch_size = DEFAULT_FALLBACK_BATCH;
+    }
+    if (rx_ts != NULL) {
+        const int mode = rx_ts_enable(udp_rx_socket);
+        if (mode < 0) {
+            LOGE_ERRNO(TAG, "Kernel receive timestamps unsupported");
+            close_rx_socket(udp_rx_socket);
+            return EXIT_FAILURE;
+        }
+        LOGD(TAG, PROTO_TAG "Receive timestamps via %s", mode == RX_TS_TIMESTAMPING ? "SO_TIMESTAMPING" : "SO_TIMESTAMPNS");
+    }
+    if ((gro || rx_ts != NULL || peers != NULL) && use_uring) {
+        LOGW(TAG, PROTO_TAG "GRO, timestamps and stats need the control messages of recvmmsg, ignoring -u");
+        use_uring = 0;
+    }
+    if (spin_us > 0) {
+        if (use_uring) {
+            LOGW(TAG, PROTO_TAG "Busy-poll spins on recvmmsg, ignoring -u");
+            use_uring = 0;
+        }
+        if (batch_size == 0 && !echo) batch_size = DEFAULT_FALLBACK_BATCH;
+    }
+    if (peers != NULL) {
+        if (peer_stats_init(peers, MAX_PEERS, net_now_ns()) != 0) {
+            LOGE(TAG, "Failed to allocate stats for %d senders", MAX_PEERS);
+            close_rx_socket(udp_rx_socket);
+            return EXIT_FAILURE;
+        }
+        if (peer_stats_enable_drops(udp_rx_socket) < 0) {
+            LOGW_ERRNO(TAG, PROTO_TAG "SO_RXQ_OVFL unsupported, socket drops are not counted");
+        }
+        if (batch_size == 0) batch_size = DEFAULT_FALLBACK_BATCH;
+    }
+
+    if (echo) {
+        int ret = echo_batched(udp_rx_socket, buffer_size, batch_size > 0 ? batch_size : 1, repetitions, spin_us * 1000ull);
+        close_rx_socket(udp_rx_socket);
+        return ret;
+    }
+
+    if (use_uring) {
+        int ret = receive_uring(udp_rx_socket, buffer_size, repetitions, tracker);
+        if (ret != URING_FALLBACK) {
+            close_rx_socket(udp_rx_socket);
+            return ret;
+        }
+        if (batch_size == 0) batch_size = DEFAULT_FALLBACK_BATCH;
+    }
+
+    if (batch_size > 0) {
+        int ret = receive_batched(udp_rx_socket, buffer_size, batch_size, repetitions, tracker, gro, rx_ts, peers,
+                                  spin_us * 1000ull);
+        if (peers != NULL) {
+            peer_stats_free(peers);
+        }
+        close_rx_socket(udp_rx_socket);
+        return ret;
+    }
+
     struct sockaddr_in peer_addr;
-    socklen_t addr_len = sizeof(peer_addr);
+    char ctrl[RX_TS_CMSG_SPACE];
+    struct iovec iov;
+    struct msghdr msg_hdr = { .msg_name = &peer_addr, .msg_iov = &iov, .msg_iovlen = 1 };
     char *rx_buf = malloc(buffer_size);
     if (rx_buf == NULL) {
         LOGE(TAG, "Failed to allocate receive buffer of size: %d", buffer_size);
-        close(udp_rx_socket);
+        close_rx_socket(udp_rx_socket);
         return EXIT_FAILURE;
     }
+
+    // Summaries are printed between packets, so wake up even when idle
+    uint64_t last_report_ms = net_now_ns() / 1000000;
+    if (tracker != NULL || rx_ts != NULL) {
+        struct timeval tv = { .tv_sec = REPORT_INTERVAL_MS / 1000, .tv_usec = (REPORT_INTERVAL_MS % 1000) * 1000 };
+        setsockopt(udp_rx_socket, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    }
+
     while (running) {
-        addr_len = sizeof(peer_addr);
-        ssize_t bytes_received = recvfrom(udp_rx_socket, rx_buf, buffer_size - 1, MSG_TRUNC,
-                                          (struct sockaddr *)&peer_addr, &addr_len);
+        if ((tracker != NULL || rx_ts != NULL) && net_now_ns() / 1000000 - last_report_ms >= REPORT_INTERVAL_MS) {
+            if (tracker != NULL) report_seq(tracker);
+            if (rx_ts != NULL) report_rx_ts(rx_ts);
+            last_report_ms = net_now_ns() / 1000000;
+        }
+
+        iov.iov_base = rx_buf;
+        iov.iov_len = buffer_size - 1;
+        msg_hdr.msg_namelen = sizeof(peer_addr);
+        msg_hdr.msg_control = (rx_ts != NULL) ? ctrl : NULL;
+        msg_hdr.msg_controllen = (rx_ts != NULL) ? sizeof(ctrl) : 0;
+        ssize_t bytes_received = recvmsg(udp_rx_socket, &msg_hdr, MSG_TRUNC);
+        const uint64_t user_ns = (rx_ts != NULL) ? rx_ts_now_ns() : 0;
 
         if (bytes_received < 0) {
-            if (errno == EINTR) {
-                continue;  // interrupted by signal, check running flag
+            if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK) {
+                continue;  // interrupted by signal or report timeout, check running flag
             }
-            LOGE_ERRNO(TAG, "recvfrom() failed.");
+            LOGE_ERRNO(TAG, "recvmsg() failed.");
             free(rx_buf);
-            close(udp_rx_socket);
+            close_rx_socket(udp_rx_socket);
             return EXIT_FAILURE;
         }
 
         if (bytes_received > buffer_size - 1) {
             LOGW(TAG, "Message truncated: received %zd, buffer only %d",
                  bytes_received, buffer_size - 1);
+            bytes_received = buffer_size - 1;
+        }
+
+        char *msg = rx_buf;
+        seq_header_t hdr;
+        const int has_hdr = tracker != NULL && seq_header_decode(rx_buf, bytes_received, &hdr) == 0;
+        if (has_hdr) {
+            seq_tracker_record(tracker, &hdr, seq_now_ns());
+            msg += SEQ_HEADER_SIZE;
+        }
+
+        rx_ts_t ts;
+        const int has_ts = rx_ts != NULL && rx_ts_read(&msg_hdr, &ts) == 0;
+        if (has_ts) {
+            rx_ts_stats_add(rx_ts, &ts, user_ns, has_hdr ? hdr.send_ns : 0);
+        } else if (rx_ts != NULL) {
+            rx_ts->missing++;
         }
 
         rx_buf[bytes_received] = '\0';
@@ -143,68 +408,858 @@ int main(int argc, char **argv) {
         }
         #endif
 
-        LOGI(TAG, PROTO_TAG "Received %zd bytes from %s:%d -- Message: %s",
-            bytes_received, inet_ntoa(peer_addr.sin_addr),
-            ntohs(peer_addr.sin_port), rx_buf);
+        char ts_info[48] = "";
+        if (has_ts) {
+            snprintf(ts_info, sizeof(ts_info), " -- kernel->user %.1f us", (int64_t)(user_ns - ts.kernel_ns) / 1e3);
+        }
+
+        if (has_hdr) {
+            LOGI(TAG, PROTO_TAG "Received %zd bytes from %s:%d -- sender %u seq %llu%s -- Message: %s",
+                bytes_received, inet_ntoa(peer_addr.sin_addr), ntohs(peer_addr.sin_port),
+                hdr.sender_id, (unsigned long long)hdr.seq, ts_info, msg);
+        } else {
+            LOGI(TAG, PROTO_TAG "Received %zd bytes from %s:%d%s -- Message: %s",
+                bytes_received, inet_ntoa(peer_addr.sin_addr),
+                ntohs(peer_addr.sin_port), ts_info, rx_buf);
+        }
 
         if (repetitions > 0) repetitions--;
         if (repetitions == 0) break;
     }
     
 
+    if (tracker != NULL) {
+        report_seq(tracker);
+    }
+    if (rx_ts != NULL) {
+        report_rx_ts(rx_ts);
+    }
     if (!running) {
         LOGD(TAG, "Received shutdown signal, exiting gracefully");
     }
-    close(udp_rx_socket);
+    close_rx_socket(udp_rx_socket);
     free(rx_buf);
     return EXIT_SUCCESS;
 }
 
 
-static inline int parse_port(const char *str) {
-    char *endptr;
-    errno = 0;
-    const long port = strtol(str, &endptr, 10);
-
-    if (errno != 0 || endptr == str || *endptr != '\0') {
+static inline int parse_group(const char *str, struct in_addr *group) {
+    if (inet_pton(AF_INET, str, group) != 1 || !mcast_is_group(*group)) {
         return -1;
     }
+    return 0;
+}
 
-    if (port > 65535 || port < 1) {
-        return -1;
+static inline int parse_rcvbuf(const char *str) {
+    if (strcmp(str, "max") == 0) {
+        const long max = net_rmem_max();
+        return max > 0 ? (int)(max < MAX_RCVBUF ? max : MAX_RCVBUF) : -1;
     }
+    long bytes;
+    return net_parse_long(str, 1, MAX_RCVBUF, &bytes) == 0 ? (int)bytes : -1;
+}
 
-    return (int)port;
+static inline int parse_spin(const char *str) {
+    long us;
+    return net_parse_long(str, 1, MAX_SPIN_US, &us) == 0 ? (int)us : -1;
 }
 
-static inline int parse_size(const char *str) {
-    char *endptr;
-    errno = 0;
-    const long size = strtol(str, &endptr, 10);
+static inline int parse_batch(const char *str) {
+    long batch;
+    return net_parse_long(str, 1, MAX_BATCH_SIZE, &batch) == 0 ? (int)batch : -1;
+}
 
-    if (errno != 0 || endptr == str || *endptr != '\0') {
-        return -1;
+// Closing would drop the memberships too, leaving them first keeps it explicit
+static void close_rx_socket(int sock) {
+    for (int i = 0; i < n_mcast_groups; i++) {
+        if (mcast_leave(sock, mcast_groups[i], &mcast_iface) < 0) {
+            LOGW_ERRNO(TAG, "Failed to leave %s", inet_ntoa(mcast_groups[i]));
+        }
     }
-    
-    if (size > 65507 || size < 1) {
-        return -1;
+    close(sock);
+}
+
+// Busy-poll mode, a non-blocking receive found nothing. The caller retries at
+// once until spin_ns passed since the socket went idle, only then this blocks
+// until data arrives or timeout_ms, so reports still get printed
+static void spin_idle(int sock, uint64_t *idle_since_ns, uint64_t spin_ns, int timeout_ms, spin_stats_t *stats) {
+    const uint64_t now = net_now_ns();
+    stats->empty++;
+    if (*idle_since_ns == 0) {
+        *idle_since_ns = now;
+        return;
     }
+    if (now - *idle_since_ns < spin_ns) {
+        return;
+    }
+    struct pollfd pfd = { .fd = sock, .events = POLLIN };
+    poll(&pfd, 1, timeout_ms);
+    stats->blocked++;
+    *idle_since_ns = 0;
+}
 
-    return (int)size;
+static void report_spin(const spin_stats_t *stats, uint64_t spin_ns) {
+    LOGI(TAG, PROTO_TAG "Busy-poll: %llu empty receives, %llu blocking waits after the %llu us budget",
+         stats->empty, stats->blocked, (unsigned long long)(spin_ns / 1000));
 }
 
-static inline int parse_repetitions(const char *str) {
-    char *endptr;
-    errno = 0;
-    const long repetitions = strtol(str, &endptr, 10);
+// Segment size of a GRO buffer, from the UDP_GRO control message
+// Buffers without one hold a single datagram
+static int gro_segment_size(struct msghdr *hdr, int len) {
+    for (struct cmsghdr *cm = CMSG_FIRSTHDR(hdr); cm != NULL; cm = CMSG_NXTHDR(hdr, cm)) {
+        if (cm->cmsg_level == SOL_UDP && cm->cmsg_type == UDP_GRO) {
+            int size;
+            memcpy(&size, CMSG_DATA(cm), sizeof(size));
+            return size > 0 ? size : len;
+        }
+    }
+    return len;
+}
 
-    if (errno != 0 || endptr == str || *endptr != '\0') {
-        return -2;
+// High-throughput path: up to batch_size datagrams per recvmmsg into
+// preallocated buffers, aggregate rates logged every REPORT_INTERVAL_MS
+// With gro the kernel may hand over several same-sized datagrams of one flow
+// as a single coalesced buffer, which is split back here at the segment size
+// rx_ts != NULL accounts kernel receive timestamps against the time recvmmsg returned
+// peers != NULL counts per sender and replaces the rate line with a dashboard
+static int receive_batched(int sock, int buffer_size, int batch_size, int repetitions, seq_tracker_t *tracker, int gro,
+                           rx_ts_stats_t *rx_ts, peer_stats_t *peers, uint64_t spin_ns) {
+    if (gro) {
+        int one = 1;
+        if (setsockopt(sock, SOL_UDP, UDP_GRO, &one, sizeof(one)) < 0) {
+            LOGW_ERRNO(TAG, PROTO_TAG "UDP_GRO unsupported, receiving one datagram per buffer");
+            gro = 0;
+        }
     }
 
-    if (repetitions < -1 || repetitions > INT_MAX) {
-        return -2;
+    // Coalesced buffers can be far larger than a single datagram
+    const int slot_size = gro ? GRO_BUFFER_SIZE : buffer_size;
+    char *bufs = malloc((size_t)batch_size * slot_size);
+    const int use_ctrl = gro || rx_ts != NULL || peers != NULL;
+    char *ctrls = use_ctrl ? calloc(batch_size, RX_CMSG_SPACE) : NULL;
+    struct sockaddr_in *addrs = (peers != NULL) ? calloc(batch_size, sizeof(struct sockaddr_in)) : NULL;
+    struct iovec *iovs = calloc(batch_size, sizeof(struct iovec));
+    struct mmsghdr *msgs = calloc(batch_size, sizeof(struct mmsghdr));
+    if (bufs == NULL || iovs == NULL || msgs == NULL || (use_ctrl && ctrls == NULL) || (peers != NULL && addrs == NULL)) {
+        LOGE(TAG, "Failed to allocate %d receive buffers of size %d", batch_size, slot_size);
+        free(bufs);
+        free(ctrls);
+        free(addrs);
+        free(iovs);
+        free(msgs);
+        return EXIT_FAILURE;
     }
-    
-    return (int)repetitions;
-}
\ No newline at end of file
+
+    for (int i = 0; i < batch_size; i++) {
+        iovs[i].iov_base = bufs + (size_t)i * slot_size;
+        iovs[i].iov_len  = slot_size;
+        msgs[i].msg_hdr.msg_iov    = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        if (use_ctrl) {
+            msgs[i].msg_hdr.msg_control = ctrls + (size_t)i * RX_CMSG_SPACE;
+        }
+        if (peers != NULL) {
+            msgs[i].msg_hdr.msg_name = &addrs[i];
+        }
+    }
+
+    // Wake up periodically so reports are printed even when idle
+    struct timeval tv = { .tv_sec = REPORT_INTERVAL_MS / 1000, .tv_usec = (REPORT_INTERVAL_MS % 1000) * 1000 };
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    LOGI(TAG, PROTO_TAG "Batched receive, up to %d %s per syscall%s", batch_size, gro ? "GRO buffers" : "datagrams",
+         spin_ns > 0 ? ", busy-polling" : "");
+
+    unsigned long long total_packets = 0, total_bytes = 0, total_truncated = 0, total_calls = 0, total_buffers = 0;
+    unsigned long long interval_packets = 0, interval_bytes = 0;
+    uint64_t last_report_ms = net_now_ns() / 1000000;
+    const uint64_t start_cpu_ns = net_cpu_ns();
+    spin_stats_t spin = { 0 };
+    uint64_t idle_since_ns = 0;
+    int ret = EXIT_SUCCESS;
+
+    while (running) {
+        if (use_ctrl) {
+            for (int i = 0; i < batch_size; i++) {
+                msgs[i].msg_hdr.msg_controllen = RX_CMSG_SPACE;  // Overwritten with the used length
+            }
+        }
+        if (peers != NULL) {
+            for (int i = 0; i < batch_size; i++) {
+                msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+            }
+        }
+
+        int n = recvmmsg(sock, msgs, batch_size, spin_ns > 0 ? MSG_DONTWAIT : MSG_WAITFORONE, NULL);
+        if (n < 0) {
+            if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK) {
+                LOGE_ERRNO(TAG, "recvmmsg() failed.");
+                ret = EXIT_FAILURE;
+                break;
+            }
+            if (spin_ns > 0 && errno != EINTR) {
+                spin_idle(sock, &idle_since_ns, spin_ns, REPORT_INTERVAL_MS, &spin);
+            }
+            n = 0;
+        } else {
+            idle_since_ns = 0;
+        }
+
+        total_calls += n > 0;
+        total_buffers += n;
+        int packets = 0;
+        // One user space receive time for the whole batch, that is when the data becomes usable
+        const uint64_t recv_ns = ((tracker != NULL || rx_ts != NULL) && n > 0) ? seq_now_ns() : 0;
+        for (int i = 0; i < n; i++) {
+            const char *data = iovs[i].iov_base;
+            const int len = msgs[i].msg_len;
+            const int seg_size = gro ? gro_segment_size(&msgs[i].msg_hdr, len) : len;
+            const int truncated = (msgs[i].msg_hdr.msg_flags & MSG_TRUNC) != 0;
+            if (truncated) {
+                total_truncated++;
+            }
+            // A GRO buffer is one flow, so one sender for all its segments
+            peer_stats_entry_t *peer = NULL;
+            if (peers != NULL) {
+                peer = peer_stats_get(peers, &addrs[i]);
+                peer_stats_read_drops(peers, &msgs[i].msg_hdr);
+            }
+            rx_ts_t ts;
+            const int has_ts = rx_ts != NULL && rx_ts_read(&msgs[i].msg_hdr, &ts) == 0;
+
+            // Every segment but the last is exactly seg_size bytes
+            int off = 0;
+            do {
+                const int seg_len = (len - off < seg_size) ? len - off : seg_size;
+                int used = seg_len;
+                int seg_truncated = truncated;
+                if (gro && used > buffer_size) {
+                    total_truncated++;  // Same view as without GRO and a buffer_size receive buffer
+                    used = buffer_size;
+                    seg_truncated = 1;
+                }
+                if (peer != NULL) {
+                    peer_stats_count(peer, used, seg_truncated);
+                }
+                packets++;
+                interval_bytes += used;
+                seq_header_t hdr;
+                const int has_hdr = (tracker != NULL || has_ts) && seq_header_decode(data + off, used, &hdr) == 0;
+                if (has_hdr && tracker != NULL) {
+                    seq_tracker_record(tracker, &hdr, recv_ns);
+                }
+                if (has_ts) {
+                    rx_ts_stats_add(rx_ts, &ts, recv_ns, has_hdr ? hdr.send_ns : 0);  // Segments share the stamp
+                } else if (rx_ts != NULL) {
+                    rx_ts->missing++;
+                }
+                off += seg_len;
+            } while (off < len);
+        }
+        interval_packets += packets;
+
+        const uint64_t now = net_now_ns() / 1000000;
+        if (now - last_report_ms >= REPORT_INTERVAL_MS) {
+            const double secs = (now - last_report_ms) / 1000.0;
+            total_packets += interval_packets;
+            total_bytes += interval_bytes;
+            if (peers != NULL) {
+                report_peers(peers, now * 1000000ull);
+            } else {
+                LOGI(TAG, PROTO_TAG "%.0f pkt/s, %.2f MB/s, %.1f pkt/syscall (total %llu pkts, %llu bytes, %llu truncated)",
+                     interval_packets / secs, interval_bytes / secs / 1e6,
+                     total_calls ? (double)total_packets / total_calls : 0.0,
+                     total_packets, total_bytes, total_truncated);
+            }
+            if (tracker != NULL) {
+                report_seq(tracker);
+            }
+            if (rx_ts != NULL) {
+                report_rx_ts(rx_ts);
+            }
+            interval_packets = 0;
+            interval_bytes = 0;
+            last_report_ms = now;
+        }
+
+        if (repetitions > 0) {
+            repetitions = (packets >= repetitions) ? 0 : repetitions - packets;
+            if (repetitions == 0) break;
+        }
+    }
+
+    total_packets += interval_packets;
+    total_bytes += interval_bytes;
+    const uint64_t used_cpu_ns = net_cpu_ns() - start_cpu_ns;
+    LOGI(TAG, PROTO_TAG "Received %llu packets, %llu bytes in %llu syscalls (%llu buffers, %.1f pkt/syscall, %.0f ns CPU/pkt, %llu truncated)",
+         total_packets, total_bytes, total_calls, total_buffers,
+         total_calls ? (double)total_packets / total_calls : 0.0,
+         total_packets ? (double)used_cpu_ns / total_packets : 0.0, total_truncated);
+    if (spin_ns > 0) {
+        report_spin(&spin, spin_ns);
+    }
+    if (tracker != NULL) {
+        report_seq(tracker);
+    }
+    if (rx_ts != NULL) {
+        report_rx_ts(rx_ts);
+    }
+    if (peers != NULL) {
+        report_peer_totals(peers);
+    }
+
+    if (!running) {
+        LOGD(TAG, "Received shutdown signal, exiting gracefully");
+    }
+    free(bufs);
+    free(ctrls);
+    free(addrs);
+    free(iovs);
+    free(msgs);
+    return ret;
+}
+
+// io_uring path: one multishot recv keeps delivering datagrams into kernel
+// picked buffers from a provided buffer ring, so the only syscall left is the
+// io_uring_enter that waits for a batch of completions
+// Returns URING_FALLBACK if the kernel lacks io_uring, buffer rings or multishot recv
+static int receive_uring(int sock, int buffer_size, int repetitions, seq_tracker_t *tracker) {
+    uring_t ring;
+    uring_buf_ring_t bufs;
+    if (uring_init(&ring, URING_ENTRIES) != 0) {
+        LOGW_ERRNO(TAG, PROTO_TAG "io_uring unavailable, falling back to recvmmsg");
+        return URING_FALLBACK;
+    }
+    if (uring_buf_ring_init(&ring, &bufs, 0, URING_BUF_ENTRIES, buffer_size) != 0) {
+        LOGW_ERRNO(TAG, PROTO_TAG "io_uring buffer rings unsupported, falling back to recvmmsg");
+        uring_free(&ring);
+        return URING_FALLBACK;
+    }
+
+    // MSG_TRUNC makes res the full datagram length, so truncation is visible
+    uring_prep_recv_multishot(uring_get_sqe(&ring), sock, bufs.bgid, MSG_TRUNC, 0);
+
+    LOGI(TAG, PROTO_TAG "io_uring multishot receive, %d provided buffers of %d bytes", URING_BUF_ENTRIES, buffer_size);
+
+    unsigned long long total_packets = 0, total_bytes = 0, total_truncated = 0, rearms = 0;
+    unsigned long long interval_packets = 0, interval_bytes = 0;
+    uint64_t last_report_ms = net_now_ns() / 1000000;
+    int ret = EXIT_SUCCESS;
+
+    while (running && ret == EXIT_SUCCESS) {
+        int err = uring_submit_and_wait(&ring, 1, REPORT_INTERVAL_MS);
+        if (err < 0 && err != -ETIME && err != -EINTR) {
+            errno = -err;
+            LOGE_ERRNO(TAG, "io_uring_enter() failed");
+            ret = EXIT_FAILURE;
+            break;
+        }
+
+        const uint64_t recv_ns = (tracker != NULL) ? seq_now_ns() : 0;
+        struct io_uring_cqe *cqe;
+        while ((cqe = uring_peek_cqe(&ring)) != NULL) {
+            const int res = cqe->res;
+            const unsigned flags = cqe->flags;
+            uring_cqe_seen(&ring);
+
+            if (res >= 0 && (flags & IORING_CQE_F_BUFFER)) {
+                const uint16_t bid = flags >> IORING_CQE_BUFFER_SHIFT;
+                const char *data = uring_buf_ring_buf(&bufs, bid);
+                const int len = res < buffer_size ? res : buffer_size;
+                interval_packets++;
+                interval_bytes += len;
+                if (res > buffer_size) {
+                    total_truncated++;
+                }
+                seq_header_t hdr;
+                if (tracker != NULL && seq_header_decode(data, len, &hdr) == 0) {
+                    seq_tracker_record(tracker, &hdr, recv_ns);
+                }
+                uring_buf_ring_add(&bufs, bid);
+            } else if (res < 0 && res != -ENOBUFS) {
+                if (res == -EINVAL && total_packets + interval_packets == 0) {
+                    LOGW(TAG, PROTO_TAG "Multishot recv unsupported, falling back to recvmmsg");
+                    ret = URING_FALLBACK;
+                    break;
+                }
+                errno = -res;
+                LOGE_ERRNO(TAG, "io_uring recv failed");
+                ret = EXIT_FAILURE;
+                break;
+            }
+
+            // Multishot stops when the buffer ring runs dry, re-arm once buffers are back
+            if (!(flags & IORING_CQE_F_MORE)) {
+                rearms++;
+                uring_prep_recv_multishot(uring_get_sqe(&ring), sock, bufs.bgid, MSG_TRUNC, 0);
+            }
+
+            if (repetitions > 0 && --repetitions == 0) {
+                running = 0;
+                break;
+            }
+        }
+        uring_buf_ring_publish(&bufs);
+
+        const uint64_t now = net_now_ns() / 1000000;
+        if (now - last_report_ms >= REPORT_INTERVAL_MS) {
+            const double secs = (now - last_report_ms) / 1000.0;
+            total_packets += interval_packets;
+            total_bytes += interval_bytes;
+            LOGI(TAG, PROTO_TAG "%.0f pkt/s, %.2f MB/s, %.1f pkt/syscall (total %llu pkts, %llu bytes, %llu truncated)",
+                 interval_packets / secs, interval_bytes / secs / 1e6,
+                 ring.enters ? (double)total_packets / ring.enters : 0.0,
+                 total_packets, total_bytes, total_truncated);
+            if (tracker != NULL) {
+                report_seq(tracker);
+            }
+            interval_packets = 0;
+            interval_bytes = 0;
+            last_report_ms = now;
+        }
+    }
+
+    total_packets += interval_packets;
+    total_bytes += interval_bytes;
+    if (ret != URING_FALLBACK) {
+        LOGI(TAG, PROTO_TAG "Received %llu packets, %llu bytes in %llu syscalls (%llu truncated, %llu re-arms)",
+             total_packets, total_bytes, ring.enters, total_truncated, rearms);
+        if (tracker != NULL) {
+            report_seq(tracker);
+        }
+        if (!running) {
+            LOGD(TAG, "Received shutdown signal, exiting gracefully");
+        }
+    }
+    uring_buf_ring_free(&ring, &bufs);
+    uring_free(&ring);
+    return ret;
+}
+
+typedef struct {
+    unsigned long long messages;
+    unsigned long long bytes;
+    seq_tracker_t *tracker;
+} reliable_rx_t;
+
+static void on_reliable_message(void *arg, const struct sockaddr_in *from, const void *data, size_t len) {
+    (void)from;
+    reliable_rx_t *rx = arg;
+    rx->messages++;
+    rx->bytes += len;
+    seq_header_t hdr;
+    if (rx->tracker != NULL && seq_header_decode(data, len, &hdr) == 0) {
+        seq_tracker_record(rx->tracker, &hdr, seq_now_ns());
+    }
+}
+
+// Reliable mode: the rudp library acknowledges every message and suppresses
+// duplicates, each message reaches on_reliable_message exactly once.
+// Messages larger than buffer_size are dropped unacknowledged
+// impair_cfg != NULL impairs the outgoing ACKs to exercise the sender's recovery
+static int receive_reliable(int sock, int buffer_size, int repetitions, const impair_config_t *impair_cfg, seq_tracker_t *tracker) {
+    reliable_rx_t rx = { .messages = 0, .bytes = 0, .tracker = tracker };
+    rudp_t rudp;
+    impair_t im;
+    rudp_config_t cfg = RUDP_CONFIG_DEFAULT;
+    cfg.max_payload = buffer_size;
+    cfg.pool_blocks = 1;  // Nothing is sent but ACKs
+    cfg.on_message = on_reliable_message;
+    cfg.arg = &rx;
+    if (impair_cfg != NULL) {
+        if (impair_init(&im, impair_cfg, RUDP_ACK_SIZE, impair_sendto, &sock) != 0) {
+            LOGE(TAG, "Failed to set up impairment");
+            return EXIT_FAILURE;
+        }
+        cfg.impair = &im;
+    }
+    if (rudp_init(&rudp, sock, &cfg) != 0) {
+        LOGE(TAG, "Failed to set up reliable transport");
+        if (impair_cfg != NULL) impair_free(&im);
+        return EXIT_FAILURE;
+    }
+
+    LOGI(TAG, PROTO_TAG "Reliable receive, messages up to %d bytes", buffer_size);
+    if (impair_cfg != NULL) {
+        char desc[256];
+        impair_describe(impair_cfg, desc, sizeof(desc));
+        LOGI(TAG, PROTO_TAG "ACK impairment: %s", desc);
+    }
+
+    unsigned long long last_messages = 0, last_bytes = 0;
+    uint64_t last_report_ms = net_now_ns() / 1000000;
+    int ret = EXIT_SUCCESS;
+
+    while (running) {
+        // Delayed ACKs need a wake-up of their own
+        uint64_t wait_ns = REPORT_INTERVAL_MS * 1000000ull;
+        if (impair_cfg != NULL) {
+            const uint64_t due = impair_next_ns(&im);
+            const uint64_t now_ns = net_now_ns();
+            if (due != UINT64_MAX && (due <= now_ns || due - now_ns < wait_ns)) {
+                wait_ns = (due > now_ns) ? due - now_ns : 0;
+            }
+        }
+        const struct timespec timeout = { .tv_sec = wait_ns / 1000000000ull, .tv_nsec = wait_ns % 1000000000ull };
+        struct pollfd pfd = { .fd = sock, .events = POLLIN };
+        if (ppoll(&pfd, 1, &timeout, NULL) < 0 && errno != EINTR) {
+            LOGE_ERRNO(TAG, "ppoll() failed");
+            ret = EXIT_FAILURE;
+            break;
+        }
+        if (rudp_process(&rudp) < 0) {
+            LOGE_ERRNO(TAG, "recvmmsg() failed.");
+            ret = EXIT_FAILURE;
+            break;
+        }
+
+        const uint64_t now = net_now_ns() / 1000000;
+        if (now - last_report_ms >= REPORT_INTERVAL_MS) {
+            const double secs = (now - last_report_ms) / 1000.0;
+            LOGI(TAG, PROTO_TAG "%.0f msg/s, %.2f MB/s delivered (total %llu msgs, %llu duplicates suppressed, %llu ACKs sent)",
+                 (rx.messages - last_messages) / secs, (rx.bytes - last_bytes) / secs / 1e6,
+                 rx.messages, (unsigned long long)rudp.stats.duplicates, (unsigned long long)rudp.stats.acks_sent);
+            if (tracker != NULL) {
+                report_seq(tracker);
+            }
+            last_messages = rx.messages;
+            last_bytes = rx.bytes;
+            last_report_ms = now;
+        }
+
+        if (repetitions > 0 && rx.messages >= (unsigned long long)repetitions) {
+            break;
+        }
+    }
+
+    const rudp_stats_t *st = &rudp.stats;
+    LOGI(TAG, PROTO_TAG "Delivered %llu messages, %llu bytes (%llu duplicates suppressed, %llu out of window, "
+         "%llu skipped after the sender gave up, %llu invalid, %llu ACKs sent)",
+         rx.messages, rx.bytes, (unsigned long long)st->duplicates, (unsigned long long)st->out_of_window,
+         (unsigned long long)st->skipped, (unsigned long long)st->invalid, (unsigned long long)st->acks_sent);
+    if (tracker != NULL) {
+        report_seq(tracker);
+    }
+    if (impair_cfg != NULL) {
+        report_impair(&im);
+        impair_free(&im);
+    }
+    if (!running) {
+        LOGD(TAG, "Received shutdown signal, exiting gracefully");
+    }
+    rudp_free(&rudp);
+    return ret;
+}
+
+typedef struct {
+    unsigned long long packets;
+    unsigned long long bytes;
+    seq_tracker_t *tracker;
+} impaired_rx_t;
+
+static void on_impaired_datagram(void *arg, const void *data, size_t len, const struct sockaddr_in *from) {
+    (void)from;
+    impaired_rx_t *rx = arg;
+    rx->packets++;
+    rx->bytes += len;
+    seq_header_t hdr;
+    if (rx->tracker != NULL && seq_header_decode(data, len, &hdr) == 0) {
+        seq_tracker_record(rx->tracker, &hdr, seq_now_ns());
+    }
+}
+
+// Impaired receive: datagrams drained with recvmmsg pass through the impairment
+// shim before they count, so -H measures the loss, reordering, duplicates and
+// jitter it adds. The loop wakes for the socket, the next delayed datagram and reports
+static int receive_impaired(int sock, int buffer_size, int batch_size, int repetitions, const impair_config_t *impair_cfg,
+                            seq_tracker_t *tracker) {
+    impaired_rx_t rx = { .packets = 0, .bytes = 0, .tracker = tracker };
+    impair_t im;
+    if (impair_init(&im, impair_cfg, buffer_size, on_impaired_datagram, &rx) != 0) {
+        LOGE(TAG, "Failed to set up impairment");
+        return EXIT_FAILURE;
+    }
+    char *bufs = malloc((size_t)batch_size * buffer_size);
+    struct iovec *iovs = calloc(batch_size, sizeof(struct iovec));
+    struct mmsghdr *msgs = calloc(batch_size, sizeof(struct mmsghdr));
+    struct sockaddr_in *addrs = calloc(batch_size, sizeof(struct sockaddr_in));
+    if (bufs == NULL || iovs == NULL || msgs == NULL || addrs == NULL) {
+        LOGE(TAG, "Failed to allocate %d receive buffers of size %d", batch_size, buffer_size);
+        free(bufs);
+        free(iovs);
+        free(msgs);
+        free(addrs);
+        impair_free(&im);
+        return EXIT_FAILURE;
+    }
+    for (int i = 0; i < batch_size; i++) {
+        iovs[i].iov_base = bufs + (size_t)i * buffer_size;
+        iovs[i].iov_len  = buffer_size;
+        msgs[i].msg_hdr.msg_iov    = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_name   = &addrs[i];
+    }
+
+    char desc[256];
+    impair_describe(impair_cfg, desc, sizeof(desc));
+    LOGI(TAG, PROTO_TAG "Impaired receive: %s", desc);
+
+    unsigned long long total_truncated = 0, last_packets = 0, last_bytes = 0;
+    uint64_t last_report_ms = net_now_ns() / 1000000;
+    int ret = EXIT_SUCCESS;
+
+    while (running) {
+        uint64_t wait_ns = REPORT_INTERVAL_MS * 1000000ull;
+        const uint64_t due = impair_next_ns(&im);
+        const uint64_t now_ns = net_now_ns();
+        if (due != UINT64_MAX && (due <= now_ns || due - now_ns < wait_ns)) {
+            wait_ns = (due > now_ns) ? due - now_ns : 0;
+        }
+        const struct timespec timeout = { .tv_sec = wait_ns / 1000000000ull, .tv_nsec = wait_ns % 1000000000ull };
+        struct pollfd pfd = { .fd = sock, .events = POLLIN };
+        if (ppoll(&pfd, 1, &timeout, NULL) < 0 && errno != EINTR) {
+            LOGE_ERRNO(TAG, "ppoll() failed");
+            ret = EXIT_FAILURE;
+            break;
+        }
+
+        for (int i = 0; i < batch_size; i++) {
+            msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+        }
+        const int n = recvmmsg(sock, msgs, batch_size, MSG_DONTWAIT, NULL);
+        if (n < 0 && errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK) {
+            LOGE_ERRNO(TAG, "recvmmsg() failed.");
+            ret = EXIT_FAILURE;
+            break;
+        }
+        for (int i = 0; i < n; i++) {
+            if (msgs[i].msg_hdr.msg_flags & MSG_TRUNC) {
+                total_truncated++;
+            }
+            impair_submit(&im, iovs[i].iov_base, msgs[i].msg_len, &addrs[i]);
+        }
+        impair_run(&im);
+
+        const uint64_t now = net_now_ns() / 1000000;
+        if (now - last_report_ms >= REPORT_INTERVAL_MS) {
+            const double secs = (now - last_report_ms) / 1000.0;
+            LOGI(TAG, PROTO_TAG "%.0f pkt/s, %.2f MB/s after impairment (total %llu pkts, %llu lost, %llu duplicated, %u held)",
+                 (rx.packets - last_packets) / secs, (rx.bytes - last_bytes) / secs / 1e6, rx.packets,
+                 (unsigned long long)(im.stats.lost + im.stats.overflow), (unsigned long long)im.stats.duplicated,
+                 impair_held(&im));
+            if (tracker != NULL) {
+                report_seq(tracker);
+            }
+            last_packets = rx.packets;
+            last_bytes = rx.bytes;
+            last_report_ms = now;
+        }
+
+        if (repetitions > 0 && rx.packets >= (unsigned long long)repetitions) {
+            break;
+        }
+    }
+
+    LOGI(TAG, PROTO_TAG "Received %llu packets, %llu bytes after impairment (%llu truncated)",
+         rx.packets, rx.bytes, total_truncated);
+    report_impair(&im);
+    if (tracker != NULL) {
+        report_seq(tracker);
+    }
+    if (!running) {
+        LOGD(TAG, "Received shutdown signal, exiting gracefully");
+    }
+    impair_free(&im);
+    free(bufs);
+    free(iovs);
+    free(msgs);
+    free(addrs);
+    return ret;
+}
+
+// Reflects every datagram to its source, up to batch_size per recvmmsg/sendmmsg
+// No per-packet logging, it would dominate the measured RTT
+static int echo_batched(int sock, int buffer_size, int batch_size, int repetitions, uint64_t spin_ns) {
+    char *bufs = malloc((size_t)batch_size * buffer_size);
+    struct iovec *iovs = calloc(batch_size, sizeof(struct iovec));
+    struct mmsghdr *msgs = calloc(batch_size, sizeof(struct mmsghdr));
+    struct sockaddr_in *peers = calloc(batch_size, sizeof(struct sockaddr_in));
+    if (bufs == NULL || iovs == NULL || msgs == NULL || peers == NULL) {
+        LOGE(TAG, "Failed to allocate %d echo buffers of size %d", batch_size, buffer_size);
+        free(bufs);
+        free(iovs);
+        free(msgs);
+        free(peers);
+        return EXIT_FAILURE;
+    }
+
+    for (int i = 0; i < batch_size; i++) {
+        msgs[i].msg_hdr.msg_iov    = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_name   = &peers[i];
+    }
+
+    LOGI(TAG, PROTO_TAG "Echo mode, up to %d datagrams per syscall%s", batch_size, spin_ns > 0 ? ", busy-polling" : "");
+
+    unsigned long long total_echoed = 0, send_errors = 0;
+    spin_stats_t spin = { 0 };
+    uint64_t idle_since_ns = 0;
+    int ret = EXIT_SUCCESS;
+
+    while (running) {
+        for (int i = 0; i < batch_size; i++) {
+            iovs[i].iov_base = bufs + (size_t)i * buffer_size;
+            iovs[i].iov_len  = buffer_size;
+            msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+        }
+
+        int n = recvmmsg(sock, msgs, batch_size, spin_ns > 0 ? MSG_DONTWAIT : MSG_WAITFORONE, NULL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (spin_ns > 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                spin_idle(sock, &idle_since_ns, spin_ns, REPORT_INTERVAL_MS, &spin);
+                continue;
+            }
+            LOGE_ERRNO(TAG, "recvmmsg() failed.");
+            ret = EXIT_FAILURE;
+            break;
+        }
+        idle_since_ns = 0;
+
+        // Send back exactly what arrived (truncated to the buffer)
+        for (int i = 0; i < n; i++) {
+            iovs[i].iov_len = msgs[i].msg_len < (unsigned)buffer_size ? msgs[i].msg_len : (unsigned)buffer_size;
+        }
+        int sent = 0;
+        while (sent < n) {
+            int m = sendmmsg(sock, msgs + sent, n - sent, 0);
+            if (m < 0) {
+                if (errno == EINTR) continue;
+                send_errors++;  // Skip the failing datagram, the peer counts it as lost
+                m = 1;
+            }
+            sent += m;
+        }
+        total_echoed += n;
+
+        if (repetitions > 0) {
+            repetitions = (n >= repetitions) ? 0 : repetitions - n;
+            if (repetitions == 0) break;
+        }
+    }
+
+    LOGI(TAG, PROTO_TAG "Echoed %llu datagrams (%llu send errors)", total_echoed, send_errors);
+    if (spin_ns > 0) {
+        report_spin(&spin, spin_ns);
+    }
+    if (!running) {
+        LOGD(TAG, "Received shutdown signal, exiting gracefully");
+    }
+    free(bufs);
+    free(iovs);
+    free(msgs);
+    free(peers);
+    return ret;
+}
+
+// One line per sender, cumulative since start
+// Latency is only meaningful with synchronized clocks, jitter is not affected by offset
+static void report_seq(const seq_tracker_t *tracker) {
+    for (size_t i = 0; i < tracker->count; i++) {
+        const seq_sender_t *s = &tracker->senders[i];
+        const uint64_t expected = s->highest_seq - s->first_seq + 1;
+        const uint64_t lost = seq_sender_lost(s);
+        LOGI(TAG, PROTO_TAG "sender %u: seq %llu-%llu, rx %llu, lost %llu (%.3f%%), reordered %llu, dup %llu, late %llu, "
+             "latency min/avg/max %.1f/%.1f/%.1f us, jitter %.1f us",
+             s->sender_id, (unsigned long long)s->first_seq, (unsigned long long)s->highest_seq,
+             (unsigned long long)s->received, (unsigned long long)lost, 100.0 * lost / expected,
+             (unsigned long long)s->reordered, (unsigned long long)s->duplicates, (unsigned long long)s->late,
+             s->min_transit_ns / 1e3, (double)s->sum_transit_ns / s->received / 1e3, s->max_transit_ns / 1e3,
+             s->jitter_ns / 1e3);
+    }
+    if (tracker->untracked > 0) {
+        LOGW(TAG, PROTO_TAG "%llu packets from senders beyond the %d tracked",
+             (unsigned long long)tracker->untracked, SEQ_MAX_SENDERS);
+    }
+}
+
+// Cumulative since start. Scheduling delay is kernel stamp to user space, network
+// delay sender stamp to kernel stamp, the latter only for packets with a sequence header
+static void report_rx_ts(const rx_ts_stats_t *stats) {
+    if (stats->samples == 0) {
+        LOGW(TAG, PROTO_TAG "No kernel receive timestamps (%llu packets without)", (unsigned long long)stats->missing);
+        return;
+    }
+    const rx_ts_delay_t *sched = &stats->sched;
+    const rx_ts_delay_t *net = &stats->net;
+    LOGI(TAG, PROTO_TAG "kernel->user min/avg/max %.1f/%.1f/%.1f us over %llu packets (%llu hardware stamps, %llu without)",
+         sched->min_ns / 1e3, (double)sched->sum_ns / sched->count / 1e3, sched->max_ns / 1e3,
+         (unsigned long long)stats->samples, (unsigned long long)stats->hardware, (unsigned long long)stats->missing);
+    if (net->count > 0) {
+        LOGI(TAG, PROTO_TAG "sender->kernel min/avg/max %.1f/%.1f/%.1f us over %llu packets",
+             net->min_ns / 1e3, (double)net->sum_ns / net->count / 1e3, net->max_ns / 1e3,
+             (unsigned long long)net->count);
+    }
+}
+
+static void report_impair(const impair_t *im) {
+    const impair_stats_t *st = &im->stats;
+    LOGI(TAG, PROTO_TAG "Impairment: %llu datagrams in, %llu out, %llu lost, %llu queue overflows, %llu duplicated, %llu reordered, %u still held",
+         (unsigned long long)st->submitted, (unsigned long long)st->delivered, (unsigned long long)st->lost,
+         (unsigned long long)st->overflow, (unsigned long long)st->duplicated, (unsigned long long)st->reordered,
+         impair_held(im));
+}
+
+static const char *peer_name(const peer_stats_entry_t *e, char *buf, size_t len) {
+    if (e->addr.sin_family != AF_INET) {
+        snprintf(buf, len, "other");  // Senders beyond MAX_PEERS
+    } else {
+        snprintf(buf, len, "%s:%d", inet_ntoa(e->addr.sin_addr), ntohs(e->addr.sin_port));
+    }
+    return buf;
+}
+
+// Socket line, then one line per sender active since the last report, busiest
+// first. On a terminal the screen is cleared first, so it redraws in place
+static void report_peers(peer_stats_t *peers, uint64_t now_ns) {
+    const double secs = (now_ns - peers->mark_ns) / 1e9;
+    peer_stats_entry_t total;
+    peer_stats_total(peers, &total);
+    const peer_stats_entry_t *top[DASHBOARD_PEERS];
+    const uint32_t shown = peer_stats_top(peers, top, DASHBOARD_PEERS);
+
+    if (isatty(STDERR_FILENO)) {
+        fputs("\033[H\033[2J", stderr);
+    }
+    LOGI(TAG, PROTO_TAG "%u senders, %.0f pkt/s, %.2f MB/s, %.0f drops/s (total %llu pkts, %llu bytes, %llu dropped by the socket, %llu truncated)",
+         peers->count, (total.packets - total.last_packets) / secs, (total.bytes - total.last_bytes) / secs / 1e6,
+         (peers->drops - peers->last_drops) / secs, (unsigned long long)total.packets, (unsigned long long)total.bytes,
+         (unsigned long long)peers->drops, (unsigned long long)total.truncated);
+    for (uint32_t i = 0; i < shown; i++) {
+        char name[32];
+        LOGI(TAG, PROTO_TAG "  %-21s %10.0f pkt/s %9.2f MB/s   total %llu pkts, %llu bytes, %llu truncated",
+             peer_name(top[i], name, sizeof(name)), (top[i]->packets - top[i]->last_packets) / secs,
+             (top[i]->bytes - top[i]->last_bytes) / secs / 1e6, (unsigned long long)top[i]->packets,
+             (unsigned long long)top[i]->bytes, (unsigned long long)top[i]->truncated);
+    }
+    peer_stats_mark(peers, now_ns);
+}
+
+static void report_peer_totals(const peer_stats_t *peers) {
+    LOGI(TAG, PROTO_TAG "%u senders, %llu datagrams dropped by the socket", peers->count, (unsigned long long)peers->drops);
+    // In order of first datagram, the overflow entry last
+    uint32_t shown = 0;
+    for (uint32_t i = 0; i <= peers->count; i++) {
+        const peer_stats_entry_t *e = (i < peers->count) ? &peers->entries[i] : &peers->other;
+        if (e->packets == 0) {
+            continue;
+        }
+        if (shown++ == DASHBOARD_PEERS) {
+            LOGI(TAG, PROTO_TAG "  ... and the rest of the %u", peers->count);
+            break;
+        }
+        char name[32];
+        LOGI(TAG, PROTO_TAG "  %-21s %llu pkts, %llu bytes, %llu truncated", peer_name(e, name, sizeof(name)),
+             (unsigned long long)e->packets, (unsigned long long)e->bytes, (unsigned long long)e->truncated);
+    }
+}
@@ -0,0 +1,989 @@
+// Single-threaded peer node: UDP broadcast heartbeats, unicast probes and a
+// TCP mesh on one epoll, every periodic send and timeout on one timer wheel
+//
+// Nodes announce themselves to -a (broadcast address or multicast group) on
+// the shared UDP port with discovery heartbeats, the TCP port as their service
+// port, so they see and are seen by the discovery library as well. A heartbeat
+// makes the sender a peer in a peer_table and restarts its timeout, a leaving
+// heartbeat removes it at once. Each peer is probed by unicast for RTT, and the
+// node with the lower id opens a TCP connection to the other, over which both
+// sides stream state messages. Peers, connections and -W load timers are all
+// timers on the wheel, so neither threads nor timerfds grow with the number of
+// peers.
+
+#define _GNU_SOURCE // recvmmsg
+#include <netinet/in.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <arpa/inet.h>
+#include <signal.h>
+
+#define LOG_LEVEL LOG_LEVEL_DEBUG
+#include "log_helper/log_helper.h"
+#include "framing/framing.h"
+#include "mcast/mcast.h"
+#include "discovery/discovery.h"
+#include "peer_table/peer_table.h"
+#include "timer_wheel/timer_wheel.h"
+#include "net/net.h"
+
+#define DEFAULT_PORT 8080
+#define DEFAULT_HOST "255.255.255.255"
+#define DEFAULT_HEARTBEAT_MS 100
+#define DEFAULT_PROBE_MS 1000
+#define DEFAULT_STATE_MS 1000
+#define MAX_INTERVAL_MS 60000
+#define TIMEOUT_BEATS 5             // Missed heartbeats (or state messages on TCP) before giving up
+#define DEFAULT_MAX_PEERS 1024
+#define MAX_PEERS 65536
+#define MAX_LOAD_TIMERS 1000000
+#define LOAD_TIMER_MS 100           // Period of each -W load timer
+#define TICK_NS 1000000ull          // Timer wheel resolution, matches the epoll_wait timeout
+#define MAX_EVENTS 256
+#define RX_BATCH 64
+#define DEFAULT_BACKLOG 1024
+#define REPORT_INTERVAL_NS 1000000000ull
+
+#define PROBE_MAGIC 0x50524f42u     // "PROB"
+#define PROBE_MSG_SIZE 20           // magic(4) type(1) pad(3) seq(4) send_ns(8), network byte order
+#define STATE_MSG_SIZE 8            // node(4) seq(4), length-prefixed on TCP
+#define STATE_FRAME_SIZE (FRAMING_LENGTH_PREFIX_SIZE + STATE_MSG_SIZE)
+#define CONN_BUFFER_SIZE 256
+
+static const char *TAG = "udp_tcp_node";
+
+static volatile sig_atomic_t running = 1;
+
+typedef enum { MSG_PROBE = 1, MSG_PROBE_REPLY = 2 } msg_type_t;
+
+// What epoll data points at, first member of every registered object
+typedef enum { HANDLE_HEARTBEAT, HANDLE_PROBE, HANDLE_LISTEN, HANDLE_CONN } handle_kind_t;
+
+typedef struct {
+    handle_kind_t kind;
+    int fd;
+} handle_t;
+
+typedef struct peer peer_t;
+
+typedef struct conn {
+    handle_t handle;
+    int connecting;         // Non-blocking connect still in progress
+    peer_t *peer;           // NULL until a message names the node
+    struct sockaddr_in addr;
+    frame_decoder_t dec;
+    char out[STATE_FRAME_SIZE];  // Unsent tail of the last frame, newer states are dropped meanwhile
+    size_t out_off;
+    size_t out_len;
+    uint32_t seq;
+    wheel_timer_t send_timer;
+    wheel_timer_t idle_timer;
+    struct conn *prev, *next;
+} conn_t;
+
+struct peer {
+    uint32_t node_id;
+    uint32_t incarnation;
+    struct sockaddr_in addr;  // Heartbeat source, the peer's own UDP socket
+    uint16_t tcp_port;
+    uint32_t probe_seq;
+    wheel_timer_t timeout_timer;
+    wheel_timer_t probe_timer;
+    conn_t *conn;
+};
+
+typedef struct {
+    uint64_t heartbeats_sent;
+    uint64_t datagrams_received;    // From other nodes
+    uint64_t invalid;
+    uint64_t probes_sent;
+    uint64_t probes_answered;
+    uint64_t rtt_count;
+    uint64_t rtt_sum_ns;
+    uint64_t rtt_min_ns;
+    uint64_t rtt_max_ns;
+    uint64_t states_sent;
+    uint64_t states_received;
+    uint64_t states_dropped;        // Socket buffer full
+    uint64_t joins;
+    uint64_t leaves;                // Announced with a leaving heartbeat
+    uint64_t timeouts;
+    uint64_t restarts;
+    uint64_t conns_opened;
+    uint64_t conns_closed;
+    uint64_t load_fired;
+    uint64_t wakeups;
+} node_stats_t;
+
+typedef struct {
+    uint32_t node_id;
+    uint32_t incarnation;
+    uint32_t heartbeat_seq;
+    int epfd;
+    handle_t bcast;         // Shared port, heartbeats of every node
+    handle_t ucast;         // Own port, sends everything and gets probes and replies
+    handle_t listen;        // fd -1 without TCP
+    uint16_t tcp_port;
+    struct sockaddr_in dest;
+    uint64_t heartbeat_ns;
+    uint64_t probe_ns;      // 0 disables probes
+    uint64_t state_ns;      // 0 disables TCP
+    unsigned rng;
+
+    timer_wheel_t wheel;
+    wheel_timer_t heartbeat_timer;
+    wheel_timer_t report_timer;
+    wheel_timer_t *load_timers;
+    uint32_t n_load_timers;
+
+    peer_t *peers;          // Indexed by table slot
+    peer_table_t table;
+    uint32_t max_peers;
+    conn_t *conns;
+    conn_t *closed;         // Freed after the epoll batch, later events in it may still name them
+    uint32_t n_conns;
+
+    node_stats_t stats;
+    node_stats_t last;      // At the previous report
+    uint64_t last_fired;
+    uint64_t start_ns;
+    uint64_t last_report_ns;
+    uint64_t last_cpu_ns;
+} node_t;
+
+// One node per process, timer callbacks reach it from here
+static node_t node;
+
+static inline long parse_node_id(const char *str);
+static inline long parse_interval(const char *str, long min);
+static inline long parse_count(const char *str, long min, long max);
+
+static int  create_udp_socket(int port, const mcast_iface_t *iface);
+static void raise_fd_limit(uint32_t max_peers);
+static int  run_node(void);
+static void node_shutdown(void);
+
+#define CHECK(result, tag, fmt, ...) \
+    do { if ((result) < 0) { \
+        LOGE(tag, fmt, ##__VA_ARGS__); \
+        return EXIT_FAILURE; \
+    } } while(0)
+
+#define HELP_MSG() \
+    LOGI(TAG, "[-h (this message)] -i <node_id 0-%u> [-p <udp_port 1-65535> (shared by all nodes, %d by default)] "\
+         "[-a <broadcast address or multicast group> (%s by default)] [-I <interface name or address> (multicast)] "\
+         "[-t <tcp_port 0-65535> (0 picks one, announced in heartbeats)] [-K <heartbeat_ms 1-%d> (%d by default)] "\
+         "[-U <probe_ms 0-%d> (unicast RTT probe per peer, 0 disables, %d by default)] "\
+         "[-S <state_ms 0-%d> (TCP state message per connection, 0 disables TCP, %d by default)] "\
+         "[-c <max_peers 1-%d> (%d by default)] [-W <load_timers 0-%d> (extra %d ms periodic timers)]\n", \
+         UINT32_MAX, DEFAULT_PORT, DEFAULT_HOST, MAX_INTERVAL_MS, DEFAULT_HEARTBEAT_MS, MAX_INTERVAL_MS, DEFAULT_PROBE_MS, \
+         MAX_INTERVAL_MS, DEFAULT_STATE_MS, MAX_PEERS, DEFAULT_MAX_PEERS, MAX_LOAD_TIMERS, LOAD_TIMER_MS)
+
+
+int main(int argc, char **argv) {
+    long node_id       = -1;
+    int  udp_port      = DEFAULT_PORT;
+    int  tcp_port      = 0;
+    const char *dest_host = DEFAULT_HOST;
+    mcast_iface_t iface = MCAST_IFACE_DEFAULT;
+    long heartbeat_ms  = DEFAULT_HEARTBEAT_MS;
+    long probe_ms      = DEFAULT_PROBE_MS;
+    long state_ms      = DEFAULT_STATE_MS;
+    long max_peers     = DEFAULT_MAX_PEERS;
+    long load_timers   = 0;
+    int  opt;
+    while ((opt = getopt(argc, argv, "i:p:a:I:t:K:U:S:c:W:h")) != -1) {
+        switch (opt) {
+            case 'i':
+                node_id = parse_node_id(optarg);
+                CHECK(node_id, TAG, "Invalid node id: %s (must be between 0-%u)", optarg, UINT32_MAX);
+                break;
+            case 'p':
+                udp_port = net_parse_port(optarg);
+                CHECK(udp_port, TAG, "Invalid port: %s (must be between 1-65535)", optarg);
+                break;
+            case 'a':
+                dest_host = optarg;
+                break;
+            case 'I':
+                CHECK(mcast_parse_iface(optarg, &iface), TAG, "Invalid interface: %s (must be an interface name or IPv4 address)", optarg);
+                break;
+            case 't':
+                tcp_port = strcmp(optarg, "0") == 0 ? 0 : net_parse_port(optarg);
+                CHECK(tcp_port, TAG, "Invalid TCP port: %s (must be between 0-65535)", optarg);
+                break;
+            case 'K':
+                heartbeat_ms = parse_interval(optarg, 1);
+                CHECK(heartbeat_ms, TAG, "Invalid heartbeat: %s (must be between 1-%d ms)", optarg, MAX_INTERVAL_MS);
+                break;
+            case 'U':
+                probe_ms = parse_interval(optarg, 0);
+                CHECK(probe_ms, TAG, "Invalid probe interval: %s (must be between 0-%d ms)", optarg, MAX_INTERVAL_MS);
+                break;
+            case 'S':
+                state_ms = parse_interval(optarg, 0);
+                CHECK(state_ms, TAG, "Invalid state interval: %s (must be between 0-%d ms)", optarg, MAX_INTERVAL_MS);
+                break;
+            case 'c':
+                max_peers = parse_count(optarg, 1, MAX_PEERS);
+                CHECK(max_peers, TAG, "Invalid peer limit: %s (must be between 1-%d)", optarg, MAX_PEERS);
+                break;
+            case 'W':
+                load_timers = parse_count(optarg, 0, MAX_LOAD_TIMERS);
+                CHECK(load_timers, TAG, "Invalid load timer count: %s (must be between 0-%d)", optarg, MAX_LOAD_TIMERS);
+                break;
+            case 'h':
+                HELP_MSG();
+                return EXIT_SUCCESS;
+            case '?':
+                LOGE(TAG, "Disallowed argument %c", optopt);
+                HELP_MSG();
+                return EXIT_FAILURE;
+            default:
+                LOGE(TAG, "DEFAULT BRANCH GETOPT: Disallowed argument %c", optopt);
+                HELP_MSG();
+            return EXIT_FAILURE;
+        }
+    }
+    if (node_id < 0) {
+        LOGE(TAG, "A node id (-i) is required");
+        HELP_MSG();
+        return EXIT_FAILURE;
+    }
+
+    struct sockaddr_in dest = { .sin_family = AF_INET, .sin_port = htons(udp_port) };
+    if (inet_pton(AF_INET, dest_host, &dest.sin_addr) != 1) {
+        LOGE(TAG, "Invalid destination: %s (must be an IPv4 broadcast address or multicast group)", dest_host);
+        return EXIT_FAILURE;
+    }
+
+    node = (node_t){
+        .node_id = (uint32_t)node_id, .epfd = -1, .dest = dest,
+        .bcast = { HANDLE_HEARTBEAT, -1 }, .ucast = { HANDLE_PROBE, -1 }, .listen = { HANDLE_LISTEN, -1 },
+        .heartbeat_ns = (uint64_t)heartbeat_ms * 1000000ull,
+        .probe_ns = (uint64_t)probe_ms * 1000000ull,
+        .state_ns = (uint64_t)state_ms * 1000000ull,
+        .rng = (unsigned)node_id ^ (unsigned)getpid(),
+        .max_peers = (uint32_t)max_peers,
+        .n_load_timers = (uint32_t)load_timers,
+    };
+    raise_fd_limit(node.max_peers);
+
+    // Also ignores SIGPIPE, peers resetting mid-send must not kill the process
+    net_handle_signals(&running);
+
+    node.bcast.fd = create_udp_socket(udp_port, &iface);
+    node.ucast.fd = create_udp_socket(0, &iface);
+    if (node.state_ns > 0) {
+        const net_opts_t listen_opts = { .nonblocking = 1, .reuseaddr = 1 };
+        node.listen.fd = net_tcp_listener(tcp_port, DEFAULT_BACKLOG, &listen_opts);
+        if (node.listen.fd < 0) {
+            LOGE_ERRNO(TAG, "Could not listen on port %d", tcp_port);
+        }
+    }
+    if (node.bcast.fd < 0 || node.ucast.fd < 0 || (node.state_ns > 0 && node.listen.fd < 0)) {
+        node_shutdown();
+        return EXIT_FAILURE;
+    }
+    if (node.listen.fd >= 0) {
+        node.tcp_port = net_local_port(node.listen.fd);
+    }
+
+    int ret = run_node();
+    node_shutdown();
+    if (!running) {
+        LOGD(TAG, "Received shutdown signal, exiting gracefully");
+    }
+    return ret;
+}
+
+static inline long parse_node_id(const char *str) {
+    long id;
+    return net_parse_long(str, 0, (long)UINT32_MAX, &id) == 0 ? id : -1;
+}
+
+static inline long parse_interval(const char *str, long min) {
+    long ms;
+    return net_parse_long(str, min, MAX_INTERVAL_MS, &ms) == 0 ? ms : -1;
+}
+
+static inline long parse_count(const char *str, long min, long max) {
+    long count;
+    return net_parse_long(str, min, max, &count) == 0 ? count : -1;
+}
+
+// Somewhere in [0, interval), spreads periodic timers of many peers apart
+static inline uint64_t random_phase(uint64_t interval_ns) {
+    const uint64_t r = ((uint64_t)rand_r(&node.rng) << 31) ^ (uint64_t)rand_r(&node.rng);
+    return interval_ns > 0 ? r % interval_ns : 0;
+}
+
+// Next period of a periodic timer, skipping ahead instead of bursting after a stall
+static inline uint64_t next_period(const wheel_timer_t *t, uint64_t interval_ns, uint64_t now) {
+    const uint64_t next = t->expire_ns + interval_ns;
+    return next > now ? next : now + interval_ns;
+}
+
+static inline void put_u32(uint8_t *p, uint32_t v) {
+    v = htonl(v);
+    memcpy(p, &v, 4);
+}
+
+static inline uint32_t get_u32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return ntohl(v);
+}
+
+// A lost datagram is covered by the next period
+static void send_probe(msg_type_t type, uint32_t seq, uint64_t send_ns, const struct sockaddr_in *to) {
+    uint8_t pkt[PROBE_MSG_SIZE] = { 0 };
+    put_u32(pkt, PROBE_MAGIC);
+    pkt[4] = (uint8_t)type;
+    put_u32(pkt + 8, seq);
+    put_u32(pkt + 12, (uint32_t)(send_ns >> 32));
+    put_u32(pkt + 16, (uint32_t)send_ns);
+    sendto(node.ucast.fd, pkt, sizeof(pkt), MSG_DONTWAIT, (const struct sockaddr *)to, sizeof(*to));
+}
+
+static void send_heartbeat(uint8_t flags) {
+    const discovery_heartbeat_t hb = {
+        .node_id = node.node_id, .incarnation = node.incarnation, .seq = node.heartbeat_seq++,
+        .service_port = node.tcp_port, .flags = flags,
+    };
+    uint8_t pkt[DISCOVERY_HEARTBEAT_SIZE];
+    discovery_heartbeat_encode(&hb, pkt);
+    sendto(node.ucast.fd, pkt, sizeof(pkt), MSG_DONTWAIT, (const struct sockaddr *)&node.dest, sizeof(node.dest));
+    node.stats.heartbeats_sent++;
+}
+
+// =============================================================================
+// Peer table
+// =============================================================================
+
+static peer_t *find_peer(uint32_t node_id) {
+    const int32_t slot = peer_table_find(&node.table, node_id);
+    return slot >= 0 ? &node.peers[slot] : NULL;
+}
+
+static void on_peer_timeout(wheel_timer_t *t, void *arg);
+static void on_probe(wheel_timer_t *t, void *arg);
+static void conn_close(conn_t *c, const char *reason);
+static void connect_peer(peer_t *p);
+
+static peer_t *add_peer(uint32_t node_id, uint32_t incarnation) {
+    const int32_t slot = peer_table_add(&node.table, node_id);
+    if (slot < 0) {
+        return NULL;
+    }
+    peer_t *p = &node.peers[slot];
+    *p = (peer_t){ .node_id = node_id, .incarnation = incarnation };
+    timer_wheel_timer_init(&p->timeout_timer, on_peer_timeout, p);
+    timer_wheel_timer_init(&p->probe_timer, on_probe, p);
+    return p;
+}
+
+// Drops the connection, a restarted or departed peer has lost its end of it
+static void peer_disconnect(peer_t *p, const char *reason) {
+    if (p->conn != NULL) {
+        conn_t *c = p->conn;
+        c->peer = NULL;
+        p->conn = NULL;
+        conn_close(c, reason);
+    }
+}
+
+static void remove_peer(peer_t *p) {
+    timer_wheel_cancel(&node.wheel, &p->timeout_timer);
+    timer_wheel_cancel(&node.wheel, &p->probe_timer);
+    peer_disconnect(p, "peer gone");
+    peer_table_remove(&node.table, (int32_t)(p - node.peers));
+}
+
+static void on_peer_timeout(wheel_timer_t *t, void *arg) {
+    (void)t;
+    peer_t *p = arg;
+    node.stats.timeouts++;
+    LOGI(TAG, "[UDP] Peer %u timed out, %u alive", p->node_id, peer_table_count(&node.table) - 1);
+    remove_peer(p);
+}
+
+static void on_probe(wheel_timer_t *t, void *arg) {
+    peer_t *p = arg;
+    const uint64_t now = net_now_ns();
+    send_probe(MSG_PROBE, p->probe_seq++, now, &p->addr);
+    node.stats.probes_sent++;
+    timer_wheel_schedule(&node.wheel, t, next_period(t, node.probe_ns, now));
+}
+
+// =============================================================================
+// UDP
+// =============================================================================
+
+static void on_heartbeat_datagram(const uint8_t *buf, size_t len, const struct sockaddr_in *from, uint64_t now) {
+    discovery_heartbeat_t hb;
+    if (discovery_heartbeat_decode(buf, len, &hb) < 0) {
+        node.stats.invalid++;
+        return;
+    }
+    if (hb.node_id == node.node_id) {
+        return;  // Our own heartbeat coming back
+    }
+    node.stats.datagrams_received++;
+
+    peer_t *p = find_peer(hb.node_id);
+    if (hb.flags & DISCOVERY_FLAG_LEAVING) {
+        if (p != NULL && p->incarnation == hb.incarnation) {
+            node.stats.leaves++;
+            LOGI(TAG, "[UDP] Peer %u left, %u alive", p->node_id, peer_table_count(&node.table) - 1);
+            remove_peer(p);
+        }
+        return;
+    }
+    if (p == NULL) {
+        p = add_peer(hb.node_id, hb.incarnation);
+        if (p == NULL) {
+            return;  // Table full, counted as a datagram only
+        }
+        node.stats.joins++;
+        LOGI(TAG, "[UDP] Peer %u joined (%s:%d), %u alive", hb.node_id, inet_ntoa(from->sin_addr), ntohs(from->sin_port),
+             peer_table_count(&node.table));
+        // Peers heartbeating from the shared port run the discovery library,
+        // which does not answer probes, and unicast there reaches only one
+        // process on that host
+        if (node.probe_ns > 0 && from->sin_port != node.dest.sin_port) {
+            timer_wheel_schedule(&node.wheel, &p->probe_timer, now + random_phase(node.probe_ns));
+        }
+    } else if (p->incarnation != hb.incarnation) {
+        p->incarnation = hb.incarnation;
+        node.stats.restarts++;
+        LOGI(TAG, "[UDP] Peer %u restarted", p->node_id);
+        peer_disconnect(p, "peer restarted");
+    }
+    p->addr = *from;
+    p->tcp_port = hb.service_port;
+    timer_wheel_schedule(&node.wheel, &p->timeout_timer, now + node.heartbeat_ns * TIMEOUT_BEATS);
+
+    // The lower id connects, so each pair ends up with one connection. Retried
+    // on every heartbeat while it is missing
+    if (node.listen.fd >= 0 && p->tcp_port != 0 && p->conn == NULL && node.node_id < hb.node_id) {
+        connect_peer(p);
+    }
+}
+
+static void on_probe_datagram(const uint8_t *buf, size_t len, const struct sockaddr_in *from, uint64_t now) {
+    (void)now;
+    if (len != PROBE_MSG_SIZE || get_u32(buf) != PROBE_MAGIC) {
+        node.stats.invalid++;
+        return;
+    }
+    const uint32_t seq = get_u32(buf + 8);
+    const uint64_t send_ns = (uint64_t)get_u32(buf + 12) << 32 | get_u32(buf + 16);
+    node.stats.datagrams_received++;
+
+    switch (buf[4]) {
+    case MSG_PROBE:
+        send_probe(MSG_PROBE_REPLY, seq, send_ns, from);
+        node.stats.probes_answered++;
+        break;
+    case MSG_PROBE_REPLY: {
+        // Our own clock on both ends, no sync needed
+        const uint64_t rtt = net_now_ns() - send_ns;
+        node.stats.rtt_count++;
+        node.stats.rtt_sum_ns += rtt;
+        if (node.stats.rtt_min_ns == 0 || rtt < node.stats.rtt_min_ns) node.stats.rtt_min_ns = rtt;
+        if (rtt > node.stats.rtt_max_ns) node.stats.rtt_max_ns = rtt;
+        break;
+    }
+    default:
+        node.stats.invalid++;
+    }
+}
+
+typedef void (*datagram_fn)(const uint8_t *buf, size_t len, const struct sockaddr_in *from, uint64_t now);
+
+static void udp_read(int fd, datagram_fn on_datagram, size_t msg_size) {
+    uint8_t bufs[RX_BATCH][DISCOVERY_HEARTBEAT_SIZE > PROBE_MSG_SIZE ? DISCOVERY_HEARTBEAT_SIZE : PROBE_MSG_SIZE];
+    struct iovec iovs[RX_BATCH];
+    struct mmsghdr msgs[RX_BATCH];
+    struct sockaddr_in addrs[RX_BATCH];
+
+    for (;;) {
+        for (int i = 0; i < RX_BATCH; i++) {
+            // Anything longer is truncated and rejected for its length
+            iovs[i] = (struct iovec){ .iov_base = bufs[i], .iov_len = msg_size };
+            msgs[i].msg_hdr = (struct msghdr){
+                .msg_name = &addrs[i], .msg_namelen = sizeof(addrs[i]), .msg_iov = &iovs[i], .msg_iovlen = 1,
+            };
+        }
+        const int n = recvmmsg(fd, msgs, RX_BATCH, MSG_DONTWAIT, NULL);
+        if (n <= 0) {
+            if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                LOGE_ERRNO(TAG, "recvmmsg() failed");
+            }
+            return;
+        }
+        const uint64_t now = net_now_ns();
+        for (int i = 0; i < n; i++) {
+            const size_t len = (msgs[i].msg_hdr.msg_flags & MSG_TRUNC) ? 0 : msgs[i].msg_len;
+            on_datagram(bufs[i], len, &addrs[i], now);
+        }
+        if (n < RX_BATCH) {
+            return;
+        }
+    }
+}
+
+static void on_heartbeat(wheel_timer_t *t, void *arg) {
+    (void)arg;
+    const uint64_t now = net_now_ns();
+    send_heartbeat(0);
+    timer_wheel_schedule(&node.wheel, t, next_period(t, node.heartbeat_ns, now));
+}
+
+// =============================================================================
+// TCP
+// =============================================================================
+
+static void on_state_send(wheel_timer_t *t, void *arg);
+static void on_conn_idle(wheel_timer_t *t, void *arg);
+
+static void conn_set_events(conn_t *c, uint32_t events) {
+    struct epoll_event ev = { .events = events, .data.ptr = c };
+    epoll_ctl(node.epfd, EPOLL_CTL_MOD, c->handle.fd, &ev);
+}
+
+static conn_t *conn_open(int fd, const struct sockaddr_in *addr, peer_t *peer, int connecting) {
+    conn_t *c = calloc(1, sizeof(conn_t));
+    if (c == NULL || frame_decoder_init(&c->dec, FRAMING_LENGTH_PREFIX, CONN_BUFFER_SIZE) != 0) {
+        LOGE(TAG, "[TCP] Failed to allocate connection state");
+        free(c);
+        close(fd);
+        return NULL;
+    }
+    c->handle = (handle_t){ HANDLE_CONN, fd };
+    c->addr = *addr;
+    c->peer = peer;
+    c->connecting = connecting;
+    timer_wheel_timer_init(&c->send_timer, on_state_send, c);
+    timer_wheel_timer_init(&c->idle_timer, on_conn_idle, c);
+
+    struct epoll_event ev = { .events = connecting ? EPOLLOUT : EPOLLIN, .data.ptr = c };
+    if (epoll_ctl(node.epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        LOGE_ERRNO(TAG, "[TCP] epoll_ctl() failed");
+        frame_decoder_free(&c->dec);
+        free(c);
+        close(fd);
+        return NULL;
+    }
+    c->next = node.conns;
+    if (node.conns != NULL) node.conns->prev = c;
+    node.conns = c;
+    node.n_conns++;
+    node.stats.conns_opened++;
+    return c;
+}
+
+// Both ends stream state once connected, first message right away so the
+// accepting side learns who it is talking to
+static void conn_established(conn_t *c, uint64_t now) {
+    net_set_nodelay(c->handle.fd);
+    timer_wheel_schedule(&node.wheel, &c->send_timer, now);
+    timer_wheel_schedule(&node.wheel, &c->idle_timer, now + node.state_ns * TIMEOUT_BEATS);
+}
+
+static void conn_close(conn_t *c, const char *reason) {
+    LOGD(TAG, "[TCP] Connection %s:%d closed (%s)", inet_ntoa(c->addr.sin_addr), ntohs(c->addr.sin_port), reason);
+    timer_wheel_cancel(&node.wheel, &c->send_timer);
+    timer_wheel_cancel(&node.wheel, &c->idle_timer);
+    if (c->peer != NULL && c->peer->conn == c) {
+        c->peer->conn = NULL;
+    }
+    close(c->handle.fd);  // Also removes it from the epoll set
+    c->handle.fd = -1;
+    frame_decoder_free(&c->dec);
+    if (c->prev != NULL) c->prev->next = c->next; else node.conns = c->next;
+    if (c->next != NULL) c->next->prev = c->prev;
+    node.n_conns--;
+    node.stats.conns_closed++;
+    c->next = node.closed;
+    node.closed = c;
+}
+
+static void free_closed(void) {
+    while (node.closed != NULL) {
+        conn_t *c = node.closed;
+        node.closed = c->next;
+        free(c);
+    }
+}
+
+static void connect_peer(peer_t *p) {
+    const struct sockaddr_in addr = { .sin_family = AF_INET, .sin_addr = p->addr.sin_addr, .sin_port = htons(p->tcp_port) };
+    const net_opts_t opts = { .nonblocking = 1 };
+    const int fd = net_tcp_connect(&addr, &opts);
+    if (fd < 0) {
+        LOGW_ERRNO(TAG, "[TCP] connect() to peer %u failed", p->node_id);
+        return;
+    }
+    p->conn = conn_open(fd, &addr, p, 1);
+}
+
+// Returns -1 once the connection is gone
+static int conn_flush(conn_t *c) {
+    while (c->out_len > 0) {
+        const ssize_t n = send(c->handle.fd, c->out + c->out_off, c->out_len, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                conn_set_events(c, EPOLLIN | EPOLLOUT);
+                return 0;
+            }
+            if (errno == EINTR) continue;
+            conn_close(c, strerror(errno));
+            return -1;
+        }
+        c->out_off += (size_t)n;
+        c->out_len -= (size_t)n;
+    }
+    conn_set_events(c, EPOLLIN);
+    return 0;
+}
+
+static void on_state_send(wheel_timer_t *t, void *arg) {
+    conn_t *c = arg;
+    const uint64_t now = net_now_ns();
+    timer_wheel_schedule(&node.wheel, t, next_period(t, node.state_ns, now));
+    if (c->out_len > 0) {
+        node.stats.states_dropped++;  // The previous one is still queued, the next one supersedes this
+        return;
+    }
+
+    uint8_t msg[STATE_MSG_SIZE];
+    put_u32(msg, node.node_id);
+    put_u32(msg + 4, c->seq++);
+    c->out_len = (size_t)frame_encode(FRAMING_LENGTH_PREFIX, (const char *)msg, sizeof(msg), c->out, sizeof(c->out));
+    c->out_off = 0;
+    node.stats.states_sent++;
+
+    // Common case: the whole frame goes out at once, no epoll change needed
+    const ssize_t n = send(c->handle.fd, c->out, c->out_len, MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (n == (ssize_t)c->out_len) {
+        c->out_len = 0;
+        return;
+    }
+    if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        conn_close(c, strerror(errno));
+        return;
+    }
+    if (n > 0) {
+        c->out_off = (size_t)n;
+        c->out_len -= (size_t)n;
+    }
+    conn_set_events(c, EPOLLIN | EPOLLOUT);
+}
+
+static void on_conn_idle(wheel_timer_t *t, void *arg) {
+    (void)t;
+    conn_close(arg, "idle");
+}
+
+static void conn_message(conn_t *c, const char *msg, size_t len, uint64_t now) {
+    if (len != STATE_MSG_SIZE) {
+        node.stats.invalid++;
+        return;
+    }
+    const uint32_t node_id = get_u32((const uint8_t *)msg);
+    if (c->peer == NULL) {
+        peer_t *p = find_peer(node_id);
+        if (p != NULL && p->conn == NULL) {
+            p->conn = c;
+            c->peer = p;
+        }
+    }
+    node.stats.states_received++;
+    timer_wheel_schedule(&node.wheel, &c->idle_timer, now + node.state_ns * TIMEOUT_BEATS);
+}
+
+static void conn_read(conn_t *c) {
+    for (;;) {
+        size_t space;
+        char *dst = frame_decoder_write_ptr(&c->dec, &space);
+        const ssize_t n = recv(c->handle.fd, dst, space, MSG_DONTWAIT);
+        if (n == 0) {
+            conn_close(c, "closed by peer");
+            return;
+        }
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                conn_close(c, strerror(errno));
+            }
+            return;
+        }
+        frame_decoder_commit(&c->dec, (size_t)n);
+
+        const uint64_t now = net_now_ns();
+        const char *msg;
+        size_t len;
+        int rc;
+        while ((rc = frame_decoder_next(&c->dec, &msg, &len)) == 1) {
+            conn_message(c, msg, len, now);
+        }
+        if (rc < 0) {
+            conn_close(c, "oversized message");
+            return;
+        }
+        if ((size_t)n < space) {
+            return;  // Drained
+        }
+    }
+}
+
+static void conn_event(conn_t *c, uint32_t events) {
+    if (c->connecting) {
+        int err = 0;
+        socklen_t err_len = sizeof(err);
+        getsockopt(c->handle.fd, SOL_SOCKET, SO_ERROR, &err, &err_len);
+        if (err != 0 || (events & (EPOLLERR | EPOLLHUP))) {
+            conn_close(c, err != 0 ? strerror(err) : "connect failed");
+            return;
+        }
+        c->connecting = 0;
+        conn_set_events(c, EPOLLIN);
+        conn_established(c, net_now_ns());
+        return;
+    }
+    if (events & EPOLLOUT) {
+        if (conn_flush(c) < 0) return;
+    }
+    if (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+        conn_read(c);
+    }
+}
+
+static void accept_all(void) {
+    for (;;) {
+        struct sockaddr_in addr;
+        const int fd = net_accept(node.listen.fd, &addr);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                LOGE_ERRNO(TAG, "[TCP] accept() failed");
+            }
+            return;
+        }
+        conn_t *c = conn_open(fd, &addr, NULL, 0);
+        if (c != NULL) {
+            conn_established(c, net_now_ns());
+        }
+    }
+}
+
+// =============================================================================
+// Event loop
+// =============================================================================
+
+static void on_load_timer(wheel_timer_t *t, void *arg) {
+    (void)arg;
+    node.stats.load_fired++;
+    timer_wheel_schedule(&node.wheel, t, next_period(t, LOAD_TIMER_MS * 1000000ull, net_now_ns()));
+}
+
+static void on_report(wheel_timer_t *t, void *arg) {
+    (void)arg;
+    const uint64_t now = net_now_ns();
+    const uint64_t cpu = net_cpu_ns();
+    const double secs = (double)(now - node.last_report_ns) / 1e9;
+    const node_stats_t *s = &node.stats;
+    const node_stats_t *l = &node.last;
+    const uint64_t rtt_count = s->rtt_count - l->rtt_count;
+
+    LOGI(TAG, "%u peers, %u TCP connections, %u timers armed, %.0f timer fires/s, %.0f datagrams/s, %.0f TCP messages/s in, "
+         "probe RTT %.1f us avg, %.1f%% CPU",
+         peer_table_count(&node.table), node.n_conns, timer_wheel_count(&node.wheel),
+         (double)(node.wheel.stats.fired - node.last_fired) / secs,
+         (double)(s->datagrams_received - l->datagrams_received) / secs,
+         (double)(s->states_received - l->states_received) / secs,
+         rtt_count > 0 ? (double)(s->rtt_sum_ns - l->rtt_sum_ns) / rtt_count / 1e3 : 0.0,
+         100.0 * (double)(cpu - node.last_cpu_ns) / (double)(now - node.last_report_ns));
+
+    node.last = node.stats;
+    node.last_fired = node.wheel.stats.fired;
+    node.last_report_ns = now;
+    node.last_cpu_ns = cpu;
+    timer_wheel_schedule(&node.wheel, t, next_period(t, REPORT_INTERVAL_NS, now));
+}
+
+static int run_node(void) {
+    node.peers = calloc(node.max_peers, sizeof(peer_t));
+    node.load_timers = calloc(node.n_load_timers > 0 ? node.n_load_timers : 1, sizeof(wheel_timer_t));
+    node.epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (node.peers == NULL || peer_table_init(&node.table, node.max_peers) < 0 || node.load_timers == NULL || node.epfd < 0) {
+        LOGE_ERRNO(TAG, "Failed to set up the node");
+        return EXIT_FAILURE;
+    }
+    node.incarnation = discovery_new_incarnation();
+
+    // Level-triggered, connections left in the backlog on EMFILE are retried
+    handle_t *handles[] = { &node.bcast, &node.ucast, &node.listen };
+    for (size_t i = 0; i < sizeof(handles) / sizeof(handles[0]); i++) {
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = handles[i] };
+        if (handles[i]->fd >= 0) {
+            epoll_ctl(node.epfd, EPOLL_CTL_ADD, handles[i]->fd, &ev);
+        }
+    }
+
+    const uint64_t start = net_now_ns();
+    timer_wheel_init(&node.wheel, TICK_NS, start);
+    timer_wheel_timer_init(&node.heartbeat_timer, on_heartbeat, NULL);
+    timer_wheel_schedule(&node.wheel, &node.heartbeat_timer, start);
+    timer_wheel_timer_init(&node.report_timer, on_report, NULL);
+    timer_wheel_schedule(&node.wheel, &node.report_timer, start + REPORT_INTERVAL_NS);
+    for (uint32_t i = 0; i < node.n_load_timers; i++) {
+        timer_wheel_timer_init(&node.load_timers[i], on_load_timer, NULL);
+        timer_wheel_schedule(&node.wheel, &node.load_timers[i], start + random_phase(LOAD_TIMER_MS * 1000000ull));
+    }
+    node.start_ns = node.last_report_ns = start;
+    node.last_cpu_ns = net_cpu_ns();
+    const uint64_t start_cpu = node.last_cpu_ns;
+
+    LOGI(TAG, "Node %u: heartbeats every %llu ms to %s:%d, UDP probes every %llu ms, %s, %u load timers",
+         node.node_id, (unsigned long long)(node.heartbeat_ns / 1000000), inet_ntoa(node.dest.sin_addr),
+         ntohs(node.dest.sin_port), (unsigned long long)(node.probe_ns / 1000000),
+         node.listen.fd >= 0 ? "TCP state stream" : "no TCP", node.n_load_timers);
+    if (node.listen.fd >= 0) {
+        LOGI(TAG, "[TCP] Listening on port %u, state every %llu ms", node.tcp_port, (unsigned long long)(node.state_ns / 1000000));
+    }
+
+    struct epoll_event events[MAX_EVENTS];
+    while (running) {
+        const uint64_t next = timer_wheel_next_ns(&node.wheel);
+        const uint64_t now = net_now_ns();
+        const int timeout_ms = next == UINT64_MAX ? -1 :
+                               next <= now ? 0 : (int)((next - now + 999999) / 1000000);
+        const int n = epoll_wait(node.epfd, events, MAX_EVENTS, timeout_ms);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            LOGE_ERRNO(TAG, "epoll_wait() failed");
+            return EXIT_FAILURE;
+        }
+        node.stats.wakeups++;
+
+        for (int i = 0; i < n; i++) {
+            handle_t *h = events[i].data.ptr;
+            switch (h->kind) {
+            case HANDLE_HEARTBEAT:
+                udp_read(h->fd, on_heartbeat_datagram, DISCOVERY_HEARTBEAT_SIZE);
+                break;
+            case HANDLE_PROBE:
+                udp_read(h->fd, on_probe_datagram, PROBE_MSG_SIZE);
+                break;
+            case HANDLE_LISTEN:
+                accept_all();
+                break;
+            case HANDLE_CONN:
+                if (h->fd >= 0) {
+                    conn_event((conn_t *)h, events[i].events);
+                }
+                break;
+            }
+        }
+        free_closed();
+        timer_wheel_advance(&node.wheel, net_now_ns());
+    }
+    send_heartbeat(DISCOVERY_FLAG_LEAVING);
+
+    const double secs = (double)(net_now_ns() - node.start_ns) / 1e9;
+    const node_stats_t *s = &node.stats;
+    const uint64_t events_handled = s->datagrams_received + s->states_received + node.wheel.stats.fired;
+    LOGI(TAG, "Node %u: %u peers after %.1f s, %llu joins, %llu left, %llu timed out, %llu restarted, %llu heartbeats sent, "
+         "%llu datagrams received (%llu invalid)",
+         node.node_id, peer_table_count(&node.table), secs, (unsigned long long)s->joins, (unsigned long long)s->leaves,
+         (unsigned long long)s->timeouts, (unsigned long long)s->restarts, (unsigned long long)s->heartbeats_sent,
+         (unsigned long long)s->datagrams_received, (unsigned long long)s->invalid);
+    LOGI(TAG, "Node %u: %llu probes, %llu replies, RTT %.1f/%.1f/%.1f us min/avg/max, %llu probes answered",
+         node.node_id, (unsigned long long)s->probes_sent, (unsigned long long)s->rtt_count,
+         s->rtt_min_ns / 1e3, s->rtt_count > 0 ? (double)s->rtt_sum_ns / s->rtt_count / 1e3 : 0.0, s->rtt_max_ns / 1e3,
+         (unsigned long long)s->probes_answered);
+    LOGI(TAG, "Node %u: %llu TCP connections opened, %llu closed, %llu state messages sent, %llu received, %llu dropped",
+         node.node_id, (unsigned long long)s->conns_opened, (unsigned long long)s->conns_closed,
+         (unsigned long long)s->states_sent, (unsigned long long)s->states_received, (unsigned long long)s->states_dropped);
+    LOGI(TAG, "Node %u: %llu timers fired (%llu load), %llu cascaded, %llu epoll wakeups, %.0f ns CPU/event",
+         node.node_id, (unsigned long long)node.wheel.stats.fired, (unsigned long long)s->load_fired,
+         (unsigned long long)node.wheel.stats.cascaded, (unsigned long long)s->wakeups,
+         events_handled > 0 ? (double)(net_cpu_ns() - start_cpu) / events_handled : 0.0);
+    return EXIT_SUCCESS;
+}
+
+static void node_shutdown(void) {
+    while (node.conns != NULL) {
+        conn_close(node.conns, "shutdown");
+    }
+    free_closed();
+    if (node.epfd >= 0) close(node.epfd);
+    if (node.listen.fd >= 0) close(node.listen.fd);
+    if (node.ucast.fd >= 0) close(node.ucast.fd);
+    if (node.bcast.fd >= 0) {
+        if (mcast_is_group(node.dest.sin_addr)) {
+            mcast_leave(node.bcast.fd, node.dest.sin_addr, NULL);
+        }
+        close(node.bcast.fd);
+    }
+    free(node.peers);
+    peer_table_free(&node.table);
+    free(node.load_timers);
+}
+
+// =============================================================================
+// Sockets
+// =============================================================================
+
+// port 0 makes the node's own unicast socket, which sends to the destination.
+// Any other port is shared by every node on the host (SO_REUSEADDR) and joins
+// the destination if it is a multicast group. Unicast to a shared port would
+// reach only one of the nodes
+static int create_udp_socket(int port, const mcast_iface_t *iface) {
+    const net_opts_t opts = { .nonblocking = 1, .reuseaddr = 1, .broadcast = 1 };
+    const int fd = net_udp_socket(port, &opts);
+    if (fd < 0) {
+        LOGE_ERRNO(TAG, "Could not bind socket to port %d", port);
+        return -1;
+    }
+
+    if (!mcast_is_group(node.dest.sin_addr)) {
+        return fd;
+    }
+    char name[INET_ADDRSTRLEN];
+    if (port == 0) {
+        // Loopback on, other nodes may run on this host
+        if (mcast_set_sender(fd, iface, MCAST_DEFAULT_TTL, 1) < 0) {
+            LOGE_ERRNO(TAG, "Failed to send multicast on interface %s", mcast_iface_name(iface, name, sizeof(name)));
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+    if (mcast_join(fd, node.dest.sin_addr, iface) < 0) {
+        LOGE_ERRNO(TAG, "Failed to join %s on interface %s", inet_ntoa(node.dest.sin_addr), mcast_iface_name(iface, name, sizeof(name)));
+        close(fd);
+        return -1;
+    }
+    LOGI(TAG, "[UDP] Joined %s on interface %s", inet_ntoa(node.dest.sin_addr), mcast_iface_name(iface, name, sizeof(name)));
+    return fd;
+}
+
+// A connection per peer plus the sockets of the node itself
+static void raise_fd_limit(uint32_t max_peers) {
+    const long wanted = (long)max_peers * 2 + 16;
+    const long limit = net_raise_fd_limit(wanted);
+    if (limit >= 0 && limit < wanted) {
+        LOGW(TAG, "Open file limit is %ld, connections to some of %u peers may fail", limit, max_peers);
+    }
+}
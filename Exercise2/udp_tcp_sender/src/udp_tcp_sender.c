@@ -1,22 +1,65 @@
+#define _GNU_SOURCE // sendmmsg, ppoll, MSG_ZEROCOPY
 #include <netinet/in.h>
+#include <netinet/udp.h>
+#include <netinet/tcp.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <limits.h>
+#include <math.h>
 #include <errno.h>
 #include <unistd.h>
+#include <time.h>
 #include <sys/socket.h>
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <string.h>
 #include <signal.h>
+#include <poll.h>
+#include <linux/errqueue.h>
 
 #define LOG_LEVEL LOG_LEVEL_DEBUG
 #include "log_helper/log_helper.h"
+#include "seq_header/seq_header.h"
+#include "framing/framing.h"
+#include "rudp/rudp.h"
+#include "impair/impair.h"
+#include "discovery/discovery.h"
+#include "mcast/mcast.h"
+#include "net/net.h"
 
 
 #define DEFAULT_PORT 8080
-#define DEFAULT_MAX_MSG_SIZE 65507
 #define DEFAULT_HOST "127.0.0.1"
 #define DEFAULT_SLEEP_PERIOD_S 5
+#define DEFAULT_PAYLOAD_SIZE 64
+#define DEFAULT_BURST 8
+#define MAX_BURST 1024
+#define MAX_GSO_SEGMENTS 64      // Kernel limit (UDP_MAX_SEGMENTS) on older kernels
+#define DEFAULT_RELIABLE_WINDOW 128
+#define DISCOVERY_HOST "255.255.255.255"  // Default destination in discovery mode
+#define DEFAULT_HEARTBEAT_MS 100
+#define MAX_HEARTBEAT_MS 60000
+#define DISCOVERY_TIMEOUT_BEATS 5         // Missed heartbeats before a peer has left
+#define REPORT_INTERVAL_NS 1000000000ull
+#define MAX_PACING_LAG_NS 10000000ull // Skip ahead instead of bursting when further behind
+#define PING_DRAIN_NS 1000000000ull    // Wait this long for outstanding replies after the last probe
+#define ZEROCOPY_MAX_INFLIGHT 256      // MSG_ZEROCOPY sends not yet completed before waiting, bounds pinned pages
+#define ZEROCOPY_DRAIN_NS 1000000000ull  // Wait this long for the last completions
+
+// Log-linear RTT histogram in ns, HDR style: 2^RTT_SUB_BITS buckets per power of two
+// gives about 3% relative precision over the whole range
+#define RTT_SUB_BITS 5
+#define RTT_SUB_COUNT (1 << RTT_SUB_BITS)
+#define RTT_MAX_SHIFT 36  // Values up to about 2^41 ns, larger ones go to the last bucket
+#define RTT_BUCKETS ((RTT_MAX_SHIFT + 1) * RTT_SUB_COUNT)
+
+typedef struct {
+    uint64_t buckets[RTT_BUCKETS];
+    uint64_t count;
+    uint64_t min;
+    uint64_t max;
+    uint64_t sum;
+} rtt_hist_t;
 
 static const char *TAG = "udp_tcp_sender";
 
@@ -24,15 +67,36 @@ static volatile sig_atomic_t running = 1;
 
 typedef enum { PROTO_UDP, PROTO_TCP } protocol_t;
 
-static void signal_handler(int sig) {
-    (void)sig;
-    running = 0;
-}
+// TCP streaming (-S): how messages reach the socket
+typedef enum { STREAM_OFF, STREAM_SEND, STREAM_WRITEV, STREAM_ZEROCOPY } stream_mode_t;
+static const char *const stream_mode_names[] = { "off", "send", "writev", "zerocopy" };
+
+// TCP streaming (-C): how the kernel coalesces them into segments
+typedef enum { COALESCE_NAGLE, COALESCE_NODELAY, COALESCE_CORK } coalesce_t;
+static const char *const coalesce_names[] = { "nagle", "nodelay", "cork" };
 
-static inline int parse_port(const char *str);
-static inline int parse_size(const char *str);
-static inline int parse_repetitions(const char *str);
 static inline long parse_period(const char *str);
+static inline double parse_rate(const char *str);
+static inline int parse_burst(const char *str);
+static inline long parse_sender_id(const char *str);
+static inline int parse_gso_segments(const char *str);
+static inline int parse_window(const char *str);
+static inline long parse_heartbeat(const char *str);
+static inline int parse_ttl(const char *str);
+static inline int parse_name(const char *str, const char *const *names, int n_names, int first);
+
+static int send_benchmark(int sockfd, const struct addrinfo *dest, const char *message, int msg_size,
+                          int payload_size, double rate_pps, int burst, int repetitions, long sender_id, int gso_segs,
+                          const impair_config_t *impair_cfg);
+static int ping(int sockfd, protocol_t protocol, int payload_size, double rate, int count, int busy_poll);
+static int send_reliable(int sockfd, const struct addrinfo *dest, const char *message, int msg_size,
+                         int payload_size, double rate_pps, int count, long sender_id, int window,
+                         const impair_config_t *impair_cfg);
+static int send_stream(int sockfd, const char *message, int msg_size, int payload_size, framing_type_t framing,
+                       double rate_pps, int burst, int repetitions, stream_mode_t mode, coalesce_t coalesce);
+static void report_impair(const impair_t *im);
+static int run_discovery(int sockfd, const struct addrinfo *dest, int port, uint32_t node_id, long heartbeat_ms,
+                         const mcast_iface_t *iface, int ttl, int loop);
 
 #define CHECK(result, tag, fmt, ...) \
     do { if ((result) < 0) { \
@@ -41,47 +105,171 @@ static inline long parse_period(const char *str);
     } } while(0)
 
 #define HELP_MSG() \
-    LOGI(TAG, "[-h (this message)] [-T (use TCP instead of UDP)] [-p <port 1-65535>] [-m \"message\"] [-s <max_msg_size> (%d by default)] [-a <host/ip address>] [-r <repetitions -1-%d> (infinite by default)] [-t <period_s> (%d by default)]\n", DEFAULT_MAX_MSG_SIZE, INT_MAX, DEFAULT_SLEEP_PERIOD_S)
+    LOGI(TAG, "[-h (this message)] [-T (use TCP instead of UDP)] [-p <port 1-65535>] [-m \"message\"] [-s <max_msg_size> (%d by default)] [-a <host/ip address>] [-r <repetitions -1-%d> (infinite by default)] [-t <period_s> (%d by default)] "\
+         "[-R <packets/s> | -M <Mbit/s> (UDP benchmark mode)] [-n <payload_size> (%d by default)] [-b <burst 1-%d> (%d by default)] "\
+         "[-i <sender_id 0-%u> (UDP, prefix payloads with a sequence header)] [-G <segments 1-%d> (UDP_SEGMENT offload in benchmark mode)] "\
+         "[-P <probes/s> (ping mode, RTT against an echoing receiver)] [-B (busy-poll for replies in ping mode)] "\
+         "[-f <none|len|fixed|nul> (TCP message framing, none by default)] "\
+         "[-L (reliable UDP: retransmit until acknowledged, -R/-M pace it)] [-w <window 1-%d> (%d by default)] "\
+         "[-N <%s> (impair outgoing datagrams in benchmark and reliable mode)] [-l <loss %%> (same as -N loss=)] "\
+         "[-D <node_id 0-%u> (peer discovery: heartbeats to -a, a broadcast address (%s by default) or multicast group, track peers on -p)] [-K <heartbeat_ms 1-%d> (%d by default)] "\
+         "[-I <interface name or address> (multicast: outgoing interface)] [-y <ttl 0-255> (multicast TTL, %d by default)] [-x (multicast: no loopback to this host)] "\
+         "[-S <send|writev|zerocopy> (TCP streaming of -n byte messages, -b per writev, unpaced unless -R/-M)] [-C <nagle|nodelay|cork> (TCP streaming coalescing, nagle by default)]\n", \
+         NET_MAX_UDP_PAYLOAD, INT_MAX, DEFAULT_SLEEP_PERIOD_S, DEFAULT_PAYLOAD_SIZE, MAX_BURST, DEFAULT_BURST, UINT32_MAX, MAX_GSO_SEGMENTS, RUDP_MAX_WINDOW, DEFAULT_RELIABLE_WINDOW, IMPAIR_SPEC_HELP, \
+         UINT32_MAX, DISCOVERY_HOST, MAX_HEARTBEAT_MS, DEFAULT_HEARTBEAT_MS, MCAST_DEFAULT_TTL)
 
 
 int main(int argc, char **argv) {
     int         dest_port = DEFAULT_PORT;
     const char *dest_host = DEFAULT_HOST;
+    int  dest_host_set    = 0;
     long sleep_period_s   = DEFAULT_SLEEP_PERIOD_S;
     int  repetitions      = -1; //infinite by default
 
-    int  max_msg_size   = DEFAULT_MAX_MSG_SIZE;
+    int  max_msg_size   = NET_MAX_UDP_PAYLOAD;
     int  msg_size       = 0;
     const char *message = "";
     protocol_t protocol = PROTO_UDP;
+    double rate_pps     = 0;   // >0 enables benchmark mode
+    double rate_mbps    = 0;
+    int  payload_size   = DEFAULT_PAYLOAD_SIZE;
+    int  burst          = DEFAULT_BURST;
+    long sender_id      = -1;  // >=0 enables the sequence header
+    double ping_rate    = 0;   // >0 enables ping mode
+    int  busy_poll      = 0;
+    int  gso_segs       = 0;   // >0 sends that many datagrams per buffer with UDP_SEGMENT
+    int  reliable       = 0;
+    int  window         = DEFAULT_RELIABLE_WINDOW;
+    impair_config_t impair_cfg = IMPAIR_CONFIG_DEFAULT;
+    int  impaired       = 0;
+    long discovery_id   = -1;  // >=0 enables discovery mode
+    long heartbeat_ms   = DEFAULT_HEARTBEAT_MS;
+    mcast_iface_t mcast_iface = MCAST_IFACE_DEFAULT;
+    int  mcast_opts     = 0;   // -I, -y or -x given
+    int  mcast_ttl      = MCAST_DEFAULT_TTL;
+    int  mcast_loop     = 1;
+    framing_type_t framing = FRAMING_NONE;
+    stream_mode_t stream_mode = STREAM_OFF;
+    coalesce_t coalesce = COALESCE_NAGLE;
+    int  coalesce_set   = 0;
     int  opt;
-    while ((opt = getopt(argc, argv, "Tp:m:s:a:r:t:h")) != -1) {
+    while ((opt = getopt(argc, argv, "Tp:m:s:a:r:t:R:M:n:b:i:P:Bf:G:Lw:l:N:D:K:I:y:xS:C:h")) != -1) {
         switch (opt) {
             case 'T':
                 protocol = PROTO_TCP;
                 break;
             case 'p':
-                dest_port = parse_port(optarg);
+                dest_port = net_parse_port(optarg);
                 CHECK(dest_port, TAG, "Invalid port: %s (must be between 1-65535)", optarg);
                 break;
             case 'm':
                 message = optarg;
                 break;
             case 's':
-                max_msg_size = parse_size(optarg);
-                CHECK(max_msg_size, TAG, "Invalid size: %s (must be between 0-65507)", optarg);
+                max_msg_size = net_parse_size(optarg, 0);
+                CHECK(max_msg_size, TAG, "Invalid size: %s (must be between 0-%d)", optarg, NET_MAX_UDP_PAYLOAD);
                 break;
             case 'a':
                 dest_host = optarg;
+                dest_host_set = 1;
                 break;
             case 'r':
-                repetitions = parse_repetitions(optarg);
+                repetitions = net_parse_repetitions(optarg);
                 if (repetitions != -1) CHECK(repetitions, TAG, "Invalid repetition: %s (must be between -1-%d)", optarg, INT_MAX);
                 break;
             case 't':
                 sleep_period_s = parse_period(optarg);
                 CHECK(sleep_period_s, TAG, "Invalid period: %s (must be between 0-%ld)", optarg, LONG_MAX);
                 break;
+            case 'R':
+                rate_pps = parse_rate(optarg);
+                CHECK(rate_pps, TAG, "Invalid rate: %s (must be > 0 packets/s)", optarg);
+                break;
+            case 'M':
+                rate_mbps = parse_rate(optarg);
+                CHECK(rate_mbps, TAG, "Invalid rate: %s (must be > 0 Mbit/s)", optarg);
+                break;
+            case 'n':
+                payload_size = net_parse_size(optarg, 0);
+                CHECK(payload_size, TAG, "Invalid payload size: %s (must be between 0-%d)", optarg, NET_MAX_UDP_PAYLOAD);
+                break;
+            case 'b':
+                burst = parse_burst(optarg);
+                CHECK(burst, TAG, "Invalid burst: %s (must be between 1-%d)", optarg, MAX_BURST);
+                break;
+            case 'i':
+                sender_id = parse_sender_id(optarg);
+                CHECK(sender_id, TAG, "Invalid sender id: %s (must be between 0-%u)", optarg, UINT32_MAX);
+                break;
+            case 'P':
+                ping_rate = parse_rate(optarg);
+                CHECK(ping_rate, TAG, "Invalid probe rate: %s (must be > 0 probes/s)", optarg);
+                break;
+            case 'B':
+                busy_poll = 1;
+                break;
+            case 'f': {
+                const int parsed = framing_parse(optarg);
+                CHECK(parsed, TAG, "Invalid framing: %s (must be none, len, fixed or nul)", optarg);
+                framing = parsed;
+                break;
+            }
+            case 'G':
+                gso_segs = parse_gso_segments(optarg);
+                CHECK(gso_segs, TAG, "Invalid GSO segments: %s (must be between 1-%d)", optarg, MAX_GSO_SEGMENTS);
+                break;
+            case 'L':
+                reliable = 1;
+                break;
+            case 'w':
+                window = parse_window(optarg);
+                CHECK(window, TAG, "Invalid window: %s (must be between 1-%d)", optarg, RUDP_MAX_WINDOW);
+                break;
+            case 'l': {
+                const double loss = net_parse_percent(optarg);
+                CHECK(loss, TAG, "Invalid loss: %s (must be between 0-100 %%)", optarg);
+                impair_cfg.loss = loss;
+                impaired = 1;
+                break;
+            }
+            case 'N':
+                CHECK(impair_parse(&impair_cfg, optarg), TAG, "Invalid impairment: %s (must be %s)", optarg, IMPAIR_SPEC_HELP);
+                impaired = 1;
+                break;
+            case 'D':
+                discovery_id = parse_sender_id(optarg);
+                CHECK(discovery_id, TAG, "Invalid node id: %s (must be between 0-%u)", optarg, UINT32_MAX);
+                break;
+            case 'K':
+                heartbeat_ms = parse_heartbeat(optarg);
+                CHECK(heartbeat_ms, TAG, "Invalid heartbeat: %s (must be between 1-%d ms)", optarg, MAX_HEARTBEAT_MS);
+                break;
+            case 'I':
+                CHECK(mcast_parse_iface(optarg, &mcast_iface), TAG, "Invalid interface: %s (must be an interface name or IPv4 address)", optarg);
+                mcast_opts = 1;
+                break;
+            case 'y':
+                mcast_ttl = parse_ttl(optarg);
+                CHECK(mcast_ttl, TAG, "Invalid TTL: %s (must be between 0-255)", optarg);
+                mcast_opts = 1;
+                break;
+            case 'x':
+                mcast_loop = 0;
+                mcast_opts = 1;
+                break;
+            case 'S': {
+                const int parsed = parse_name(optarg, stream_mode_names, STREAM_ZEROCOPY + 1, STREAM_SEND);
+                CHECK(parsed, TAG, "Invalid streaming mode: %s (must be send, writev or zerocopy)", optarg);
+                stream_mode = parsed;
+                break;
+            }
+            case 'C': {
+                const int parsed = parse_name(optarg, coalesce_names, COALESCE_CORK + 1, COALESCE_NAGLE);
+                CHECK(parsed, TAG, "Invalid coalescing: %s (must be nagle, nodelay or cork)", optarg);
+                coalesce = parsed;
+                coalesce_set = 1;
+                break;
+            }
             case 'h':
                 HELP_MSG();
                 return EXIT_SUCCESS;
@@ -102,6 +290,36 @@ int main(int argc, char **argv) {
         msg_size = max_msg_size;
     }
 
+    if (sender_id >= 0 && protocol != PROTO_UDP) {
+        LOGE(TAG, "Sequence header (-i) is UDP only");
+        return EXIT_FAILURE;
+    }
+    if (framing != FRAMING_NONE && protocol != PROTO_TCP) {
+        LOGE(TAG, "Framing (-f) is TCP only, datagrams are already framed");
+        return EXIT_FAILURE;
+    }
+    if (stream_mode != STREAM_OFF && (protocol != PROTO_TCP || ping_rate > 0)) {
+        LOGE(TAG, "Streaming (-S) is TCP only and runs without -P");
+        return EXIT_FAILURE;
+    }
+    if (coalesce_set && stream_mode == STREAM_OFF) {
+        LOGE(TAG, "Coalescing (-C) needs streaming mode (-S)");
+        return EXIT_FAILURE;
+    }
+    if (impaired && (protocol != PROTO_UDP || ping_rate > 0 || (!reliable && rate_pps == 0 && rate_mbps == 0))) {
+        LOGE(TAG, "Impairment (-N/-l) needs UDP benchmark (-R/-M) or reliable mode (-L)");
+        return EXIT_FAILURE;
+    }
+    if (discovery_id >= 0) {
+        if (protocol != PROTO_UDP || ping_rate > 0 || reliable || rate_pps > 0 || rate_mbps > 0 || impaired) {
+            LOGE(TAG, "Discovery (-D) runs on its own, without -T, -P, -L, -R/-M or -N");
+            return EXIT_FAILURE;
+        }
+        if (!dest_host_set) {
+            dest_host = DISCOVERY_HOST;
+        }
+    }
+
     const char *proto_str = (protocol == PROTO_TCP) ? "TCP" : "UDP";
 
     struct addrinfo hints = {
@@ -110,7 +328,7 @@ int main(int argc, char **argv) {
     };
     struct addrinfo *res;
 
-    char port_str[6];
+    char port_str[NI_MAXSERV];
     snprintf(port_str, sizeof(port_str), "%d", dest_port);
 
     int err = getaddrinfo(dest_host, port_str, &hints, &res);
@@ -119,27 +337,44 @@ int main(int argc, char **argv) {
         return EXIT_FAILURE;
     }
 
-    int sockfd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    // Broadcast for UDP sockets (required for 255.255.255.255)
+    net_opts_t sock_opts = NET_OPTS_DEFAULT;
+    sock_opts.broadcast = protocol == PROTO_UDP;
+    int sockfd = net_socket(res->ai_socktype, &sock_opts);
     if (sockfd < 0) {
         LOGE_ERRNO(TAG, "Failed to create socket");
         freeaddrinfo(res);
         return EXIT_FAILURE;
     }
 
-    // Enable broadcast for UDP sockets (required for 255.255.255.255)
-    if (protocol == PROTO_UDP) {
-        int broadcast = 1;
-        if (setsockopt(sockfd, SOL_SOCKET, SO_BROADCAST, &broadcast, sizeof(broadcast)) < 0) {
-            LOGE_ERRNO(TAG, "Failed to set SO_BROADCAST");
+    const int multicast = mcast_is_group(((const struct sockaddr_in *)res->ai_addr)->sin_addr);
+    if (multicast && protocol != PROTO_UDP) {
+        LOGE(TAG, "%s is a multicast group, which needs UDP", dest_host);
+        freeaddrinfo(res);
+        return EXIT_FAILURE;
+    }
+    if (mcast_opts && !multicast) {
+        LOGW(TAG, "%s is not a multicast group, ignoring -I, -y and -x", dest_host);
+    }
+
+    LOGD(TAG, "[%s] Created socket", proto_str);
+
+    // Discovery joins the group itself, it receives on the same socket
+    if (multicast && discovery_id < 0) {
+        char iface_name[INET_ADDRSTRLEN];
+        if (mcast_set_sender(sockfd, &mcast_iface, mcast_ttl, mcast_loop) < 0) {
+            LOGE_ERRNO(TAG, "Failed to set up multicast on interface %s", mcast_iface_name(&mcast_iface, iface_name, sizeof(iface_name)));
             close(sockfd);
             freeaddrinfo(res);
             return EXIT_FAILURE;
         }
+        LOGI(TAG, "[UDP] Multicast to %s: interface %s, TTL %d, loopback %s", dest_host,
+             mcast_iface_name(&mcast_iface, iface_name, sizeof(iface_name)), mcast_ttl, mcast_loop ? "on" : "off");
     }
-    LOGD(TAG, "[%s] Created socket", proto_str);
 
-    // TCP requires connection, UDP uses sendto()
-    if (protocol == PROTO_TCP) {
+    // TCP requires connection, UDP uses sendto() except in ping mode, where
+    // connecting filters replies to the echo server and surfaces ICMP errors
+    if (protocol == PROTO_TCP || ping_rate > 0) {
         if (connect(sockfd, res->ai_addr, res->ai_addrlen) < 0) {
             LOGE_ERRNO(TAG, "connect() failed");
             close(sockfd);
@@ -149,19 +384,128 @@ int main(int argc, char **argv) {
         LOGD(TAG, "[%s] Connected to %s:%d", proto_str, dest_host, dest_port);
     }
 
-    struct sigaction sa = {
-        .sa_handler = signal_handler,
-        .sa_flags = 0 // Allow for interrupt
-    };
-    sigemptyset(&sa.sa_mask);
-    sigaction(SIGINT, &sa, NULL);
-    sigaction(SIGTERM, &sa, NULL);
+    net_handle_signals(&running);
+
+    if (discovery_id >= 0) {
+        int ret = run_discovery(sockfd, res, dest_port, (uint32_t)discovery_id, heartbeat_ms, &mcast_iface, mcast_ttl, mcast_loop);
+        close(sockfd);
+        freeaddrinfo(res);
+        return ret;
+    }
+
+    if (ping_rate > 0) {
+        if (payload_size < SEQ_HEADER_SIZE) {
+            LOGW(TAG, "Payload size raised from %d to %d bytes to fit the probe header", payload_size, SEQ_HEADER_SIZE);
+            payload_size = SEQ_HEADER_SIZE;
+        }
+        int ret = ping(sockfd, protocol, payload_size, ping_rate, repetitions, busy_poll);
+        close(sockfd);
+        freeaddrinfo(res);
+        return ret;
+    }
+
+    if (reliable) {
+        if (protocol != PROTO_UDP) {
+            LOGE(TAG, "Reliable mode (-L) is UDP only");
+            close(sockfd);
+            freeaddrinfo(res);
+            return EXIT_FAILURE;
+        }
+        if (sender_id >= 0 && payload_size < SEQ_HEADER_SIZE) {
+            LOGW(TAG, "Payload size raised from %d to %d bytes to fit the sequence header", payload_size, SEQ_HEADER_SIZE);
+            payload_size = SEQ_HEADER_SIZE;
+        }
+        if (rate_mbps > 0) {
+            rate_pps = rate_mbps * 1e6 / (8.0 * (payload_size > 0 ? payload_size : 1));
+        }
+        int ret = send_reliable(sockfd, res, message, msg_size, payload_size, rate_pps, repetitions, sender_id, window, impaired ? &impair_cfg : NULL);
+        close(sockfd);
+        freeaddrinfo(res);
+        return ret;
+    }
+
+    if (stream_mode != STREAM_OFF) {
+        if (rate_mbps > 0) {
+            rate_pps = rate_mbps * 1e6 / (8.0 * (payload_size > 0 ? payload_size : 1));
+        }
+        int ret = send_stream(sockfd, message, msg_size, payload_size, framing, rate_pps, burst, repetitions, stream_mode, coalesce);
+        close(sockfd);
+        freeaddrinfo(res);
+        return ret;
+    }
+
+    if (gso_segs > 0 && rate_pps == 0 && rate_mbps == 0) {
+        LOGE(TAG, "GSO (-G) needs benchmark mode (-R/-M)");
+        close(sockfd);
+        freeaddrinfo(res);
+        return EXIT_FAILURE;
+    }
+
+    if (rate_pps > 0 || rate_mbps > 0) {
+        if (protocol != PROTO_UDP) {
+            LOGE(TAG, "Benchmark mode (-R/-M) is UDP only");
+            close(sockfd);
+            freeaddrinfo(res);
+            return EXIT_FAILURE;
+        }
+        if (sender_id >= 0 && payload_size < SEQ_HEADER_SIZE) {
+            LOGW(TAG, "Payload size raised from %d to %d bytes to fit the sequence header", payload_size, SEQ_HEADER_SIZE);
+            payload_size = SEQ_HEADER_SIZE;
+        }
+        if (rate_mbps > 0) {
+            rate_pps = rate_mbps * 1e6 / (8.0 * (payload_size > 0 ? payload_size : 1));
+        }
+        if (impaired && gso_segs > 0) {
+            LOGW(TAG, "Impairment works on single datagrams, ignoring -G");
+            gso_segs = 0;
+        }
+        int ret = send_benchmark(sockfd, res, message, msg_size, payload_size, rate_pps, burst, repetitions, sender_id, gso_segs,
+                                 impaired ? &impair_cfg : NULL);
+        close(sockfd);
+        freeaddrinfo(res);
+        return ret;
+    }
+
+    // With a sequence header the datagram is header + message, with TCP
+    // framing the whole frame is built once up front
+    char *tx_buf = NULL;
+    int tx_len = msg_size;
+    if (sender_id >= 0) {
+        tx_buf = malloc(SEQ_HEADER_SIZE + msg_size);
+        if (tx_buf == NULL) {
+            LOGE(TAG, "Failed to allocate send buffer of size: %d", SEQ_HEADER_SIZE + msg_size);
+            close(sockfd);
+            freeaddrinfo(res);
+            return EXIT_FAILURE;
+        }
+        memcpy(tx_buf + SEQ_HEADER_SIZE, message, msg_size);
+        tx_len = SEQ_HEADER_SIZE + msg_size;
+    } else if (framing != FRAMING_NONE) {
+        const size_t cap = (size_t)msg_size + FRAMING_FIXED_SIZE + FRAMING_LENGTH_PREFIX_SIZE + 1;
+        tx_buf = malloc(cap);
+        if (tx_buf != NULL) {
+            tx_len = frame_encode(framing, message, msg_size, tx_buf, cap);
+        }
+        if (tx_buf == NULL || tx_len < 0) {
+            LOGE(TAG, "Message of %d bytes does not fit %s framing", msg_size, framing_name(framing));
+            free(tx_buf);
+            close(sockfd);
+            freeaddrinfo(res);
+            return EXIT_FAILURE;
+        }
+    }
+    uint64_t seq = 0;
 
     LOGI(TAG, "[%s] Sending to %s:%d", proto_str, dest_host, dest_port);
     while (running) {
         ssize_t bytes_sent;
         if (protocol == PROTO_TCP) {
-            bytes_sent = send(sockfd, message, msg_size, 0);
+            bytes_sent = send(sockfd, tx_buf != NULL ? tx_buf : message, tx_len, 0);
+        } else if (tx_buf != NULL) {
+            const seq_header_t hdr = { .sender_id = (uint32_t)sender_id, .seq = seq++, .send_ns = seq_now_ns() };
+            seq_header_encode(tx_buf, &hdr);
+            bytes_sent = sendto(sockfd, tx_buf, tx_len, 0,
+                                res->ai_addr, res->ai_addrlen);
         } else {
             bytes_sent = sendto(sockfd, message, msg_size, 0,
                                 res->ai_addr, res->ai_addrlen);
@@ -169,6 +513,7 @@ int main(int argc, char **argv) {
         if (bytes_sent < 0) {
             if (errno == EINTR) continue;
             LOGE_ERRNO(TAG, "send() failed");
+            free(tx_buf);
             close(sockfd);
             freeaddrinfo(res);
             return EXIT_FAILURE;
@@ -185,71 +530,982 @@ int main(int argc, char **argv) {
     if (!running) {
         LOGD(TAG, "Received shutdown signal, exiting gracefully");
     }
+    free(tx_buf);
     close(sockfd);
     freeaddrinfo(res);
     return EXIT_SUCCESS;
 }
 
-static inline int parse_port(const char *str) {
-    char *endptr;
-    errno = 0;
-    const long port = strtol(str, &endptr, 10);
+static inline long parse_period(const char *str) {
+    long period;
+    return net_parse_long(str, 0, LONG_MAX, &period) == 0 ? period : -1;
+}
+
+static inline double parse_rate(const char *str) {
+    double rate;
+    return net_parse_double(str, 0, HUGE_VAL, &rate) == 0 && rate > 0 ? rate : -1;
+}
+
+static inline int parse_burst(const char *str) {
+    long burst;
+    return net_parse_long(str, 1, MAX_BURST, &burst) == 0 ? (int)burst : -1;
+}
+
+static inline long parse_sender_id(const char *str) {
+    long id;
+    return net_parse_long(str, 0, (long)UINT32_MAX, &id) == 0 ? id : -1;
+}
+
+static inline int parse_gso_segments(const char *str) {
+    long segs;
+    return net_parse_long(str, 1, MAX_GSO_SEGMENTS, &segs) == 0 ? (int)segs : -1;
+}
+
+static inline int parse_window(const char *str) {
+    long window;
+    return net_parse_long(str, 1, RUDP_MAX_WINDOW, &window) == 0 ? (int)window : -1;
+}
+
+static inline int parse_ttl(const char *str) {
+    long ttl;
+    return net_parse_long(str, 0, 255, &ttl) == 0 ? (int)ttl : -1;
+}
+
+// Index of str in names, from first on, -1 if not there
+static inline int parse_name(const char *str, const char *const *names, int n_names, int first) {
+    for (int i = first; i < n_names; i++) {
+        if (strcmp(str, names[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static inline long parse_heartbeat(const char *str) {
+    long ms;
+    return net_parse_long(str, 1, MAX_HEARTBEAT_MS, &ms) == 0 ? ms : -1;
+}
+
+static inline struct timespec ns_timespec(uint64_t ns) {
+    struct timespec ts = { .tv_sec = ns / 1000000000ull, .tv_nsec = ns % 1000000000ull };
+    return ts;
+}
+
+// Sleeps until deadline_ns, waking in between to release impaired datagrams on time
+static void sleep_impaired(impair_t *im, uint64_t deadline_ns) {
+    for (;;) {
+        impair_run(im);
+        if (!running || net_now_ns() >= deadline_ns) break;
+        const uint64_t due = impair_next_ns(im);
+        const struct timespec wake = ns_timespec(due < deadline_ns ? due : deadline_ns);
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL);
+    }
+}
+
+// Load generator: bursts of sendmmsg paced to rate_pps with an absolute-time
+// clock_nanosleep loop, so sleep overshoot does not accumulate as drift
+// sender_id >= 0 stamps each packet with a sequence header
+// gso_segs > 0 packs that many payloads back to back into each message and lets
+// the kernel cut them into datagrams (UDP_SEGMENT), one trip through the stack per message
+// impair_cfg != NULL sends every datagram through the impairment shim instead of sendmmsg
+static int send_benchmark(int sockfd, const struct addrinfo *dest, const char *message, int msg_size,
+                          int payload_size, double rate_pps, int burst, int repetitions, long sender_id, int gso_segs,
+                          const impair_config_t *impair_cfg) {
+    int segs = 1;
+    if (gso_segs > 0) {
+        if (payload_size == 0) {
+            LOGE(TAG, "GSO needs a payload size > 0");
+            return EXIT_FAILURE;
+        }
+        // The unsegmented buffer is still one UDP datagram on the way down
+        segs = gso_segs;
+        if ((long)segs * payload_size > NET_MAX_UDP_PAYLOAD) {
+            segs = NET_MAX_UDP_PAYLOAD / payload_size;
+            LOGW(TAG, "GSO segments lowered from %d to %d to fit %d bytes per buffer", gso_segs, segs, NET_MAX_UDP_PAYLOAD);
+        }
+        int gso_size = payload_size;
+        if (setsockopt(sockfd, SOL_UDP, UDP_SEGMENT, &gso_size, sizeof(gso_size)) < 0) {
+            LOGW_ERRNO(TAG, "UDP_SEGMENT unsupported, sending one datagram per message");
+            segs = 1;
+        }
+    }
+
+    // Without a header or GSO all messages can share one payload, GSO needs
+    // the payloads of a message to be contiguous
+    const int n_payloads = (sender_id >= 0 || segs > 1) ? burst : 1;
+    const int n_msgs = (burst + segs - 1) / segs;
+    char *payloads = malloc((size_t)n_payloads * (payload_size > 0 ? payload_size : 1));
+    struct iovec *iovs = calloc(n_msgs, sizeof(struct iovec));
+    struct mmsghdr *msgs = calloc(n_msgs, sizeof(struct mmsghdr));
+    if (payloads == NULL || iovs == NULL || msgs == NULL) {
+        LOGE(TAG, "Failed to allocate %d payloads of size %d", n_payloads, payload_size);
+        free(payloads);
+        free(iovs);
+        free(msgs);
+        return EXIT_FAILURE;
+    }
+
+    impair_t *im = NULL;
+    if (impair_cfg != NULL) {
+        im = malloc(sizeof(impair_t));
+        if (im == NULL || impair_init(im, impair_cfg, payload_size > 0 ? payload_size : 1, impair_sendto, &sockfd) != 0) {
+            LOGE(TAG, "Failed to set up impairment");
+            free(im);
+            free(payloads);
+            free(iovs);
+            free(msgs);
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Payload is the message (if any) padded with a fixed pattern, after the header
+    const int offset = (sender_id >= 0) ? SEQ_HEADER_SIZE : 0;
+    const int copy = (msg_size < payload_size - offset) ? msg_size : payload_size - offset;
+    for (int i = 0; i < n_payloads; i++) {
+        char *payload = payloads + (size_t)i * payload_size;
+        memset(payload, 'x', payload_size);
+        memcpy(payload + offset, message, copy);
+    }
+
+    // Message j carries packets j*segs up to (j+1)*segs of the burst
+    for (int j = 0; j < n_msgs; j++) {
+        iovs[j].iov_base = payloads + (size_t)((j * segs) % n_payloads) * payload_size;
+        msgs[j].msg_hdr.msg_name    = dest->ai_addr;
+        msgs[j].msg_hdr.msg_namelen = dest->ai_addrlen;
+        msgs[j].msg_hdr.msg_iov     = &iovs[j];
+        msgs[j].msg_hdr.msg_iovlen  = 1;
+    }
+    uint64_t seq = 0;
+
+    const uint64_t interval_ns = (uint64_t)(1e9 * burst / rate_pps);
+    LOGI(TAG, "[UDP] Benchmark: %.0f pkt/s (%.2f Mbit/s), %d byte payload, burst %d every %llu ns, %d datagrams per message",
+         rate_pps, rate_pps * payload_size * 8 / 1e6, payload_size, burst, (unsigned long long)interval_ns, segs);
+    if (im != NULL) {
+        char desc[256];
+        impair_describe(impair_cfg, desc, sizeof(desc));
+        LOGI(TAG, "[UDP] Impairment: %s", desc);
+    }
+
+    unsigned long long total_packets = 0, interval_packets = 0, errors = 0, calls = 0;
+    const uint64_t start_ns = net_now_ns();
+    const uint64_t start_cpu_ns = net_cpu_ns();
+    uint64_t next_ns = start_ns;
+    uint64_t last_report_ns = start_ns;
+    int ret = EXIT_SUCCESS;
+
+    while (running) {
+        int to_send = burst;
+        if (repetitions >= 0) {
+            const long long left = (long long)repetitions - (long long)total_packets;
+            if (left <= 0) break;
+            if (left < to_send) to_send = (int)left;
+        }
+
+        if (sender_id >= 0) {
+            const uint64_t send_ns = seq_now_ns();
+            for (int i = 0; i < to_send; i++) {
+                const seq_header_t hdr = { .sender_id = (uint32_t)sender_id, .seq = seq++, .send_ns = send_ns };
+                seq_header_encode(payloads + (size_t)i * payload_size, &hdr);
+            }
+        }
+
+        // Only the last message of a short burst carries fewer segments
+        const int msgs_to_send = (to_send + segs - 1) / segs;
+        for (int j = 0; j < msgs_to_send; j++) {
+            const int pkts = (to_send - j * segs < segs) ? to_send - j * segs : segs;
+            iovs[j].iov_len = (size_t)pkts * payload_size;
+        }
+
+        int sent = 0;
+        if (im != NULL) {
+            // One sendto per datagram that survives, now or when it is due
+            const struct sockaddr_in *to = (const struct sockaddr_in *)dest->ai_addr;
+            for (int i = 0; i < to_send; i++) {
+                impair_submit(im, payloads + (size_t)(i % n_payloads) * payload_size, payload_size, to);
+            }
+            sent = to_send;
+            calls += to_send;
+        }
+        while (sent < msgs_to_send && running) {
+            int n = sendmmsg(sockfd, msgs + sent, msgs_to_send - sent, 0);
+            calls++;
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                if (errno == ENOBUFS || errno == EAGAIN || errno == ECONNREFUSED) {
+                    errors++;  // Transient, count and move on to next burst
+                    break;
+                }
+                if (errno == EINVAL && segs > 1) {
+                    LOGE_ERRNO(TAG, "sendmmsg() failed, is the %d byte payload larger than the path MTU allows for GSO?", payload_size);
+                } else {
+                    LOGE_ERRNO(TAG, "sendmmsg() failed");
+                }
+                ret = EXIT_FAILURE;
+                running = 0;
+                break;
+            }
+            sent += n;
+        }
+        const int sent_packets = (sent * segs < to_send) ? sent * segs : to_send;
+        total_packets += sent_packets;
+        interval_packets += sent_packets;
+
+        const uint64_t now = net_now_ns();
+        if (now - last_report_ns >= REPORT_INTERVAL_NS) {
+            const double secs = (now - last_report_ns) / 1e9;
+            LOGI(TAG, "[UDP] %.0f pkt/s, %.2f Mbit/s (total %llu pkts, %llu send errors)",
+                 interval_packets / secs, interval_packets * payload_size * 8 / secs / 1e6,
+                 total_packets, errors);
+            interval_packets = 0;
+            last_report_ns = now;
+        }
+
+        next_ns += interval_ns;
+        if (now > next_ns + MAX_PACING_LAG_NS) {
+            next_ns = now;  // Fell too far behind, do not try to catch up in one go
+        }
+        if (im != NULL) {
+            sleep_impaired(im, next_ns);
+        } else {
+            const struct timespec deadline = ns_timespec(next_ns);
+            while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR && running) { }
+        }
+    }
+
+    const double secs = (net_now_ns() - start_ns) / 1e9;
+    const uint64_t used_cpu_ns = net_cpu_ns() - start_cpu_ns;
+    LOGI(TAG, "[UDP] Sent %llu packets in %.2f s (%.0f pkt/s, %.2f Mbit/s, %.1f pkt/syscall, %.0f ns CPU/pkt, %llu send errors)",
+         total_packets, secs, total_packets / secs, total_packets * payload_size * 8 / secs / 1e6,
+         calls ? (double)total_packets / calls : 0.0,
+         total_packets ? (double)used_cpu_ns / total_packets : 0.0, errors);
+
+    if (im != NULL) {
+        // Let the datagrams still in flight arrive
+        while (running && impair_held(im) > 0) {
+            sleep_impaired(im, impair_next_ns(im));
+        }
+        report_impair(im);
+        impair_free(im);
+        free(im);
+    }
+
+    if (!running && ret == EXIT_SUCCESS) {
+        LOGD(TAG, "Received shutdown signal, exiting gracefully");
+    }
+    free(payloads);
+    free(iovs);
+    free(msgs);
+    return ret;
+}
+
+typedef struct {
+    unsigned long long sent;       // sendmsg() calls with MSG_ZEROCOPY that queued data
+    unsigned long long completed;
+    unsigned long long copied;     // Completed, but the kernel had to copy after all
+} zerocopy_stats_t;
+
+// Reads MSG_ZEROCOPY completions off the socket error queue, waiting up to
+// wait_ms for the first one. Returns -1 on an error other than a completion
+static int zerocopy_reap(int sockfd, zerocopy_stats_t *zc, int wait_ms) {
+    if (wait_ms > 0) {
+        // A non-empty error queue is POLLERR, whatever the requested events
+        struct pollfd pfd = { .fd = sockfd, .events = 0 };
+        poll(&pfd, 1, wait_ms);
+    }
+    for (;;) {
+        char ctrl[CMSG_SPACE(sizeof(struct sock_extended_err) + sizeof(struct sockaddr_in))];
+        struct msghdr msg = { .msg_control = ctrl, .msg_controllen = sizeof(ctrl) };
+        if (recvmsg(sockfd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+            if (errno == EINTR) continue;
+            return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+        }
+        for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm != NULL; cm = CMSG_NXTHDR(&msg, cm)) {
+            if (cm->cmsg_level != SOL_IP || cm->cmsg_type != IP_RECVERR) {
+                continue;
+            }
+            const struct sock_extended_err *serr = (const struct sock_extended_err *)CMSG_DATA(cm);
+            if (serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY || serr->ee_errno != 0) {
+                errno = serr->ee_errno;
+                return -1;
+            }
+            // Consecutive sends complete as one range of their ids
+            const unsigned long long n = (unsigned long long)(serr->ee_data - serr->ee_info) + 1;
+            zc->completed += n;
+            if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+                zc->copied += n;
+            }
+        }
+    }
+}
+
+// sendmsg() until all of iov is written, stepping over partial writes (iov is
+// consumed). Returns the bytes written, short only on shutdown, or -1
+static ssize_t stream_write(int sockfd, struct iovec *iov, int iovcnt, int flags,
+                            unsigned long long *calls, zerocopy_stats_t *zc) {
+    size_t total = 0;
+    while (iovcnt > 0) {
+        struct msghdr msg = { .msg_iov = iov, .msg_iovlen = (size_t)iovcnt };
+        const ssize_t n = sendmsg(sockfd, &msg, flags);
+        (*calls)++;
+        if (n < 0) {
+            if (errno == EINTR) {
+                if (!running) break;
+                continue;
+            }
+            if (errno == ENOBUFS && (flags & MSG_ZEROCOPY)) {
+                // Out of socket option memory for pending completions
+                if (zerocopy_reap(sockfd, zc, 100) < 0) return -1;
+                continue;
+            }
+            return -1;
+        }
+        if (flags & MSG_ZEROCOPY) {
+            zc->sent++;
+        }
+        total += (size_t)n;
+        size_t left = (size_t)n;
+        while (iovcnt > 0 && left >= iov->iov_len) {
+            left -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char *)iov->iov_base + left;
+            iov->iov_len -= left;
+        }
+    }
+    return (ssize_t)total;
+}
+
+// TCP load generator: payload_size byte messages (framed with -f), written as
+// fast as the connection takes them or paced to rate_pps in bursts
+//  STREAM_SEND:     one send per message, the plain loop to compare against
+//  STREAM_WRITEV:   a burst of messages gathered into one sendmsg()
+//  STREAM_ZEROCOPY: the same with MSG_ZEROCOPY. The kernel pins the pages
+//                   instead of copying and says on the error queue when it is
+//                   done with them. All messages here share one frame that
+//                   never changes, a producer with fresh data would recycle a
+//                   buffer only once the send that used it has completed
+// TCP_CORK holds partial segments for a whole burst and pushes the rest when
+// the burst is done, TCP_NODELAY sends every write at once
+static int send_stream(int sockfd, const char *message, int msg_size, int payload_size, framing_type_t framing,
+                       double rate_pps, int burst, int repetitions, stream_mode_t mode, coalesce_t coalesce) {
+    if (payload_size == 0) {
+        LOGE(TAG, "Streaming needs a payload size > 0");
+        return EXIT_FAILURE;
+    }
+
+    // Payload is the message (if any) padded with a fixed pattern, framed once up front
+    const size_t cap = (size_t)payload_size + FRAMING_FIXED_SIZE + FRAMING_LENGTH_PREFIX_SIZE + 1;
+    char *payload = malloc(payload_size);
+    char *frame = malloc(cap);
+    struct iovec *iovs = calloc(burst, sizeof(struct iovec));
+    if (payload == NULL || frame == NULL || iovs == NULL) {
+        LOGE(TAG, "Failed to allocate a burst of %d messages of size %d", burst, payload_size);
+        free(payload);
+        free(frame);
+        free(iovs);
+        return EXIT_FAILURE;
+    }
+    memset(payload, 'x', payload_size);
+    memcpy(payload, message, msg_size < payload_size ? msg_size : payload_size);
+    int frame_len = payload_size;
+    if (framing == FRAMING_NONE) {
+        memcpy(frame, payload, payload_size);
+    } else {
+        frame_len = frame_encode(framing, payload, payload_size, frame, cap);
+    }
+    free(payload);
+    if (frame_len < 0) {
+        LOGE(TAG, "Message of %d bytes does not fit %s framing", payload_size, framing_name(framing));
+        free(frame);
+        free(iovs);
+        return EXIT_FAILURE;
+    }
+
+    int on = 1;
+    if (coalesce == COALESCE_NODELAY && net_set_nodelay(sockfd) < 0) {
+        LOGW_ERRNO(TAG, "Failed to set TCP_NODELAY");
+    }
+    if (mode == STREAM_ZEROCOPY && setsockopt(sockfd, SOL_SOCKET, SO_ZEROCOPY, &on, sizeof(on)) < 0) {
+        LOGW_ERRNO(TAG, "SO_ZEROCOPY unsupported, gathering with writev instead");
+        mode = STREAM_WRITEV;
+    }
+    const int flags = MSG_NOSIGNAL | (mode == STREAM_ZEROCOPY ? MSG_ZEROCOPY : 0);
+
+    const uint64_t interval_ns = rate_pps > 0 ? (uint64_t)(1e9 * burst / rate_pps) : 0;
+    if (rate_pps > 0) {
+        LOGI(TAG, "[TCP] Streaming %d byte messages (%d framed, %s framing) with %s, %s, bursts of %d every %llu ns",
+             payload_size, frame_len, framing_name(framing), stream_mode_names[mode], coalesce_names[coalesce],
+             burst, (unsigned long long)interval_ns);
+    } else {
+        LOGI(TAG, "[TCP] Streaming %d byte messages (%d framed, %s framing) with %s, %s, bursts of %d, unpaced",
+             payload_size, frame_len, framing_name(framing), stream_mode_names[mode], coalesce_names[coalesce], burst);
+    }
+
+    zerocopy_stats_t zc = { 0 };
+    unsigned long long total_bytes = 0, interval_bytes = 0, calls = 0;
+    const uint64_t start_ns = net_now_ns();
+    const uint64_t start_cpu_ns = net_cpu_ns();
+    uint64_t next_ns = start_ns;
+    uint64_t last_report_ns = start_ns;
+    int ret = EXIT_SUCCESS;
+
+    while (running) {
+        int to_send = burst;
+        if (repetitions >= 0) {
+            const long long left = (long long)repetitions - (long long)(total_bytes / frame_len);
+            if (left <= 0) break;
+            if (left < to_send) to_send = (int)left;
+        }
+
+        // Bound the pages pinned by sends the kernel has not released yet
+        while (running && mode == STREAM_ZEROCOPY && zc.sent - zc.completed >= ZEROCOPY_MAX_INFLIGHT) {
+            if (zerocopy_reap(sockfd, &zc, 100) < 0) {
+                LOGE_ERRNO(TAG, "Reading zerocopy completions failed");
+                ret = EXIT_FAILURE;
+                running = 0;
+            }
+        }
+
+        if (coalesce == COALESCE_CORK) {
+            setsockopt(sockfd, IPPROTO_TCP, TCP_CORK, &on, sizeof(on));
+            calls++;
+        }
+        ssize_t n = 0;
+        if (mode == STREAM_SEND) {
+            for (int i = 0; i < to_send && running; i++) {
+                struct iovec iov = { .iov_base = frame, .iov_len = (size_t)frame_len };
+                const ssize_t w = stream_write(sockfd, &iov, 1, flags, &calls, &zc);
+                if (w < 0) {
+                    n = -1;
+                    break;
+                }
+                n += w;
+            }
+        } else {
+            for (int i = 0; i < to_send; i++) {
+                iovs[i] = (struct iovec){ .iov_base = frame, .iov_len = (size_t)frame_len };
+            }
+            n = stream_write(sockfd, iovs, to_send, flags, &calls, &zc);
+        }
+        if (coalesce == COALESCE_CORK) {
+            const int off = 0;
+            setsockopt(sockfd, IPPROTO_TCP, TCP_CORK, &off, sizeof(off));  // Pushes out the partial last segment
+            calls++;
+        }
+        if (n < 0) {
+            if (errno == EPIPE || errno == ECONNRESET) {
+                LOGW(TAG, "[TCP] Receiver closed the connection");
+            } else {
+                LOGE_ERRNO(TAG, "sendmsg() failed");
+                ret = EXIT_FAILURE;
+            }
+            break;
+        }
+        total_bytes += (unsigned long long)n;
+        interval_bytes += (unsigned long long)n;
+        if (mode == STREAM_ZEROCOPY && zerocopy_reap(sockfd, &zc, 0) < 0) {
+            LOGE_ERRNO(TAG, "Reading zerocopy completions failed");
+            ret = EXIT_FAILURE;
+            break;
+        }
+
+        const uint64_t now = net_now_ns();
+        if (now - last_report_ns >= REPORT_INTERVAL_NS) {
+            const double secs = (now - last_report_ns) / 1e9;
+            LOGI(TAG, "[TCP] %.0f msg/s, %.2f Mbit/s (total %llu msgs)",
+                 interval_bytes / frame_len / secs, interval_bytes * 8 / secs / 1e6, total_bytes / frame_len);
+            interval_bytes = 0;
+            last_report_ns = now;
+        }
+
+        if (interval_ns > 0) {
+            next_ns += interval_ns;
+            if (now > next_ns + MAX_PACING_LAG_NS) {
+                next_ns = now;  // Fell too far behind, do not try to catch up in one go
+            }
+            const struct timespec deadline = ns_timespec(next_ns);
+            while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR && running) { }
+        }
+    }
+
+    const double secs = (net_now_ns() - start_ns) / 1e9;
+    const uint64_t used_cpu_ns = net_cpu_ns() - start_cpu_ns;
+    const unsigned long long total_msgs = total_bytes / frame_len;
+    LOGI(TAG, "[TCP] Sent %llu messages in %.2f s (%.0f msg/s, %.2f Mbit/s, %.1f msg/syscall, %.0f ns CPU/msg)",
+         total_msgs, secs, total_msgs / secs, total_bytes * 8 / secs / 1e6,
+         calls ? (double)total_msgs / calls : 0.0, total_msgs ? (double)used_cpu_ns / total_msgs : 0.0);
 
-    if (errno != 0 || endptr == str || *endptr != '\0') {
-        return -1;
+    if (mode == STREAM_ZEROCOPY) {
+        // The pages stay pinned until the receiver has acknowledged the data
+        const uint64_t drain_until = net_now_ns() + ZEROCOPY_DRAIN_NS;
+        while (zc.completed < zc.sent && net_now_ns() < drain_until) {
+            if (zerocopy_reap(sockfd, &zc, 100) < 0) break;
+        }
+        LOGI(TAG, "[TCP] Zerocopy: %llu sends, %llu completed, %llu (%.0f%%) copied by the kernel after all",
+             zc.sent, zc.completed, zc.copied, zc.completed ? 100.0 * zc.copied / zc.completed : 0.0);
     }
 
-    if (port > 65535 || port < 1) {
-        return -1;
+    if (!running && ret == EXIT_SUCCESS) {
+        LOGD(TAG, "Received shutdown signal, exiting gracefully");
     }
+    free(frame);
+    free(iovs);
+    return ret;
+}
 
-    return (int)port;
+static inline size_t rtt_bucket(uint64_t v) {
+    if (v < RTT_SUB_COUNT) {
+        return v;
+    }
+    const int shift = 63 - __builtin_clzll(v) - RTT_SUB_BITS;
+    if (shift >= RTT_MAX_SHIFT) {
+        return RTT_BUCKETS - 1;
+    }
+    return (size_t)(shift + 1) * RTT_SUB_COUNT + (size_t)((v >> shift) - RTT_SUB_COUNT);
+}
+
+// Highest value that maps to bucket idx
+static inline uint64_t rtt_bucket_high(size_t idx) {
+    if (idx < RTT_SUB_COUNT) {
+        return idx;
+    }
+    const int shift = (int)(idx / RTT_SUB_COUNT) - 1;
+    const uint64_t mantissa = idx % RTT_SUB_COUNT + RTT_SUB_COUNT;
+    return ((mantissa + 1) << shift) - 1;
+}
+
+static void rtt_record(rtt_hist_t *hist, uint64_t rtt_ns) {
+    hist->buckets[rtt_bucket(rtt_ns)]++;
+    if (hist->count == 0 || rtt_ns < hist->min) hist->min = rtt_ns;
+    if (rtt_ns > hist->max) hist->max = rtt_ns;
+    hist->sum += rtt_ns;
+    hist->count++;
+}
+
+static uint64_t rtt_percentile(const rtt_hist_t *hist, double p) {
+    uint64_t rank = (uint64_t)(p * (double)hist->count + 0.5);
+    if (rank == 0) rank = 1;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < RTT_BUCKETS; i++) {
+        seen += hist->buckets[i];
+        if (seen >= rank) {
+            const uint64_t high = rtt_bucket_high(i);
+            return high < hist->max ? high : hist->max;
+        }
+    }
+    return hist->max;
 }
 
-static inline int parse_size(const char *str) {
-    char *endptr;
-    errno = 0;
-    const long size = strtol(str, &endptr, 10);
+// Sends seq-header probes at rate/s and measures the RTT of each echoed reply
+// The probe carries its own CLOCK_MONOTONIC send time, so no per-probe state
+// is kept. TCP replies are reassembled to payload_size before matching.
+static int ping(int sockfd, protocol_t protocol, int payload_size, double rate, int count, int busy_poll) {
+    const char *proto_str = (protocol == PROTO_TCP) ? "TCP" : "UDP";
+    rtt_hist_t *hist = calloc(1, sizeof(rtt_hist_t));
+    char *tx_buf = malloc(payload_size);
+    char *rx_buf = malloc(payload_size);
+    if (hist == NULL || tx_buf == NULL || rx_buf == NULL) {
+        LOGE(TAG, "Failed to allocate ping buffers of size %d", payload_size);
+        free(hist);
+        free(tx_buf);
+        free(rx_buf);
+        return EXIT_FAILURE;
+    }
+    memset(tx_buf, 'x', payload_size);
+
+    if (protocol == PROTO_TCP) {
+        net_set_nodelay(sockfd);
+    }
+
+    const uint32_t id = (uint32_t)getpid();
+    const uint64_t interval_ns = (uint64_t)(1e9 / rate);
+    uint64_t sent = 0, received = 0, unmatched = 0, send_errors = 0;
+    size_t rx_fill = 0;
+    uint64_t next_ns = net_now_ns();
+    uint64_t drain_deadline_ns = 0;
+    int ret = EXIT_SUCCESS;
+
+    LOGI(TAG, "[%s] Ping: %.0f probes/s, %d byte payload, %s", proto_str, rate, payload_size,
+         busy_poll ? "busy-polling" : "blocking in ppoll");
+
+    while (running) {
+        uint64_t now = net_now_ns();
+        const int sending = (count < 0 || sent < (uint64_t)count);
+
+        if (sending && now >= next_ns) {
+            const seq_header_t hdr = { .sender_id = id, .seq = sent, .send_ns = now };
+            seq_header_encode(tx_buf, &hdr);
+            ssize_t off = 0;
+            while (off < payload_size) {
+                ssize_t n = send(sockfd, tx_buf + off, payload_size - off, 0);
+                if (n < 0) {
+                    if (errno == EINTR && running) continue;
+                    break;
+                }
+                off += n;
+            }
+            if (off < payload_size) {
+                if (protocol == PROTO_TCP || (errno != ECONNREFUSED && errno != ENOBUFS)) {
+                    LOGE_ERRNO(TAG, "send() failed");
+                    ret = EXIT_FAILURE;
+                    break;
+                }
+                send_errors++;  // No echo server yet, keep probing
+            }
+            sent++;
+            next_ns += interval_ns;
+            if (now > next_ns + MAX_PACING_LAG_NS) {
+                next_ns = now;
+            }
+            if (count >= 0 && sent == (uint64_t)count) {
+                drain_deadline_ns = now + PING_DRAIN_NS;
+            }
+            continue;
+        }
+
+        if (!sending && (received + unmatched >= sent || now >= drain_deadline_ns)) {
+            break;
+        }
+
+        // Wait for a reply until the next probe is due
+        const uint64_t wake_ns = sending ? next_ns : drain_deadline_ns;
+        if (!busy_poll) {
+            const uint64_t wait_ns = wake_ns > now ? wake_ns - now : 0;
+            const struct timespec timeout = ns_timespec(wait_ns);
+            struct pollfd pfd = { .fd = sockfd, .events = POLLIN };
+            if (ppoll(&pfd, 1, &timeout, NULL) <= 0) {
+                continue;  // Timeout or signal
+            }
+        }
+
+        ssize_t n = recv(sockfd, rx_buf + rx_fill, payload_size - rx_fill, MSG_DONTWAIT);
+        const uint64_t recv_ns = net_now_ns();
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR || errno == ECONNREFUSED) {
+                continue;
+            }
+            LOGE_ERRNO(TAG, "recv() failed");
+            ret = EXIT_FAILURE;
+            break;
+        }
+        if (n == 0) {
+            LOGE(TAG, "[%s] Connection closed by echo server", proto_str);
+            ret = EXIT_FAILURE;
+            break;
+        }
+
+        // UDP replies are whole datagrams, TCP ones are reassembled to a full probe
+        if (protocol == PROTO_TCP) {
+            rx_fill += n;
+            if (rx_fill < (size_t)payload_size) {
+                continue;
+            }
+            rx_fill = 0;
+            n = payload_size;
+        }
+
+        seq_header_t hdr;
+        if (seq_header_decode(rx_buf, n, &hdr) != 0 || hdr.sender_id != id || hdr.seq >= sent ||
+            recv_ns < hdr.send_ns) {
+            unmatched++;
+            continue;
+        }
+        rtt_record(hist, recv_ns - hdr.send_ns);
+        received++;
+    }
 
-    if (errno != 0 || endptr == str || *endptr != '\0') {
-        return -1;
+    const uint64_t lost = sent > received ? sent - received : 0;
+    LOGI(TAG, "[%s] Ping: sent %llu, received %llu, lost %llu (%.3f%%), unmatched %llu, send errors %llu",
+         proto_str, (unsigned long long)sent, (unsigned long long)received, (unsigned long long)lost,
+         sent ? 100.0 * lost / sent : 0.0, (unsigned long long)unmatched, (unsigned long long)send_errors);
+    if (hist->count > 0) {
+        LOGI(TAG, "[%s] RTT us: min %.1f p50 %.1f p90 %.1f p99 %.1f p99.9 %.1f max %.1f mean %.1f",
+             proto_str, hist->min / 1e3,
+             rtt_percentile(hist, 0.50) / 1e3, rtt_percentile(hist, 0.90) / 1e3,
+             rtt_percentile(hist, 0.99) / 1e3, rtt_percentile(hist, 0.999) / 1e3,
+             hist->max / 1e3, (double)hist->sum / hist->count / 1e3);
     }
 
-    if (size > 65507 || size < 0) {
-        return -1;
+    if (!running) {
+        LOGD(TAG, "Received shutdown signal, exiting gracefully");
     }
+    free(hist);
+    free(tx_buf);
+    free(rx_buf);
+    return ret;
+}
 
-    return (int)size;
+static void on_reliable_acked(void *arg, const struct sockaddr_in *peer, uint64_t latency_ns) {
+    (void)peer;
+    rtt_record(arg, latency_ns);
 }
 
-static inline int parse_repetitions(const char *str) {
-    char *endptr;
-    errno = 0;
-    const long repetitions = strtol(str, &endptr, 10);
+// Reliable mode: every message goes through the rudp library, as fast as the
+// window allows or paced to rate_pps. Latency is first transmission to ACK, so
+// it includes every retransmission a lost message or lost ACK needed
+static int send_reliable(int sockfd, const struct addrinfo *dest, const char *message, int msg_size,
+                         int payload_size, double rate_pps, int count, long sender_id, int window,
+                         const impair_config_t *impair_cfg) {
+    rtt_hist_t *hist = calloc(1, sizeof(rtt_hist_t));
+    char *payload = malloc(payload_size > 0 ? payload_size : 1);
+    rudp_t *rudp = malloc(sizeof(rudp_t));
+    impair_t *im = (impair_cfg != NULL) ? malloc(sizeof(impair_t)) : NULL;
+    if (hist == NULL || payload == NULL || rudp == NULL || (impair_cfg != NULL && im == NULL)) {
+        LOGE(TAG, "Failed to allocate reliable mode state");
+        free(hist);
+        free(payload);
+        free(rudp);
+        free(im);
+        return EXIT_FAILURE;
+    }
+
+    rudp_config_t cfg = RUDP_CONFIG_DEFAULT;
+    cfg.window = window;
+    cfg.max_payload = payload_size > 0 ? payload_size : 1;
+    cfg.on_acked = on_reliable_acked;
+    cfg.arg = hist;
+    if (im != NULL) {
+        if (impair_init(im, impair_cfg, RUDP_HEADER_SIZE + cfg.max_payload, impair_sendto, &sockfd) != 0) {
+            LOGE(TAG, "Failed to set up impairment");
+            free(hist);
+            free(payload);
+            free(rudp);
+            free(im);
+            return EXIT_FAILURE;
+        }
+        cfg.impair = im;
+    }
+    if (rudp_init(rudp, sockfd, &cfg) != 0) {
+        LOGE(TAG, "Failed to set up reliable transport");
+        if (im != NULL) impair_free(im);
+        free(hist);
+        free(payload);
+        free(rudp);
+        free(im);
+        return EXIT_FAILURE;
+    }
+    const struct sockaddr_in *to = (const struct sockaddr_in *)dest->ai_addr;
+
+    const int offset = (sender_id >= 0) ? SEQ_HEADER_SIZE : 0;
+    const int copy = (msg_size < payload_size - offset) ? msg_size : payload_size - offset;
+    memset(payload, 'x', payload_size);
+    memcpy(payload + offset, message, copy);
 
-    if (errno != 0 || endptr == str || *endptr != '\0') {
-        return -2;
+    const uint64_t interval_ns = (rate_pps > 0) ? (uint64_t)(1e9 / rate_pps) : 0;
+    char mode[48] = "window limited";
+    if (interval_ns) {
+        snprintf(mode, sizeof(mode), "paced to %.0f msg/s", rate_pps);
+    }
+    LOGI(TAG, "[UDP] Reliable: %d byte payload, window %d, %s", payload_size, window, mode);
+    if (im != NULL) {
+        char desc[256];
+        impair_describe(impair_cfg, desc, sizeof(desc));
+        LOGI(TAG, "[UDP] Impairment: %s", desc);
+    }
+
+    uint64_t queued = 0, last_acked = 0;
+    const uint64_t start_ns = net_now_ns();
+    uint64_t next_ns = start_ns;
+    uint64_t last_report_ns = start_ns;
+    int ret = EXIT_SUCCESS;
+
+    while (running) {
+        uint64_t now = net_now_ns();
+        while (running && (count < 0 || queued < (uint64_t)count) && (interval_ns == 0 || now >= next_ns)) {
+            if (sender_id >= 0) {
+                const seq_header_t hdr = { .sender_id = (uint32_t)sender_id, .seq = queued, .send_ns = seq_now_ns() };
+                seq_header_encode(payload, &hdr);
+            }
+            if (rudp_send(rudp, to, payload, payload_size) < 0) {
+                if (errno == EAGAIN) break;  // Window full, wait for ACKs
+                LOGE_ERRNO(TAG, "rudp_send() failed");
+                ret = EXIT_FAILURE;
+                running = 0;
+                break;
+            }
+            queued++;
+            if (interval_ns) {
+                next_ns += interval_ns;
+                if (now > next_ns + MAX_PACING_LAG_NS) {
+                    next_ns = now;
+                }
+            }
+        }
+
+        const int sending = count < 0 || queued < (uint64_t)count;
+        if (!sending && rudp_inflight(rudp) == 0) {
+            break;  // Everything acknowledged or given up on
+        }
+
+        // Sleep until input, the next retransmission or the next paced message.
+        // A paced message that is already due means the window is full
+        const int timeout_ms = rudp_timeout_ms(rudp);
+        uint64_t wait_ns = (timeout_ms < 0) ? REPORT_INTERVAL_NS : (uint64_t)timeout_ms * 1000000ull;
+        if (interval_ns && sending && next_ns > now && next_ns - now < wait_ns) {
+            wait_ns = next_ns - now;
+        }
+        if (im != NULL) {
+            const uint64_t due = impair_next_ns(im);
+            if (due != UINT64_MAX && (due <= now || due - now < wait_ns)) {
+                wait_ns = (due > now) ? due - now : 0;
+            }
+        }
+        if (wait_ns > REPORT_INTERVAL_NS) {
+            wait_ns = REPORT_INTERVAL_NS;
+        }
+        const struct timespec timeout = ns_timespec(wait_ns);
+        struct pollfd pfd = { .fd = sockfd, .events = POLLIN };
+        ppoll(&pfd, 1, &timeout, NULL);
+
+        if (rudp_process(rudp) < 0) {
+            LOGE_ERRNO(TAG, "Reliable receive failed");
+            ret = EXIT_FAILURE;
+            break;
+        }
+
+        now = net_now_ns();
+        if (now - last_report_ns >= REPORT_INTERVAL_NS) {
+            const double secs = (now - last_report_ns) / 1e9;
+            const rudp_peer_t *peer = rudp_peer(rudp, to);
+            const uint64_t acked = rudp->stats.acked - last_acked;
+            LOGI(TAG, "[UDP] %.0f msg/s acked, %.2f Mbit/s (total %llu acked, %llu retransmits, %llu failed), srtt %.1f us, rto %.1f us",
+                 acked / secs, acked * payload_size * 8 / secs / 1e6,
+                 (unsigned long long)rudp->stats.acked, (unsigned long long)rudp->stats.retransmits,
+                 (unsigned long long)rudp->stats.failed,
+                 peer ? peer->srtt_ns / 1e3 : 0.0, peer ? peer->rto_ns / 1e3 : 0.0);
+            last_acked = rudp->stats.acked;
+            last_report_ns = now;
+        }
+    }
+
+    const double secs = (net_now_ns() - start_ns) / 1e9;
+    const rudp_stats_t *st = &rudp->stats;
+    LOGI(TAG, "[UDP] Reliable: %llu messages in %.2f s, %llu acked (%.0f msg/s, %.2f Mbit/s goodput), %llu failed, %llu unacked, "
+         "%llu retransmits (%llu fast, %llu timeouts)",
+         (unsigned long long)queued, secs, (unsigned long long)st->acked, st->acked / secs,
+         st->acked * payload_size * 8 / secs / 1e6, (unsigned long long)st->failed,
+         (unsigned long long)rudp_inflight(rudp), (unsigned long long)st->retransmits,
+         (unsigned long long)st->fast_retransmits, (unsigned long long)st->timeouts);
+    if (hist->count > 0) {
+        LOGI(TAG, "[UDP] Delivery latency us: min %.1f p50 %.1f p90 %.1f p99 %.1f p99.9 %.1f max %.1f mean %.1f",
+             hist->min / 1e3,
+             rtt_percentile(hist, 0.50) / 1e3, rtt_percentile(hist, 0.90) / 1e3,
+             rtt_percentile(hist, 0.99) / 1e3, rtt_percentile(hist, 0.999) / 1e3,
+             hist->max / 1e3, (double)hist->sum / hist->count / 1e3);
     }
 
-    if (repetitions < -1 || repetitions > INT_MAX) {
-        return -2;
+    if (!running && ret == EXIT_SUCCESS) {
+        LOGD(TAG, "Received shutdown signal, exiting gracefully");
+    }
+    if (im != NULL) {
+        report_impair(im);
+        impair_free(im);
+        free(im);
     }
+    rudp_free(rudp);
+    free(rudp);
+    free(hist);
+    free(payload);
+    return ret;
+}
 
-    return (int)repetitions;
+static void report_impair(const impair_t *im) {
+    const impair_stats_t *st = &im->stats;
+    LOGI(TAG, "[UDP] Impairment: %llu datagrams in, %llu out, %llu lost, %llu queue overflows, %llu duplicated, %llu reordered, %u still held",
+         (unsigned long long)st->submitted, (unsigned long long)st->delivered, (unsigned long long)st->lost,
+         (unsigned long long)st->overflow, (unsigned long long)st->duplicated, (unsigned long long)st->reordered,
+         impair_held(im));
 }
 
-static inline long parse_period(const char *str) {
-    char *endptr;
-    errno = 0;
-    const long period = strtol(str, &endptr, 10);
+static const char *discovery_event_name(const discovery_event_t *ev) {
+    switch (ev->type) {
+        case DISCOVERY_JOINED:    return "joined";
+        case DISCOVERY_RESTARTED: return "restarted";
+        case DISCOVERY_LEFT:      return ev->graceful ? "left" : "timed out";
+    }
+    return "?";
+}
+
+// Discovery mode: heartbeats go to the broadcast or multicast destination, heartbeats of
+// every other node on the same port keep the peer table alive. Membership
+// changes arrive on the eventfd next to the socket, as in an event loop
+static int run_discovery(int sockfd, const struct addrinfo *dest, int port, uint32_t node_id, long heartbeat_ms,
+                         const mcast_iface_t *iface, int ttl, int loop) {
+    discovery_config_t cfg = DISCOVERY_CONFIG_DEFAULT;
+    cfg.node_id = node_id;
+    cfg.port = (uint16_t)port;
+    memcpy(&cfg.dest, dest->ai_addr, sizeof(cfg.dest));
+    cfg.iface = *iface;
+    cfg.mcast_ttl = ttl;
+    cfg.mcast_loop = loop;
+    cfg.interval_ns = (uint64_t)heartbeat_ms * 1000000ull;
+    cfg.timeout_ns = cfg.interval_ns * DISCOVERY_TIMEOUT_BEATS;
 
-    if (errno != 0 || endptr == str || *endptr != '\0') {
-        return -1;
+    discovery_t *disc = malloc(sizeof(discovery_t));
+    if (disc == NULL || discovery_init(disc, sockfd, &cfg) != 0) {
+        LOGE_ERRNO(TAG, "Failed to start discovery on port %d", port);
+        free(disc);
+        return EXIT_FAILURE;
     }
+    LOGI(TAG, "[UDP] Discovery: node %u, heartbeat every %ld ms to %s:%d, peers time out after %ld ms",
+         node_id, heartbeat_ms, inet_ntoa(cfg.dest.sin_addr), port, heartbeat_ms * DISCOVERY_TIMEOUT_BEATS);
 
-    if (period < 0) {
-        return -1;
+    const uint64_t start_ns = net_now_ns();
+    const uint64_t start_cpu_ns = net_cpu_ns();
+    uint64_t last_report_ns = start_ns;
+    uint64_t last_received = 0;
+    int ret = EXIT_SUCCESS;
+
+    while (running) {
+        struct pollfd pfd[2] = {
+            { .fd = sockfd, .events = POLLIN },
+            { .fd = discovery_event_fd(disc), .events = POLLIN },
+        };
+        if (poll(pfd, 2, discovery_timeout_ms(disc)) < 0 && errno != EINTR) {
+            LOGE_ERRNO(TAG, "poll() failed");
+            ret = EXIT_FAILURE;
+            break;
+        }
+        if (discovery_process(disc) < 0) {
+            LOGE_ERRNO(TAG, "Discovery receive failed");
+            ret = EXIT_FAILURE;
+            break;
+        }
+
+        discovery_event_t ev;
+        while (discovery_next_event(disc, &ev)) {
+            LOGI(TAG, "[UDP] Peer %u %s (%s:%d), %u alive",
+                 ev.node_id, discovery_event_name(&ev), inet_ntoa(ev.addr.sin_addr), ntohs(ev.addr.sin_port),
+                 discovery_peer_count(disc));
+        }
+
+        const uint64_t now = net_now_ns();
+        if (now - last_report_ns >= REPORT_INTERVAL_NS) {
+            const double secs = (now - last_report_ns) / 1e9;
+            LOGI(TAG, "[UDP] %u peers alive, %.0f heartbeats/s received",
+                 discovery_peer_count(disc), (disc->stats.heartbeats_received - last_received) / secs);
+            last_received = disc->stats.heartbeats_received;
+            last_report_ns = now;
+        }
     }
 
-    return period;
+    const discovery_stats_t *st = &disc->stats;
+    const double secs = (net_now_ns() - start_ns) / 1e9;
+    const uint64_t used_cpu_ns = net_cpu_ns() - start_cpu_ns;
+    LOGI(TAG, "[UDP] Discovery: %u peers alive after %.1f s, %llu heartbeats sent, %llu received (%.0f ns CPU/heartbeat), "
+         "%llu joins, %llu leaves (%llu timed out), %llu restarts, %llu invalid, %llu over table capacity",
+         discovery_peer_count(disc), secs, (unsigned long long)st->heartbeats_sent,
+         (unsigned long long)st->heartbeats_received,
+         st->heartbeats_received ? (double)used_cpu_ns / st->heartbeats_received : 0.0,
+         (unsigned long long)st->joins, (unsigned long long)st->leaves, (unsigned long long)st->timeouts,
+         (unsigned long long)st->restarts, (unsigned long long)st->invalid, (unsigned long long)st->table_full);
+
+    if (!running && ret == EXIT_SUCCESS) {
+        LOGD(TAG, "Received shutdown signal, exiting gracefully");
+    }
+    discovery_free(disc);
+    free(disc);
+    return ret;
 }
@@ -0,0 +1,4 @@
+#!/bin/bash
+# Start the simulator first (SimElevatorServer --port 15657)
+gcc -O2 elevator_hardware.c elevator_hardware_bench.c -o elevator_bench -lpthread
+./elevator_bench
@@ -3,6 +3,7 @@
 #include <sys/socket.h>
 #include <netdb.h>
 #include <stdio.h>
+#include <string.h>
 #include <pthread.h>
 
 #include "elevator_hardware.h"
@@ -126,3 +127,58 @@ int elevator_hardware_get_obstruction_signal(void) {
     pthread_mutex_unlock(&sockmtx);
     return buf[1];
 }
+
+
+
+
+// Requests in a scan: every button, then floor, stop and obstruction
+#define SCAN_REQUESTS (N_FLOORS*N_BUTTONS + 3)
+
+// A reply may arrive split over several segments
+static void recv_all(char* buf, int len){
+    int got = 0;
+    while(got < len){
+        int n = recv(sockfd, buf + got, len - got, 0);
+        if(n <= 0){
+            fprintf(stderr, "Lost connection to simulator server\n");
+            exit(EXIT_FAILURE);
+        }
+        got += n;
+    }
+}
+
+void elevator_hardware_scan(elevator_hardware_scan_t* scan) {
+    char req[SCAN_REQUESTS][4];
+    char rep[SCAN_REQUESTS][4];
+    memset(req, 0, sizeof(req));
+
+    int i = 0;
+    for(int f = 0; f < N_FLOORS; f++){
+        for(int b = 0; b < N_BUTTONS; b++){
+            req[i][0] = 6;
+            req[i][1] = b;
+            req[i][2] = f;
+            i++;
+        }
+    }
+    req[i++][0] = 7;
+    req[i++][0] = 8;
+    req[i++][0] = 9;
+
+    pthread_mutex_lock(&sockmtx);
+    send(sockfd, req, sizeof(req), 0);
+    recv_all((char*)rep, sizeof(rep));
+    pthread_mutex_unlock(&sockmtx);
+
+    // The server answers in request order
+    i = 0;
+    for(int f = 0; f < N_FLOORS; f++){
+        for(int b = 0; b < N_BUTTONS; b++){
+            scan->buttons[f][b] = rep[i++][1];
+        }
+    }
+    scan->floor         = rep[i][1] ? rep[i][2] : -1;
+    i++;
+    scan->stop          = rep[i++][1];
+    scan->obstruction   = rep[i++][1];
+}
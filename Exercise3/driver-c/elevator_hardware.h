@@ -33,3 +33,15 @@ int elevator_hardware_get_obstruction_signal(void);
 
 
 
+// All inputs, read in one round trip by elevator_hardware_scan
+typedef struct tag_elevator_hardware_scan {
+    int buttons[N_FLOORS][N_BUTTONS];   // Indexed [floor][button]
+    int floor;                          // -1 between floors
+    int stop;
+    int obstruction;
+} elevator_hardware_scan_t;
+
+// Pipelined read of every button, the floor sensor, stop and obstruction.
+// All requests go out in one send and the replies are matched in order, so a
+// scan costs one round trip instead of one per signal.
+void elevator_hardware_scan(elevator_hardware_scan_t* scan);
@@ -0,0 +1,58 @@
+#include <stdio.h>
+#include <time.h>
+
+#include "elevator_hardware.h"
+
+// Scans per second, polling every input one query at a time and pipelined
+// Run against a simulator started on the port in elevator_hardware.con
+
+#define SCANS 2000
+
+static double now(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+static void scan_serial(elevator_hardware_scan_t* scan){
+    for(int f = 0; f < N_FLOORS; f++){
+        for(int b = 0; b < N_BUTTONS; b++){
+            scan->buttons[f][b] = elevator_hardware_get_button_signal(b, f);
+        }
+    }
+    scan->floor         = elevator_hardware_get_floor_sensor_signal();
+    scan->stop          = elevator_hardware_get_stop_signal();
+    scan->obstruction   = elevator_hardware_get_obstruction_signal();
+}
+
+int main() {
+    elevator_hardware_init();
+
+    elevator_hardware_scan_t serial;
+    elevator_hardware_scan_t pipelined;
+
+    double t0 = now();
+    for(int i = 0; i < SCANS; i++){
+        scan_serial(&serial);
+    }
+    double t1 = now();
+    for(int i = 0; i < SCANS; i++){
+        elevator_hardware_scan(&pipelined);
+    }
+    double t2 = now();
+
+    printf("%d scans of %d signals\n", SCANS, N_FLOORS*N_BUTTONS + 3);
+    printf("  serial:    %8.0f scans/s, %6.1f us/scan\n", SCANS/(t1 - t0), (t1 - t0)/SCANS*1e6);
+    printf("  pipelined: %8.0f scans/s, %6.1f us/scan\n", SCANS/(t2 - t1), (t2 - t1)/SCANS*1e6);
+    printf("  floor %d/%d, stop %d/%d, obstruction %d/%d (serial/pipelined)\n",
+        serial.floor, pipelined.floor, serial.stop, pipelined.stop, serial.obstruction, pipelined.obstruction);
+
+    // Both ways must read the same inputs, buttons are held by the simulator
+    // between scans so a mismatch means replies were matched wrongly
+    if(serial.floor != pipelined.floor || serial.stop != pipelined.stop ||
+        serial.obstruction != pipelined.obstruction){
+        printf("Mismatch between serial and pipelined scan\n");
+        return 1;
+    }
+    return 0;
+}
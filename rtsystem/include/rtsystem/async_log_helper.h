@@ -15,6 +15,7 @@
 #include <time.h>
 
 #include <rtsystem/core/fifo_queue.h>
+#include <rtsystem/core/metrics.h>
 
 #define LOG_LEVEL_DEBUG 0
 #define LOG_LEVEL_INFO  1
@@ -38,6 +39,9 @@ extern fifo_queue_t g_log_queue;
 
 extern volatile int g_log_running;
 
+// Messages lost because g_log_queue was full (defined in log_task.c)
+extern metric_counter_t g_log_dropped;
+
 // Internal: Append log to queue (non-blocking)
 #define ALOG(_level, _tag, _fmt, ...) \
     do { \
@@ -52,6 +56,7 @@ extern volatile int g_log_running;
             clock_gettime(CLOCK_REALTIME, &_msg.timestamp); \
             snprintf(_msg.message, sizeof(_msg.message), _fmt, ##__VA_ARGS__); \
             if (fifo_queue_send(&g_log_queue, &_msg) != 0) { \
+                metric_counter_add(&g_log_dropped, 1); \
                 fprintf(stderr, "ERR: log queue full [%s]\n", _tag); \
             } \
         } \
@@ -2,6 +2,7 @@
 #define CMD_PARSER_H
 
 #include <rtsystem/tasks/dispatcher_task.h>
+#include <rtsystem/tasks/latency_task.h>
 
 #define MAX_ARGS 32
 
@@ -19,6 +20,14 @@ int parse_echo(cmd_t command, char **message);
 
 int parse_help(cmd_t command, char **message);
 
+// trace start | trace stop [file]
+// returns 0 on success, -1 on error
+int parse_trace(cmd_t command);
+
+// latency -i <period_us> -d <duration_ms>
+// returns 0 on success, -1 on error or if only help was requested
+int parse_latency(cmd_t command, latency_params_t *params);
+
 int parse_NIL(cmd_t command);
 
 // Frees dynamically allocated argv array and its strings
@@ -0,0 +1,112 @@
+// Lock-free metrics registry exported in Prometheus text format
+//
+// Subsystems declare their metrics in a static metric_t array, wrap it in a
+// metric_group_t and register it with METRICS_REGISTER_GROUP. Registration
+// runs before main, so no init call is needed.
+//
+/* Usage example:
+static metric_counter_t sent_total;
+
+static metric_t my_metrics[] = {
+    { .name = "sent_total", .help = "Messages sent", .type = METRIC_COUNTER, .counter = &sent_total },
+};
+static metric_group_t my_group = METRIC_GROUP("my_subsystem", my_metrics);
+METRICS_REGISTER_GROUP(my_group)
+
+void hot_path(void) {
+    metric_counter_add(&sent_total, 1);
+}
+*/
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define METRICS_PREFIX "rtsystem_"
+#define METRIC_HIST_MAX_BOUNDS 16
+
+typedef enum {
+    METRIC_COUNTER,    // Monotonic, updated with metric_counter_add
+    METRIC_GAUGE,      // Up/down value, updated with metric_gauge_add/set
+    METRIC_GAUGE_FN,   // Gauge read by callback at scrape time
+    METRIC_HISTOGRAM,  // Bucketed observations
+    METRIC_COLLECTOR,  // Callback writes its own labeled counter samples
+} metric_type_t;
+
+typedef struct {
+    uint64_t value;
+} metric_counter_t;
+
+typedef struct {
+    int64_t value;
+} metric_gauge_t;
+
+typedef struct {
+    const uint64_t *bounds;  // Ascending upper bounds in raw units
+    size_t n_bounds;         // At most METRIC_HIST_MAX_BOUNDS
+    double scale;            // Raw unit to exported unit (1e-9 for ns -> s)
+    uint64_t buckets[METRIC_HIST_MAX_BOUNDS + 1];  // Last bucket is +Inf
+    uint64_t sum;            // _count is not stored, it is the bucket total
+} metric_histogram_t;
+
+typedef struct metric metric_t;
+typedef struct metric_group metric_group_t;
+
+struct metric {
+    const char *name;     // Exported as METRICS_PREFIX<subsystem>_<name>
+    const char *help;
+    metric_type_t type;
+    const char *labels;   // Optional, e.g. "class=\"critical\"". Metrics sharing
+                          // a name must be adjacent in the array
+    metric_counter_t *counter;
+    metric_gauge_t *gauge;
+    metric_histogram_t *histogram;
+    double (*read)(void);                                   // METRIC_GAUGE_FN
+    void (*collect)(FILE *out, const char *full_name);      // METRIC_COLLECTOR
+};
+
+struct metric_group {
+    const char *subsystem;
+    metric_t *metrics;
+    size_t count;
+    metric_group_t *next;
+};
+
+#define METRIC_GROUP(_subsystem, _metrics) \
+    { .subsystem = _subsystem, .metrics = _metrics, \
+      .count = sizeof(_metrics) / sizeof(_metrics[0]), .next = NULL }
+
+#define METRICS_REGISTER_GROUP(_group) \
+    __attribute__((constructor)) static void _group##_register(void) { \
+        metrics_register_group(&_group); \
+    }
+
+// Hot path updates, each a single relaxed atomic add or store
+static inline void metric_counter_add(metric_counter_t *c, uint64_t n) {
+    __atomic_fetch_add(&c->value, n, __ATOMIC_RELAXED);
+}
+
+static inline void metric_gauge_add(metric_gauge_t *g, int64_t n) {
+    __atomic_fetch_add(&g->value, n, __ATOMIC_RELAXED);
+}
+
+static inline void metric_gauge_set(metric_gauge_t *g, int64_t v) {
+    __atomic_store_n(&g->value, v, __ATOMIC_RELAXED);
+}
+
+// One relaxed add to the bucket, plus one to sum. Prometheus requires _sum
+// and it cannot be derived from the buckets, so it is the one exception to
+// single-add updates. A scrape may see sum a sample ahead or behind the
+// buckets, _count is the bucket total and always matches them
+void metric_histogram_observe(metric_histogram_t *h, uint64_t value);
+
+// Add a group to the registry (normally through METRICS_REGISTER_GROUP)
+void metrics_register_group(metric_group_t *group);
+
+// Write all registered metrics in Prometheus text exposition format
+void metrics_write_prometheus(FILE *out);
+
+#endif
@@ -39,6 +39,7 @@ struct task_handle {
     volatile task_state_t state;
     void* task_resources;         
     task_array_t* array;          // Back-reference to owning array (or NULL)
+    task_handle_t* live_next;     // Internal: list of unjoined threads (metrics)
 };
 
 struct task_array {
@@ -52,6 +53,10 @@ struct task_array {
 // Returns handle on success, NULL on failure
 task_handle_t* task_create(task_array_t* arr, const task_config_t* config, void* init_arg, const char *name);
 
+// Set task state (use instead of assigning handle->state directly)
+// Records a trace event in tracing builds
+void task_handle_set_state(task_handle_t* handle, task_state_t state);
+
 // Mark task as done and signal done_fd
 // Call this at the end of your entry function before returning
 void task_handle_mark_done(task_handle_t* handle);
@@ -0,0 +1,51 @@
+// Optional begin/end event tracing exported as Chrome trace JSON
+// Load the output in chrome://tracing or https://ui.perfetto.dev
+//
+// Build with -DRTSYSTEM_TRACE=ON to enable. Otherwise all TRACE_* macros
+// compile to nothing and trace_start/trace_stop return -1.
+//
+// Each thread records into its own buffer, so recording takes no locks.
+// _name and _arg are stored by pointer and must outlive the trace
+// (use string literals).
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#define TRACE_MAX_THREADS 128
+#define TRACE_BUFFER_EVENTS 8192  // Per thread, events beyond this are dropped
+
+#ifdef RTSYSTEM_TRACE
+
+// Nonzero while recording (between trace_start and trace_stop)
+extern int g_trace_enabled;
+
+// Internal: record one event in the calling thread's buffer
+void trace_event(char phase, const char *name, const char *arg);
+
+#define TRACE_EVENT(_phase, _name, _arg) \
+    do { \
+        if (__atomic_load_n(&g_trace_enabled, __ATOMIC_RELAXED)) { \
+            trace_event(_phase, _name, _arg); \
+        } \
+    } while(0)
+
+#else
+
+#define TRACE_EVENT(_phase, _name, _arg) do { } while(0)
+
+#endif
+
+#define TRACE_BEGIN(_name)            TRACE_EVENT('B', _name, NULL)
+#define TRACE_BEGIN_ARG(_name, _arg)  TRACE_EVENT('B', _name, _arg)
+#define TRACE_END(_name)              TRACE_EVENT('E', _name, NULL)
+#define TRACE_INSTANT(_name, _arg)    TRACE_EVENT('i', _name, _arg)
+
+// Discard everything recorded so far and start recording
+// Returns 0 on success, -1 if tracing is not compiled in
+int trace_start(void);
+
+// Stop recording and write all buffered events to path as Chrome trace JSON
+// Returns number of events written, -1 on error or if not compiled in
+int trace_stop(const char *path);
+
+#endif
@@ -8,6 +8,8 @@ typedef enum {
     SOCKET,
     ECHO,
     HELP,
+    TRACE,
+    LATENCY,
     NIL,
 } cmd_type_t;
 
@@ -19,15 +21,41 @@ struct cmd {
     cmd_type_t cmd_type;
 };
 
+// Command classes, each served from its own queue
+// Lower value = higher priority
+typedef enum {
+    CMD_PRIO_CRITICAL,  // Cheap and urgent (stop, diagnostics)
+    CMD_PRIO_NORMAL,    // Regular interactive commands
+    CMD_PRIO_BULK,      // Long-running or background work
+    CMD_PRIO_COUNT,
+} cmd_priority_t;
+
+typedef enum {
+    DISPATCH_POLICY_STRICT,   // Always serve highest non-empty class first
+    DISPATCH_POLICY_WEIGHTED, // Serve up to weight[i] commands per class per round
+} dispatch_policy_t;
+
+typedef struct {
+    size_t queue_size[CMD_PRIO_COUNT];
+    dispatch_policy_t policy;
+    unsigned weight[CMD_PRIO_COUNT];  // Only used with DISPATCH_POLICY_WEIGHTED
+    size_t max_workers;               // Max concurrent offloaded handlers
+} dispatcher_init_t;
+
 #define DEFAULT_DISPATCHER_TASK_PRIORITY 40
+#define DEFAULT_DISPATCH_HANDLER_PRIORITY 20
 
 // Task configuration for dispatcher_task
-// Use with task_create(arr, &dispatcher_task_config, &queue_size)
-// init_arg: pointer to size_t queue size
+// Use with task_create(arr, &dispatcher_task_config, &init)
+// init_arg: pointer to dispatcher_init_t
 extern const task_config_t dispatcher_task_config;
 
+// Get the priority class a command type is queued in
+cmd_priority_t dispatcher_cmd_priority(cmd_type_t cmd_type);
+
 // global way to add command to the dispatcher queue
+// Command is routed to the queue of its priority class
 // Returns 0 on success, -1 on failure
 int dispatcher_add_to_queue(cmd_t command);
 
-#endif
\ No newline at end of file
+#endif
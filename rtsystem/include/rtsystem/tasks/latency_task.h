@@ -0,0 +1,45 @@
+#ifndef LATENCY_TASK_H
+#define LATENCY_TASK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <rtsystem/core/task_helper.h>
+
+#define DEFAULT_LATENCY_TASK_PRIORITY 80
+#define DEFAULT_LATENCY_LOAD_PRIORITY 15
+
+#define DEFAULT_LATENCY_PERIOD_US 1000
+#define DEFAULT_LATENCY_DURATION_MS 5000
+
+// 1 us per bucket, wakeups later than this go to overflow
+#define LATENCY_HIST_BUCKETS 1000
+
+typedef struct {
+    uint64_t buckets[LATENCY_HIST_BUCKETS];
+    uint64_t overflow;
+    uint64_t count;
+    uint64_t sum_ns;
+    uint64_t min_ns;
+    uint64_t max_ns;
+} latency_hist_t;
+
+typedef struct {
+    size_t period_us;
+    size_t duration_ms;
+} latency_params_t;
+
+// Periodic wakeup measurement task (cyclictest style)
+// Sleeps to absolute deadlines with clock_nanosleep and records how late
+// each wakeup was. Exits after duration_ms or when stopped.
+// Use with task_create(arr, &latency_task_config, &params)
+// init_arg: pointer to latency_params_t
+extern const task_config_t latency_task_config;
+
+// Runs the measurement twice, idle and while flooding g_log_queue and the
+// dispatcher queues, then logs both histograms and the change in tail latency
+// Blocks for about 2 * duration_ms, call from a worker task
+// Returns 0 on success, -1 on error
+int latency_run_report(const latency_params_t *params);
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef METRICS_TASK_H
+#define METRICS_TASK_H
+
+#include <rtsystem/core/task_helper.h>
+
+#define DEFAULT_METRICS_TASK_PRIORITY 5
+
+// Serves all registered metrics in Prometheus text format over HTTP on
+// 127.0.0.1:<port>, one request per connection (GET /metrics)
+// Use with task_create(arr, &metrics_task_config, &port)
+// init_arg: pointer to int port
+extern const task_config_t metrics_task_config;
+
+#endif
@@ -0,0 +1,410 @@
+// Microbenchmarks for rtsystem core
+// Writes results as JSON (stdout by default) for tracking between releases
+// Each case runs BENCH_WARMUP + repeats times, the median of repeats is reported
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#include <poll.h>
+#include <sched.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#define LOG_LEVEL LOG_LEVEL_DEBUG
+#include <rtsystem/async_log_helper.h>
+#include <rtsystem/core/fifo_queue.h>
+#include <rtsystem/core/task_helper.h>
+
+#define BENCH_DEFAULT_REPEATS 5
+#define BENCH_WARMUP 1
+#define BENCH_MAX_REPEATS 101
+
+#define FIFO_CAPACITY 1024
+#define FIFO_ITEMS 200000
+#define FIFO_LATENCY_SAMPLE_EVERY 16
+
+#define TASK_CREATE_ITERATIONS 500
+#define POLL_ALL_ITERATIONS 2000
+#define LOG_ITERATIONS 20000
+#define LOG_QUEUE_SIZE 4096
+
+static const char *TAG = "bench";
+
+static const size_t fifo_item_sizes[]  = { 16, 64, 256, 1024 };
+static const int    fifo_producers[]   = { 1, 2, 4 };
+static const size_t poll_task_counts[] = { 1, 8, 64, 256 };
+
+static int repeats = BENCH_DEFAULT_REPEATS;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static uint64_t median_u64(uint64_t *v, size_t n) {
+    qsort(v, n, sizeof(uint64_t), cmp_u64);
+    return v[n / 2];
+}
+
+static uint64_t percentile_u64(const uint64_t *sorted, size_t n, double p) {
+    if (n == 0) return 0;
+    size_t idx = (size_t)(p * (double)(n - 1));
+    return sorted[idx];
+}
+
+// =============================================================================
+// Log sink: discards log messages so task_helper and ALOG have a consumer
+// =============================================================================
+
+static pthread_t log_sink_thread;
+static volatile int log_sink_running = 1;
+
+static void *log_sink(void *arg) {
+    (void)arg;
+    struct pollfd pfd = { .fd = g_log_queue.event_fd, .events = POLLIN };
+    log_message_t msg;
+    while (log_sink_running) {
+        if (poll(&pfd, 1, 10) > 0) {
+            while (fifo_queue_receive(&g_log_queue, &msg) == 0) { }
+        }
+    }
+    return NULL;
+}
+
+// =============================================================================
+// fifo_queue throughput and latency
+// =============================================================================
+
+typedef struct {
+    fifo_queue_t *queue;
+    size_t item_size;
+    size_t items;
+} fifo_producer_arg_t;
+
+static void *fifo_producer(void *arg) {
+    fifo_producer_arg_t *p = arg;
+    char item[1024];
+    memset(item, 0xA5, sizeof(item));
+
+    for (size_t i = 0; i < p->items; i++) {
+        uint64_t ts = now_ns();
+        memcpy(item, &ts, sizeof(ts));
+        while (fifo_queue_send(p->queue, item) != 0) {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+typedef struct {
+    uint64_t elapsed_ns;
+    uint64_t lat_p50_ns;
+    uint64_t lat_p99_ns;
+    uint64_t lat_max_ns;
+} fifo_result_t;
+
+static int fifo_run_once(size_t item_size, int producers, fifo_result_t *res) {
+    fifo_queue_t queue;
+    if (fifo_queue_init(&queue, item_size, FIFO_CAPACITY) != 0) {
+        return -1;
+    }
+
+    const size_t per_producer = FIFO_ITEMS / producers;
+    const size_t total = per_producer * producers;
+    const size_t max_samples = total / FIFO_LATENCY_SAMPLE_EVERY + 1;
+    uint64_t *samples = malloc(max_samples * sizeof(uint64_t));
+    if (samples == NULL) {
+        fifo_queue_destroy(&queue);
+        return -1;
+    }
+
+    pthread_t threads[4];
+    fifo_producer_arg_t args = { .queue = &queue, .item_size = item_size, .items = per_producer };
+
+    const uint64_t start = now_ns();
+    for (int i = 0; i < producers; i++) {
+        pthread_create(&threads[i], NULL, fifo_producer, &args);
+    }
+
+    char item[1024];
+    size_t received = 0;
+    size_t n_samples = 0;
+    while (received < total) {
+        if (fifo_queue_receive(&queue, item) != 0) {
+            sched_yield();
+            continue;
+        }
+        if (received % FIFO_LATENCY_SAMPLE_EVERY == 0) {
+            uint64_t ts;
+            memcpy(&ts, item, sizeof(ts));
+            samples[n_samples++] = now_ns() - ts;
+        }
+        received++;
+    }
+    const uint64_t end = now_ns();
+
+    for (int i = 0; i < producers; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    qsort(samples, n_samples, sizeof(uint64_t), cmp_u64);
+    res->elapsed_ns = end - start;
+    res->lat_p50_ns = percentile_u64(samples, n_samples, 0.50);
+    res->lat_p99_ns = percentile_u64(samples, n_samples, 0.99);
+    res->lat_max_ns = samples[n_samples - 1];
+
+    free(samples);
+    fifo_queue_destroy(&queue);
+    return 0;
+}
+
+static void bench_fifo_queue(FILE *out, int *first) {
+    for (size_t s = 0; s < sizeof(fifo_item_sizes) / sizeof(fifo_item_sizes[0]); s++) {
+        for (size_t p = 0; p < sizeof(fifo_producers) / sizeof(fifo_producers[0]); p++) {
+            const size_t item_size = fifo_item_sizes[s];
+            const int producers = fifo_producers[p];
+            const size_t total = (FIFO_ITEMS / producers) * producers;
+
+            uint64_t elapsed[BENCH_MAX_REPEATS], p50[BENCH_MAX_REPEATS];
+            uint64_t p99[BENCH_MAX_REPEATS], max[BENCH_MAX_REPEATS];
+            int ok = 1;
+            for (int r = -BENCH_WARMUP; r < repeats && ok; r++) {
+                fifo_result_t res;
+                if (fifo_run_once(item_size, producers, &res) != 0) {
+                    ok = 0;
+                    break;
+                }
+                if (r < 0) continue;
+                elapsed[r] = res.elapsed_ns;
+                p50[r] = res.lat_p50_ns;
+                p99[r] = res.lat_p99_ns;
+                max[r] = res.lat_max_ns;
+            }
+            if (!ok) {
+                fprintf(stderr, "fifo_queue bench failed (item_size=%zu producers=%d)\n",
+                        item_size, producers);
+                continue;
+            }
+
+            const uint64_t med = median_u64(elapsed, repeats);
+            fprintf(out, "%s    {\"name\": \"fifo_queue\", \"item_size\": %zu, \"producers\": %d, "
+                         "\"items\": %zu, \"items_per_s\": %.0f, \"latency_p50_ns\": %llu, "
+                         "\"latency_p99_ns\": %llu, \"latency_max_ns\": %llu}",
+                    *first ? "" : ",\n", item_size, producers, total,
+                    (double)total * 1e9 / (double)med,
+                    (unsigned long long)median_u64(p50, repeats),
+                    (unsigned long long)median_u64(p99, repeats),
+                    (unsigned long long)median_u64(max, repeats));
+            *first = 0;
+        }
+    }
+}
+
+// =============================================================================
+// task_create / task_join cost
+// =============================================================================
+
+static void *noop_entry(task_handle_t *self) {
+    task_handle_mark_done(self);
+    return NULL;
+}
+
+static const task_config_t noop_task_config = {
+    .priority   = 0,
+    .entry      = noop_entry,
+    .on_init    = NULL,
+    .on_stop    = NULL,
+    .on_cleanup = NULL,
+};
+
+static void bench_task_create(FILE *out, int *first) {
+    task_array_t arr;
+    if (task_array_init(&arr, 1) != 0) {
+        return;
+    }
+
+    uint64_t per_iter[BENCH_MAX_REPEATS];
+    for (int r = -BENCH_WARMUP; r < repeats; r++) {
+        const uint64_t start = now_ns();
+        for (int i = 0; i < TASK_CREATE_ITERATIONS; i++) {
+            task_handle_t *h = task_create(&arr, &noop_task_config, NULL, "bench_noop");
+            if (h == NULL) {
+                fprintf(stderr, "task_create failed in bench\n");
+                task_array_destroy(&arr);
+                return;
+            }
+            task_join(h);
+            task_handle_destroy(h);
+        }
+        if (r >= 0) {
+            per_iter[r] = (now_ns() - start) / TASK_CREATE_ITERATIONS;
+        }
+    }
+    task_array_destroy(&arr);
+
+    fprintf(out, "%s    {\"name\": \"task_create_join\", \"iterations\": %d, \"ns_per_op\": %llu}",
+            *first ? "" : ",\n", TASK_CREATE_ITERATIONS,
+            (unsigned long long)median_u64(per_iter, repeats));
+    *first = 0;
+}
+
+// =============================================================================
+// task_array_poll_all scaling (all tasks already finished)
+// =============================================================================
+
+static void bench_task_poll_all(FILE *out, int *first) {
+    for (size_t c = 0; c < sizeof(poll_task_counts) / sizeof(poll_task_counts[0]); c++) {
+        const size_t n_tasks = poll_task_counts[c];
+        task_array_t arr;
+        if (task_array_init(&arr, n_tasks) != 0) {
+            continue;
+        }
+
+        size_t created = 0;
+        for (size_t i = 0; i < n_tasks; i++) {
+            if (task_create(&arr, &noop_task_config, NULL, "bench_noop") != NULL) {
+                created++;
+            }
+        }
+        // Wait for every task to have signaled done_fd
+        int ret = task_array_poll_all(&arr, -1, 1000);
+
+        uint64_t per_call[BENCH_MAX_REPEATS];
+        for (int r = -BENCH_WARMUP; r < repeats && ret >= 0; r++) {
+            const uint64_t start = now_ns();
+            for (int i = 0; i < POLL_ALL_ITERATIONS; i++) {
+                task_array_poll_all(&arr, -1, 0);
+            }
+            if (r >= 0) {
+                per_call[r] = (now_ns() - start) / POLL_ALL_ITERATIONS;
+            }
+        }
+
+        task_array_join_all(&arr);
+        task_array_destroy_all(&arr);
+        task_array_destroy(&arr);
+
+        if (ret < 0 || created != n_tasks) {
+            fprintf(stderr, "task_array_poll_all bench failed (tasks=%zu)\n", n_tasks);
+            continue;
+        }
+
+        fprintf(out, "%s    {\"name\": \"task_array_poll_all\", \"tasks\": %zu, \"ns_per_call\": %llu}",
+                *first ? "" : ",\n", n_tasks, (unsigned long long)median_u64(per_call, repeats));
+        *first = 0;
+    }
+}
+
+// =============================================================================
+// ALOG cost per level
+// =============================================================================
+
+static void bench_alog(FILE *out, int *first) {
+    static const char *level_names[] = { "debug", "info", "warn", "error" };
+
+    for (int level = LOG_LEVEL_DEBUG; level <= LOG_LEVEL_ERROR; level++) {
+        uint64_t per_call[BENCH_MAX_REPEATS];
+        for (int r = -BENCH_WARMUP; r < repeats; r++) {
+            uint64_t elapsed = 0;
+            // Log in chunks smaller than the queue so no message is dropped
+            for (int done = 0; done < LOG_ITERATIONS; done += LOG_QUEUE_SIZE / 2) {
+                while (fifo_queue_count(&g_log_queue) > 0) {
+                    sched_yield();
+                }
+                const uint64_t start = now_ns();
+                for (int i = 0; i < LOG_QUEUE_SIZE / 2; i++) {
+                    switch (level) {
+                        case LOG_LEVEL_DEBUG: LOGD(TAG, "bench message %d", i); break;
+                        case LOG_LEVEL_INFO:  LOGI(TAG, "bench message %d", i); break;
+                        case LOG_LEVEL_WARN:  LOGW(TAG, "bench message %d", i); break;
+                        default:              LOGE(TAG, "bench message %d", i); break;
+                    }
+                }
+                elapsed += now_ns() - start;
+            }
+            if (r >= 0) {
+                const int calls = ((LOG_ITERATIONS + LOG_QUEUE_SIZE / 2 - 1) / (LOG_QUEUE_SIZE / 2))
+                                  * (LOG_QUEUE_SIZE / 2);
+                per_call[r] = elapsed / calls;
+            }
+        }
+
+        fprintf(out, "%s    {\"name\": \"alog\", \"level\": \"%s\", \"ns_per_call\": %llu}",
+                *first ? "" : ",\n", level_names[level],
+                (unsigned long long)median_u64(per_call, repeats));
+        *first = 0;
+    }
+}
+
+#define HELP_MSG() \
+    fprintf(stderr, "[-h (this message)] [-o <output.json> (stdout by default)] [-r <repeats 1-%d> (%d by default)]\n", \
+            BENCH_MAX_REPEATS, BENCH_DEFAULT_REPEATS)
+
+int main(int argc, char **argv) {
+    const char *out_path = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "o:r:h")) != -1) {
+        switch (opt) {
+            case 'o':
+                out_path = optarg;
+                break;
+            case 'r':
+                repeats = atoi(optarg);
+                if (repeats < 1 || repeats > BENCH_MAX_REPEATS) {
+                    fprintf(stderr, "Invalid repeats: %s\n", optarg);
+                    HELP_MSG();
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'h':
+                HELP_MSG();
+                return EXIT_SUCCESS;
+            default:
+                HELP_MSG();
+                return EXIT_FAILURE;
+        }
+    }
+
+    if (fifo_queue_init(&g_log_queue, sizeof(log_message_t), LOG_QUEUE_SIZE) != 0) {
+        fprintf(stderr, "Failed to initialize log queue\n");
+        return EXIT_FAILURE;
+    }
+    pthread_create(&log_sink_thread, NULL, log_sink, NULL);
+
+    FILE *out = stdout;
+    if (out_path != NULL) {
+        out = fopen(out_path, "w");
+        if (out == NULL) {
+            perror("fopen");
+            return EXIT_FAILURE;
+        }
+    }
+
+    int first = 1;
+    fprintf(out, "{\n  \"suite\": \"rtsystem_core\",\n  \"repeats\": %d,\n  \"timestamp\": %lld,\n  \"benchmarks\": [\n",
+            repeats, (long long)time(NULL));
+    bench_fifo_queue(out, &first);
+    bench_task_create(out, &first);
+    bench_task_poll_all(out, &first);
+    bench_alog(out, &first);
+    fprintf(out, "\n  ]\n}\n");
+
+    if (out != stdout) {
+        fclose(out);
+    }
+
+    log_sink_running = 0;
+    pthread_join(log_sink_thread, NULL);
+    fifo_queue_destroy(&g_log_queue);
+    return EXIT_SUCCESS;
+}
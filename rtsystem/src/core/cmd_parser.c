@@ -4,8 +4,11 @@
 #include <stdint.h>
 #include <wordexp.h>
 
+#define DEFAULT_TRACE_FILE "rtsystem_trace.json"
+
 #define LOG_LEVEL LOG_LEVEL_DEBUG
 #include <rtsystem/core/cmd_parser.h>
+#include <rtsystem/core/trace.h>
 #include <rtsystem/async_log_helper.h>
 #include <rtsystem/tasks/dispatcher_task.h>
 
@@ -13,6 +16,8 @@ const static char *TAG = "cmd_parser";
 static char *CMD_HELP_MESSAGE = "possible commands: \n\
                                     socket <to be added>\n\
                                     echo -m <message> -h <this message>\n\
+                                    latency -i <period_us> -d <duration_ms> -h <this message>\n\
+                                    trace start | trace stop [file] (needs RTSYSTEM_TRACE build)\n\
                                     help <this message>";
 
 int tokenize(char *input, char **argv) {
@@ -48,6 +53,10 @@ int set_cmd_type(cmd_t *result) {
         result->cmd_type = ECHO;
     } else if (strcmp(first_token, "help") == 0) {
         result->cmd_type = HELP;
+    } else if (strcmp(first_token, "trace") == 0) {
+        result->cmd_type = TRACE;
+    } else if (strcmp(first_token, "latency") == 0) {
+        result->cmd_type = LATENCY;
     }
     return 0;
 }
@@ -84,6 +93,70 @@ int parse_help(cmd_t command, char **message) {
     return 0;
 }
 
+int parse_trace(cmd_t command) {
+    LOGD(TAG, "in trace");
+    if (command.argc < 2) {
+        LOGW(TAG, "usage: trace start | trace stop [file]");
+        return -1;
+    }
+
+    if (strcmp(command.argv[1], "start") == 0) {
+        return trace_start();
+    }
+
+    if (strcmp(command.argv[1], "stop") == 0) {
+        const char *path = command.argc > 2 ? command.argv[2] : DEFAULT_TRACE_FILE;
+        return trace_stop(path) < 0 ? -1 : 0;
+    }
+
+    LOGW(TAG, "unknown trace action '%s'", command.argv[1]);
+    return -1;
+}
+
+int parse_latency(cmd_t command, latency_params_t *params) {
+    LOGD(TAG, "in latency");
+    params->period_us   = DEFAULT_LATENCY_PERIOD_US;
+    params->duration_ms = DEFAULT_LATENCY_DURATION_MS;
+
+    // Parsed by hand, this runs on handler workers in parallel with other
+    // commands and getopt keeps its state in globals
+    for (int i = 1; i < command.argc; i++) {
+        const char *arg = command.argv[i];
+        if (arg[0] != '-' || arg[1] == '\0') {
+            LOGW(TAG, "unexpected argument '%s'", arg);
+            continue;
+        }
+        const char opt = arg[1];
+        if (opt == 'h') {
+            LOGI(TAG, "latency -i <period_us> (%d by default) -d <duration_ms> (%d by default)",
+                 DEFAULT_LATENCY_PERIOD_US, DEFAULT_LATENCY_DURATION_MS);
+            return -1;
+        }
+        if (opt != 'i' && opt != 'd') {
+            LOGW(TAG, "unknown option");
+            continue;
+        }
+
+        // Value attached (-i500) or in the next argument (-i 500)
+        const char *value = arg[2] != '\0' ? &arg[2] : (i + 1 < command.argc ? command.argv[++i] : NULL);
+        if (value == NULL) {
+            LOGW(TAG, "option -%c needs a value", opt);
+            return -1;
+        }
+        if (opt == 'i') {
+            params->period_us = strtoul(value, NULL, 10);
+        } else {
+            params->duration_ms = strtoul(value, NULL, 10);
+        }
+    }
+
+    if (params->period_us == 0 || params->duration_ms == 0) {
+        LOGW(TAG, "period and duration must be > 0");
+        return -1;
+    }
+    return 0;
+}
+
 int parse_NIL(cmd_t command) {
     LOGD(TAG, "in NIL");
     return 0;
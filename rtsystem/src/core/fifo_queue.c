@@ -5,6 +5,7 @@
 #include <stdint.h>
 
 #include <rtsystem/core/fifo_queue.h>
+#include <rtsystem/core/trace.h>
 
 int fifo_queue_init(fifo_queue_t* queue, size_t item_size, size_t capacity) {
     queue->buffer = malloc(item_size * capacity);
@@ -50,10 +51,12 @@ void fifo_queue_destroy(fifo_queue_t* queue) {
 }
 
 int fifo_queue_send(fifo_queue_t* queue, const void* item) {
+    TRACE_BEGIN("fifo_queue_send");
     pthread_mutex_lock(&queue->lock);
 
     if (queue->count >= queue->capacity) {
         pthread_mutex_unlock(&queue->lock);
+        TRACE_END("fifo_queue_send");
         return -1;
     }
 
@@ -67,14 +70,17 @@ int fifo_queue_send(fifo_queue_t* queue, const void* item) {
     write(queue->event_fd, &val, sizeof(val));
 
     pthread_mutex_unlock(&queue->lock);
+    TRACE_END("fifo_queue_send");
     return 0;
 }
 
 int fifo_queue_receive(fifo_queue_t* queue, void* item) {
+    TRACE_BEGIN("fifo_queue_receive");
     pthread_mutex_lock(&queue->lock);
 
     if (queue->count == 0) {
         pthread_mutex_unlock(&queue->lock);
+        TRACE_END("fifo_queue_receive");
         return -1;
     }
 
@@ -88,6 +94,7 @@ int fifo_queue_receive(fifo_queue_t* queue, void* item) {
     read(queue->event_fd, &val, sizeof(val));
 
     pthread_mutex_unlock(&queue->lock);
+    TRACE_END("fifo_queue_receive");
     return 0;
 }
 
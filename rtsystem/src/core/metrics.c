@@ -0,0 +1,103 @@
+#include <string.h>
+
+#include <rtsystem/core/metrics.h>
+
+// Only modified by constructors before main, read-only afterwards
+static metric_group_t *g_metric_groups = NULL;
+
+void metric_histogram_observe(metric_histogram_t *h, uint64_t value) {
+    size_t i = 0;
+    while (i < h->n_bounds && value > h->bounds[i]) {
+        i++;
+    }
+    __atomic_fetch_add(&h->buckets[i], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->sum, value, __ATOMIC_RELAXED);
+}
+
+void metrics_register_group(metric_group_t *group) {
+    group->next = g_metric_groups;
+    g_metric_groups = group;
+}
+
+static const char *metric_type_name(metric_type_t type) {
+    switch (type) {
+        case METRIC_COUNTER:
+        case METRIC_COLLECTOR: return "counter";
+        case METRIC_HISTOGRAM: return "histogram";
+        default:               return "gauge";
+    }
+}
+
+static void write_histogram(FILE *out, const char *full_name, const metric_t *m) {
+    const metric_histogram_t *h = m->histogram;
+    const char *sep = m->labels ? "," : "";
+    const char *labels = m->labels ? m->labels : "";
+
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i <= h->n_bounds; i++) {
+        cumulative += __atomic_load_n(&h->buckets[i], __ATOMIC_RELAXED);
+        if (i < h->n_bounds) {
+            fprintf(out, "%s_bucket{%s%sle=\"%g\"} %llu\n", full_name, labels, sep,
+                    (double)h->bounds[i] * h->scale, (unsigned long long)cumulative);
+        } else {
+            fprintf(out, "%s_bucket{%s%sle=\"+Inf\"} %llu\n", full_name, labels, sep,
+                    (unsigned long long)cumulative);
+        }
+    }
+
+    const double sum = (double)__atomic_load_n(&h->sum, __ATOMIC_RELAXED) * h->scale;
+    const unsigned long long count = cumulative;
+    if (m->labels) {
+        fprintf(out, "%s_sum{%s} %g\n%s_count{%s} %llu\n", full_name, labels, sum, full_name, labels, count);
+    } else {
+        fprintf(out, "%s_sum %g\n%s_count %llu\n", full_name, sum, full_name, count);
+    }
+}
+
+static void write_metric(FILE *out, const char *full_name, const metric_t *m) {
+    char labels[128] = "";
+    if (m->labels) {
+        snprintf(labels, sizeof(labels), "{%s}", m->labels);
+    }
+
+    switch (m->type) {
+        case METRIC_COUNTER:
+            fprintf(out, "%s%s %llu\n", full_name, labels,
+                    (unsigned long long)__atomic_load_n(&m->counter->value, __ATOMIC_RELAXED));
+            break;
+        case METRIC_GAUGE:
+            fprintf(out, "%s%s %lld\n", full_name, labels,
+                    (long long)__atomic_load_n(&m->gauge->value, __ATOMIC_RELAXED));
+            break;
+        case METRIC_GAUGE_FN:
+            fprintf(out, "%s%s %g\n", full_name, labels, m->read());
+            break;
+        case METRIC_HISTOGRAM:
+            write_histogram(out, full_name, m);
+            break;
+        case METRIC_COLLECTOR:
+            m->collect(out, full_name);
+            break;
+    }
+}
+
+void metrics_write_prometheus(FILE *out) {
+    for (const metric_group_t *g = g_metric_groups; g != NULL; g = g->next) {
+        const char *prev_name = NULL;
+        for (size_t i = 0; i < g->count; i++) {
+            const metric_t *m = &g->metrics[i];
+
+            char full_name[128];
+            snprintf(full_name, sizeof(full_name), METRICS_PREFIX "%s_%s", g->subsystem, m->name);
+
+            // HELP and TYPE only once per metric family
+            if (prev_name == NULL || strcmp(prev_name, m->name) != 0) {
+                fprintf(out, "# HELP %s %s\n# TYPE %s %s\n",
+                        full_name, m->help, full_name, metric_type_name(m->type));
+            }
+            prev_name = m->name;
+
+            write_metric(out, full_name, m);
+        }
+    }
+}
@@ -3,22 +3,115 @@
 #include <poll.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #define LOG_LEVEL LOG_LEVEL_DEBUG
 #include <rtsystem/core/task_helper.h>
+#include <rtsystem/core/trace.h>
+#include <rtsystem/core/metrics.h>
 #include <rtsystem/async_log_helper.h>
 
 static const char *TAG = "task_helper";
 
+// Tasks with a running or unjoined thread, for per-task CPU time. Taken by
+// task_create and task_handle_destroy on SCHED_FIFO threads, so priority
+// inheritance, initialised before main
+static task_handle_t *g_live_tasks = NULL;
+static pthread_mutex_t g_live_lock;
+
+__attribute__((constructor)) static void live_lock_init(void) {
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_INHERIT);
+    pthread_mutex_init(&g_live_lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+// Distinct task names per scrape, the rest are left out
+#define TASK_CPU_MAX_NAMES 64
+#define TASK_CPU_NAME_LEN 32
+
+static metric_counter_t m_created_total;
+static metric_gauge_t m_tasks;
+
+static void collect_task_cpu(FILE *out, const char *full_name);
+
+static metric_t task_metrics[] = {
+    { .name = "created_total", .help = "Tasks created", .type = METRIC_COUNTER, .counter = &m_created_total },
+    { .name = "count", .help = "Tasks currently allocated", .type = METRIC_GAUGE, .gauge = &m_tasks },
+    { .name = "cpu_seconds_total", .help = "CPU time used per task thread",
+      .type = METRIC_COLLECTOR, .collect = collect_task_cpu },
+};
+static metric_group_t task_metric_group = METRIC_GROUP("task", task_metrics);
+METRICS_REGISTER_GROUP(task_metric_group)
+
+// Threads sharing a name (the dispatcher's workers) are summed, one sample
+// per label set. Only the snapshot is taken under the lock, a slow scraper
+// must not hold up task creation
+static void collect_task_cpu(FILE *out, const char *full_name) {
+    struct {
+        char name[TASK_CPU_NAME_LEN];
+        double seconds;
+    } samples[TASK_CPU_MAX_NAMES];
+    size_t n = 0;
+
+    pthread_mutex_lock(&g_live_lock);
+    for (task_handle_t *h = g_live_tasks; h != NULL; h = h->live_next) {
+        clockid_t cid;
+        struct timespec ts;
+        if (pthread_getcpuclockid(h->thread, &cid) != 0 || clock_gettime(cid, &ts) != 0) {
+            continue;
+        }
+        size_t i = 0;
+        while (i < n && strncmp(samples[i].name, h->name, TASK_CPU_NAME_LEN - 1) != 0) {
+            i++;
+        }
+        if (i == n) {
+            if (n == TASK_CPU_MAX_NAMES) continue;
+            snprintf(samples[n].name, sizeof(samples[n].name), "%s", h->name);
+            samples[n++].seconds = 0.0;
+        }
+        samples[i].seconds += (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+    }
+    pthread_mutex_unlock(&g_live_lock);
+
+    for (size_t i = 0; i < n; i++) {
+        fprintf(out, "%s{task=\"%s\"} %.6f\n", full_name, samples[i].name, samples[i].seconds);
+    }
+}
+
+static void live_tasks_remove(task_handle_t* handle) {
+    pthread_mutex_lock(&g_live_lock);
+    for (task_handle_t **p = &g_live_tasks; *p != NULL; p = &(*p)->live_next) {
+        if (*p == handle) {
+            *p = handle->live_next;
+            break;
+        }
+    }
+    handle->live_next = NULL;
+    pthread_mutex_unlock(&g_live_lock);
+}
+
+#ifdef RTSYSTEM_TRACE
+static const char *state_names[] = {
+    [TASK_STATE_INIT]     = "TASK_STATE_INIT",
+    [TASK_STATE_RUNNING]  = "TASK_STATE_RUNNING",
+    [TASK_STATE_STOPPING] = "TASK_STATE_STOPPING",
+    [TASK_STATE_STOPPED]  = "TASK_STATE_STOPPED",
+};
+#endif
+
 task_handle_t* task_create(task_array_t* arr, const task_config_t* config, void* init_arg, const char *name) {
     if (arr == NULL || config == NULL || config->entry == NULL) {
         LOGE(TAG, "task_create: invalid arguments");
         return NULL;
     }
+    TRACE_BEGIN_ARG("task_create", name);
 
     task_handle_t* handle = malloc(sizeof(task_handle_t));
     if (handle == NULL) {
         LOGE(TAG, "task_create: malloc failed for task '%s'", name);
+        TRACE_END("task_create");
         return NULL;
     }
 
@@ -28,11 +121,13 @@ task_handle_t* task_create(task_array_t* arr, const task_config_t* config, void*
     handle->task_resources = NULL;
     handle->array = NULL;
     handle->thread = 0;
+    handle->live_next = NULL;
 
     handle->done_fd = eventfd(0, EFD_NONBLOCK);
     if (handle->done_fd == -1) {
         LOGE_ERRNO(TAG, "task_create: eventfd failed for task '%s'", handle->name);
         free(handle);
+        TRACE_END("task_create");
         return NULL;
     }
 
@@ -43,6 +138,7 @@ task_handle_t* task_create(task_array_t* arr, const task_config_t* config, void*
             LOGE(TAG, "task_create: on_init failed for task '%s'", handle->name);
             close(handle->done_fd);
             free(handle);
+            TRACE_END("task_create");
             return NULL;
         }
     }
@@ -56,6 +152,7 @@ task_handle_t* task_create(task_array_t* arr, const task_config_t* config, void*
         }
         close(handle->done_fd);
         free(handle);
+        TRACE_END("task_create");
         return NULL;
     }
 
@@ -83,15 +180,29 @@ task_handle_t* task_create(task_array_t* arr, const task_config_t* config, void*
         }
         close(handle->done_fd);
         free(handle);
+        TRACE_END("task_create");
         return NULL;
     }
 
+    pthread_mutex_lock(&g_live_lock);
+    handle->live_next = g_live_tasks;
+    g_live_tasks = handle;
+    pthread_mutex_unlock(&g_live_lock);
+
+    metric_counter_add(&m_created_total, 1);
+    metric_gauge_add(&m_tasks, 1);
     LOGD(TAG, "created task '%s'", handle->name);
+    TRACE_END("task_create");
     return handle;
 }
 
+void task_handle_set_state(task_handle_t* handle, task_state_t state) {
+    handle->state = state;
+    TRACE_INSTANT(state_names[state], handle->name);
+}
+
 void task_handle_mark_done(task_handle_t* handle) {
-    handle->state = TASK_STATE_STOPPED;
+    task_handle_set_state(handle, TASK_STATE_STOPPED);
     uint64_t done = 1;
     write(handle->done_fd, &done, sizeof(done));
     LOGD(TAG, "task '%s' marked done", handle->name);
@@ -110,6 +221,8 @@ void task_handle_destroy(task_handle_t* handle) {
         }
     }
 
+    live_tasks_remove(handle);
+
     // Call cleanup callback
     if (handle->config && handle->config->on_cleanup != NULL) {
         handle->config->on_cleanup(handle);
@@ -122,6 +235,7 @@ void task_handle_destroy(task_handle_t* handle) {
     }
 
     handle->state = TASK_STATE_STOPPED;
+    metric_gauge_add(&m_tasks, -1);
     LOGD(TAG, "destroyed task '%s'", name);
 
     free(handle);
@@ -135,12 +249,14 @@ void task_stop(task_handle_t* handle) {
     if (handle->config && handle->config->on_stop != NULL) {
         handle->config->on_stop(handle);
     } else {
-        handle->state = TASK_STATE_STOPPING;
+        task_handle_set_state(handle, TASK_STATE_STOPPING);
     }
     LOGD(TAG, "stop signal sent to task '%s'", handle->name);
 }
 
 void task_join(task_handle_t* handle) {
+    // Thread id is invalid after join, stop reading its CPU clock first
+    live_tasks_remove(handle);
     pthread_join(handle->thread, NULL);
     LOGD(TAG, "joined task '%s'", handle->name);
 }
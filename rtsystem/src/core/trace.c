@@ -0,0 +1,219 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+
+#define LOG_LEVEL LOG_LEVEL_DEBUG
+#include <rtsystem/core/trace.h>
+#include <rtsystem/async_log_helper.h>
+
+static const char *TAG = "trace";
+
+#ifdef RTSYSTEM_TRACE
+
+typedef struct {
+    const char *name;
+    const char *arg;
+    uint64_t ts_ns;
+    char phase;
+} trace_record_t;
+
+// Single writer (owning thread), published to the dumper through count.
+// trace_start only bumps g_trace_epoch, the owner resets its own buffer on
+// its first event of a new epoch, and the dumper skips buffers of older ones
+typedef struct {
+    trace_record_t events[TRACE_BUFFER_EVENTS];
+    size_t count;       // Written with release by owner, read with acquire
+    size_t dropped;     // Written by owner only
+    unsigned epoch;     // Epoch count and dropped belong to, published with release
+    pid_t tid;
+    int in_use;         // Claimed by a live thread or holding unread events
+    int exited;         // Owning thread has exited
+} trace_buffer_t;
+
+int g_trace_enabled = 0;
+static unsigned g_trace_epoch = 0;  // Bumped by every trace_start
+
+static trace_buffer_t *g_trace_buffers[TRACE_MAX_THREADS];
+static pthread_key_t g_trace_key;
+static pthread_once_t g_trace_key_once = PTHREAD_ONCE_INIT;
+static __thread trace_buffer_t *tls_buffer = NULL;
+
+static void trace_thread_exit(void *arg) {
+    trace_buffer_t *buf = arg;
+    __atomic_store_n(&buf->exited, 1, __ATOMIC_RELEASE);
+}
+
+static void trace_key_create(void) {
+    pthread_key_create(&g_trace_key, trace_thread_exit);
+}
+
+static uint64_t trace_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Owner only: discard events of an earlier epoch
+static void trace_reset(trace_buffer_t *buf, unsigned epoch) {
+    __atomic_store_n(&buf->count, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&buf->dropped, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&buf->epoch, epoch, __ATOMIC_RELEASE);
+}
+
+// Claim a free buffer slot for the calling thread, allocating it on first use
+static trace_buffer_t *trace_claim_buffer(void) {
+    pthread_once(&g_trace_key_once, trace_key_create);
+
+    for (size_t i = 0; i < TRACE_MAX_THREADS; i++) {
+        trace_buffer_t *buf = __atomic_load_n(&g_trace_buffers[i], __ATOMIC_ACQUIRE);
+
+        if (buf == NULL) {
+            trace_buffer_t *fresh = calloc(1, sizeof(trace_buffer_t));
+            if (fresh == NULL) {
+                return NULL;
+            }
+            fresh->in_use = 1;
+            if (!__atomic_compare_exchange_n(&g_trace_buffers[i], &buf, fresh, 0,
+                                             __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                free(fresh);
+                continue;  // Lost the race for this slot
+            }
+            buf = fresh;
+        } else {
+            int expected = 0;
+            if (!__atomic_compare_exchange_n(&buf->in_use, &expected, 1, 0,
+                                             __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+                continue;
+            }
+            buf->exited = 0;
+        }
+
+        trace_reset(buf, __atomic_load_n(&g_trace_epoch, __ATOMIC_ACQUIRE));
+        buf->tid = (pid_t)syscall(SYS_gettid);
+        pthread_setspecific(g_trace_key, buf);
+        return buf;
+    }
+    return NULL;
+}
+
+void trace_event(char phase, const char *name, const char *arg) {
+    trace_buffer_t *buf = tls_buffer;
+    if (buf == NULL) {
+        buf = trace_claim_buffer();
+        if (buf == NULL) {
+            return;  // Out of thread slots, event is lost
+        }
+        tls_buffer = buf;
+    }
+
+    const unsigned epoch = __atomic_load_n(&g_trace_epoch, __ATOMIC_ACQUIRE);
+    if (buf->epoch != epoch) {
+        trace_reset(buf, epoch);
+    }
+
+    size_t idx = __atomic_load_n(&buf->count, __ATOMIC_RELAXED);
+    if (idx >= TRACE_BUFFER_EVENTS) {
+        __atomic_store_n(&buf->dropped, buf->dropped + 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    trace_record_t *rec = &buf->events[idx];
+    rec->name  = name;
+    rec->arg   = arg;
+    rec->phase = phase;
+    rec->ts_ns = trace_now_ns();
+    __atomic_store_n(&buf->count, idx + 1, __ATOMIC_RELEASE);
+}
+
+int trace_start(void) {
+    // Events of live threads are discarded by the threads themselves
+    __atomic_add_fetch(&g_trace_epoch, 1, __ATOMIC_RELEASE);
+
+    for (size_t i = 0; i < TRACE_MAX_THREADS; i++) {
+        trace_buffer_t *buf = __atomic_load_n(&g_trace_buffers[i], __ATOMIC_ACQUIRE);
+        if (buf == NULL) {
+            break;
+        }
+        // Slots of exited threads may be reused, their events are from before this epoch
+        if (__atomic_load_n(&buf->exited, __ATOMIC_ACQUIRE)) {
+            __atomic_store_n(&buf->in_use, 0, __ATOMIC_RELEASE);
+        }
+    }
+
+    __atomic_store_n(&g_trace_enabled, 1, __ATOMIC_RELEASE);
+    LOGI(TAG, "tracing started");
+    return 0;
+}
+
+int trace_stop(const char *path) {
+    __atomic_store_n(&g_trace_enabled, 0, __ATOMIC_RELEASE);
+
+    FILE *f = fopen(path, "w");
+    if (f == NULL) {
+        LOGE_ERRNO(TAG, "could not open trace file '%s'", path);
+        return -1;
+    }
+
+    const pid_t pid = getpid();
+    const unsigned epoch = __atomic_load_n(&g_trace_epoch, __ATOMIC_ACQUIRE);
+    int written = 0;
+    size_t dropped = 0;
+
+    fprintf(f, "{\"traceEvents\":[\n");
+    for (size_t i = 0; i < TRACE_MAX_THREADS; i++) {
+        trace_buffer_t *buf = __atomic_load_n(&g_trace_buffers[i], __ATOMIC_ACQUIRE);
+        if (buf == NULL) {
+            break;
+        }
+
+        if (__atomic_load_n(&buf->epoch, __ATOMIC_ACQUIRE) != epoch) {
+            continue;  // Nothing recorded since trace_start
+        }
+        size_t count = __atomic_load_n(&buf->count, __ATOMIC_ACQUIRE);
+        dropped += __atomic_load_n(&buf->dropped, __ATOMIC_RELAXED);
+        for (size_t e = 0; e < count; e++) {
+            const trace_record_t *rec = &buf->events[e];
+            fprintf(f, "%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%llu.%03llu,\"pid\":%d,\"tid\":%d",
+                    written > 0 ? ",\n" : "",
+                    rec->name, rec->phase,
+                    (unsigned long long)(rec->ts_ns / 1000),
+                    (unsigned long long)(rec->ts_ns % 1000),
+                    (int)pid, (int)buf->tid);
+            if (rec->phase == 'i') {
+                fprintf(f, ",\"s\":\"t\"");
+            }
+            if (rec->arg != NULL) {
+                fprintf(f, ",\"args\":{\"arg\":\"%s\"}", rec->arg);
+            }
+            fprintf(f, "}");
+            written++;
+        }
+    }
+    fprintf(f, "\n],\"displayTimeUnit\":\"ns\"}\n");
+    fclose(f);
+
+    if (dropped > 0) {
+        LOGW(TAG, "%zu event(s) dropped, buffers full", dropped);
+    }
+    LOGI(TAG, "wrote %d event(s) to '%s'", written, path);
+    return written;
+}
+
+#else
+
+int trace_start(void) {
+    LOGW(TAG, "tracing not compiled in (build with -DRTSYSTEM_TRACE=ON)");
+    return -1;
+}
+
+int trace_stop(const char *path) {
+    (void)path;
+    LOGW(TAG, "tracing not compiled in (build with -DRTSYSTEM_TRACE=ON)");
+    return -1;
+}
+
+#endif
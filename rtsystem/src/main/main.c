@@ -14,10 +14,15 @@
 #include <rtsystem/tasks/stdin_task.h>
 #include <rtsystem/tasks/dispatcher_task.h>
 #include <rtsystem/tasks/example_worker_task.h>
+#include <rtsystem/tasks/metrics_task.h>
 
 #define LOG_QUEUE_SIZE 64
 #define STDIN_LINE_BUF_SIZE 256
-#define DISPATCH_QUEUE_SIZE 8
+#define DISPATCH_CRITICAL_QUEUE_SIZE 8
+#define DISPATCH_NORMAL_QUEUE_SIZE 32
+#define DISPATCH_BULK_QUEUE_SIZE 64
+#define DISPATCH_MAX_WORKERS 4
+#define METRICS_HTTP_PORT 9464  // 0 disables the metrics endpoint
 
 #define PRIORITY_MAIN 50
 #define PRIORITY_LOG_TASK 10
@@ -25,7 +30,7 @@
 #define TASK_SHUTDOWN_TIMEOUT_MS 1000
 #define LOG_TASK_SHUTDOWN_TIMEOUT_MS 3000
 
-#define SYSTEM_TASKS_ARRAY_CAPACITY 3
+#define SYSTEM_TASKS_ARRAY_CAPACITY 4
 
 static const char *TAG = "main";
 
@@ -52,6 +57,10 @@ int main(void) {
     sigaddset(&mask, SIGINT);
     sigprocmask(SIG_BLOCK, &mask, NULL);
 
+    // A scraper resetting the metrics connection must not kill the process,
+    // writes to it fail with EPIPE instead
+    signal(SIGPIPE, SIG_IGN);
+
     sig_fd = signalfd(-1, &mask, 0);
     if (sig_fd == -1) {
         perror("signalfd");
@@ -81,15 +90,35 @@ int main(void) {
 
     // Create system tasks
     size_t stdin_buf_size = STDIN_LINE_BUF_SIZE;
-    size_t dispatch_queue_size = DISPATCH_QUEUE_SIZE;
+    dispatcher_init_t dispatch_init = {
+        .queue_size = {
+            [CMD_PRIO_CRITICAL] = DISPATCH_CRITICAL_QUEUE_SIZE,
+            [CMD_PRIO_NORMAL]   = DISPATCH_NORMAL_QUEUE_SIZE,
+            [CMD_PRIO_BULK]     = DISPATCH_BULK_QUEUE_SIZE,
+        },
+        .policy = DISPATCH_POLICY_WEIGHTED,
+        .weight = {
+            [CMD_PRIO_CRITICAL] = 8,
+            [CMD_PRIO_NORMAL]   = 4,
+            [CMD_PRIO_BULK]     = 1,
+        },
+        .max_workers = DISPATCH_MAX_WORKERS,
+    };
 
     if (task_create(&g_system_tasks, &stdin_task_config, &stdin_buf_size, "stdin_task") == NULL) {
         LOGE(TAG, "failed to create stdin_task");
     }
 
-    if (task_create(&g_system_tasks, &dispatcher_task_config, &dispatch_queue_size, "disp_task") == NULL) {
+    if (task_create(&g_system_tasks, &dispatcher_task_config, &dispatch_init, "disp_task") == NULL) {
         LOGE(TAG, "failed to create dispatcher_task");
     }
+
+    int metrics_port = METRICS_HTTP_PORT;
+    if (metrics_port > 0 &&
+        task_create(&g_system_tasks, &metrics_task_config, &metrics_port, "metrics_task") == NULL) {
+        LOGE(TAG, "failed to create metrics_task");
+    }
+
     // Example task that helps understand functionality
     char *temp = "I AM A SURGEON";
     const size_t msg_len = strlen(temp) + 1;
@@ -1,27 +1,164 @@
 #include <poll.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <sched.h>
+#include <time.h>
 
 #define LOG_LEVEL LOG_LEVEL_DEBUG
 #include <rtsystem/core/task_helper.h>
 #include <rtsystem/core/fifo_queue.h>
 #include <rtsystem/tasks/dispatcher_task.h>
+#include <rtsystem/tasks/latency_task.h>
 #include <rtsystem/async_log_helper.h>
 #include <rtsystem/core/cmd_parser.h>
+#include <rtsystem/core/trace.h>
+#include <rtsystem/core/metrics.h>
 
 #define DISPATCHER_POLL_TIMEOUT_MS 10
+#define DISPATCHER_WORKER_SHUTDOWN_TIMEOUT_MS 500
 
 static const char *TAG = "disp_task";
 
 extern volatile int g_running;
 
-static fifo_queue_t g_command_queue;
+// Priority class and whether the handler runs in its own worker task
+// Offloaded handlers never block the dispatcher loop
+typedef struct {
+    cmd_priority_t priority;
+    bool offload;
+} cmd_class_t;
+
+static const cmd_class_t cmd_classes[] = {
+    [SOCKET] = { .priority = CMD_PRIO_BULK,     .offload = true  },
+    [ECHO]   = { .priority = CMD_PRIO_NORMAL,   .offload = false },
+    [HELP]   = { .priority = CMD_PRIO_CRITICAL, .offload = false },
+    [TRACE]  = { .priority = CMD_PRIO_NORMAL,   .offload = true  },
+    [LATENCY]= { .priority = CMD_PRIO_BULK,     .offload = true  },
+    [NIL]    = { .priority = CMD_PRIO_CRITICAL, .offload = false },
+};
+
+static bool dispatcher_cmd_offload(cmd_type_t cmd_type) {
+    if ((size_t)cmd_type >= sizeof(cmd_classes) / sizeof(cmd_classes[0])) {
+        return false;
+    }
+    return cmd_classes[cmd_type].offload;
+}
+
+static const char *prio_names[CMD_PRIO_COUNT] = { "critical", "normal", "bulk" };
+
+#ifdef RTSYSTEM_TRACE
+static const char *cmd_names[] = {
+    [SOCKET] = "socket",
+    [ECHO]   = "echo",
+    [HELP]   = "help",
+    [TRACE]  = "trace",
+    [LATENCY]= "latency",
+    [NIL]    = "NIL",
+};
+
+// cmd_type comes off the queue, anything out of range is named "?"
+static const char *cmd_name(cmd_type_t type) {
+    if ((size_t)type >= sizeof(cmd_names) / sizeof(cmd_names[0]) || cmd_names[type] == NULL) {
+        return "?";
+    }
+    return cmd_names[type];
+}
+#endif
+
+static fifo_queue_t g_command_queues[CMD_PRIO_COUNT];
+// Read from other threads (metrics scrapes, the stdin task), always access
+// with __atomic builtins. Users outside the dispatcher hold g_queue_users
+// while touching the queues, cleanup waits for it to drain before destroying
 static bool g_command_queue_initialized = false;
+static int g_queue_users = 0;
+
+static metric_counter_t m_dispatched[CMD_PRIO_COUNT];
+static metric_counter_t m_dropped[CMD_PRIO_COUNT];
+static metric_counter_t m_offloaded;
+
+// Handler run time in ns, 10 us to 1 s
+static const uint64_t handler_duration_bounds[] = {
+    10000, 100000, 1000000, 10000000, 100000000, 1000000000,
+};
+static metric_histogram_t m_handler_duration = {
+    .bounds   = handler_duration_bounds,
+    .n_bounds = sizeof(handler_duration_bounds) / sizeof(handler_duration_bounds[0]),
+    .scale    = 1e-9,
+};
+
+// Returns true if the queues may be used until queues_release
+// Sequentially consistent so that either cleanup sees the user or the user
+// sees the cleared flag
+static bool queues_acquire(void) {
+    __atomic_add_fetch(&g_queue_users, 1, __ATOMIC_SEQ_CST);
+    if (!__atomic_load_n(&g_command_queue_initialized, __ATOMIC_SEQ_CST)) {
+        __atomic_sub_fetch(&g_queue_users, 1, __ATOMIC_SEQ_CST);
+        return false;
+    }
+    return true;
+}
+
+static void queues_release(void) {
+    __atomic_sub_fetch(&g_queue_users, 1, __ATOMIC_SEQ_CST);
+}
+
+static double queue_depth(cmd_priority_t prio) {
+    if (!queues_acquire()) {
+        return 0;
+    }
+    const double depth = (double)fifo_queue_count(&g_command_queues[prio]);
+    queues_release();
+    return depth;
+}
+
+static double queue_depth_critical(void) { return queue_depth(CMD_PRIO_CRITICAL); }
+static double queue_depth_normal(void)   { return queue_depth(CMD_PRIO_NORMAL); }
+static double queue_depth_bulk(void)     { return queue_depth(CMD_PRIO_BULK); }
+
+#define CLASS_LABEL(_class) "class=\"" _class "\""
+
+static metric_t dispatcher_metrics[] = {
+    { .name = "commands_total", .help = "Commands dispatched per priority class", .type = METRIC_COUNTER,
+      .labels = CLASS_LABEL("critical"), .counter = &m_dispatched[CMD_PRIO_CRITICAL] },
+    { .name = "commands_total", .help = "", .type = METRIC_COUNTER,
+      .labels = CLASS_LABEL("normal"), .counter = &m_dispatched[CMD_PRIO_NORMAL] },
+    { .name = "commands_total", .help = "", .type = METRIC_COUNTER,
+      .labels = CLASS_LABEL("bulk"), .counter = &m_dispatched[CMD_PRIO_BULK] },
+    { .name = "dropped_total", .help = "Commands rejected because the class queue was full", .type = METRIC_COUNTER,
+      .labels = CLASS_LABEL("critical"), .counter = &m_dropped[CMD_PRIO_CRITICAL] },
+    { .name = "dropped_total", .help = "", .type = METRIC_COUNTER,
+      .labels = CLASS_LABEL("normal"), .counter = &m_dropped[CMD_PRIO_NORMAL] },
+    { .name = "dropped_total", .help = "", .type = METRIC_COUNTER,
+      .labels = CLASS_LABEL("bulk"), .counter = &m_dropped[CMD_PRIO_BULK] },
+    { .name = "queue_depth", .help = "Commands waiting per priority class", .type = METRIC_GAUGE_FN,
+      .labels = CLASS_LABEL("critical"), .read = queue_depth_critical },
+    { .name = "queue_depth", .help = "", .type = METRIC_GAUGE_FN,
+      .labels = CLASS_LABEL("normal"), .read = queue_depth_normal },
+    { .name = "queue_depth", .help = "", .type = METRIC_GAUGE_FN,
+      .labels = CLASS_LABEL("bulk"), .read = queue_depth_bulk },
+    { .name = "offloaded_total", .help = "Commands run in a handler task", .type = METRIC_COUNTER,
+      .counter = &m_offloaded },
+    { .name = "handler_duration_seconds", .help = "Command handler run time", .type = METRIC_HISTOGRAM,
+      .histogram = &m_handler_duration },
+};
+static metric_group_t dispatcher_metric_group = METRIC_GROUP("dispatcher", dispatcher_metrics);
+METRICS_REGISTER_GROUP(dispatcher_metric_group)
+
+typedef struct {
+    dispatch_policy_t policy;
+    unsigned weight[CMD_PRIO_COUNT];
+    unsigned credit[CMD_PRIO_COUNT];  // Remaining commands this round (weighted)
+    task_array_t workers;
+} dispatcher_data_t;
 
 static int   dispatcher_init(task_handle_t *self, void *init_arg);
 static void  dispatcher_cleanup(task_handle_t *self);
 static void *dispatcher_entry(task_handle_t *self);
 
+static int   handler_init(task_handle_t *self, void *init_arg);
+static void  handler_cleanup(task_handle_t *self);
+static void *handler_entry(task_handle_t *self);
+
 const task_config_t dispatcher_task_config = {
     .priority   = DEFAULT_DISPATCHER_TASK_PRIORITY,
     .entry      = dispatcher_entry,
@@ -30,112 +167,307 @@ const task_config_t dispatcher_task_config = {
     .on_cleanup = dispatcher_cleanup,
 };
 
+// Short-lived task running a single offloaded command
+static const task_config_t handler_task_config = {
+    .priority   = DEFAULT_DISPATCH_HANDLER_PRIORITY,
+    .entry      = handler_entry,
+    .on_init    = handler_init,
+    .on_stop    = NULL,
+    .on_cleanup = handler_cleanup,
+};
+
 static int dispatcher_init(task_handle_t *self, void *init_arg) {
-    size_t queue_size = *(size_t *)init_arg;
+    const dispatcher_init_t *init = init_arg;
 
-    if (g_command_queue_initialized) {
-        LOGW(TAG, "command queue already initialized");
-        return 0;
+    if (__atomic_load_n(&g_command_queue_initialized, __ATOMIC_SEQ_CST)) {
+        LOGE(TAG, "command queues already initialized, only one dispatcher allowed");
+        return -1;
     }
 
-    int err = fifo_queue_init(&g_command_queue, sizeof(cmd_t), queue_size);
-    if (err != 0) {
-        LOGE(TAG, "failed to initialize command queue of capacity %zu", queue_size);
+    dispatcher_data_t *data = malloc(sizeof(dispatcher_data_t));
+    if (data == NULL) {
+        LOGE(TAG, "malloc failed for dispatcher_data_t");
         return -1;
     }
 
-    g_command_queue_initialized = true;
-    LOGD(TAG, "initialized command queue with capacity %zu", queue_size);
+    data->policy = init->policy;
+    for (int i = 0; i < CMD_PRIO_COUNT; i++) {
+        // Weight 0 would starve the class forever
+        data->weight[i] = init->weight[i] > 0 ? init->weight[i] : 1;
+        data->credit[i] = data->weight[i];
+    }
+
+    if (task_array_init(&data->workers, init->max_workers) != 0) {
+        LOGE(TAG, "failed to initialize worker array of capacity %zu", init->max_workers);
+        free(data);
+        return -1;
+    }
+
+    for (int i = 0; i < CMD_PRIO_COUNT; i++) {
+        int err = fifo_queue_init(&g_command_queues[i], sizeof(cmd_t), init->queue_size[i]);
+        if (err != 0) {
+            LOGE(TAG, "failed to initialize %s command queue of capacity %zu",
+                 prio_names[i], init->queue_size[i]);
+            while (--i >= 0) {
+                fifo_queue_destroy(&g_command_queues[i]);
+            }
+            task_array_destroy(&data->workers);
+            free(data);
+            return -1;
+        }
+        LOGD(TAG, "initialized %s command queue with capacity %zu",
+             prio_names[i], init->queue_size[i]);
+    }
+
+    self->task_resources = data;
+    __atomic_store_n(&g_command_queue_initialized, true, __ATOMIC_SEQ_CST);
     return 0;
 }
 
 static void dispatcher_cleanup(task_handle_t *self) {
-    (void)self;
-    if (g_command_queue_initialized) {
-        fifo_queue_destroy(&g_command_queue);
-        g_command_queue_initialized = false;
-        LOGD(TAG, "destroyed command queue");
+    if (__atomic_exchange_n(&g_command_queue_initialized, false, __ATOMIC_SEQ_CST)) {
+        // Let scrapes and senders that passed the check finish first
+        while (__atomic_load_n(&g_queue_users, __ATOMIC_SEQ_CST) > 0) {
+            sched_yield();
+        }
+        for (int i = 0; i < CMD_PRIO_COUNT; i++) {
+            // Free argv of commands that were never dispatched
+            cmd_t command;
+            while (fifo_queue_receive(&g_command_queues[i], &command) == 0) {
+                cmd_free(&command);
+            }
+            fifo_queue_destroy(&g_command_queues[i]);
+        }
+        LOGD(TAG, "destroyed command queues");
+    }
+
+    dispatcher_data_t *data = self->task_resources;
+    if (data != NULL) {
+        task_array_destroy(&data->workers);
+        free(data);
+        self->task_resources = NULL;
+    }
+}
+
+// Runs the handler for a command. Called inline or from a handler task
+static void dispatch_command(cmd_t *command) {
+    char *message = "";
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    TRACE_BEGIN_ARG("dispatch", cmd_name(command->cmd_type));
+    switch (command->cmd_type) {
+        case SOCKET:
+            parse_socket(*command);
+            break;
+        case ECHO:
+            parse_echo(*command, &message);
+            LOGI(TAG, "%s", message);
+            break;
+        case HELP:
+            parse_help(*command, &message);
+            LOGI(TAG, "%s", message);
+            break;
+        case TRACE:
+            parse_trace(*command);
+            break;
+        case LATENCY: {
+            latency_params_t params;
+            if (parse_latency(*command, &params) == 0) {
+                latency_run_report(&params);
+            }
+            break;
+        }
+        case NIL:
+            LOGW(TAG, "received NIL, not a valid command (type 'help' for help)");
+            parse_NIL(*command);
+            break;
+        default:
+            LOGE(TAG, "unknown command type %d", command->cmd_type);
+            break;
+    }
+    TRACE_END("dispatch");
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    metric_histogram_observe(&m_handler_duration,
+        (uint64_t)(end.tv_sec - start.tv_sec) * 1000000000ull + (uint64_t)end.tv_nsec - (uint64_t)start.tv_nsec);
+}
+
+// Picks the class to serve next according to policy
+// Returns class index, or -1 if all queues are empty
+static int dispatcher_select_class(dispatcher_data_t *data) {
+    bool pending[CMD_PRIO_COUNT];
+    bool any_pending = false;
+    for (int i = 0; i < CMD_PRIO_COUNT; i++) {
+        pending[i] = fifo_queue_count(&g_command_queues[i]) > 0;
+        any_pending |= pending[i];
+    }
+
+    if (!any_pending) {
+        return -1;
+    }
+
+    if (data->policy == DISPATCH_POLICY_STRICT) {
+        for (int i = 0; i < CMD_PRIO_COUNT; i++) {
+            if (pending[i]) return i;
+        }
+    }
+
+    // Weighted round robin: highest class with credit left goes first,
+    // start a new round once every pending class has spent its credit
+    for (int round = 0; round < 2; round++) {
+        for (int i = 0; i < CMD_PRIO_COUNT; i++) {
+            if (pending[i] && data->credit[i] > 0) {
+                data->credit[i]--;
+                return i;
+            }
+        }
+        for (int i = 0; i < CMD_PRIO_COUNT; i++) {
+            data->credit[i] = data->weight[i];
+        }
+    }
+    return -1;
+}
+
+// Hands command over to a handler task, runs it inline if no worker is free
+static void dispatcher_offload(dispatcher_data_t *data, cmd_t *command) {
+    task_array_reap_finished(&data->workers);
+
+    if (task_array_count(&data->workers) < data->workers.capacity) {
+        // handler_init takes ownership of argv, handler_cleanup frees it
+        if (task_create(&data->workers, &handler_task_config, command, "disp_wrk") != NULL) {
+            metric_counter_add(&m_offloaded, 1);
+            return;
+        }
+        if (command->argv == NULL) {
+            LOGE(TAG, "failed to start handler task, command dropped");
+            return;
+        }
     }
+
+    LOGW(TAG, "no free handler task for '%s', running inline", command->argv[0]);
+    dispatch_command(command);
+    cmd_free(command);
+}
+
+static void dispatcher_stop_workers(dispatcher_data_t *data) {
+    task_array_stop_all(&data->workers);
+    int ret = task_array_poll_all(&data->workers, -1, DISPATCHER_WORKER_SHUTDOWN_TIMEOUT_MS);
+    if (ret < 0) {
+        LOGW(TAG, "handler tasks did not finish in time, cancelling");
+        task_array_cancel_all(&data->workers);
+    }
+    task_array_join_all(&data->workers);
+    task_array_destroy_all(&data->workers);
 }
 
 static void *dispatcher_entry(task_handle_t *self) {
-    struct pollfd fds = {
-        .fd     = g_command_queue.event_fd,
-        .events = POLLIN,
-    };
+    dispatcher_data_t *data = self->task_resources;
 
-    char *message = "";
+    struct pollfd fds[CMD_PRIO_COUNT];
+    for (int i = 0; i < CMD_PRIO_COUNT; i++) {
+        fds[i].fd     = g_command_queues[i].event_fd;
+        fds[i].events = POLLIN;
+    }
 
-    self->state = TASK_STATE_RUNNING;
+    task_handle_set_state(self, TASK_STATE_RUNNING);
     LOGD(TAG, "ready to dispatch commands...");
 
     while (g_running && self->state != TASK_STATE_STOPPING) {
-        int err = poll(&fds, 1, DISPATCHER_POLL_TIMEOUT_MS);
+        int err = poll(fds, CMD_PRIO_COUNT, DISPATCHER_POLL_TIMEOUT_MS);
 
         if (err == 0) {
-            // Timeout
-
+            // Timeout, clean up handler tasks that have finished
+            task_array_reap_finished(&data->workers);
             continue;
         }
 
         if (err == -1) {
-            LOGW_ERRNO(TAG, "could not poll command queue: ");
+            LOGW_ERRNO(TAG, "could not poll command queues: ");
             continue;
         }
 
-        if (!(fds.revents & POLLIN)) {
-            LOGW(TAG, "poll returned but no POLLIN, should not happen");
+        int class = dispatcher_select_class(data);
+        if (class == -1) {
+            LOGW(TAG, "poll returned but all queues empty, should not happen");
             continue;
         }
 
         cmd_t command;
-        err = fifo_queue_receive(&g_command_queue, &command);
+        err = fifo_queue_receive(&g_command_queues[class], &command);
         if (err == -1) {
-            LOGW(TAG, "could not receive command from queue");
+            LOGW(TAG, "could not receive command from %s queue", prio_names[class]);
             continue;
         }
+        metric_counter_add(&m_dispatched[class], 1);
 
-        switch (command.cmd_type) {
-            case SOCKET:
-                parse_socket(command);
-                break;
-            case ECHO:
-                parse_echo(command, &message);
-                LOGI(TAG, "%s", message);
-                break;
-            case HELP:
-                parse_help(command, &message);
-                LOGI(TAG, "%s", message);
-                break;
-            case NIL:
-                LOGW(TAG, "received NIL, not a valid command (type 'help' for help)");
-                parse_NIL(command);
-                break;
-            default:
-                LOGE(TAG, "unknown command type %d", command.cmd_type);
-                break;
+        if (dispatcher_cmd_offload(command.cmd_type)) {
+            dispatcher_offload(data, &command);
+            continue;
         }
 
-        message = "";
+        dispatch_command(&command);
         cmd_free(&command);
     }
+    dispatcher_stop_workers(data);
     dispatcher_cleanup(self);
     LOGD(TAG, "exiting...");
     task_handle_mark_done(self);
     return NULL;
 }
 
+static int handler_init(task_handle_t *self, void *init_arg) {
+    cmd_t *source = init_arg;
+    cmd_t *command = malloc(sizeof(cmd_t));
+    if (command == NULL) {
+        LOGE(TAG, "malloc failed for handler command");
+        return -1;
+    }
+
+    *command = *source;
+    source->argv = NULL;
+    source->argc = 0;
+    self->task_resources = command;
+    return 0;
+}
+
+static void handler_cleanup(task_handle_t *self) {
+    cmd_t *command = self->task_resources;
+    if (command != NULL) {
+        cmd_free(command);
+        free(command);
+        self->task_resources = NULL;
+    }
+}
+
+static void *handler_entry(task_handle_t *self) {
+    task_handle_set_state(self, TASK_STATE_RUNNING);
+    dispatch_command(self->task_resources);
+    task_handle_mark_done(self);
+    return NULL;
+}
+
+cmd_priority_t dispatcher_cmd_priority(cmd_type_t cmd_type) {
+    if ((size_t)cmd_type >= sizeof(cmd_classes) / sizeof(cmd_classes[0])) {
+        return CMD_PRIO_NORMAL;
+    }
+    return cmd_classes[cmd_type].priority;
+}
+
 int dispatcher_add_to_queue(cmd_t command) {
-    if (!g_command_queue_initialized) {
+    if (!queues_acquire()) {
         LOGE(TAG, "command queue not initialized");
         return -1;
     }
 
-    int err = fifo_queue_send(&g_command_queue, (const void *)&command);
+    cmd_priority_t prio = dispatcher_cmd_priority(command.cmd_type);
+    int err = fifo_queue_send(&g_command_queues[prio], (const void *)&command);
+    queues_release();
     if (err != 0) {
-        LOGE(TAG, "command queue full");
+        metric_counter_add(&m_dropped[prio], 1);
+        LOGE(TAG, "%s command queue full", prio_names[prio]);
         return -1;
     }
 
     return 0;
-}
\ No newline at end of file
+}
@@ -70,7 +70,7 @@ static void *example_worker_entry(task_handle_t *self) {
     // Optional, just for keeping track of multiple instances of same task
     worker_num_counter++;
 
-    self->state = TASK_STATE_RUNNING;
+    task_handle_set_state(self, TASK_STATE_RUNNING);
     size_t counter_ms = 0;
     size_t prev_message_timestamp_ms = 0;
     while (counter_ms < my_TTL_ms && g_running && self->state != TASK_STATE_STOPPING) {
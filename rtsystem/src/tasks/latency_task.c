@@ -0,0 +1,288 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+
+#define LOG_LEVEL LOG_LEVEL_DEBUG
+#include <rtsystem/core/task_helper.h>
+#include <rtsystem/core/cmd_parser.h>
+#include <rtsystem/tasks/latency_task.h>
+#include <rtsystem/tasks/dispatcher_task.h>
+#include <rtsystem/async_log_helper.h>
+
+#define LATENCY_TASKS_CAPACITY 3
+#define LATENCY_SHUTDOWN_MARGIN_MS 1000
+
+#define LOG_FLOOD_IDLE_US 100
+#define CMD_FLOOD_PERIOD_US 500
+
+static const char *TAG = "latency";
+
+extern volatile int g_running;
+
+typedef struct {
+    latency_params_t params;
+    latency_hist_t hist;
+} latency_data_t;
+
+static int   latency_init(task_handle_t *self, void *init_arg);
+static void  latency_cleanup(task_handle_t *self);
+static void *latency_entry(task_handle_t *self);
+
+static void *log_flood_entry(task_handle_t *self);
+static void *cmd_flood_entry(task_handle_t *self);
+
+const task_config_t latency_task_config = {
+    .priority   = DEFAULT_LATENCY_TASK_PRIORITY,
+    .entry      = latency_entry,
+    .on_init    = latency_init,
+    .on_stop    = NULL,
+    .on_cleanup = latency_cleanup,
+};
+
+// Keeps g_log_queue near full without overflowing it
+static const task_config_t log_flood_task_config = {
+    .priority   = DEFAULT_LATENCY_LOAD_PRIORITY,
+    .entry      = log_flood_entry,
+    .on_init    = NULL,
+    .on_stop    = NULL,
+    .on_cleanup = NULL,
+};
+
+// Sends a steady stream of echo commands to the dispatcher
+static const task_config_t cmd_flood_task_config = {
+    .priority   = DEFAULT_LATENCY_LOAD_PRIORITY,
+    .entry      = cmd_flood_entry,
+    .on_init    = NULL,
+    .on_stop    = NULL,
+    .on_cleanup = NULL,
+};
+
+static uint64_t timespec_to_ns(const struct timespec *ts) {
+    return (uint64_t)ts->tv_sec * 1000000000ull + (uint64_t)ts->tv_nsec;
+}
+
+static void timespec_add_ns(struct timespec *ts, uint64_t ns) {
+    ts->tv_nsec += ns;
+    while (ts->tv_nsec >= 1000000000L) {
+        ts->tv_nsec -= 1000000000L;
+        ts->tv_sec++;
+    }
+}
+
+static void hist_record(latency_hist_t *hist, uint64_t lat_ns) {
+    const uint64_t us = lat_ns / 1000;
+    if (us < LATENCY_HIST_BUCKETS) {
+        hist->buckets[us]++;
+    } else {
+        hist->overflow++;
+    }
+    if (lat_ns < hist->min_ns) hist->min_ns = lat_ns;
+    if (lat_ns > hist->max_ns) hist->max_ns = lat_ns;
+    hist->sum_ns += lat_ns;
+    hist->count++;
+}
+
+// Returns upper bound in us of the bucket holding percentile p,
+// or 0 if it falls in overflow
+static uint64_t hist_percentile_us(const latency_hist_t *hist, double p) {
+    const uint64_t target = (uint64_t)(p * (double)hist->count);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < LATENCY_HIST_BUCKETS; i++) {
+        seen += hist->buckets[i];
+        if (seen > target) {
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+// Percentile p as "<Nus", or ">=Nus" when it lies past the last bucket
+static const char *hist_percentile_str(const latency_hist_t *hist, double p, char *buf, size_t len) {
+    const uint64_t us = hist_percentile_us(hist, p);
+    if (us == 0) {
+        snprintf(buf, len, ">=%dus", LATENCY_HIST_BUCKETS);
+    } else {
+        snprintf(buf, len, "<%lluus", (unsigned long long)us);
+    }
+    return buf;
+}
+
+static int latency_init(task_handle_t *self, void *init_arg) {
+    latency_data_t *data = calloc(1, sizeof(latency_data_t));
+    if (data == NULL) {
+        LOGE(TAG, "malloc failed for latency_data_t");
+        return -1;
+    }
+
+    data->params = *(latency_params_t *)init_arg;
+    data->hist.min_ns = UINT64_MAX;
+    self->task_resources = data;
+    return 0;
+}
+
+static void latency_cleanup(task_handle_t *self) {
+    free(self->task_resources);
+    self->task_resources = NULL;
+}
+
+static void *latency_entry(task_handle_t *self) {
+    latency_data_t *data = self->task_resources;
+    const uint64_t period_ns = (uint64_t)data->params.period_us * 1000;
+
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    const uint64_t end_ns = timespec_to_ns(&next) + (uint64_t)data->params.duration_ms * 1000000;
+
+    task_handle_set_state(self, TASK_STATE_RUNNING);
+
+    // No logging inside the loop, it would disturb the measurement
+    while (g_running && self->state != TASK_STATE_STOPPING) {
+        timespec_add_ns(&next, period_ns);
+        int err = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+        if (err != 0) {
+            continue;  // EINTR, deadline is absolute so just retry
+        }
+
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        const uint64_t now_ns = timespec_to_ns(&now);
+        const uint64_t deadline_ns = timespec_to_ns(&next);
+        hist_record(&data->hist, now_ns > deadline_ns ? now_ns - deadline_ns : 0);
+
+        if (now_ns >= end_ns) {
+            break;
+        }
+    }
+
+    task_handle_mark_done(self);
+    return NULL;
+}
+
+static void *log_flood_entry(task_handle_t *self) {
+    task_handle_set_state(self, TASK_STATE_RUNNING);
+    size_t sent = 0;
+    while (g_running && self->state != TASK_STATE_STOPPING) {
+        while (fifo_queue_count(&g_log_queue) < g_log_queue.capacity * 3 / 4) {
+            LOGD(TAG, "log load %zu", sent++);
+        }
+        usleep(LOG_FLOOD_IDLE_US);
+    }
+    task_handle_mark_done(self);
+    return NULL;
+}
+
+static void *cmd_flood_entry(task_handle_t *self) {
+    static const char *load_argv[] = { "echo", "-m", "latency load" };
+    const int load_argc = sizeof(load_argv) / sizeof(load_argv[0]);
+
+    task_handle_set_state(self, TASK_STATE_RUNNING);
+    while (g_running && self->state != TASK_STATE_STOPPING) {
+        // Dispatcher frees argv, so each command gets its own copy. NULL
+        // terminated like tokenize() output, the getopt parsers rely on it
+        cmd_t command = { .argc = 0, .argv = calloc(load_argc + 1, sizeof(char *)), .cmd_type = ECHO };
+        if (command.argv != NULL) {
+            for (int i = 0; i < load_argc; i++) {
+                command.argv[i] = strdup(load_argv[i]);
+                command.argc++;
+            }
+            if (dispatcher_add_to_queue(command) != 0) {
+                cmd_free(&command);
+            }
+        }
+        usleep(CMD_FLOOD_PERIOD_US);
+    }
+    task_handle_mark_done(self);
+    return NULL;
+}
+
+// Runs one measurement phase, optionally with load tasks
+// Returns 0 and fills hist on success, -1 on error
+static int latency_run_phase(const latency_params_t *params, int with_load, latency_hist_t *hist) {
+    task_array_t tasks;
+    if (task_array_init(&tasks, LATENCY_TASKS_CAPACITY) != 0) {
+        return -1;
+    }
+
+    int result = -1;
+    task_handle_t *meas = NULL;
+    if (with_load &&
+        (task_create(&tasks, &log_flood_task_config, NULL, "lat_log_load") == NULL ||
+         task_create(&tasks, &cmd_flood_task_config, NULL, "lat_cmd_load") == NULL)) {
+        LOGE(TAG, "failed to create load tasks");
+    } else {
+        meas = task_create(&tasks, &latency_task_config, (void *)params, "lat_meas");
+        if (meas == NULL) {
+            LOGE(TAG, "failed to create measurement task");
+        }
+    }
+
+    if (meas != NULL) {
+        // Wait for measurement task only, load keeps running until then
+        struct pollfd pfd = { .fd = meas->done_fd, .events = POLLIN };
+        const int timeout_ms = (int)params->duration_ms + LATENCY_SHUTDOWN_MARGIN_MS;
+        if (poll(&pfd, 1, timeout_ms) > 0) {
+            const latency_data_t *data = meas->task_resources;
+            *hist = data->hist;
+            result = 0;
+        } else {
+            LOGE(TAG, "measurement task did not finish in time");
+        }
+    }
+
+    task_array_stop_all(&tasks);
+    if (task_array_poll_all(&tasks, -1, LATENCY_SHUTDOWN_MARGIN_MS) < 0) {
+        task_array_cancel_all(&tasks);
+    }
+    task_array_join_all(&tasks);
+    task_array_destroy_all(&tasks);
+    task_array_destroy(&tasks);
+    return result;
+}
+
+static void latency_log_hist(const char *phase, const latency_hist_t *hist) {
+    if (hist->count == 0) {
+        LOGW(TAG, "%-6s: no samples", phase);
+        return;
+    }
+    char p50[24], p99[24], p999[24];
+    LOGI(TAG, "%-6s: samples=%llu min=%.1fus avg=%.1fus p50%s p99%s p99.9%s max=%.1fus over%dus=%llu",
+         phase,
+         (unsigned long long)hist->count,
+         hist->min_ns / 1000.0,
+         (double)hist->sum_ns / (double)hist->count / 1000.0,
+         hist_percentile_str(hist, 0.50, p50, sizeof(p50)),
+         hist_percentile_str(hist, 0.99, p99, sizeof(p99)),
+         hist_percentile_str(hist, 0.999, p999, sizeof(p999)),
+         hist->max_ns / 1000.0,
+         LATENCY_HIST_BUCKETS,
+         (unsigned long long)hist->overflow);
+}
+
+int latency_run_report(const latency_params_t *params) {
+    latency_hist_t idle, loaded;
+
+    LOGI(TAG, "measuring idle wakeup latency, period %zuus for %zums...",
+         params->period_us, params->duration_ms);
+    if (latency_run_phase(params, 0, &idle) != 0) {
+        return -1;
+    }
+
+    LOGI(TAG, "measuring wakeup latency under log and command load...");
+    if (latency_run_phase(params, 1, &loaded) != 0) {
+        return -1;
+    }
+
+    latency_log_hist("idle", &idle);
+    latency_log_hist("loaded", &loaded);
+    char idle99[24], loaded99[24], idle999[24], loaded999[24];
+    LOGI(TAG, "tail change: p99 %s -> %s, p99.9 %s -> %s, max %.1fus -> %.1fus",
+         hist_percentile_str(&idle, 0.99, idle99, sizeof(idle99)),
+         hist_percentile_str(&loaded, 0.99, loaded99, sizeof(loaded99)),
+         hist_percentile_str(&idle, 0.999, idle999, sizeof(idle999)),
+         hist_percentile_str(&loaded, 0.999, loaded999, sizeof(loaded999)),
+         idle.max_ns / 1000.0, loaded.max_ns / 1000.0);
+    return 0;
+}
@@ -11,6 +11,8 @@
 
 #define LOG_LEVEL LOG_LEVEL_DEBUG
 #include <rtsystem/tasks/log_task.h>
+#include <rtsystem/core/trace.h>
+#include <rtsystem/core/metrics.h>
 #include <rtsystem/async_log_helper.h>
 
 #define LOG_POLL_TIMEOUT_MS 10
@@ -79,10 +81,29 @@ int g_log_done_fd = -1;
 // Internal thread handle
 static pthread_t log_thread;
 
+metric_counter_t g_log_dropped;
+static metric_counter_t m_lines_written;
+
+static double log_queue_depth(void) {
+    return (double)fifo_queue_count(&g_log_queue);
+}
+
+static metric_t log_metrics[] = {
+    { .name = "lines_written_total", .help = "Log lines written to stderr",
+      .type = METRIC_COUNTER, .counter = &m_lines_written },
+    { .name = "dropped_total", .help = "Log messages dropped because the queue was full",
+      .type = METRIC_COUNTER, .counter = &g_log_dropped },
+    { .name = "queue_depth", .help = "Messages waiting in the log queue",
+      .type = METRIC_GAUGE_FN, .read = log_queue_depth },
+};
+static metric_group_t log_metric_group = METRIC_GROUP("log", log_metrics);
+METRICS_REGISTER_GROUP(log_metric_group)
+
 static void print_log_message(const log_message_t* msg) {
     static const char* colors[] = {COLOR_CYAN, COLOR_GREEN, COLOR_YELLOW, COLOR_RED};
     static const char* levels[] = {"D", "I", "W", "E"};
 
+    TRACE_BEGIN_ARG("log_flush", levels[msg->level]);
     struct tm tm;
     localtime_r(&msg->timestamp.tv_sec, &tm);
 
@@ -95,6 +116,8 @@ static void print_log_message(const log_message_t* msg) {
             msg->tag,
             colors[msg->level],
             msg->message);
+    metric_counter_add(&m_lines_written, 1);
+    TRACE_END("log_flush");
 }
 
 static void* log_task(void* arg) {
@@ -0,0 +1,148 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define LOG_LEVEL LOG_LEVEL_DEBUG
+#include <rtsystem/core/task_helper.h>
+#include <rtsystem/core/metrics.h>
+#include <rtsystem/tasks/metrics_task.h>
+#include <rtsystem/async_log_helper.h>
+
+#define METRICS_POLL_TIMEOUT_MS 10
+#define METRICS_REQUEST_TIMEOUT_MS 100
+#define METRICS_BACKLOG 4
+
+static const char *TAG = "metrics_task";
+
+extern volatile int g_running;
+
+typedef struct {
+    int listen_fd;
+} metrics_data_t;
+
+static int   metrics_init(task_handle_t *self, void *init_arg);
+static void  metrics_cleanup(task_handle_t *self);
+static void *metrics_entry(task_handle_t *self);
+
+const task_config_t metrics_task_config = {
+    .priority   = DEFAULT_METRICS_TASK_PRIORITY,
+    .entry      = metrics_entry,
+    .on_init    = metrics_init,
+    .on_stop    = NULL,
+    .on_cleanup = metrics_cleanup,
+};
+
+static int metrics_init(task_handle_t *self, void *init_arg) {
+    const int port = *(int *)init_arg;
+
+    metrics_data_t *data = malloc(sizeof(metrics_data_t));
+    if (data == NULL) {
+        LOGE(TAG, "malloc failed for metrics_data_t");
+        return -1;
+    }
+
+    data->listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (data->listen_fd < 0) {
+        LOGE_ERRNO(TAG, "failed to create socket");
+        free(data);
+        return -1;
+    }
+
+    int optval = 1;
+    setsockopt(data->listen_fd, SOL_SOCKET, SO_REUSEADDR, &optval, sizeof(optval));
+
+    // Local scrape only
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+        .sin_port = htons(port),
+    };
+
+    if (bind(data->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(data->listen_fd, METRICS_BACKLOG) < 0) {
+        LOGE_ERRNO(TAG, "could not listen on 127.0.0.1:%d", port);
+        close(data->listen_fd);
+        free(data);
+        return -1;
+    }
+
+    self->task_resources = data;
+    LOGD(TAG, "serving metrics on http://127.0.0.1:%d/metrics", port);
+    return 0;
+}
+
+static void metrics_cleanup(task_handle_t *self) {
+    metrics_data_t *data = self->task_resources;
+    if (data != NULL) {
+        close(data->listen_fd);
+        free(data);
+        self->task_resources = NULL;
+    }
+}
+
+static void metrics_serve_client(int client_fd) {
+    // Bound how long a slow client can hold up the task
+    struct timeval tv = { .tv_sec = 0, .tv_usec = METRICS_REQUEST_TIMEOUT_MS * 1000 };
+    setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(client_fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    // Request content is ignored, every path returns the metrics
+    char request[1024];
+    if (recv(client_fd, request, sizeof(request), 0) <= 0) {
+        close(client_fd);
+        return;
+    }
+
+    FILE *out = fdopen(client_fd, "w");
+    if (out == NULL) {
+        LOGW_ERRNO(TAG, "fdopen failed");
+        close(client_fd);
+        return;
+    }
+
+    fprintf(out, "HTTP/1.0 200 OK\r\n"
+                 "Content-Type: text/plain; version=0.0.4\r\n"
+                 "Connection: close\r\n\r\n");
+    metrics_write_prometheus(out);
+    fclose(out);  // Also closes client_fd
+}
+
+static void *metrics_entry(task_handle_t *self) {
+    metrics_data_t *data = self->task_resources;
+
+    struct pollfd fds = {
+        .fd     = data->listen_fd,
+        .events = POLLIN,
+    };
+
+    task_handle_set_state(self, TASK_STATE_RUNNING);
+
+    while (g_running && self->state != TASK_STATE_STOPPING) {
+        int err = poll(&fds, 1, METRICS_POLL_TIMEOUT_MS);
+
+        if (err == -1) {
+            LOGW_ERRNO(TAG, "could not poll listen socket: ");
+            continue;
+        }
+
+        if (err == 0 || !(fds.revents & POLLIN)) {
+            continue;
+        }
+
+        int client_fd = accept(data->listen_fd, NULL, NULL);
+        if (client_fd < 0) {
+            LOGW_ERRNO(TAG, "accept failed");
+            continue;
+        }
+        metrics_serve_client(client_fd);
+    }
+    metrics_cleanup(self);
+    LOGD(TAG, "exiting...");
+    task_handle_mark_done(self);
+    return NULL;
+}
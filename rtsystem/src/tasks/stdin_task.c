@@ -75,7 +75,7 @@ static void *stdin_entry(task_handle_t *self) {
         .events = POLLIN,
     };
 
-    self->state = TASK_STATE_RUNNING;
+    task_handle_set_state(self, TASK_STATE_RUNNING);
     LOGD(TAG, "ready for input...");
 
     while (g_running && self->state != TASK_STATE_STOPPING) {
@@ -174,7 +174,10 @@ static void *stdin_entry(task_handle_t *self) {
             continue;
         }
 
-        dispatcher_add_to_queue(command);
+        err = dispatcher_add_to_queue(command);
+        if (err == -1) {
+            cmd_free(&command);
+        }
     }
     stdin_cleanup(self);
     LOGD(TAG, "exiting...");